@@ -0,0 +1,354 @@
+/*
+ * ahrs.c
+ *
+ *  Fixed-point Mahony AHRS. See ahrs.h.
+ */
+
+#include <string.h>
+#include "ahrs.h"
+
+#if defined(__ARM_FEATURE_DSP) && (__ARM_FEATURE_DSP == 1) && !defined(AHRS_SCALAR)
+
+#include "bsp_api.h"    /* CMSIS intrinsics */
+
+/* acc + high word of a * b */
+#define AHRS_MLA(acc, a, b)     ((int32_t) __SMMLA((a), (b), (acc)))
+/* v[0]^2 + v[1]^2 + v[2]^2 of int16 values other than -32768 */
+#define AHRS_SUMSQ16(v)         ((uint32_t) __SMUAD(__PKHBT((v)[0], (v)[1], 16), __PKHBT((v)[0], (v)[1], 16)) \
+                                 + (uint32_t) ((v)[2] * (v)[2]))
+#define AHRS_CLZ(x)             (__CLZ(x))
+
+#else
+
+#define AHRS_MLA(acc, a, b)     ((int32_t) ((uint32_t) (acc) + (uint32_t) (((int64_t) (a) * (b)) >> 32)))
+#define AHRS_SUMSQ16(v)         ((uint32_t) (((v)[0] * (v)[0]) + ((v)[1] * (v)[1])) + (uint32_t) ((v)[2] * (v)[2]))
+#define AHRS_CLZ(x)             ((uint32_t) __builtin_clz(x))
+
+#endif
+
+/* Q28 products back to Q30, and times two */
+#define AHRS_Q28_TO_Q30(x)      ((int32_t) ((uint32_t) (x) << 2))
+#define AHRS_Q28_TO_Q30_X2(x)   ((int32_t) ((uint32_t) (x) << 3))
+
+#define AHRS_HALF               (AHRS_ONE / 2)
+#define AHRS_BAM_180            (0x80000000UL)  /* Binary angle, 2^32 per turn */
+
+/* atan(2^-i) as binary angles */
+static const uint32_t ahrs_cordic_atan[] =
+{
+    0x20000000, 0x12E4051E, 0x09FB385B, 0x051111D4, 0x028B0D43, 0x0145D7E1,
+    0x00A2F61E, 0x00517C55, 0x0028BE53, 0x00145F2F, 0x000A2F98, 0x000517CC,
+    0x00028BE6, 0x000145F3, 0x0000A2FA, 0x0000517D, 0x000028BE, 0x0000145F,
+    0x00000A30, 0x00000518, 0x0000028C, 0x00000146, 0x000000A3, 0x00000051,
+    0x00000029, 0x00000014, 0x0000000A, 0x00000005, 0x00000003, 0x00000001
+};
+
+/* 1/sqrt(x) at the middle of [k/16, (k+1)/16), k = 4..15, Q29 */
+static const int32_t ahrs_rsqrt_seed[] =
+{
+    0x3C56FBBC, 0x36945278, 0x3234AAC3, 0x2EBD2E8D, 0x2BE754CE, 0x298757D2,
+    0x27806CA2, 0x25BEC18C, 0x243430A4, 0x22D651EB, 0x219D4C63, 0x20831490
+};
+
+/*
+ * 1/sqrt(s) = y * 2^(h - 45), y in Q29. Three Newton steps from the table
+ * seed reach the Q29 limit.
+ */
+static int32_t ahrs_rsqrt(uint32_t s, uint32_t *p_h)
+{
+    uint32_t e = AHRS_CLZ(s) & ~1U;
+    int64_t xq = (int64_t) ((s << e) >> 2);         /* [0.25, 1), Q30 */
+    int64_t y = ahrs_rsqrt_seed[(xq >> 26) - 4];
+    uint8_t i;
+
+    for (i = 0; i < 3U; i++)
+        y = (y * ((3LL << 30) - ((((xq * y) >> 29) * y) >> 29))) >> 31;
+
+    *p_h = e / 2U;
+    return (int32_t) y;
+}
+
+/* sqrt of a Qq_in value, q_in even, as Q30 */
+static int32_t ahrs_sqrt(uint32_t c, uint32_t q_in)
+{
+    uint32_t h;
+    int32_t y;
+
+    if (c == 0U)
+        return 0;
+
+    y = ahrs_rsqrt(c, &h);
+    return (int32_t) (((uint64_t) c * (uint32_t) y) >> (15U + (q_in / 2U) - h));
+}
+
+/* Unit vector of an int16 sample, Q30; false for a zero or overflowed sample */
+static bool ahrs_normalize16(int16_t const v[3], int32_t out[3])
+{
+    int16_t c[3];
+    uint32_t s;
+    uint32_t h;
+    int32_t y;
+    uint8_t i;
+
+    for (i = 0; i < 3U; i++)
+        c[i] = (v[i] == INT16_MIN) ? (int16_t) -INT16_MAX : v[i];
+
+    s = AHRS_SUMSQ16(c);
+    if (s == 0U)
+        return false;
+
+    y = ahrs_rsqrt(s, &h);
+    for (i = 0; i < 3U; i++)
+        out[i] = (int32_t) (((int64_t) c[i] * y) >> (15U - h));
+
+    return true;
+}
+
+/* Half the body-to-world rotation matrix, Q30 */
+static void ahrs_half_matrix(int32_t const q[4], int32_t r[3][3])
+{
+    int32_t q0q0 = AHRS_Q28_TO_Q30(AHRS_MLA(0, q[0], q[0]));
+    int32_t q0q1 = AHRS_Q28_TO_Q30(AHRS_MLA(0, q[0], q[1]));
+    int32_t q0q2 = AHRS_Q28_TO_Q30(AHRS_MLA(0, q[0], q[2]));
+    int32_t q0q3 = AHRS_Q28_TO_Q30(AHRS_MLA(0, q[0], q[3]));
+    int32_t q1q1 = AHRS_Q28_TO_Q30(AHRS_MLA(0, q[1], q[1]));
+    int32_t q1q2 = AHRS_Q28_TO_Q30(AHRS_MLA(0, q[1], q[2]));
+    int32_t q1q3 = AHRS_Q28_TO_Q30(AHRS_MLA(0, q[1], q[3]));
+    int32_t q2q2 = AHRS_Q28_TO_Q30(AHRS_MLA(0, q[2], q[2]));
+    int32_t q2q3 = AHRS_Q28_TO_Q30(AHRS_MLA(0, q[2], q[3]));
+    int32_t q3q3 = AHRS_Q28_TO_Q30(AHRS_MLA(0, q[3], q[3]));
+
+    r[0][0] = q0q0 - AHRS_HALF + q1q1;
+    r[0][1] = q1q2 - q0q3;
+    r[0][2] = q1q3 + q0q2;
+    r[1][0] = q1q2 + q0q3;
+    r[1][1] = q0q0 - AHRS_HALF + q2q2;
+    r[1][2] = q2q3 - q0q1;
+    r[2][0] = q1q3 - q0q2;
+    r[2][1] = q2q3 + q0q1;
+    r[2][2] = q0q0 - AHRS_HALF + q3q3;
+}
+
+/* Body vector to world, Q30 */
+static void ahrs_to_world(int32_t const r[3][3], int32_t const v[3], int32_t w[3])
+{
+    uint8_t i;
+
+    for (i = 0; i < 3U; i++)
+        w[i] = AHRS_Q28_TO_Q30_X2(AHRS_MLA(AHRS_MLA(AHRS_MLA(0, r[i][0], v[0]), r[i][1], v[1]), r[i][2], v[2]));
+}
+
+/* Binary angle of (x, y) by CORDIC vectoring */
+static int32_t ahrs_atan2(int32_t y, int32_t x)
+{
+    uint32_t angle = 0;
+    int32_t xt;
+    uint8_t i;
+
+    if ((x == 0) && (y == 0))
+        return 0;
+
+    /* Headroom for the CORDIC gain */
+    x >>= 2;
+    y >>= 2;
+
+    if (x < 0)
+    {
+        angle = AHRS_BAM_180;
+        x = -x;
+        y = -y;
+    }
+
+    for (i = 0; i < (sizeof(ahrs_cordic_atan) / sizeof(ahrs_cordic_atan[0])); i++)
+    {
+        if (y > 0)
+        {
+            xt = x + (y >> i);
+            y -= x >> i;
+            angle += ahrs_cordic_atan[i];
+        }
+        else
+        {
+            xt = x - (y >> i);
+            y += x >> i;
+            angle -= ahrs_cordic_atan[i];
+        }
+        x = xt;
+    }
+
+    return (int32_t) angle;
+}
+
+/* Binary angle to centidegrees, -18000..17999 */
+static int32_t ahrs_cdeg(int32_t angle)
+{
+    return (int32_t) (((int64_t) angle * 36000) >> 32);
+}
+
+void ahrs_init(ahrs_t *p_ahrs, ahrs_config_t const *p_config)
+{
+    memset(p_ahrs, 0, sizeof(*p_ahrs));
+    p_ahrs->q[0] = AHRS_ONE;
+    p_ahrs->gyro_scale = (int32_t) (p_config->gyro_rads_per_lsb * 1099511627776.0f);
+    p_ahrs->kp2 = (int32_t) (2.0f * p_config->kp * 16777216.0f);
+    p_ahrs->ki2 = (int32_t) (2.0f * p_config->ki * 16777216.0f);
+}
+
+/*
+ * One gyro/accel sample, dt_us after the previous one. p_mag is a new
+ * compensated BMM150 sample or NULL.
+ */
+void ahrs_update(ahrs_t *p_ahrs, int16_t const gyro[3], int16_t const accel[3], int16_t const *p_mag,
+                 uint32_t dt_us)
+{
+    int32_t *q = p_ahrs->q;
+    int32_t r[3][3];
+    int32_t a[3];
+    int32_t m[3];
+    int32_t h[3];
+    int32_t w[3];
+    int32_t e[3] = { 0, 0, 0 };
+    int32_t rate[3];
+    int32_t d[4];
+    int64_t step;
+    int32_t dt;
+    int32_t bx;
+    int32_t n;
+    int32_t y;
+    uint32_t sh;
+    bool use_mag;
+    uint8_t i;
+
+    if (dt_us > AHRS_DT_MAX_US)
+        dt_us = AHRS_DT_MAX_US;
+    dt = (int32_t) (((uint64_t) dt_us * 1125899907ULL) >> 20);    /* s, Q30 */
+
+    for (i = 0; i < 3U; i++)
+        rate[i] = (int32_t) (((int64_t) gyro[i] * p_ahrs->gyro_scale) >> 16);
+
+    use_mag = (p_mag != NULL) && ahrs_normalize16(p_mag, m);
+    if (use_mag)
+    {
+        memcpy(p_ahrs->mag, m, sizeof(m));
+        p_ahrs->has_mag = true;
+    }
+
+    /* No correction in free fall */
+    if (ahrs_normalize16(accel, a))
+    {
+        ahrs_half_matrix(q, r);
+
+        /* Error between measured and estimated gravity, halfv = r[2][] */
+        e[0] = AHRS_MLA(AHRS_MLA(0, a[1], r[2][2]), -a[2], r[2][1]);
+        e[1] = AHRS_MLA(AHRS_MLA(0, a[2], r[2][0]), -a[0], r[2][2]);
+        e[2] = AHRS_MLA(AHRS_MLA(0, a[0], r[2][1]), -a[1], r[2][0]);
+
+        if (use_mag)
+        {
+            /* Earth field in the horizontal plane and vertical, back to the body */
+            ahrs_to_world(r, m, h);
+            bx = ahrs_sqrt((uint32_t) AHRS_MLA(AHRS_MLA(0, h[0], h[0]), h[1], h[1]), 28U);
+            for (i = 0; i < 3U; i++)
+                w[i] = AHRS_Q28_TO_Q30(AHRS_MLA(AHRS_MLA(0, bx, r[0][i]), h[2], r[2][i]));
+
+            e[0] = AHRS_MLA(AHRS_MLA(e[0], m[1], w[2]), -m[2], w[1]);
+            e[1] = AHRS_MLA(AHRS_MLA(e[1], m[2], w[0]), -m[0], w[2]);
+            e[2] = AHRS_MLA(AHRS_MLA(e[2], m[0], w[1]), -m[1], w[0]);
+        }
+
+        /* PI feedback; e is Q28 */
+        for (i = 0; i < 3U; i++)
+        {
+            if (p_ahrs->ki2 > 0)
+            {
+                p_ahrs->bias[i] += (int32_t) (((((int64_t) p_ahrs->ki2 * e[i]) >> 22) * dt) >> 30);
+                if (p_ahrs->bias[i] > AHRS_ONE)
+                    p_ahrs->bias[i] = AHRS_ONE;
+                else if (p_ahrs->bias[i] < -AHRS_ONE)
+                    p_ahrs->bias[i] = -AHRS_ONE;
+            }
+            rate[i] += (int32_t) (((int64_t) p_ahrs->kp2 * e[i]) >> 28) + (p_ahrs->bias[i] >> 6);
+        }
+    }
+    else
+    {
+        for (i = 0; i < 3U; i++)
+            rate[i] += p_ahrs->bias[i] >> 6;
+    }
+
+    /* Half the rotation this step, Q30, limited to half a radian per axis */
+    for (i = 0; i < 3U; i++)
+    {
+        step = ((int64_t) rate[i] * dt) >> 25;
+        if (step > AHRS_HALF)
+            step = AHRS_HALF;
+        else if (step < -AHRS_HALF)
+            step = -AHRS_HALF;
+        h[i] = (int32_t) step;
+    }
+
+    d[0] = AHRS_MLA(AHRS_MLA(AHRS_MLA(0, -q[1], h[0]), -q[2], h[1]), -q[3], h[2]);
+    d[1] = AHRS_MLA(AHRS_MLA(AHRS_MLA(0, q[0], h[0]), q[2], h[2]), -q[3], h[1]);
+    d[2] = AHRS_MLA(AHRS_MLA(AHRS_MLA(0, q[0], h[1]), -q[1], h[2]), q[3], h[0]);
+    d[3] = AHRS_MLA(AHRS_MLA(AHRS_MLA(0, q[0], h[2]), q[1], h[1]), -q[2], h[0]);
+    for (i = 0; i < 4U; i++)
+        q[i] += AHRS_Q28_TO_Q30(d[i]);
+
+    /* Normalise; |q|^2 in Q28 */
+    n = AHRS_MLA(AHRS_MLA(AHRS_MLA(AHRS_MLA(0, q[0], q[0]), q[1], q[1]), q[2], q[2]), q[3], q[3]);
+    if (n <= 0)
+    {
+        memset(q, 0, sizeof(p_ahrs->q));
+        q[0] = AHRS_ONE;
+    }
+    else
+    {
+        y = ahrs_rsqrt((uint32_t) n, &sh);
+        for (i = 0; i < 4U; i++)
+            q[i] = (int32_t) (((int64_t) q[i] * y) >> (31U - sh));
+    }
+
+    p_ahrs->updates++;
+}
+
+void ahrs_get_state(ahrs_t const *p_ahrs, ahrs_state_t *p_state)
+{
+    int32_t r[3][3];
+    int32_t h[3];
+    int32_t s;
+    int32_t c;
+    int32_t yaw;
+
+    ahrs_half_matrix(p_ahrs->q, r);
+
+    memcpy(p_state->q, p_ahrs->q, sizeof(p_state->q));
+    p_state->updates = p_ahrs->updates;
+
+    /* ZYX angles; pitch from asin as atan2(s, sqrt(1 - s^2)) */
+    p_state->roll_cdeg = ahrs_cdeg(ahrs_atan2(r[2][1], r[2][2]));
+
+    s = -2 * r[2][0];
+    if (s > AHRS_ONE)
+        s = AHRS_ONE;
+    else if (s < -AHRS_ONE)
+        s = -AHRS_ONE;
+    c = (1L << 28) - AHRS_MLA(0, s, s);
+    c = ahrs_sqrt((c > 0) ? (uint32_t) c : 0U, 28U);
+    p_state->pitch_cdeg = -ahrs_cdeg(ahrs_atan2(s, c));
+
+    /* Counter-clockwise about up, reported clockwise */
+    yaw = ahrs_atan2(r[1][0], r[0][0]);
+    p_state->yaw_cdeg = -ahrs_cdeg(yaw);
+    if (p_state->yaw_cdeg < 0)
+        p_state->yaw_cdeg += 36000;
+
+    /* Direction of the levelled field relative to the body's heading */
+    p_state->heading_cdeg = -1;
+    if (p_ahrs->has_mag)
+    {
+        ahrs_to_world(r, p_ahrs->mag, h);
+        p_state->heading_cdeg = ahrs_cdeg((int32_t) ((uint32_t) ahrs_atan2(h[1], h[0]) - (uint32_t) yaw));
+        if (p_state->heading_cdeg < 0)
+            p_state->heading_cdeg += 36000;
+    }
+}
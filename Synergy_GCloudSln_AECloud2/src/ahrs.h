@@ -0,0 +1,62 @@
+/*
+ * ahrs.h
+ *
+ *  Fixed-point Mahony AHRS: orientation from the BMI160 gyro, with the
+ *  accelerometer correcting tilt and the BMM150 correcting heading.
+ *
+ *  The update is integer only. Unit quantities (quaternion, normalised
+ *  accel and mag) are Q30, rates are rad/s Q24. Products take the high
+ *  word of the 64-bit result, which the Cortex-M4 DSP extension does in
+ *  one SMMLA, and int16 sums of squares use SMUAD. The portable path
+ *  implements the same operations in C, so both paths give bit-identical
+ *  results; define AHRS_SCALAR to force it on the target.
+ *
+ *  Body frame is the BMI160's: x forward, y left, z up. The BMM150 axes
+ *  are taken as aligned with it. The world frame is x magnetic north, y
+ *  west, z up.
+ */
+
+#ifndef AHRS_H_
+#define AHRS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define AHRS_ONE                (1L << 30)      /* 1.0 in Q30 */
+#define AHRS_DT_MAX_US          (100000UL)      /* Longer steps are clamped */
+
+typedef struct st_ahrs_config
+{
+    float gyro_rads_per_lsb;
+    float kp;                   /* Proportional gain, up to 16 */
+    float ki;                   /* Integral gain (gyro bias), up to 1 */
+} ahrs_config_t;
+
+typedef struct st_ahrs_state
+{
+    int32_t  q[4];              /* w, x, y, z, Q30 */
+    int32_t  roll_cdeg;         /* Right side down positive, -18000..18000 */
+    int32_t  pitch_cdeg;        /* Nose up positive, -9000..9000 */
+    int32_t  yaw_cdeg;          /* Clockwise from magnetic north, 0..35999 */
+    int32_t  heading_cdeg;      /* Last magnetometer sample, tilt-compensated; -1 before one */
+    uint32_t updates;
+} ahrs_state_t;
+
+typedef struct st_ahrs
+{
+    int32_t  q[4];              /* Q30 */
+    int32_t  bias[3];           /* Integral feedback, rad/s Q30 */
+    int32_t  gyro_scale;        /* rad/s per LSB, Q40 */
+    int32_t  kp2;               /* 2 Kp, Q24 */
+    int32_t  ki2;               /* 2 Ki, Q24 */
+    bool     has_mag;
+    int32_t  mag[3];            /* Last magnetometer sample, normalised, Q30 */
+    uint32_t updates;
+} ahrs_t;
+
+void ahrs_init(ahrs_t *p_ahrs, ahrs_config_t const *p_config);
+void ahrs_update(ahrs_t *p_ahrs, int16_t const gyro[3], int16_t const accel[3], int16_t const *p_mag,
+                 uint32_t dt_us);
+void ahrs_get_state(ahrs_t const *p_ahrs, ahrs_state_t *p_state);
+
+#endif /* AHRS_H_ */
@@ -0,0 +1,406 @@
+/*
+ * ahrs_test.c
+ *
+ *  Host checks of the fixed-point AHRS:
+ *   - static poses converge to their roll, pitch, yaw and heading;
+ *   - 1 s at 90 dps integrates to a quarter turn;
+ *   - a constant gyro offset is learned with the firmware gains;
+ *   - the first updates follow a double-precision Mahony filter;
+ *   - the DSP path, built with host_dsp/bsp_api.h, is bit-identical to the
+ *     scalar path on random samples, clamped steps and -32768 included.
+ *  Ends with the cost per update with and without a magnetometer sample.
+ *
+ *  Built by host_test.mk with SENSORS_BUS_SIM; empty in the firmware build.
+ */
+
+#if defined(SENSORS_BUS_SIM)
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "host_test.h"
+#include "ahrs.h"
+
+#define TEST_GYRO_LSB           (0.0010652644f)     /* BMI160_GYRO_RADS_PER_LSB, 2000 dps */
+#define TEST_KP                 (0.5f)              /* AHRS_KP */
+#define TEST_KI                 (0.01f)             /* AHRS_KI */
+#define TEST_DT_US              (10000U)
+#define TEST_MAG_DIVIDER        (4U)
+#define TEST_ACCEL_1G           (16384.0)
+#define TEST_MAG_FIELD          (400.0)             /* LSB, 50 uT at 0.125 uT/LSB */
+#define TEST_MAG_DIP            (1.1)               /* rad below the horizon */
+#define TEST_Q30                (1073741824.0)
+#define TEST_DSP_UPDATES        (2000000UL)
+#define TEST_BENCH_UPDATES      (1000000UL)
+
+/* The same filter built with -D__ARM_FEATURE_DSP=1 and these names */
+void ahrs_dsp_init(ahrs_t *p_ahrs, ahrs_config_t const *p_config);
+void ahrs_dsp_update(ahrs_t *p_ahrs, int16_t const gyro[3], int16_t const accel[3], int16_t const *p_mag,
+                     uint32_t dt_us);
+void ahrs_dsp_get_state(ahrs_t const *p_ahrs, ahrs_state_t *p_state);
+
+/* Double-precision Mahony filter, the structure ahrs_update() follows */
+typedef struct st_test_ref
+{
+    double q[4];
+    double bias[3];
+} test_ref_t;
+
+/*
+ * Body-frame accel and mag for a pose, in degrees as ahrs_state_t reports
+ * them: right side down, nose up and clockwise from north positive.
+ */
+static void test_pose(double roll_deg, double pitch_deg, double yaw_deg, int16_t accel[3], int16_t mag[3])
+{
+    double const roll = roll_deg * M_PI / 180.0;
+    double const pitch = -pitch_deg * M_PI / 180.0;
+    double const yaw = -yaw_deg * M_PI / 180.0;
+    double const cr = cos(roll);
+    double const sr = sin(roll);
+    double const cp = cos(pitch);
+    double const sp = sin(pitch);
+    double const cy = cos(yaw);
+    double const sy = sin(yaw);
+    double const r[3][3] =
+    {
+        { cy * cp, (cy * sp * sr) - (sy * cr), (cy * sp * cr) + (sy * sr) },
+        { sy * cp, (sy * sp * sr) + (cy * cr), (sy * sp * cr) - (cy * sr) },
+        { -sp, cp * sr, cp * cr }
+    };
+    double const field[3] = { cos(TEST_MAG_DIP), 0.0, -sin(TEST_MAG_DIP) };
+    double a;
+    double m;
+    uint32_t i;
+
+    for (i = 0; i < 3U; i++)
+    {
+        a = r[2][i];
+        m = (r[0][i] * field[0]) + (r[1][i] * field[1]) + (r[2][i] * field[2]);
+        accel[i] = (int16_t)lround(a * TEST_ACCEL_1G);
+        mag[i] = (int16_t)lround(m * TEST_MAG_FIELD);
+    }
+}
+
+/* Difference of two angles in degrees, -180..180 */
+static double test_angle_diff(double a, double b)
+{
+    return remainder(a - b, 360.0);
+}
+
+static void test_ref_update(test_ref_t *p_ref, double const gyro[3], double const accel[3], double const *p_mag,
+                            double dt, double kp2, double ki2)
+{
+    double const *q = p_ref->q;
+    double g[3] = { gyro[0], gyro[1], gyro[2] };
+    double e[3] = { 0.0, 0.0, 0.0 };
+    double a[3];
+    double m[3];
+    double n;
+    double h[3];
+    double bx;
+    double bz;
+    double w[3];
+    double v[3];
+    double q0;
+    double q1;
+    double q2;
+    uint32_t i;
+
+    n = sqrt((accel[0] * accel[0]) + (accel[1] * accel[1]) + (accel[2] * accel[2]));
+    if (n > 0.0)
+    {
+        for (i = 0; i < 3U; i++)
+            a[i] = accel[i] / n;
+
+        /* Gravity in the body frame */
+        v[0] = (q[1] * q[3]) - (q[0] * q[2]);
+        v[1] = (q[0] * q[1]) + (q[2] * q[3]);
+        v[2] = (q[0] * q[0]) - 0.5 + (q[3] * q[3]);
+        e[0] = (a[1] * v[2]) - (a[2] * v[1]);
+        e[1] = (a[2] * v[0]) - (a[0] * v[2]);
+        e[2] = (a[0] * v[1]) - (a[1] * v[0]);
+
+        if (p_mag != NULL)
+        {
+            n = sqrt((p_mag[0] * p_mag[0]) + (p_mag[1] * p_mag[1]) + (p_mag[2] * p_mag[2]));
+            for (i = 0; i < 3U; i++)
+                m[i] = p_mag[i] / n;
+
+            /* Field in the world frame, flattened to north and down, back to the body */
+            h[0] = 2.0 * ((m[0] * (0.5 - (q[2] * q[2]) - (q[3] * q[3]))) + (m[1] * ((q[1] * q[2]) - (q[0] * q[3])))
+                          + (m[2] * ((q[1] * q[3]) + (q[0] * q[2]))));
+            h[1] = 2.0 * ((m[0] * ((q[1] * q[2]) + (q[0] * q[3]))) + (m[1] * (0.5 - (q[1] * q[1]) - (q[3] * q[3])))
+                          + (m[2] * ((q[2] * q[3]) - (q[0] * q[1]))));
+            h[2] = 2.0 * ((m[0] * ((q[1] * q[3]) - (q[0] * q[2]))) + (m[1] * ((q[2] * q[3]) + (q[0] * q[1])))
+                          + (m[2] * (0.5 - (q[1] * q[1]) - (q[2] * q[2]))));
+            bx = sqrt((h[0] * h[0]) + (h[1] * h[1]));
+            bz = h[2];
+            w[0] = (bx * (0.5 - (q[2] * q[2]) - (q[3] * q[3]))) + (bz * ((q[1] * q[3]) - (q[0] * q[2])));
+            w[1] = (bx * ((q[1] * q[2]) - (q[0] * q[3]))) + (bz * ((q[0] * q[1]) + (q[2] * q[3])));
+            w[2] = (bx * ((q[0] * q[2]) + (q[1] * q[3]))) + (bz * (0.5 - (q[1] * q[1]) - (q[2] * q[2])));
+            e[0] += (m[1] * w[2]) - (m[2] * w[1]);
+            e[1] += (m[2] * w[0]) - (m[0] * w[2]);
+            e[2] += (m[0] * w[1]) - (m[1] * w[0]);
+        }
+
+        for (i = 0; i < 3U; i++)
+        {
+            p_ref->bias[i] += ki2 * e[i] * dt;
+            g[i] += (kp2 * e[i]) + p_ref->bias[i];
+        }
+    }
+    else
+    {
+        for (i = 0; i < 3U; i++)
+            g[i] += p_ref->bias[i];
+    }
+
+    for (i = 0; i < 3U; i++)
+        g[i] *= 0.5 * dt;
+
+    q0 = p_ref->q[0];
+    q1 = p_ref->q[1];
+    q2 = p_ref->q[2];
+    p_ref->q[0] += -(q1 * g[0]) - (q2 * g[1]) - (p_ref->q[3] * g[2]);
+    p_ref->q[1] += (q0 * g[0]) + (q2 * g[2]) - (p_ref->q[3] * g[1]);
+    p_ref->q[2] += (q0 * g[1]) - (q1 * g[2]) + (p_ref->q[3] * g[0]);
+    p_ref->q[3] += (q0 * g[2]) + (q1 * g[1]) - (q2 * g[0]);
+
+    n = sqrt((p_ref->q[0] * p_ref->q[0]) + (p_ref->q[1] * p_ref->q[1]) + (p_ref->q[2] * p_ref->q[2])
+             + (p_ref->q[3] * p_ref->q[3]));
+    for (i = 0; i < 4U; i++)
+        p_ref->q[i] /= n;
+}
+
+/* Proportional-only, so the 3 minutes are settling and not integral wind-up */
+static void test_static_poses(void)
+{
+    static double const poses[][3] =
+    {
+        { 0, 0, 0 }, { 30, 0, 0 }, { 0, 20, 0 }, { 0, 0, 90 }, { -45, 10, 200 }, { 170, -60, 300 }, { 10, 80, 45 }
+    };
+    ahrs_config_t const config = { .gyro_rads_per_lsb = TEST_GYRO_LSB, .kp = 2.0f, .ki = 0.0f };
+    int16_t const gyro[3] = { 0, 0, 0 };
+    int16_t accel[3];
+    int16_t mag[3];
+    ahrs_t ahrs;
+    ahrs_state_t state;
+    double worst = 0.0;
+    double err;
+    uint32_t p;
+    uint32_t k;
+
+    for (p = 0; p < (sizeof(poses) / sizeof(poses[0])); p++)
+    {
+        ahrs_init(&ahrs, &config);
+        test_pose(poses[p][0], poses[p][1], poses[p][2], accel, mag);
+        for (k = 0; k < 18000U; k++)
+            ahrs_update(&ahrs, gyro, accel, ((k % TEST_MAG_DIVIDER) == 0U) ? mag : NULL, TEST_DT_US);
+        ahrs_get_state(&ahrs, &state);
+
+        err = fabs(test_angle_diff(state.roll_cdeg / 100.0, poses[p][0]));
+        err = fmax(err, fabs(test_angle_diff(state.pitch_cdeg / 100.0, poses[p][1])));
+        err = fmax(err, fabs(test_angle_diff(state.yaw_cdeg / 100.0, poses[p][2])));
+        err = fmax(err, fabs(test_angle_diff(state.heading_cdeg / 100.0, poses[p][2])));
+        worst = fmax(worst, err);
+    }
+    printf("static poses: worst %.2f deg after 180 s\r\n", worst);
+    HOST_TEST_CHECK(worst < 0.25);
+}
+
+/* No correction without gravity, so only the gyro turns it */
+static void test_gyro_integration(void)
+{
+    ahrs_config_t const config = { .gyro_rads_per_lsb = TEST_GYRO_LSB, .kp = 0.0f, .ki = 0.0f };
+    int16_t const gyro[3] = { 0, 0, (int16_t)lround((90.0 * M_PI / 180.0) / TEST_GYRO_LSB) };
+    int16_t const accel[3] = { 0, 0, 0 };
+    ahrs_t ahrs;
+    ahrs_state_t state;
+    uint32_t k;
+
+    ahrs_init(&ahrs, &config);
+    for (k = 0; k < 100U; k++)
+        ahrs_update(&ahrs, gyro, accel, NULL, TEST_DT_US);
+    ahrs_get_state(&ahrs, &state);
+
+    /* Counter-clockwise about up, so a quarter turn back from north */
+    printf("90 dps for 1 s: yaw %.2f deg\r\n", state.yaw_cdeg / 100.0);
+    HOST_TEST_CHECK(fabs(test_angle_diff(state.yaw_cdeg / 100.0, 270.0)) < 0.1);
+}
+
+static void test_gyro_bias(void)
+{
+    ahrs_config_t const config = { .gyro_rads_per_lsb = TEST_GYRO_LSB, .kp = TEST_KP, .ki = TEST_KI };
+    int16_t const gyro[3] = { 10, -8, 5 };
+    int16_t accel[3];
+    int16_t mag[3];
+    ahrs_t ahrs;
+    ahrs_state_t state;
+    double bias;
+    double worst = 0.0;
+    uint32_t k;
+    uint32_t i;
+
+    ahrs_init(&ahrs, &config);
+    test_pose(0.0, 0.0, 0.0, accel, mag);
+    for (k = 0; k < 30000U; k++)
+        ahrs_update(&ahrs, gyro, accel, ((k % TEST_MAG_DIVIDER) == 0U) ? mag : NULL, TEST_DT_US);
+    ahrs_get_state(&ahrs, &state);
+
+    for (i = 0; i < 3U; i++)
+    {
+        bias = -gyro[i] * (double)TEST_GYRO_LSB;
+        worst = fmax(worst, fabs((ahrs.bias[i] / TEST_Q30) - bias) / fabs(bias));
+    }
+    printf("gyro offset: learned within %.2f %% after 300 s\r\n", 100.0 * worst);
+    HOST_TEST_CHECK(worst < 0.01);
+    HOST_TEST_CHECK(fabs(test_angle_diff(state.roll_cdeg / 100.0, 0.0)) < 0.5);
+    HOST_TEST_CHECK(fabs(test_angle_diff(state.pitch_cdeg / 100.0, 0.0)) < 0.5);
+    HOST_TEST_CHECK(fabs(test_angle_diff(state.yaw_cdeg / 100.0, 0.0)) < 0.5);
+}
+
+/* Random samples diverge chaotically after a while; the first thousand must agree */
+static void test_reference(void)
+{
+    ahrs_config_t const config = { .gyro_rads_per_lsb = TEST_GYRO_LSB, .kp = TEST_KP, .ki = TEST_KI };
+    test_ref_t ref = { .q = { 1.0, 0.0, 0.0, 0.0 } };
+    ahrs_t ahrs;
+    int16_t gyro[3];
+    int16_t accel[3];
+    int16_t mag[3];
+    double gyro_d[3];
+    double accel_d[3];
+    double mag_d[3];
+    double same;
+    double flipped;
+    double worst = 0.0;
+    bool use_mag;
+    uint32_t k;
+    uint32_t i;
+
+    srand(1);
+    ahrs_init(&ahrs, &config);
+    for (k = 0; k < 1000U; k++)
+    {
+        for (i = 0; i < 3U; i++)
+        {
+            gyro[i] = (int16_t)((rand() % 2001) - 1000);
+            accel[i] = (int16_t)((rand() % 32001) - 16000);
+            mag[i] = (int16_t)((rand() % 801) - 400);
+            gyro_d[i] = gyro[i] * (double)TEST_GYRO_LSB;
+            accel_d[i] = accel[i];
+            mag_d[i] = mag[i];
+        }
+        use_mag = ((k % TEST_MAG_DIVIDER) == 0U);
+
+        ahrs_update(&ahrs, gyro, accel, use_mag ? mag : NULL, TEST_DT_US);
+        test_ref_update(&ref, gyro_d, accel_d, use_mag ? mag_d : NULL, TEST_DT_US / 1e6, 2.0 * TEST_KP,
+                        2.0 * TEST_KI);
+
+        /* q and -q are the same rotation */
+        same = 0.0;
+        flipped = 0.0;
+        for (i = 0; i < 4U; i++)
+        {
+            same += fabs((ahrs.q[i] / TEST_Q30) - ref.q[i]);
+            flipped += fabs((ahrs.q[i] / TEST_Q30) + ref.q[i]);
+        }
+        worst = fmax(worst, fmin(same, flipped));
+    }
+    printf("double reference: |q - q_ref| at most %.1e over 1000 random updates\r\n", worst);
+    HOST_TEST_CHECK(worst < 1e-4);
+}
+
+static void test_dsp_identical(void)
+{
+    ahrs_config_t const config = { .gyro_rads_per_lsb = TEST_GYRO_LSB, .kp = TEST_KP, .ki = TEST_KI };
+    ahrs_t scalar;
+    ahrs_t dsp;
+    ahrs_state_t scalar_state;
+    ahrs_state_t dsp_state;
+    int16_t gyro[3];
+    int16_t accel[3];
+    int16_t mag[3];
+    uint32_t dt_us;
+    uint32_t mismatches = 0;
+    uint32_t k;
+    uint32_t i;
+
+    srand(7);
+    ahrs_init(&scalar, &config);
+    ahrs_dsp_init(&dsp, &config);
+    for (k = 0; k < TEST_DSP_UPDATES; k++)
+    {
+        for (i = 0; i < 3U; i++)
+        {
+            gyro[i] = (int16_t)rand();
+            accel[i] = (int16_t)rand();
+            mag[i] = (int16_t)((rand() % 2001) - 1000);
+        }
+        if ((k % 97U) == 0U)
+            accel[1] = INT16_MIN;
+        dt_us = ((k % 1000U) == 0U) ? (2U * AHRS_DT_MAX_US) : (uint32_t)(rand() % 20000);
+
+        ahrs_update(&scalar, gyro, accel, ((k & 3U) == 0U) ? mag : NULL, dt_us);
+        ahrs_dsp_update(&dsp, gyro, accel, ((k & 3U) == 0U) ? mag : NULL, dt_us);
+        if (memcmp(&scalar, &dsp, sizeof(scalar)) != 0)
+        {
+            mismatches++;
+            memcpy(&dsp, &scalar, sizeof(dsp));
+        }
+
+        if ((k % 1000U) == 0U)
+        {
+            ahrs_get_state(&scalar, &scalar_state);
+            ahrs_dsp_get_state(&dsp, &dsp_state);
+            if (memcmp(&scalar_state, &dsp_state, sizeof(scalar_state)) != 0)
+                mismatches++;
+        }
+    }
+    printf("DSP path: %lu mismatches with the scalar path over %lu updates\r\n", (unsigned long)mismatches,
+           (unsigned long)TEST_DSP_UPDATES);
+    HOST_TEST_CHECK(mismatches == 0U);
+}
+
+static void test_benchmark(void)
+{
+    ahrs_config_t const config = { .gyro_rads_per_lsb = TEST_GYRO_LSB, .kp = TEST_KP, .ki = TEST_KI };
+    int16_t const gyro[3] = { 30, -20, 10 };
+    int16_t accel[3];
+    int16_t mag[3];
+    ahrs_t ahrs;
+    uint64_t start;
+    uint64_t cycles[2];
+    uint32_t with_mag;
+    uint32_t k;
+
+    ahrs_init(&ahrs, &config);
+    test_pose(17.0, 11.0, 57.0, accel, mag);
+    for (with_mag = 0; with_mag < 2U; with_mag++)
+    {
+        start = host_test_cycles();
+        for (k = 0; k < TEST_BENCH_UPDATES; k++)
+        {
+            accel[0] ^= (int16_t)(k & 1U);
+            ahrs_update(&ahrs, gyro, accel, (with_mag != 0U) ? mag : NULL, TEST_DT_US);
+        }
+        cycles[with_mag] = host_test_cycles() - start;
+    }
+    printf("%.0f cycles/update, %.0f with a magnetometer sample\r\n", (double)cycles[0] / TEST_BENCH_UPDATES,
+           (double)cycles[1] / TEST_BENCH_UPDATES);
+    HOST_TEST_CHECK(ahrs.updates == (2U * TEST_BENCH_UPDATES));
+}
+
+int main(void)
+{
+    test_static_poses();
+    test_gyro_integration();
+    test_gyro_bias();
+    test_reference();
+    test_dsp_identical();
+    test_benchmark();
+
+    return host_test_finish("ahrs");
+}
+
+#endif /* SENSORS_BUS_SIM */
@@ -0,0 +1,204 @@
+/*
+ * als_range.c
+ *
+ *  Auto-ranging ambient light readings from the ISL29035. See als_range.h.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "als_range.h"
+
+/* ISL29035 registers */
+#define ALS_REG_COMMAND_I       (0x00U)
+#define ALS_REG_COMMAND_II      (0x01U)
+#define ALS_REG_DATA            (0x02U)
+#define ALS_OP_ALS_ONCE         (0x20U)     /* COMMAND-I bits 7:5 */
+#define ALS_RES_12              (0x04U)     /* COMMAND-II bits 3:2, 0 is 16-bit */
+#define ALS_RES_MASK            (0x0CU)
+#define ALS_COMMAND_UNKNOWN     (0xFFU)
+
+#define ALS_RANGE_TOP           (ALS_RANGE_COUNT - 1U)
+#define ALS_RANGE_FAST_FROM     (2U)        /* 12-bit from the 16000 lux range up */
+
+/* Integration time plus 10 % for the internal oscillator and 1 ms for the caller's clock */
+#define ALS_WAIT_16_MS          (117U)      /* 105 ms */
+#define ALS_WAIT_12_MS          (9U)        /* 6.5 ms */
+
+static const uint16_t als_range_lux[ALS_RANGE_COUNT] = { 1000, 4000, 16000, 64000 };
+
+static uint8_t als_range_command_ii(uint8_t range)
+{
+    return (uint8_t) (((range >= ALS_RANGE_FAST_FROM) ? ALS_RES_12 : 0U) | range);
+}
+
+/* Program the next range if it changed and start a one-shot conversion */
+static int8_t als_range_trigger(als_range_t *p_als, uint32_t now_ms)
+{
+    uint8_t command_ii = als_range_command_ii(p_als->range);
+    uint8_t command_i = ALS_OP_ALS_ONCE;
+    int8_t status = 0;
+
+    if (p_als->command_ii != command_ii)
+    {
+        status = p_als->cfg.write(p_als->cfg.dev_id, ALS_REG_COMMAND_II, &command_ii, 1);
+        p_als->command_ii = (status == 0) ? command_ii : ALS_COMMAND_UNKNOWN;
+    }
+
+    if (status == 0)
+        status = p_als->cfg.write(p_als->cfg.dev_id, ALS_REG_COMMAND_I, &command_i, 1);
+
+    if (status != 0)
+    {
+        p_als->stats.errors++;
+        p_als->pending = false;
+        return ALS_RANGE_E_COM_FAIL;
+    }
+
+    p_als->pending = true;
+    p_als->pending_command_ii = command_ii;
+    p_als->trigger_ms = now_ms;
+
+    return ALS_RANGE_OK;
+}
+
+/*
+ * Range of the next conversion from an unsaturated reading. A reading fits
+ * a lower range when it stays under three quarters of its full scale; the
+ * ranges are a factor of 4 apart and full scale does not depend on the
+ * resolution, so that is a shift of the count.
+ */
+static void als_range_next(als_range_t *p_als, uint32_t count, uint8_t bits)
+{
+    uint32_t limit = (3UL << bits) / 4U;
+    uint8_t range = p_als->range;
+    uint8_t fit = range;
+
+    while ((fit > 0U) && ((count << (2U * (range - fit + 1U))) < limit))
+        fit--;
+
+    if (fit == range)
+    {
+        p_als->down_votes = 0;
+    }
+    else if (p_als->searching)
+    {
+        p_als->range = fit;
+        p_als->stats.range_changes++;
+    }
+    else
+    {
+        /* The least step down that all the recent readings agree on */
+        if ((p_als->down_votes == 0U) || (fit > p_als->down_range))
+            p_als->down_range = fit;
+
+        if (++p_als->down_votes >= ALS_RANGE_DOWN_READS)
+        {
+            p_als->range = p_als->down_range;
+            p_als->down_votes = 0;
+            p_als->stats.range_changes++;
+        }
+    }
+
+    p_als->searching = false;
+}
+
+void als_range_init(als_range_t *p_als, als_range_config_t const *p_cfg)
+{
+    memset(p_als, 0, sizeof(*p_als));
+    p_als->cfg = *p_cfg;
+    p_als->range = ALS_RANGE_TOP;           /* Search from the top on the first reading */
+    p_als->searching = true;
+    p_als->command_ii = ALS_COMMAND_UNKNOWN;
+}
+
+/*
+ * Read the conversion in flight once its integration time has passed and
+ * start the next one straight away. Returns ALS_RANGE_W_NO_NEW_DATA,
+ * without a bus transaction, while the conversion is still running, and
+ * after a saturated or mis-programmed conversion, whose replacement is
+ * then already running.
+ */
+int8_t als_range_collect(als_range_t *p_als, als_reading_t *p_reading, uint32_t now_ms)
+{
+    uint8_t regs[4];
+    uint32_t wait;
+    uint32_t elapsed;
+    uint32_t count;
+    uint32_t full;
+    uint8_t bits;
+    int8_t status;
+
+    if (!p_als->pending)
+    {
+        status = als_range_trigger(p_als, now_ms);
+        return (status == ALS_RANGE_OK) ? ALS_RANGE_W_NO_NEW_DATA : status;
+    }
+
+    bits = (p_als->pending_command_ii & ALS_RES_MASK) ? 12U : 16U;
+    wait = (bits == 12U) ? ALS_WAIT_12_MS : ALS_WAIT_16_MS;
+    elapsed = now_ms - p_als->trigger_ms;
+    if (elapsed < wait)
+        return ALS_RANGE_W_NO_NEW_DATA;
+
+    if ((elapsed - wait) > p_als->stats.late_max_ms)
+        p_als->stats.late_max_ms = elapsed - wait;
+
+    /* COMMAND-I, COMMAND-II and the data in one burst */
+    p_als->pending = false;
+    if (p_als->cfg.read(p_als->cfg.dev_id, ALS_REG_COMMAND_I, regs, sizeof(regs)) != 0)
+    {
+        p_als->stats.errors++;
+        p_als->command_ii = ALS_COMMAND_UNKNOWN;
+        return ALS_RANGE_E_COM_FAIL;
+    }
+
+    if (regs[ALS_REG_COMMAND_II] != p_als->pending_command_ii)
+    {
+        /* Reset since it was programmed, the data is at another scale */
+        p_als->stats.reprograms++;
+        p_als->command_ii = ALS_COMMAND_UNKNOWN;
+        status = als_range_trigger(p_als, now_ms);
+        return (status == ALS_RANGE_OK) ? ALS_RANGE_W_NO_NEW_DATA : status;
+    }
+
+    count = (uint32_t) regs[ALS_REG_DATA] | ((uint32_t) regs[ALS_REG_DATA + 1U] << 8);
+    full = 1UL << bits;
+
+    /* Within a sixteenth of full scale the reading may be clipped */
+    if ((count >= (full - (full / 16U))) && (p_als->range < ALS_RANGE_TOP))
+    {
+        p_als->stats.saturated++;
+        p_als->stats.range_changes++;
+        p_als->range = ALS_RANGE_TOP;
+        p_als->searching = true;
+        p_als->down_votes = 0;
+        status = als_range_trigger(p_als, now_ms);
+        return (status == ALS_RANGE_OK) ? ALS_RANGE_W_NO_NEW_DATA : status;
+    }
+
+    p_reading->saturated = (count >= (full - 1U));
+
+    p_reading->count = (uint16_t) count;
+    p_reading->range_lux = als_range_lux[p_als->range];
+    p_reading->bits = bits;
+    p_reading->lux_milli = (uint32_t) (((uint64_t) count * als_range_lux[p_als->range] * 1000U) >> bits);
+    p_als->stats.readings++;
+
+    als_range_next(p_als, count, bits);
+    als_range_trigger(p_als, now_ms);       /* On failure the next call retries */
+
+    return ALS_RANGE_OK;
+}
+
+void als_range_print(als_range_t const *p_als, void (*p_print)(char const *p_str))
+{
+    char str[96];
+
+    p_print("\r\nALS readings  Saturated  Ranges  Reprograms  Errors  Late(ms)  Range\r\n");
+    snprintf(str, sizeof(str), "%12lu  %9lu  %6lu  %10lu  %6lu  %8lu  %5u\r\n",
+             (unsigned long)p_als->stats.readings, (unsigned long)p_als->stats.saturated,
+             (unsigned long)p_als->stats.range_changes, (unsigned long)p_als->stats.reprograms,
+             (unsigned long)p_als->stats.errors, (unsigned long)p_als->stats.late_max_ms,
+             (unsigned)als_range_lux[p_als->range]);
+    p_print(str);
+}
@@ -0,0 +1,88 @@
+/*
+ * als_range.h
+ *
+ *  Auto-ranging ambient light readings from the ISL29035.
+ *
+ *  Every conversion is a one-shot (ALS once) that als_range_collect()
+ *  starts and, on a later call, reads back: the call returns
+ *  ALS_RANGE_W_NO_NEW_DATA without a bus transaction until the integration
+ *  time has passed, so the caller never waits on the sensor. Each result
+ *  picks the setting of the next conversion.
+ *
+ *  Range: a saturated reading is dropped and the next conversion goes
+ *  straight to the top range, whose reading then picks the range it fits in
+ *  with a quarter of full scale to spare. Outside that search the range
+ *  only steps down after ALS_RANGE_DOWN_READS readings in a row fit a lower
+ *  one, so flicker near a boundary does not make it hunt.
+ *
+ *  Integration time: 16-bit (105 ms, whole mains flicker cycles) below the
+ *  16000 lux range, 12-bit (6.5 ms, a sixteenth of the sensor's active
+ *  time) on the upper two, where daylight dominates and 12 bits still
+ *  resolve 0.2 % of the reading at the range's lower boundary.
+ *
+ *  The read also returns COMMAND-II, so a sensor that lost its settings
+ *  (brown-out) is reprogrammed instead of being read at the wrong scale.
+ *  Time comes from the caller, so the controller runs unchanged against the
+ *  i2c_sim model on a host.
+ */
+
+#ifndef ALS_RANGE_H_
+#define ALS_RANGE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define ALS_RANGE_COUNT         (4U)    /* 1000, 4000, 16000 and 64000 lux full scale */
+#define ALS_RANGE_DOWN_READS    (3U)
+
+#define ALS_RANGE_OK            (0)
+#define ALS_RANGE_W_NO_NEW_DATA (1)     /* Converting, or the reading was saturated */
+#define ALS_RANGE_E_COM_FAIL    (-2)
+
+typedef int8_t (*als_range_bus_t)(uint8_t dev_id, uint8_t reg_addr, uint8_t *p_data, uint16_t len);
+
+typedef struct st_als_range_config
+{
+    uint8_t         dev_id;
+    als_range_bus_t read;           /* The driver's bus hooks */
+    als_range_bus_t write;
+} als_range_config_t;
+
+typedef struct st_als_reading
+{
+    uint32_t lux_milli;
+    uint16_t count;                 /* Data register */
+    uint16_t range_lux;             /* Full scale of the conversion */
+    uint8_t  bits;                  /* 16 or 12 */
+    bool     saturated;             /* At full scale on the top range, lux_milli is a lower bound */
+} als_reading_t;
+
+typedef struct st_als_range_stats
+{
+    uint32_t readings;
+    uint32_t saturated;             /* Dropped, range raised */
+    uint32_t range_changes;
+    uint32_t reprograms;            /* COMMAND-II found changed */
+    uint32_t errors;
+    uint32_t late_max_ms;           /* Conversion done to collected, the age of a reading */
+} als_range_stats_t;
+
+typedef struct st_als_range
+{
+    als_range_config_t cfg;
+    uint8_t  range;                 /* Of the next conversion */
+    bool     searching;             /* Range raised on saturation, the next reading may drop it at once */
+    uint8_t  down_votes;            /* Readings in a row that fit a lower range */
+    uint8_t  down_range;            /* Highest range they fit */
+    uint8_t  command_ii;            /* Programmed in the sensor, 0xFF when unknown */
+    bool     pending;               /* A conversion is running */
+    uint8_t  pending_command_ii;    /* Its setting */
+    uint32_t trigger_ms;
+    als_range_stats_t stats;
+} als_range_t;
+
+void als_range_init(als_range_t *p_als, als_range_config_t const *p_cfg);
+int8_t als_range_collect(als_range_t *p_als, als_reading_t *p_reading, uint32_t now_ms);
+void als_range_print(als_range_t const *p_als, void (*p_print)(char const *p_str));
+
+#endif /* ALS_RANGE_H_ */
@@ -0,0 +1,285 @@
+/*
+ * als_range_sim.c
+ *
+ *  Host simulation of the ISL29035 auto-ranging in als_range.c against the
+ *  i2c_sim model, collected every 250 ms as sensors_read_light() is:
+ *   - steady light from darkness to 50000 lux settles on the least range
+ *     with a quarter of full scale to spare, one count of accuracy;
+ *   - a step into sunlight loses at most one reading to saturation, a step
+ *     back down waits ALS_RANGE_DOWN_READS readings;
+ *   - light swinging across a range's saturation margin does not make it
+ *     hunt;
+ *   - light above the top range reads as saturated full scale;
+ *   - a sensor that lost its settings is reprogrammed;
+ *   - calls during the integration time cost no bus transaction, and each
+ *     reading costs one read burst and one trigger write.
+ *
+ *  Built by host_test.mk with SENSORS_BUS_SIM; empty in the firmware build.
+ */
+
+#if defined(SENSORS_BUS_SIM)
+
+#include <stdlib.h>
+#include "host_test.h"
+#include "als_range.h"
+#include "i2c_sim.h"
+
+#define SIM_PERIOD_MS           (250U)      /* sensors_tasks[] ISL29035 */
+#define SIM_SETTLE_PERIODS      (8U)
+
+static als_range_t sim_als;
+static uint32_t sim_period;
+
+static void sim_set_lux_milli(uint32_t lux_milli)
+{
+    i2c_sim_inputs_t inputs = { .als_mlux = lux_milli };
+
+    i2c_sim_set_inputs(&inputs);
+}
+
+static void sim_start(uint32_t lux_milli)
+{
+    i2c_sim_config_t const config = { .bus_hz = 400000U, .overhead_us = 30U };
+    als_range_config_t const als_cfg =
+    {
+        .dev_id = I2C_SIM_ISL29035_ADDR,
+        .read = i2c_sim_read,
+        .write = i2c_sim_write
+    };
+
+    i2c_sim_init(&config);
+    sim_set_lux_milli(lux_milli);
+    als_range_init(&sim_als, &als_cfg);
+    sim_period = 0;
+}
+
+/* The next scheduler run of the light task */
+static int8_t sim_collect(als_reading_t *p_reading)
+{
+    uint64_t const due_us = (uint64_t)sim_period * SIM_PERIOD_MS * 1000U;
+
+    sim_period++;
+    if (i2c_sim_now_us() < due_us)
+        i2c_sim_advance_us((uint32_t)(due_us - i2c_sim_now_us()));
+
+    return als_range_collect(&sim_als, p_reading, (uint32_t)(i2c_sim_now_us() / 1000U));
+}
+
+/* Runs until a reading comes back; the number of runs it took, 0 if none did within limit */
+static uint32_t sim_next_reading(als_reading_t *p_reading, uint32_t limit)
+{
+    uint32_t runs;
+
+    for (runs = 1; runs <= limit; runs++)
+    {
+        if (sim_collect(p_reading) == ALS_RANGE_OK)
+            return runs;
+    }
+
+    return 0;
+}
+
+/* Smallest full scale the reading fits under three quarters of */
+static uint16_t sim_expected_range(uint32_t lux_milli)
+{
+    static uint16_t const range_lux[ALS_RANGE_COUNT] = { 1000, 4000, 16000, 64000 };
+    uint32_t i;
+
+    for (i = 0; i < (ALS_RANGE_COUNT - 1U); i++)
+    {
+        if (lux_milli < (range_lux[i] * 750U))
+            break;
+    }
+
+    return range_lux[i];
+}
+
+/* The reading agrees with the light to one count of its range and resolution */
+static bool sim_accurate(als_reading_t const *p_reading, uint32_t lux_milli)
+{
+    uint32_t const count_milli = (uint32_t)(((uint64_t)p_reading->range_lux * 1000U) >> p_reading->bits);
+
+    return (abs((int32_t)p_reading->lux_milli - (int32_t)lux_milli) <= (int32_t)count_milli);
+}
+
+static void sim_steady(void)
+{
+    static uint32_t const levels_milli[] =
+    {
+        0U, 300U, 50000U, 400000U, 749000U, 2500000U, 11000000U, 30000000U, 50000000U,
+    };
+    als_reading_t reading = { 0 };
+    uint32_t first;
+    uint32_t i;
+    uint32_t k;
+
+    for (i = 0; i < (sizeof(levels_milli) / sizeof(levels_milli[0])); i++)
+    {
+        sim_start(levels_milli[i]);
+        first = sim_next_reading(&reading, SIM_SETTLE_PERIODS);
+        for (k = 0; k < SIM_SETTLE_PERIODS; k++)
+            (void)sim_next_reading(&reading, SIM_SETTLE_PERIODS);
+
+        printf("%8.1f lux: %8.1f lux on the %5u lux range at %u bits, first reading on run %lu, "
+               "%lu range changes\r\n", levels_milli[i] / 1000.0, reading.lux_milli / 1000.0, reading.range_lux,
+               reading.bits, (unsigned long)first, (unsigned long)sim_als.stats.range_changes);
+        HOST_TEST_CHECK(first == 2U);
+        HOST_TEST_CHECK(reading.range_lux == sim_expected_range(levels_milli[i]));
+        HOST_TEST_CHECK(reading.bits == ((reading.range_lux >= 16000U) ? 12U : 16U));
+        HOST_TEST_CHECK(sim_accurate(&reading, levels_milli[i]));
+        HOST_TEST_CHECK(!reading.saturated && (sim_als.stats.saturated == 0U));
+        HOST_TEST_CHECK(sim_als.stats.range_changes <= 1U);
+        HOST_TEST_CHECK(sim_als.stats.late_max_ms < SIM_PERIOD_MS);
+    }
+}
+
+/* 300 lux indoors, then 30000 lux of sunlight, then back */
+static void sim_steps(void)
+{
+    uint32_t const indoor_milli = 300000U;
+    uint32_t const sun_milli = 30000000U;
+    als_reading_t reading = { 0 };
+    uint32_t runs;
+    uint32_t k;
+
+    sim_start(indoor_milli);
+    for (k = 0; k < SIM_SETTLE_PERIODS; k++)
+        (void)sim_next_reading(&reading, SIM_SETTLE_PERIODS);
+    HOST_TEST_CHECK(reading.range_lux == 1000U);
+
+    sim_set_lux_milli(sun_milli);
+    runs = sim_next_reading(&reading, SIM_SETTLE_PERIODS);
+    printf("step to sunlight: first reading after %lu runs, %.0f lux on the %u lux range, %lu saturated\r\n",
+           (unsigned long)runs, reading.lux_milli / 1000.0, reading.range_lux,
+           (unsigned long)sim_als.stats.saturated);
+    HOST_TEST_CHECK(runs == 2U);
+    HOST_TEST_CHECK(sim_als.stats.saturated == 1U);
+    HOST_TEST_CHECK((reading.range_lux == 64000U) && sim_accurate(&reading, sun_milli));
+
+    sim_set_lux_milli(indoor_milli);
+    for (k = 1; k <= (ALS_RANGE_DOWN_READS + 1U); k++)
+    {
+        HOST_TEST_CHECK(sim_next_reading(&reading, 1U) == 1U);
+        HOST_TEST_CHECK(sim_accurate(&reading, indoor_milli));
+        if (reading.range_lux == 1000U)
+            break;
+    }
+    printf("step back indoors: on the 1000 lux range from reading %lu\r\n", (unsigned long)k);
+    HOST_TEST_CHECK(k == (ALS_RANGE_DOWN_READS + 1U));
+    HOST_TEST_CHECK(reading.range_lux == 1000U);
+}
+
+/*
+ * Settled at 700 lux on the 1000 lux range, then 900 lux with +-5 % swings
+ * across its saturation margin at 937.5 lux: one saturated reading moves
+ * it to the 4000 lux range for good, which it leaves only below 750 lux.
+ */
+static void sim_flicker(void)
+{
+    als_reading_t reading = { 0 };
+    uint32_t lux_milli;
+    uint32_t readings = 0;
+    uint32_t k;
+
+    sim_start(700000U);
+    for (k = 0; k < SIM_SETTLE_PERIODS; k++)
+        (void)sim_next_reading(&reading, SIM_SETTLE_PERIODS);
+    HOST_TEST_CHECK(reading.range_lux == 1000U);
+
+    for (k = 0; k < 400U; k++)
+    {
+        lux_milli = 900000U + (((k * 7919U) % 91U) * 1000U) - 45000U;
+        sim_set_lux_milli(lux_milli);
+        if (sim_collect(&reading) == ALS_RANGE_OK)
+        {
+            readings++;
+            HOST_TEST_CHECK(sim_accurate(&reading, lux_milli));
+        }
+    }
+    printf("900 lux +-5 %%: %lu readings in %lu runs, %lu range changes, %lu saturated\r\n",
+           (unsigned long)readings, (unsigned long)k, (unsigned long)sim_als.stats.range_changes,
+           (unsigned long)sim_als.stats.saturated);
+    HOST_TEST_CHECK((sim_als.stats.saturated == 1U) && (sim_als.stats.range_changes == 3U));
+    HOST_TEST_CHECK(reading.range_lux == 4000U);
+    HOST_TEST_CHECK(readings == (k - 1U));
+}
+
+static void sim_over_range(void)
+{
+    als_reading_t reading = { 0 };
+
+    sim_start(100000000U);
+    HOST_TEST_CHECK(sim_next_reading(&reading, SIM_SETTLE_PERIODS) == 2U);
+    printf("100000 lux: %.0f lux on the %u lux range, saturated %d\r\n", reading.lux_milli / 1000.0,
+           reading.range_lux, reading.saturated);
+    HOST_TEST_CHECK(reading.saturated && (reading.range_lux == 64000U));
+    HOST_TEST_CHECK(reading.lux_milli >= 63900000U);
+}
+
+/* The sensor drops COMMAND-I and COMMAND-II to 0, as after a brown-out */
+static void sim_brown_out(void)
+{
+    uint32_t const lux_milli = 11000000U;
+    als_reading_t reading = { 0 };
+    uint8_t zero = 0;
+    uint32_t runs;
+    uint32_t k;
+
+    sim_start(lux_milli);
+    for (k = 0; k < SIM_SETTLE_PERIODS; k++)
+        (void)sim_next_reading(&reading, SIM_SETTLE_PERIODS);
+    HOST_TEST_CHECK(reading.range_lux == 16000U);
+
+    HOST_TEST_CHECK(i2c_sim_write(I2C_SIM_ISL29035_ADDR, 0x00, &zero, 1) == I2C_SIM_OK);
+    HOST_TEST_CHECK(i2c_sim_write(I2C_SIM_ISL29035_ADDR, 0x01, &zero, 1) == I2C_SIM_OK);
+    runs = sim_next_reading(&reading, SIM_SETTLE_PERIODS);
+    printf("settings lost: reading back after %lu runs, %lu reprograms, %.0f lux on the %u lux range\r\n",
+           (unsigned long)runs, (unsigned long)sim_als.stats.reprograms, reading.lux_milli / 1000.0,
+           reading.range_lux);
+    HOST_TEST_CHECK(runs == 2U);
+    HOST_TEST_CHECK(sim_als.stats.reprograms == 1U);
+    HOST_TEST_CHECK((reading.range_lux == 16000U) && sim_accurate(&reading, lux_milli));
+}
+
+static void sim_bus_cost(void)
+{
+    als_reading_t reading = { 0 };
+    i2c_sim_stats_t stats;
+    uint32_t now_ms;
+    uint32_t readings = 0;
+    uint32_t k;
+
+    sim_start(400000U);
+    for (k = 0; k < SIM_SETTLE_PERIODS; k++)
+        (void)sim_next_reading(&reading, SIM_SETTLE_PERIODS);
+
+    /* 16-bit: a call 5 ms after the trigger finds it converting and stays off the bus */
+    i2c_sim_reset_stats();
+    now_ms = (uint32_t)(i2c_sim_now_us() / 1000U) + 5U;
+    HOST_TEST_CHECK(als_range_collect(&sim_als, &reading, now_ms) == ALS_RANGE_W_NO_NEW_DATA);
+    i2c_sim_get_stats(I2C_SIM_ISL29035_ADDR, &stats);
+    HOST_TEST_CHECK((stats.reads == 0U) && (stats.writes == 0U));
+
+    for (k = 0; k < 100U; k++)
+        readings += (sim_collect(&reading) == ALS_RANGE_OK) ? 1U : 0U;
+    i2c_sim_get_stats(I2C_SIM_ISL29035_ADDR, &stats);
+    printf("steady 400 lux: %lu readings, %lu reads, %lu writes, %lu us of bus time each\r\n",
+           (unsigned long)readings, (unsigned long)stats.reads, (unsigned long)stats.writes,
+           (unsigned long)(stats.bus_us / readings));
+    HOST_TEST_CHECK(readings == 100U);
+    HOST_TEST_CHECK((stats.reads == readings) && (stats.writes == readings));
+}
+
+int main(void)
+{
+    sim_steady();
+    sim_steps();
+    sim_flicker();
+    sim_over_range();
+    sim_brown_out();
+    sim_bus_cost();
+
+    return host_test_finish("als_range");
+}
+
+#endif /* SENSORS_BUS_SIM */
@@ -0,0 +1,230 @@
+/*
+ * bme680_loop_sim.c
+ *
+ *  Host timing test of the sampling loop with the BME680 read blocking and
+ *  pipelined, on the i2c_sim models through sensor_bus.c. Each pass reads
+ *  the BMI160 data registers, the BMM150 through the aux interface and then
+ *  the BME680:
+ *   - blocking, as bme680_read_sensor() did: bme680_set_sensor_mode()
+ *     forced, a meas_period delay, then bme680_get_sensor_data(), which
+ *     polls every 10 ms until new_data;
+ *   - pipelined, as bme680_collect() does: nothing until meas_period has
+ *     passed since the trigger, then one data read and the next trigger.
+ *  The BME680 is configured as bme680_Initialize() leaves it (8x/4x/2x
+ *  oversampling, 150 ms heater), which the model converts in 181 ms.
+ *
+ *  Prints the pass period, the longest gap between IMU reads and the
+ *  BME680 step against its time budget for both. Fails unless the
+ *  pipelined loop keeps the BME680 rate, collects every conversion once,
+ *  and never spends the budget or a bus transaction waiting.
+ *
+ *  Built by host_test.mk with SENSORS_BUS_SIM; empty in the firmware build.
+ */
+
+#if defined(SENSORS_BUS_SIM)
+
+#include <string.h>
+#include "host_test.h"
+#include "sensor_bus.h"
+
+#define LOOP_SIM_RUN_MS         (20000U)
+#define LOOP_SIM_MEAS_PERIOD_MS (183U)      /* bme680_get_profile_dur() for these settings */
+#define LOOP_SIM_POLL_MS        (10U)       /* BME680_POLL_PERIOD_MS */
+#define LOOP_SIM_POLL_TRIES     (10U)
+#define LOOP_SIM_BUDGET_MS      (20U)       /* BME680 budget with the pipelined read */
+
+typedef struct st_loop_sim_result
+{
+    uint32_t passes;
+    uint32_t worst_pass_us;
+    uint32_t worst_imu_gap_us;
+    uint32_t worst_bme680_us;
+    uint32_t readings;
+    uint32_t index_errors;          /* Conversions collected twice or skipped */
+    sensor_bus_stats_t bme680;
+} loop_sim_result_t;
+
+static bool loop_sim_pending;
+static uint32_t loop_sim_trigger_ms;
+static uint8_t loop_sim_last_index;
+
+static uint32_t loop_sim_now_ms(void)
+{
+    return (uint32_t)(i2c_sim_now_us() / 1000U);
+}
+
+static void loop_sim_write(uint8_t dev_id, uint8_t reg, uint8_t value)
+{
+    (void)sensor_bus_write(dev_id, reg, &value, 1);
+}
+
+/* bme680_set_sensor_mode(): back to sleep if it is not, then forced */
+static void loop_sim_bme680_forced(void)
+{
+    uint8_t ctrl_meas;
+
+    (void)sensor_bus_read(I2C_SIM_BME680_ADDR, 0x74, &ctrl_meas, 1);
+    while ((ctrl_meas & 0x03U) != 0U)
+    {
+        loop_sim_write(I2C_SIM_BME680_ADDR, 0x74, (uint8_t)(ctrl_meas & ~0x03U));
+        i2c_sim_delay_ms(LOOP_SIM_POLL_MS);
+        (void)sensor_bus_read(I2C_SIM_BME680_ADDR, 0x74, &ctrl_meas, 1);
+    }
+    loop_sim_write(I2C_SIM_BME680_ADDR, 0x74, (uint8_t)((ctrl_meas & ~0x03U) | 0x01U));
+}
+
+/* bme680_get_sensor_data(): the field block, polled until new_data */
+static bool loop_sim_bme680_data(uint8_t *p_index)
+{
+    uint8_t field[15];
+    uint32_t tries;
+
+    for (tries = 0; tries < LOOP_SIM_POLL_TRIES; tries++)
+    {
+        (void)sensor_bus_read(I2C_SIM_BME680_ADDR, 0x1D, field, sizeof(field));
+        if (field[0] & 0x80U)
+        {
+            *p_index = field[1];
+            return true;
+        }
+        i2c_sim_delay_ms(LOOP_SIM_POLL_MS);
+    }
+
+    return false;
+}
+
+/* The old bme680_read_sensor(): trigger, wait out the conversion, read */
+static bool loop_sim_blocking(uint8_t *p_index)
+{
+    loop_sim_bme680_forced();
+    i2c_sim_delay_ms(LOOP_SIM_MEAS_PERIOD_MS);
+
+    return loop_sim_bme680_data(p_index);
+}
+
+/* bme680_collect() */
+static bool loop_sim_pipelined(uint8_t *p_index)
+{
+    bool fresh;
+
+    if (!loop_sim_pending)
+    {
+        loop_sim_bme680_forced();
+        loop_sim_pending = true;
+        loop_sim_trigger_ms = loop_sim_now_ms();
+        return false;
+    }
+
+    if ((loop_sim_now_ms() - loop_sim_trigger_ms) < LOOP_SIM_MEAS_PERIOD_MS)
+        return false;
+
+    fresh = loop_sim_bme680_data(p_index);
+    if (fresh)
+    {
+        loop_sim_bme680_forced();
+        loop_sim_trigger_ms = loop_sim_now_ms();
+    }
+
+    return fresh;
+}
+
+static void loop_sim_run(bool pipelined, loop_sim_result_t *p_result)
+{
+    i2c_sim_config_t const config = { .bus_hz = 400000U, .overhead_us = 30U };
+    uint8_t data[12];
+    uint8_t index = 0;
+    uint64_t pass_start;
+    uint64_t imu_last = 0;
+    uint64_t now;
+    uint64_t bme680_start;
+    bool fresh;
+
+    memset(p_result, 0, sizeof(*p_result));
+    i2c_sim_init(&config);
+    sensor_bus_init();
+
+    /* bme680_Initialize(): 2x humidity, 8x temperature, 4x pressure, 150 ms at the heater */
+    loop_sim_write(I2C_SIM_BME680_ADDR, 0x72, 0x02);
+    loop_sim_write(I2C_SIM_BME680_ADDR, 0x74, 0x8C);
+    loop_sim_write(I2C_SIM_BME680_ADDR, 0x64, 0x65);
+    loop_sim_write(I2C_SIM_BME680_ADDR, 0x71, 0x10);
+
+    /* It now leaves that first conversion running for bme680_collect() */
+    loop_sim_pending = pipelined;
+    if (pipelined)
+    {
+        loop_sim_bme680_forced();
+        loop_sim_trigger_ms = loop_sim_now_ms();
+    }
+    loop_sim_last_index = 0xFFU;
+    sensor_bus_reset_stats();
+
+    while (i2c_sim_now_us() < (LOOP_SIM_RUN_MS * 1000ULL))
+    {
+        pass_start = i2c_sim_now_us();
+
+        (void)sensor_bus_read(I2C_SIM_BMI160_ADDR, 0x0C, data, 12);     /* bmi160_get_sensor_data() */
+        now = i2c_sim_now_us();
+        if ((p_result->passes > 0U) && ((now - imu_last) > p_result->worst_imu_gap_us))
+            p_result->worst_imu_gap_us = (uint32_t)(now - imu_last);
+        imu_last = now;
+
+        (void)sensor_bus_read(I2C_SIM_BMI160_ADDR, 0x04, data, 8);      /* bmi160_read_aux_data_auto_mode() */
+
+        bme680_start = i2c_sim_now_us();
+        fresh = pipelined ? loop_sim_pipelined(&index) : loop_sim_blocking(&index);
+        now = i2c_sim_now_us();
+        if ((now - bme680_start) > p_result->worst_bme680_us)
+            p_result->worst_bme680_us = (uint32_t)(now - bme680_start);
+
+        if (fresh)
+        {
+            if (index != (uint8_t)(loop_sim_last_index + 1U))
+                p_result->index_errors++;
+            loop_sim_last_index = index;
+            p_result->readings++;
+        }
+
+        if ((now - pass_start) > p_result->worst_pass_us)
+            p_result->worst_pass_us = (uint32_t)(now - pass_start);
+        p_result->passes++;
+    }
+    sensor_bus_get_stats(I2C_SIM_BME680_ADDR, &p_result->bme680);
+
+    /* The first reading follows whatever the model counted before */
+    if (p_result->index_errors > 0U)
+        p_result->index_errors--;
+
+    printf("%-9s  %5lu passes, %8.2f ms/pass, worst %6.2f ms, IMU gap %6.2f ms, BME680 %3lu readings in %lu reads, "
+           "worst %6.2f ms\r\n",
+           pipelined ? "pipelined" : "blocking", (unsigned long)p_result->passes,
+           (double)LOOP_SIM_RUN_MS / p_result->passes, p_result->worst_pass_us / 1000.0,
+           p_result->worst_imu_gap_us / 1000.0, (unsigned long)p_result->readings,
+           (unsigned long)p_result->bme680.reads, p_result->worst_bme680_us / 1000.0);
+}
+
+int main(void)
+{
+    loop_sim_result_t blocking;
+    loop_sim_result_t pipelined;
+
+    loop_sim_run(false, &blocking);
+    loop_sim_run(true, &pipelined);
+
+    /* The old loop was held for every conversion */
+    HOST_TEST_CHECK(blocking.worst_imu_gap_us > (LOOP_SIM_MEAS_PERIOD_MS * 1000U));
+
+    /* The new one keeps the IMU going, spends no budget waiting and loses no reading */
+    HOST_TEST_CHECK(pipelined.worst_pass_us < (LOOP_SIM_BUDGET_MS * 1000U));
+    HOST_TEST_CHECK(pipelined.worst_bme680_us < (LOOP_SIM_BUDGET_MS * 1000U));
+    HOST_TEST_CHECK((pipelined.readings + 1U) >= blocking.readings);     /* Give or take the one in flight at the end */
+    HOST_TEST_CHECK(pipelined.index_errors == 0U);
+    HOST_TEST_CHECK(blocking.index_errors == 0U);
+
+    /* Two reads per conversion, the data and the trigger's mode check, none while it runs */
+    HOST_TEST_CHECK(pipelined.bme680.reads <= ((2U * pipelined.readings) + 2U));
+
+    return host_test_finish("bme680 loop");
+}
+
+#endif /* SENSORS_BUS_SIM */
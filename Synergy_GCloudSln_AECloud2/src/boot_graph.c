@@ -0,0 +1,214 @@
+/*
+ * boot_graph.c
+ *
+ *  Dependency-aware start-up sequencing. See boot_graph.h.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "boot_graph.h"
+
+#define BOOT_TIMELINE_WIDTH     (32U)
+
+static uint32_t boot_graph_now(boot_graph_t const *p_graph)
+{
+    return p_graph->now_ms() - p_graph->start_ms;
+}
+
+void boot_graph_init(boot_graph_t *p_graph, uint32_t (*now_ms)(void))
+{
+    memset(p_graph, 0, sizeof(*p_graph));
+    p_graph->now_ms = now_ms;
+    p_graph->start_ms = now_ms();
+}
+
+/*
+ * Returns the stage id for BOOT_STAGE(), or BOOT_STAGE_INVALID if the graph
+ * is full or a dependency has not been added yet.
+ */
+uint8_t boot_graph_add(boot_graph_t *p_graph, char const *name, boot_stage_run_t run, void *p_context,
+                       uint32_t depends, uint32_t resources)
+{
+    boot_stage_t *p_stage;
+
+    if ((p_graph->stage_count >= BOOT_STAGE_MAX) || (depends >> p_graph->stage_count))
+        return BOOT_STAGE_INVALID;
+
+    p_stage = &p_graph->stages[p_graph->stage_count];
+    p_stage->name = name;
+    p_stage->run = run;
+    p_stage->p_context = p_context;
+    p_stage->depends = depends;
+    p_stage->resources = resources;
+    p_stage->state = BOOT_STAGE_PENDING;
+
+    return p_graph->stage_count++;
+}
+
+/*
+ * Next stage that can start now, marked running, or NULL. Stages behind a
+ * failed dependency are skipped on the way.
+ */
+boot_stage_t *boot_graph_take(boot_graph_t *p_graph)
+{
+    boot_stage_t *p_stage;
+    uint8_t i;
+
+    for (i = 0; i < p_graph->stage_count; i++)
+    {
+        p_stage = &p_graph->stages[i];
+        if (p_stage->state != BOOT_STAGE_PENDING)
+            continue;
+
+        if (p_stage->depends & p_graph->failed)
+        {
+            p_stage->state = BOOT_STAGE_SKIPPED;
+            p_stage->start_ms = boot_graph_now(p_graph);
+            p_stage->end_ms = p_stage->start_ms;
+            p_graph->failed |= BOOT_STAGE(i);
+            continue;
+        }
+
+        if ((p_stage->depends & ~p_graph->finished) || (p_stage->resources & p_graph->resources))
+            continue;
+
+        p_stage->state = BOOT_STAGE_RUNNING;
+        p_stage->start_ms = boot_graph_now(p_graph);
+        p_graph->resources |= p_stage->resources;
+        p_graph->running++;
+        return p_stage;
+    }
+
+    return NULL;
+}
+
+void boot_graph_finish(boot_graph_t *p_graph, boot_stage_t *p_stage, int32_t status)
+{
+    uint32_t bit = BOOT_STAGE(p_stage - p_graph->stages);
+
+    p_stage->end_ms = boot_graph_now(p_graph);
+    p_stage->status = status;
+    p_graph->resources &= ~p_stage->resources;
+    p_graph->running--;
+
+    if (status == 0)
+    {
+        p_stage->state = BOOT_STAGE_DONE;
+        p_graph->finished |= bit;
+    }
+    else
+    {
+        p_stage->state = BOOT_STAGE_FAILED;
+        p_graph->failed |= bit;
+    }
+}
+
+/*
+ * With nothing running, boot_graph_take() either returns a stage or has
+ * settled every pending one, so a runner cannot stall before this is true.
+ */
+bool boot_graph_done(boot_graph_t const *p_graph)
+{
+    return (p_graph->finished | p_graph->failed) == (BOOT_STAGE(p_graph->stage_count) - 1U);
+}
+
+/* Run every stage in order on the calling thread; returns the first failure */
+int32_t boot_graph_run_serial(boot_graph_t *p_graph)
+{
+    boot_stage_t *p_stage;
+    int32_t result = 0;
+    int32_t status;
+
+    while ((p_stage = boot_graph_take(p_graph)) != NULL)
+    {
+        status = p_stage->run(p_stage->p_context);
+        boot_graph_finish(p_graph, p_stage, status);
+        if ((result == 0) && (status != 0))
+            result = status;
+    }
+
+    return result;
+}
+
+/*
+ * Check a finished run against the graph: every stage started after its
+ * dependencies ended, skips had a failed dependency, and stages sharing a
+ * resource never overlapped.
+ */
+bool boot_graph_verify(boot_graph_t const *p_graph)
+{
+    boot_stage_t const *p_stage;
+    boot_stage_t const *p_other;
+    uint8_t i;
+    uint8_t j;
+
+    if (!boot_graph_done(p_graph))
+        return false;
+
+    for (i = 0; i < p_graph->stage_count; i++)
+    {
+        p_stage = &p_graph->stages[i];
+
+        if (p_stage->state == BOOT_STAGE_SKIPPED)
+        {
+            if (!(p_stage->depends & p_graph->failed))
+                return false;
+            continue;
+        }
+
+        for (j = 0; j < p_graph->stage_count; j++)
+        {
+            p_other = &p_graph->stages[j];
+
+            if ((p_stage->depends & BOOT_STAGE(j))
+                && ((p_other->state != BOOT_STAGE_DONE) || (p_other->end_ms > p_stage->start_ms)))
+                return false;
+
+            if ((j != i) && (p_stage->resources & p_other->resources) && (p_other->state != BOOT_STAGE_SKIPPED)
+                && (p_other->start_ms < p_stage->end_ms) && (p_stage->start_ms < p_other->end_ms))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+void boot_graph_print(boot_graph_t const *p_graph, void (*p_print)(char const *p_str))
+{
+    static char const * const state_names[] = { "pending", "running", "ok", "failed", "skipped" };
+    boot_stage_t const *p_stage;
+    char bar[BOOT_TIMELINE_WIDTH + 1U];
+    char str[96];
+    uint32_t total = 1;
+    uint32_t from;
+    uint32_t to;
+    uint8_t i;
+
+    for (i = 0; i < p_graph->stage_count; i++)
+    {
+        if (p_graph->stages[i].end_ms > total)
+            total = p_graph->stages[i].end_ms;
+    }
+
+    p_print("\r\nStage       Start    End  State    Timeline\r\n");
+    for (i = 0; i < p_graph->stage_count; i++)
+    {
+        p_stage = &p_graph->stages[i];
+
+        from = (p_stage->start_ms * BOOT_TIMELINE_WIDTH) / total;
+        to = (p_stage->end_ms * BOOT_TIMELINE_WIDTH) / total;
+        if (to == from)
+            to++;
+        memset(bar, ' ', BOOT_TIMELINE_WIDTH);
+        memset(&bar[from], '#', ((to > BOOT_TIMELINE_WIDTH) ? BOOT_TIMELINE_WIDTH : to) - from);
+        bar[BOOT_TIMELINE_WIDTH] = '\0';
+
+        snprintf(str, sizeof(str), "%-10s  %5lu  %5lu  %-7s  |%s|\r\n", p_stage->name,
+                 (unsigned long) p_stage->start_ms, (unsigned long) p_stage->end_ms,
+                 state_names[p_stage->state], bar);
+        p_print(str);
+    }
+
+    snprintf(str, sizeof(str), "Boot took %lu ms\r\n", (unsigned long) total);
+    p_print(str);
+}
@@ -0,0 +1,77 @@
+/*
+ * boot_graph.h
+ *
+ *  Dependency-aware start-up sequencing.
+ *
+ *  Each init step is a stage with the stages it depends on and the
+ *  resources it holds while running (a bus, say). boot_graph_take() hands
+ *  out any stage whose dependencies have finished and whose resources are
+ *  free, so independent steps can run on separate threads and overlap their
+ *  delays. A stage only depends on stages added before it, so the graph
+ *  cannot have a cycle. When a stage fails, the stages that depend on it
+ *  are skipped and the rest still run.
+ *
+ *  The graph has no RTOS dependency and is not thread-safe: callers running
+ *  stages on several threads serialise take and finish. Time comes from the
+ *  now_ms hook and every stage's start and end are kept for the timeline.
+ */
+
+#ifndef BOOT_GRAPH_H_
+#define BOOT_GRAPH_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define BOOT_STAGE_MAX          (16U)
+#define BOOT_STAGE(id)          (1UL << (id))
+#define BOOT_STAGE_INVALID      (0xFFU)
+
+/* Returns 0 on success */
+typedef int32_t (*boot_stage_run_t)(void *p_context);
+
+typedef enum e_boot_stage_state
+{
+    BOOT_STAGE_PENDING = 0,
+    BOOT_STAGE_RUNNING,
+    BOOT_STAGE_DONE,
+    BOOT_STAGE_FAILED,
+    BOOT_STAGE_SKIPPED          /* A dependency failed */
+} boot_stage_state_t;
+
+typedef struct st_boot_stage
+{
+    char const         *name;
+    boot_stage_run_t    run;
+    void               *p_context;
+    uint32_t            depends;        /* BOOT_STAGE() bits */
+    uint32_t            resources;      /* Held while running */
+
+    boot_stage_state_t  state;
+    int32_t             status;
+    uint32_t            start_ms;       /* From boot_graph_init() */
+    uint32_t            end_ms;
+} boot_stage_t;
+
+typedef struct st_boot_graph
+{
+    boot_stage_t  stages[BOOT_STAGE_MAX];
+    uint8_t       stage_count;
+    uint8_t       running;
+    uint32_t      finished;             /* BOOT_STAGE() bits of done stages */
+    uint32_t      failed;               /* Failed or skipped */
+    uint32_t      resources;            /* Held by running stages */
+    uint32_t      start_ms;
+    uint32_t    (*now_ms)(void);
+} boot_graph_t;
+
+void boot_graph_init(boot_graph_t *p_graph, uint32_t (*now_ms)(void));
+uint8_t boot_graph_add(boot_graph_t *p_graph, char const *name, boot_stage_run_t run, void *p_context,
+                       uint32_t depends, uint32_t resources);
+boot_stage_t *boot_graph_take(boot_graph_t *p_graph);
+void boot_graph_finish(boot_graph_t *p_graph, boot_stage_t *p_stage, int32_t status);
+bool boot_graph_done(boot_graph_t const *p_graph);
+int32_t boot_graph_run_serial(boot_graph_t *p_graph);
+bool boot_graph_verify(boot_graph_t const *p_graph);
+void boot_graph_print(boot_graph_t const *p_graph, void (*p_print)(char const *p_str));
+
+#endif /* BOOT_GRAPH_H_ */
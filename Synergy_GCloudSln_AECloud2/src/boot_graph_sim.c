@@ -0,0 +1,209 @@
+/*
+ * boot_graph_sim.c
+ *
+ *  Host check of the boot graph: the stages console_thread_entry() and
+ *  init_sensors_stages() add, run on a virtual clock by 1 to 4 workers the
+ *  way boot_run() hands them out, with random durations and, in one run in
+ *  five, one stage failing.
+ *
+ *  Every run must finish without stalling and pass boot_graph_verify().
+ *  GPS must never start before the BG96 is up, and must be skipped, with
+ *  fusion and sampling, when the BG96 fails. Ends with the timeline for a
+ *  set of illustrative durations, serial and on BOOT_WORKER_COUNT workers.
+ *
+ *  Built by host_test.mk with SENSORS_BUS_SIM; empty in the firmware build.
+ */
+
+#if defined(SENSORS_BUS_SIM)
+
+#include <stdlib.h>
+#include "host_test.h"
+#include "boot_graph.h"
+
+#define BOOT_SIM_RUNS           (10000U)
+#define BOOT_SIM_WORKERS_MAX    (4U)
+#define BOOT_SIM_WORKER_COUNT   (3U)        /* BOOT_WORKER_COUNT */
+#define BOOT_SIM_I2C            (1UL << 0)  /* SENSORS_BOOT_I2C */
+#define BOOT_SIM_NO_FAILURE     (0xFFU)
+
+typedef struct st_boot_sim_ids
+{
+    uint8_t bg96;
+    uint8_t gps;
+    uint8_t nav;
+    uint8_t sampling;
+} boot_sim_ids_t;
+
+static uint32_t boot_sim_clock_ms;
+static uint32_t boot_sim_duration_ms[BOOT_STAGE_MAX];
+static uint8_t boot_sim_fail_id;
+
+static uint32_t boot_sim_now_ms(void)
+{
+    return boot_sim_clock_ms;
+}
+
+/* Never called; the workers below finish stages on the virtual clock */
+static int32_t boot_sim_stage(void *p_context)
+{
+    (void)p_context;
+    return 0;
+}
+
+/* The graph console_thread_entry() builds, init_sensors_stages() included */
+static void boot_sim_build(boot_graph_t *p_graph, boot_sim_ids_t *p_ids)
+{
+    uint8_t storage;
+    uint8_t i2c;
+    uint8_t bme680;
+    uint8_t bmi160;
+    uint8_t bmm150;
+    uint8_t mic;
+    uint8_t magcal;
+
+    boot_graph_init(p_graph, boot_sim_now_ms);
+    storage = boot_graph_add(p_graph, "Storage", boot_sim_stage, NULL, 0, 0);
+    p_ids->bg96 = boot_graph_add(p_graph, "BG96", boot_sim_stage, NULL, 0, 0);
+
+    i2c = boot_graph_add(p_graph, "I2C", boot_sim_stage, NULL, 0, BOOT_SIM_I2C);
+    bme680 = boot_graph_add(p_graph, "BME680", boot_sim_stage, NULL, BOOT_STAGE(i2c), BOOT_SIM_I2C);
+    bmi160 = boot_graph_add(p_graph, "BMI160", boot_sim_stage, NULL, BOOT_STAGE(i2c), BOOT_SIM_I2C);
+    bmm150 = boot_graph_add(p_graph, "BMM150", boot_sim_stage, NULL, BOOT_STAGE(bmi160), BOOT_SIM_I2C);
+    boot_graph_add(p_graph, "ISL29035", boot_sim_stage, NULL, BOOT_STAGE(i2c), BOOT_SIM_I2C);
+    p_ids->gps = boot_graph_add(p_graph, "GPS", boot_sim_stage, NULL, BOOT_STAGE(p_ids->bg96), 0);
+    mic = boot_graph_add(p_graph, "Mic", boot_sim_stage, NULL, 0, 0);
+    boot_graph_add(p_graph, "MicLevel", boot_sim_stage, NULL, BOOT_STAGE(mic) | BOOT_STAGE(i2c), 0);
+    magcal = boot_graph_add(p_graph, "MagCal", boot_sim_stage, NULL, BOOT_STAGE(storage), 0);
+    p_ids->nav = boot_graph_add(p_graph, "Nav", boot_sim_stage, NULL,
+                                BOOT_STAGE(bmi160) | BOOT_STAGE(bmm150) | BOOT_STAGE(p_ids->gps)
+                                | BOOT_STAGE(magcal), 0);
+    p_ids->sampling = boot_graph_add(p_graph, "Sampling", boot_sim_stage, NULL,
+                                     BOOT_STAGE(bme680) | BOOT_STAGE(p_ids->nav), 0);
+}
+
+/*
+ * boot_run() on a virtual clock: fill the idle workers, then finish whichever
+ * running stage ends first. Returns false if the graph stalls.
+ */
+static bool boot_sim_run(boot_graph_t *p_graph, boot_sim_ids_t *p_ids, uint32_t workers)
+{
+    boot_stage_t *p_busy[BOOT_SIM_WORKERS_MAX] = { NULL };
+    uint32_t end_ms[BOOT_SIM_WORKERS_MAX] = { 0 };
+    boot_stage_t *p_stage;
+    uint8_t id;
+    uint32_t next;
+    uint32_t i;
+
+    boot_sim_clock_ms = 0;
+    boot_sim_build(p_graph, p_ids);
+
+    while (!boot_graph_done(p_graph))
+    {
+        for (i = 0; i < workers; i++)
+        {
+            if (p_busy[i] != NULL)
+                continue;
+
+            p_stage = boot_graph_take(p_graph);
+            if (p_stage == NULL)
+                break;
+
+            p_busy[i] = p_stage;
+            end_ms[i] = boot_sim_clock_ms + boot_sim_duration_ms[p_stage - p_graph->stages];
+        }
+
+        if (boot_graph_done(p_graph))
+            break;
+
+        next = workers;
+        for (i = 0; i < workers; i++)
+        {
+            if ((p_busy[i] != NULL) && ((next == workers) || (end_ms[i] < end_ms[next])))
+                next = i;
+        }
+        if (next == workers)
+            return false;
+
+        boot_sim_clock_ms = end_ms[next];
+        id = (uint8_t)(p_busy[next] - p_graph->stages);
+        boot_graph_finish(p_graph, p_busy[next], (id == boot_sim_fail_id) ? -1 : 0);
+        p_busy[next] = NULL;
+    }
+
+    return true;
+}
+
+static void boot_sim_print(char const *p_str)
+{
+    printf("%s", p_str);
+}
+
+int main(void)
+{
+    /* Illustrative, not measured: the BG96 is mostly its power-key and reset delays */
+    static uint32_t const nominal_ms[] = { 40, 1200, 5, 120, 150, 60, 20, 300, 30, 5, 10, 5, 5 };
+    boot_graph_t graph;
+    boot_sim_ids_t ids;
+    boot_stage_t const *p_bg96;
+    boot_stage_t const *p_gps;
+    uint32_t stage_count;
+    uint32_t failures = 0;
+    uint32_t serial_ms;
+    uint32_t run;
+    uint32_t workers;
+    uint32_t i;
+
+    boot_sim_build(&graph, &ids);
+    stage_count = graph.stage_count;
+    HOST_TEST_CHECK(stage_count == (sizeof(nominal_ms) / sizeof(nominal_ms[0])));
+
+    srand(1);
+    for (run = 0; run < BOOT_SIM_RUNS; run++)
+    {
+        for (i = 0; i < stage_count; i++)
+            boot_sim_duration_ms[i] = (uint32_t)(rand() % 500);
+        boot_sim_fail_id = ((run % 5U) == 0U) ? (uint8_t)(rand() % (int)stage_count) : BOOT_SIM_NO_FAILURE;
+        if (boot_sim_fail_id == ids.bg96)
+            failures++;
+
+        for (workers = 1; workers <= BOOT_SIM_WORKERS_MAX; workers++)
+        {
+            HOST_TEST_CHECK(boot_sim_run(&graph, &ids, workers));
+            HOST_TEST_CHECK(boot_graph_verify(&graph));
+
+            p_bg96 = &graph.stages[ids.bg96];
+            p_gps = &graph.stages[ids.gps];
+            if (p_gps->state == BOOT_STAGE_DONE)
+                HOST_TEST_CHECK((p_bg96->state == BOOT_STAGE_DONE) && (p_gps->start_ms >= p_bg96->end_ms));
+            if (boot_sim_fail_id == ids.bg96)
+            {
+                HOST_TEST_CHECK(p_gps->state == BOOT_STAGE_SKIPPED);
+                HOST_TEST_CHECK(graph.stages[ids.nav].state == BOOT_STAGE_SKIPPED);
+                HOST_TEST_CHECK(graph.stages[ids.sampling].state == BOOT_STAGE_SKIPPED);
+            }
+            else if (boot_sim_fail_id == BOOT_SIM_NO_FAILURE)
+            {
+                HOST_TEST_CHECK(graph.failed == 0U);
+            }
+        }
+    }
+    printf("%lu runs on 1-%lu workers, %lu with the BG96 failing\r\n", (unsigned long)BOOT_SIM_RUNS,
+           (unsigned long)BOOT_SIM_WORKERS_MAX, (unsigned long)failures);
+
+    for (i = 0; i < stage_count; i++)
+        boot_sim_duration_ms[i] = nominal_ms[i];
+    boot_sim_fail_id = BOOT_SIM_NO_FAILURE;
+    HOST_TEST_CHECK(boot_sim_run(&graph, &ids, 1));
+    serial_ms = boot_sim_clock_ms;
+    HOST_TEST_CHECK(boot_sim_run(&graph, &ids, BOOT_SIM_WORKER_COUNT));
+    boot_graph_print(&graph, boot_sim_print);
+    printf("Serial %lu ms, %lu workers %lu ms\r\n", (unsigned long)serial_ms,
+           (unsigned long)BOOT_SIM_WORKER_COUNT, (unsigned long)boot_sim_clock_ms);
+
+    /* The sensor bring-up hides behind the BG96 */
+    HOST_TEST_CHECK(boot_sim_clock_ms < serial_ms);
+
+    return host_test_finish("boot graph");
+}
+
+#endif /* SENSORS_BUS_SIM */
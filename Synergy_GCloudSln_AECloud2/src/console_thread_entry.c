@@ -33,10 +33,17 @@
 #include "sf_cellular_common_private.h"
 #include "sf_cellular_serial.h"
 #include "sensors.h"
+/* BEGIN ADDED */
+#include "boot_graph.h"
+/* END ADDED */
 
 uint8_t certPEM[4096];
 unsigned int certDER[4096];
 void print_to_console(const char* msg);
+/* BEGIN ADDED */
+void sensors_print_stats(void);
+void init_sensors_stages(boot_graph_t *p_graph, uint32_t gps_depends, uint32_t storage_depends);
+/* END ADDED */
 void print_ipv4_addr(ULONG address, char *str, size_t len);
 static uint8_t sq_number = 0;
 
@@ -1529,6 +1536,10 @@ void demo_service_callback(sf_console_cb_args_t *p_args)
     }
     else if(strcmp((void*)p_args->p_remaining_string, "stop") == 0)
         tx_event_flags_set(&g_user_event_flags, DEMO_STOP_FLAG, TX_OR);
+    /* BEGIN ADDED */
+    else if(strcmp((void*)p_args->p_remaining_string, "stats") == 0)
+        sensors_print_stats();
+    /* END ADDED */
     else
         print_to_console("Invalid Argument\r\n");
 }
@@ -1545,7 +1556,7 @@ static const sf_console_command_t g_sf_console_commands[] =
       {
        .command = (uint8_t*)"demo",
        .help = (uint8_t*)"Start/Stop Synergy Cloud Connectivity Demo \r\n"
-             "          Usage: demo <start>/<stop> \r\n",
+             "          Usage: demo <start>/<stop>/<stats> \r\n",
              .callback = demo_service_callback,
              .context = NULL
       },
@@ -1614,6 +1625,136 @@ static void BG96_init(void)
     cellular_module_reset(CELLULAR_MODULE_RESET_PIN);
 }
 
+/* BEGIN ADDED */
+
+#define BOOT_WORKER_COUNT           (3U)
+#define BOOT_WORKER_STACK_SIZE      (4096U)
+#define BOOT_WORKER_PRIORITY        (11U)
+
+typedef struct st_boot_worker
+{
+    TX_THREAD     thread;
+    TX_SEMAPHORE  start;
+    boot_stage_t *p_stage;          /* NULL when idle; started with NULL, the worker exits */
+    int32_t       status;
+} boot_worker_t;
+
+static boot_graph_t boot_graph;
+static boot_worker_t boot_workers[BOOT_WORKER_COUNT];
+static uint8_t boot_worker_stacks[BOOT_WORKER_COUNT][BOOT_WORKER_STACK_SIZE];
+static TX_QUEUE boot_done_queue;
+static ULONG boot_done_storage[BOOT_WORKER_COUNT];
+
+static uint32_t boot_now_ms(void)
+{
+    return (uint32_t)(((uint64_t)tx_time_get() * 1000U) / TX_TIMER_TICKS_PER_SECOND);
+}
+
+static int32_t boot_storage(void *p_context)
+{
+    SSP_PARAMETER_NOT_USED(p_context);
+
+    int_storage_init();
+
+    return 0;
+}
+
+/* Mostly power-key and reset delays, which the sensor steps overlap */
+static int32_t boot_bg96(void *p_context)
+{
+    SSP_PARAMETER_NOT_USED(p_context);
+
+    print_to_console("\r\nPowering up BG96 Shield....\r\n");
+    BG96_init();
+    print_to_console("BG96 Shield powered up\r\n");
+
+    return 0;
+}
+
+/* Runs the stages boot_run() hands it, one at a time */
+static void boot_worker_entry(ULONG thread_input)
+{
+    boot_worker_t *p_worker = &boot_workers[thread_input];
+
+    while (1)
+    {
+        tx_semaphore_get(&p_worker->start, TX_WAIT_FOREVER);
+        if (p_worker->p_stage == NULL)
+            break;
+
+        p_worker->status = p_worker->p_stage->run(p_worker->p_stage->p_context);
+        tx_queue_send(&boot_done_queue, &thread_input, TX_WAIT_FOREVER);
+    }
+}
+
+/*
+ * Run the boot graph on BOOT_WORKER_COUNT threads. Only this thread touches
+ * the graph: it hands ready stages to idle workers and records each one as
+ * it finishes. Falls back to running in order if the workers cannot be
+ * created.
+ */
+static void boot_run(void)
+{
+    boot_stage_t *p_stage;
+    ULONG index;
+    ULONG i;
+
+    if (tx_queue_create(&boot_done_queue, (CHAR *)"Boot Done Queue", TX_1_ULONG, boot_done_storage,
+                        sizeof(boot_done_storage)) != TX_SUCCESS)
+    {
+        boot_graph_run_serial(&boot_graph);
+        return;
+    }
+
+    for (i = 0; i < BOOT_WORKER_COUNT; i++)
+    {
+        boot_workers[i].p_stage = NULL;
+        if ((tx_semaphore_create(&boot_workers[i].start, (CHAR *)"Boot Worker Start", 0) != TX_SUCCESS)
+            || (tx_thread_create(&boot_workers[i].thread, (CHAR *)"Boot Worker", boot_worker_entry, i,
+                                 boot_worker_stacks[i], BOOT_WORKER_STACK_SIZE, BOOT_WORKER_PRIORITY,
+                                 BOOT_WORKER_PRIORITY, TX_NO_TIME_SLICE, TX_AUTO_START) != TX_SUCCESS))
+        {
+            break;
+        }
+    }
+
+    if (i < BOOT_WORKER_COUNT)
+    {
+        boot_graph_run_serial(&boot_graph);
+        return;
+    }
+
+    while (!boot_graph_done(&boot_graph))
+    {
+        for (i = 0; i < BOOT_WORKER_COUNT; i++)
+        {
+            if (boot_workers[i].p_stage != NULL)
+                continue;
+
+            p_stage = boot_graph_take(&boot_graph);
+            if (p_stage == NULL)
+                break;
+
+            boot_workers[i].p_stage = p_stage;
+            tx_semaphore_put(&boot_workers[i].start);
+        }
+
+        /* Taking may have skipped the last stages */
+        if (boot_graph_done(&boot_graph))
+            break;
+
+        tx_queue_receive(&boot_done_queue, &index, TX_WAIT_FOREVER);
+        boot_graph_finish(&boot_graph, boot_workers[index].p_stage, boot_workers[index].status);
+        boot_workers[index].p_stage = NULL;
+    }
+
+    /* Workers are all idle; let them return */
+    for (i = 0; i < BOOT_WORKER_COUNT; i++)
+        tx_semaphore_put(&boot_workers[i].start);
+}
+
+/* END ADDED */
+
 /* Console Thread entry function */
 void console_thread_entry(void)
 {
@@ -1647,16 +1788,39 @@ void console_thread_entry(void)
     center_and_print_string(str);
     print_to_console ("\r\n********************************************************************************\r\n");
 
-    int_storage_init();
+    /* BEGIN MODIFIED */
+
+    // int_storage_init();
 
-    print_to_console("\r\nPowering up BG96 Shield....");
+    // print_to_console("\r\nPowering up BG96 Shield....");
 
     //Initialize BG96 shield. This needs to be done before GPS initialization
-    BG96_init();
+    // BG96_init();
+
+    // print_to_console("done\r\n");
+
+    // init_sensors();
+
+    // Storage, the BG96 and the sensors come up in parallel; only GPS
+    // waits for the BG96, and the saved magnetometer calibration for
+    // storage.
+
+    uint8_t storage;
+    uint8_t modem;
 
-    print_to_console("done\r\n");
+    boot_graph_init(&boot_graph, boot_now_ms);
+    storage = boot_graph_add(&boot_graph, "Storage", boot_storage, NULL, 0, 0);
+    modem = boot_graph_add(&boot_graph, "BG96", boot_bg96, NULL, 0, 0);
+    init_sensors_stages(&boot_graph, BOOT_STAGE(modem), BOOT_STAGE(storage));
 
-    init_sensors();
+    boot_run();
+
+    boot_graph_print(&boot_graph, print_to_console);
+    if (!boot_graph_verify(&boot_graph)) {
+        print_to_console("Boot order check failed\r\n");
+    }
+
+    /* END MODIFIED */
 
     /* BEGIN ADDED */
 
@@ -0,0 +1,430 @@
+/*
+ * geofence.c
+ *
+ *  Grid-indexed geofence engine. See geofence.h.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "geofence.h"
+
+#define GEOFENCE_M_PER_E7_LAT   (0.0111319491f)     /* Metres per 1e-7 degree of latitude */
+#define GEOFENCE_E7_TO_RAD      (1.745329252e-9f)
+#define GEOFENCE_MAX_CELLS      (0x100000UL)
+
+static bool geofence_def_bbox(geofence_def_t const *p_def, geofence_point_t *p_min, geofence_point_t *p_max)
+{
+    int32_t dlat;
+    int32_t dlon;
+    uint8_t i;
+
+    if (p_def->type == GEOFENCE_TYPE_CIRCLE)
+    {
+        dlat = (int32_t)((float)p_def->radius_m / GEOFENCE_M_PER_E7_LAT) + 1;
+        dlon = (int32_t)((float)dlat / cosf((float)p_def->center.latitude_e7 * GEOFENCE_E7_TO_RAD)) + 1;
+        p_min->latitude_e7 = p_def->center.latitude_e7 - dlat;
+        p_max->latitude_e7 = p_def->center.latitude_e7 + dlat;
+        p_min->longitude_e7 = p_def->center.longitude_e7 - dlon;
+        p_max->longitude_e7 = p_def->center.longitude_e7 + dlon;
+        return true;
+    }
+
+    if ((p_def->type != GEOFENCE_TYPE_POLYGON) || (p_def->vertex_count < 3) || (p_def->p_vertices == NULL))
+        return false;
+
+    *p_min = p_def->p_vertices[0];
+    *p_max = p_def->p_vertices[0];
+    for (i = 1; i < p_def->vertex_count; i++)
+    {
+        geofence_point_t const *p_v = &p_def->p_vertices[i];
+
+        if (p_v->latitude_e7 < p_min->latitude_e7)
+            p_min->latitude_e7 = p_v->latitude_e7;
+        if (p_v->latitude_e7 > p_max->latitude_e7)
+            p_max->latitude_e7 = p_v->latitude_e7;
+        if (p_v->longitude_e7 < p_min->longitude_e7)
+            p_min->longitude_e7 = p_v->longitude_e7;
+        if (p_v->longitude_e7 > p_max->longitude_e7)
+            p_max->longitude_e7 = p_v->longitude_e7;
+    }
+
+    return true;
+}
+
+/*
+ * Lay out an image for count fences with square cells of cell_size_e7.
+ * p_image must be 4-byte aligned. Returns the image size in bytes, or 0 if
+ * a definition is invalid, the grid is too large or the buffer too small.
+ */
+uint32_t geofence_image_build(geofence_def_t const *p_defs, uint16_t count, uint32_t cell_size_e7,
+                              void *p_image, uint32_t image_size)
+{
+    geofence_image_header_t *p_header = (geofence_image_header_t *)p_image;
+    geofence_record_t *p_fences;
+    geofence_point_t *p_vertices;
+    uint32_t *p_cell_start;
+    uint16_t *p_cell_fences;
+    geofence_point_t min;
+    geofence_point_t max;
+    geofence_point_t grid_min = { INT32_MAX, INT32_MAX };
+    geofence_point_t grid_max = { INT32_MIN, INT32_MIN };
+    uint32_t vertex_count = 0;
+    uint32_t entries = 0;
+    uint32_t cols;
+    uint32_t rows;
+    uint32_t cells;
+    uint32_t size;
+    uint32_t c0, c1, r0, r1, r, c;
+    uint16_t f;
+
+    if ((count == 0) || (cell_size_e7 == 0))
+        return 0;
+
+    /* Grid bounds and vertex count */
+    for (f = 0; f < count; f++)
+    {
+        if (!geofence_def_bbox(&p_defs[f], &min, &max))
+            return 0;
+        if (min.latitude_e7 < grid_min.latitude_e7)
+            grid_min.latitude_e7 = min.latitude_e7;
+        if (min.longitude_e7 < grid_min.longitude_e7)
+            grid_min.longitude_e7 = min.longitude_e7;
+        if (max.latitude_e7 > grid_max.latitude_e7)
+            grid_max.latitude_e7 = max.latitude_e7;
+        if (max.longitude_e7 > grid_max.longitude_e7)
+            grid_max.longitude_e7 = max.longitude_e7;
+        if (p_defs[f].type == GEOFENCE_TYPE_POLYGON)
+            vertex_count += p_defs[f].vertex_count;
+    }
+
+    cols = (uint32_t)(((int64_t)grid_max.longitude_e7 - grid_min.longitude_e7) / cell_size_e7) + 1U;
+    rows = (uint32_t)(((int64_t)grid_max.latitude_e7 - grid_min.latitude_e7) / cell_size_e7) + 1U;
+    if ((cols > UINT16_MAX) || (rows > UINT16_MAX) || (((uint64_t)cols * rows) > GEOFENCE_MAX_CELLS))
+        return 0;
+    cells = cols * rows;
+
+    /* Cell list length */
+    for (f = 0; f < count; f++)
+    {
+        geofence_def_bbox(&p_defs[f], &min, &max);
+        c0 = (uint32_t)(((int64_t)min.longitude_e7 - grid_min.longitude_e7) / cell_size_e7);
+        c1 = (uint32_t)(((int64_t)max.longitude_e7 - grid_min.longitude_e7) / cell_size_e7);
+        r0 = (uint32_t)(((int64_t)min.latitude_e7 - grid_min.latitude_e7) / cell_size_e7);
+        r1 = (uint32_t)(((int64_t)max.latitude_e7 - grid_min.latitude_e7) / cell_size_e7);
+        entries += (c1 - c0 + 1U) * (r1 - r0 + 1U);
+    }
+
+    size = (uint32_t)sizeof(geofence_image_header_t) + (count * (uint32_t)sizeof(geofence_record_t))
+           + (vertex_count * (uint32_t)sizeof(geofence_point_t)) + ((cells + 1U) * (uint32_t)sizeof(uint32_t))
+           + (entries * (uint32_t)sizeof(uint16_t));
+    if (size > image_size)
+        return 0;
+
+    p_fences = (geofence_record_t *)(p_header + 1);
+    p_vertices = (geofence_point_t *)(p_fences + count);
+    p_cell_start = (uint32_t *)(p_vertices + vertex_count);
+    p_cell_fences = (uint16_t *)(p_cell_start + cells + 1U);
+
+    p_header->magic = GEOFENCE_IMAGE_MAGIC;
+    p_header->version = GEOFENCE_IMAGE_VERSION;
+    p_header->fence_count = count;
+    p_header->vertex_count = vertex_count;
+    p_header->cell_entries = entries;
+    p_header->origin_lat_e7 = grid_min.latitude_e7;
+    p_header->origin_lon_e7 = grid_min.longitude_e7;
+    p_header->cell_size_e7 = cell_size_e7;
+    p_header->cols = (uint16_t)cols;
+    p_header->rows = (uint16_t)rows;
+
+    /* Fence records and vertices; count fences per cell in p_cell_start */
+    memset(p_cell_start, 0, (cells + 1U) * sizeof(uint32_t));
+    vertex_count = 0;
+    for (f = 0; f < count; f++)
+    {
+        geofence_def_t const *p_def = &p_defs[f];
+        geofence_record_t *p_rec = &p_fences[f];
+
+        geofence_def_bbox(p_def, &p_rec->bbox_min, &p_rec->bbox_max);
+        p_rec->id = p_def->id;
+        p_rec->type = (uint8_t)p_def->type;
+        if (p_def->type == GEOFENCE_TYPE_CIRCLE)
+        {
+            p_rec->vertex_count = 0;
+            p_rec->param = p_def->radius_m;
+            p_rec->center = p_def->center;
+        }
+        else
+        {
+            p_rec->vertex_count = p_def->vertex_count;
+            p_rec->param = vertex_count;
+            p_rec->center = p_def->p_vertices[0];
+            memcpy(&p_vertices[vertex_count], p_def->p_vertices, p_def->vertex_count * sizeof(geofence_point_t));
+            vertex_count += p_def->vertex_count;
+        }
+
+        c0 = (uint32_t)(((int64_t)p_rec->bbox_min.longitude_e7 - grid_min.longitude_e7) / cell_size_e7);
+        c1 = (uint32_t)(((int64_t)p_rec->bbox_max.longitude_e7 - grid_min.longitude_e7) / cell_size_e7);
+        r0 = (uint32_t)(((int64_t)p_rec->bbox_min.latitude_e7 - grid_min.latitude_e7) / cell_size_e7);
+        r1 = (uint32_t)(((int64_t)p_rec->bbox_max.latitude_e7 - grid_min.latitude_e7) / cell_size_e7);
+        for (r = r0; r <= r1; r++)
+            for (c = c0; c <= c1; c++)
+                p_cell_start[(r * cols) + c]++;
+    }
+
+    /* Turn counts into end offsets, then fill backwards so they become starts */
+    for (c = 1; c <= cells; c++)
+        p_cell_start[c] += p_cell_start[c - 1U];
+
+    for (f = count; f-- > 0;)
+    {
+        geofence_record_t const *p_rec = &p_fences[f];
+
+        c0 = (uint32_t)(((int64_t)p_rec->bbox_min.longitude_e7 - grid_min.longitude_e7) / cell_size_e7);
+        c1 = (uint32_t)(((int64_t)p_rec->bbox_max.longitude_e7 - grid_min.longitude_e7) / cell_size_e7);
+        r0 = (uint32_t)(((int64_t)p_rec->bbox_min.latitude_e7 - grid_min.latitude_e7) / cell_size_e7);
+        r1 = (uint32_t)(((int64_t)p_rec->bbox_max.latitude_e7 - grid_min.latitude_e7) / cell_size_e7);
+        for (r = r0; r <= r1; r++)
+            for (c = c0; c <= c1; c++)
+                p_cell_fences[--p_cell_start[(r * cols) + c]] = f;
+    }
+
+    return size;
+}
+
+bool geofence_attach(geofence_t *p_geofence, void const *p_image)
+{
+    geofence_image_header_t const *p_header = (geofence_image_header_t const *)p_image;
+    uint32_t cells;
+
+    memset(p_geofence, 0, sizeof(*p_geofence));
+
+    if ((p_header == NULL) || (p_header->magic != GEOFENCE_IMAGE_MAGIC)
+        || (p_header->version != GEOFENCE_IMAGE_VERSION))
+        return false;
+
+    cells = (uint32_t)p_header->cols * p_header->rows;
+
+    p_geofence->p_header = p_header;
+    p_geofence->p_fences = (geofence_record_t const *)(p_header + 1);
+    p_geofence->p_vertices = (geofence_point_t const *)(p_geofence->p_fences + p_header->fence_count);
+    p_geofence->p_cell_start = (uint32_t const *)(p_geofence->p_vertices + p_header->vertex_count);
+    p_geofence->p_cell_fences = (uint16_t const *)(p_geofence->p_cell_start + cells + 1U);
+
+    return true;
+}
+
+/* Crossing-number test, exact in integer arithmetic */
+static bool geofence_in_polygon(geofence_point_t const *p_v, uint8_t n, int32_t lat, int32_t lon)
+{
+    bool inside = false;
+    int64_t lhs;
+    int64_t rhs;
+    int64_t dlat;
+    uint8_t i;
+    uint8_t j = (uint8_t)(n - 1U);
+
+    for (i = 0; i < n; j = i++)
+    {
+        if ((p_v[i].latitude_e7 > lat) != (p_v[j].latitude_e7 > lat))
+        {
+            /* Is lon west of the edge where it crosses lat? */
+            dlat = (int64_t)p_v[j].latitude_e7 - p_v[i].latitude_e7;
+            lhs = ((int64_t)lon - p_v[i].longitude_e7) * dlat;
+            rhs = ((int64_t)lat - p_v[i].latitude_e7) * ((int64_t)p_v[j].longitude_e7 - p_v[i].longitude_e7);
+            if ((dlat > 0) ? (lhs < rhs) : (lhs > rhs))
+                inside = !inside;
+        }
+    }
+
+    return inside;
+}
+
+static void geofence_queue_event(geofence_t *p_geofence, uint16_t index, geofence_event_type_t type, uint32_t time_ms)
+{
+    geofence_event_t *p_event;
+
+    if (p_geofence->event_count == GEOFENCE_EVENT_LEN)
+    {
+        /* Reader fell behind, drop the oldest event */
+        p_geofence->event_head = (uint8_t)((p_geofence->event_head + 1U) % GEOFENCE_EVENT_LEN);
+        p_geofence->event_count--;
+        p_geofence->events_lost++;
+    }
+
+    p_event = &p_geofence->events[(p_geofence->event_head + p_geofence->event_count) % GEOFENCE_EVENT_LEN];
+    p_event->fence_id = p_geofence->p_fences[index].id;
+    p_event->type = (uint8_t)type;
+    p_event->time_ms = time_ms;
+    p_geofence->event_count++;
+}
+
+static bool geofence_was_inside(geofence_t const *p_geofence, uint16_t index)
+{
+    uint8_t i;
+
+    for (i = 0; (i < p_geofence->inside_count) && (p_geofence->inside[i] <= index); i++)
+    {
+        if (p_geofence->inside[i] == index)
+            return true;
+    }
+
+    return false;
+}
+
+/*
+ * Add a containing fence to now[], kept ascending. When now[] is full a
+ * fence the device was already in takes the place of one it was not, so
+ * a tracked fence never drops out and re-enters because of the cell scan
+ * order. Returns false when a containing fence was left out.
+ */
+static bool geofence_add_hit(geofence_t const *p_geofence, uint16_t *p_now, uint8_t *p_count, uint16_t index)
+{
+    uint8_t count = *p_count;
+    bool kept_all = true;
+    uint8_t i;
+
+    if (count == GEOFENCE_MAX_INSIDE)
+    {
+        kept_all = false;
+        if (!geofence_was_inside(p_geofence, index))
+            return false;
+
+        /* Evict the highest newcomer; inside[] cannot hold all of now[] as well as this one */
+        for (i = count; (i > 0) && geofence_was_inside(p_geofence, p_now[i - 1U]); i--)
+            ;
+        for (i--; (i + 1U) < count; i++)
+            p_now[i] = p_now[i + 1U];
+        count--;
+    }
+
+    for (i = count; (i > 0) && (p_now[i - 1U] > index); i--)
+        p_now[i] = p_now[i - 1U];
+    p_now[i] = index;
+    *p_count = (uint8_t)(count + 1U);
+
+    return kept_all;
+}
+
+/*
+ * Test a fix against the fences listed in its grid cell and queue an event
+ * for every fence entered or left since the previous fix. Returns false
+ * when more than GEOFENCE_MAX_INSIDE fences contain the fix; the ones left
+ * out are entered on a later fix once there is room.
+ */
+bool geofence_update(geofence_t *p_geofence, int32_t latitude_e7, int32_t longitude_e7, uint32_t time_ms)
+{
+    geofence_image_header_t const *p_header = p_geofence->p_header;
+    uint16_t now[GEOFENCE_MAX_INSIDE];
+    uint8_t now_count = 0;
+    bool overflow = false;
+    float m_per_e7_lon = 0.0f;
+    float dx;
+    float dy;
+    int64_t col;
+    int64_t row;
+    uint32_t cell;
+    uint32_t k;
+    uint8_t i;
+    uint8_t j;
+    bool hit;
+
+    if (p_header == NULL)
+        return true;
+
+    col = ((int64_t)longitude_e7 - p_header->origin_lon_e7) / (int64_t)p_header->cell_size_e7;
+    row = ((int64_t)latitude_e7 - p_header->origin_lat_e7) / (int64_t)p_header->cell_size_e7;
+
+    if ((longitude_e7 >= p_header->origin_lon_e7) && (latitude_e7 >= p_header->origin_lat_e7)
+        && (col < p_header->cols) && (row < p_header->rows))
+    {
+        cell = ((uint32_t)row * p_header->cols) + (uint32_t)col;
+
+        for (k = p_geofence->p_cell_start[cell]; k < p_geofence->p_cell_start[cell + 1U]; k++)
+        {
+            uint16_t index = p_geofence->p_cell_fences[k];
+            geofence_record_t const *p_rec = &p_geofence->p_fences[index];
+
+            if ((latitude_e7 < p_rec->bbox_min.latitude_e7) || (latitude_e7 > p_rec->bbox_max.latitude_e7)
+                || (longitude_e7 < p_rec->bbox_min.longitude_e7) || (longitude_e7 > p_rec->bbox_max.longitude_e7))
+                continue;
+
+            p_geofence->candidates_tested++;
+
+            if (p_rec->type == GEOFENCE_TYPE_CIRCLE)
+            {
+                if (m_per_e7_lon == 0.0f)
+                    m_per_e7_lon = GEOFENCE_M_PER_E7_LAT * cosf((float)latitude_e7 * GEOFENCE_E7_TO_RAD);
+                dx = (float)((int64_t)longitude_e7 - p_rec->center.longitude_e7) * m_per_e7_lon;
+                dy = (float)((int64_t)latitude_e7 - p_rec->center.latitude_e7) * GEOFENCE_M_PER_E7_LAT;
+                hit = ((dx * dx) + (dy * dy)) <= ((float)p_rec->param * (float)p_rec->param);
+            }
+            else
+            {
+                hit = geofence_in_polygon(&p_geofence->p_vertices[p_rec->param], p_rec->vertex_count,
+                                          latitude_e7, longitude_e7);
+            }
+
+            if (hit && !geofence_add_hit(p_geofence, now, &now_count, index))
+                overflow = true;
+        }
+    }
+
+    /* Merge the previous and current sets, both ascending */
+    i = 0;
+    j = 0;
+    while ((i < p_geofence->inside_count) || (j < now_count))
+    {
+        if ((j == now_count) || ((i < p_geofence->inside_count) && (p_geofence->inside[i] < now[j])))
+        {
+            geofence_queue_event(p_geofence, p_geofence->inside[i++], GEOFENCE_EVENT_EXIT, time_ms);
+        }
+        else if ((i == p_geofence->inside_count) || (now[j] < p_geofence->inside[i]))
+        {
+            geofence_queue_event(p_geofence, now[j++], GEOFENCE_EVENT_ENTER, time_ms);
+        }
+        else
+        {
+            i++;
+            j++;
+        }
+    }
+
+    memcpy(p_geofence->inside, now, now_count * sizeof(now[0]));
+    p_geofence->inside_count = now_count;
+
+    if (overflow)
+        p_geofence->inside_overflows++;
+
+    return !overflow;
+}
+
+/*
+ * Copy out up to max_events queued events, oldest first, and remove them.
+ * Returns the number copied.
+ */
+uint32_t geofence_read_events(geofence_t *p_geofence, geofence_event_t *p_events, uint32_t max_events)
+{
+    uint32_t count = 0;
+
+    while ((count < max_events) && (p_geofence->event_count > 0))
+    {
+        p_events[count++] = p_geofence->events[p_geofence->event_head];
+        p_geofence->event_head = (uint8_t)((p_geofence->event_head + 1U) % GEOFENCE_EVENT_LEN);
+        p_geofence->event_count--;
+    }
+
+    return count;
+}
+
+void geofence_print(geofence_t const *p_geofence, void (*p_print)(char const *p_str))
+{
+    char str[80];
+
+    p_print("\r\nFences  Inside  Tested  Events lost  Overflows\r\n");
+    snprintf(str, sizeof(str), "%6u  %6u  %6lu  %11lu  %9lu\r\n",
+             (unsigned)((p_geofence->p_header != NULL) ? p_geofence->p_header->fence_count : 0U),
+             (unsigned)p_geofence->inside_count, (unsigned long)p_geofence->candidates_tested,
+             (unsigned long)p_geofence->events_lost, (unsigned long)p_geofence->inside_overflows);
+    p_print(str);
+}
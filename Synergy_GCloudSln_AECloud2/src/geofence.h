@@ -0,0 +1,120 @@
+/*
+ * geofence.h
+ *
+ *  Geofence engine evaluated on every GNSS fix.
+ *
+ *  Fences (circles and polygons) live in a read-only image that can sit in
+ *  memory-mapped flash. The image carries a uniform grid over the area the
+ *  fences cover; each cell lists the fences whose bounding box overlaps it,
+ *  so a fix is only tested against the handful of fences in its cell. The
+ *  engine remembers which fences contain the device and queues an event on
+ *  every enter and exit. Up to GEOFENCE_MAX_INSIDE fences are tracked at
+ *  once; past that, fences already inside keep their place and the update
+ *  reports the overflow.
+ *
+ *  geofence_image_build() lays out an image from a list of fence
+ *  definitions. It runs on the host to produce a flash image, or on the
+ *  device into a RAM buffer.
+ */
+
+#ifndef GEOFENCE_H_
+#define GEOFENCE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define GEOFENCE_IMAGE_MAGIC    (0x434E4647UL)  /* "GFNC" */
+#define GEOFENCE_IMAGE_VERSION  (1U)
+#define GEOFENCE_MAX_INSIDE     (16U)   /* Fences that may contain the device at once */
+#define GEOFENCE_EVENT_LEN      (8U)    /* Events held for the reader */
+
+typedef enum e_geofence_type
+{
+    GEOFENCE_TYPE_CIRCLE = 0,
+    GEOFENCE_TYPE_POLYGON
+} geofence_type_t;
+
+typedef enum e_geofence_event_type
+{
+    GEOFENCE_EVENT_ENTER = 0,
+    GEOFENCE_EVENT_EXIT
+} geofence_event_type_t;
+
+/* A vertex or a circle centre */
+typedef struct st_geofence_point
+{
+    int32_t latitude_e7;
+    int32_t longitude_e7;
+} geofence_point_t;
+
+/* Fence definition handed to geofence_image_build() */
+typedef struct st_geofence_def
+{
+    uint16_t                id;             /* Reported in events */
+    geofence_type_t         type;
+    geofence_point_t        center;         /* Circle only */
+    uint32_t                radius_m;       /* Circle only */
+    geofence_point_t const *p_vertices;     /* Polygon only, not closed */
+    uint8_t                 vertex_count;   /* Polygon only, at least 3 */
+} geofence_def_t;
+
+/* Image layout: header, fences, vertices, cell_start[cells + 1], cell_fences[] */
+typedef struct st_geofence_image_header
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t fence_count;
+    uint32_t vertex_count;
+    uint32_t cell_entries;          /* Length of cell_fences[] */
+    int32_t  origin_lat_e7;         /* South-west corner of the grid */
+    int32_t  origin_lon_e7;
+    uint32_t cell_size_e7;          /* Cell edge in 1e-7 degree */
+    uint16_t cols;
+    uint16_t rows;
+} geofence_image_header_t;
+
+typedef struct st_geofence_record
+{
+    uint16_t         id;
+    uint8_t          type;          /* geofence_type_t */
+    uint8_t          vertex_count;
+    uint32_t         param;         /* Circle: radius in metres, polygon: first vertex */
+    geofence_point_t center;
+    geofence_point_t bbox_min;
+    geofence_point_t bbox_max;
+} geofence_record_t;
+
+typedef struct st_geofence_event
+{
+    uint16_t fence_id;
+    uint8_t  type;                  /* geofence_event_type_t */
+    uint32_t time_ms;
+} geofence_event_t;
+
+typedef struct st_geofence
+{
+    geofence_image_header_t const *p_header;
+    geofence_record_t const       *p_fences;
+    geofence_point_t const        *p_vertices;
+    uint32_t const                *p_cell_start;
+    uint16_t const                *p_cell_fences;
+
+    uint16_t         inside[GEOFENCE_MAX_INSIDE];  /* Fence indices, ascending */
+    uint8_t          inside_count;
+
+    geofence_event_t events[GEOFENCE_EVENT_LEN];
+    uint8_t          event_head;
+    uint8_t          event_count;
+    uint32_t         events_lost;
+    uint32_t         candidates_tested;
+    uint32_t         inside_overflows;  /* Updates that left a containing fence untracked */
+} geofence_t;
+
+uint32_t geofence_image_build(geofence_def_t const *p_defs, uint16_t count, uint32_t cell_size_e7,
+                              void *p_image, uint32_t image_size);
+bool geofence_attach(geofence_t *p_geofence, void const *p_image);
+bool geofence_update(geofence_t *p_geofence, int32_t latitude_e7, int32_t longitude_e7, uint32_t time_ms);
+uint32_t geofence_read_events(geofence_t *p_geofence, geofence_event_t *p_events, uint32_t max_events);
+void geofence_print(geofence_t const *p_geofence, void (*p_print)(char const *p_str));
+
+#endif /* GEOFENCE_H_ */
@@ -0,0 +1,243 @@
+/*
+ * geofence_test.c
+ *
+ *  Host test and benchmark of the geofence engine.
+ *
+ *  10k random circles and hexagons are built into a gridded image and into
+ *  a one-cell image, which makes geofence_update() test every fence, i.e.
+ *  a linear scan with the same geometry. Random fixes must give the same
+ *  set of containing fences from both; the cost per fix of each is
+ *  printed.
+ *
+ *  20 concentric circles then check the GEOFENCE_MAX_INSIDE limit: an
+ *  update with more containing fences reports the overflow, and fences
+ *  already inside keep their place, so none of them exits and re-enters
+ *  while the device stays within it.
+ *
+ *  Built by host_test.mk with SENSORS_BUS_SIM; empty in the firmware build.
+ */
+
+#if defined(SENSORS_BUS_SIM)
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "geofence.h"
+#include "host_test.h"
+
+#define TEST_FENCES             (10000U)
+#define TEST_FIXES              (20000U)
+#define TEST_AREA_E7            (20000000)      /* 2 degrees square */
+#define TEST_ORIGIN_LAT_E7      (370000000)
+#define TEST_ORIGIN_LON_E7      (-1220000000)
+#define TEST_CELL_E7            (100000U)       /* About 1.1 km */
+#define TEST_RINGS              (20U)
+
+static geofence_def_t test_defs[TEST_FENCES];
+static geofence_point_t test_vertices[TEST_FENCES][6];
+static uint32_t test_grid_image[1024U * 1024U];
+static uint32_t test_scan_image[256U * 1024U];
+static geofence_t test_grid;
+static geofence_t test_scan;
+
+static void test_build_fences(void)
+{
+    int32_t lat;
+    int32_t lon;
+    int32_t radius;
+    uint32_t f;
+    uint32_t v;
+
+    srand(7);
+    for (f = 0; f < TEST_FENCES; f++)
+    {
+        lat = TEST_ORIGIN_LAT_E7 + (rand() % TEST_AREA_E7);
+        lon = TEST_ORIGIN_LON_E7 + (rand() % TEST_AREA_E7);
+        test_defs[f].id = (uint16_t)f;
+
+        if (f & 1U)
+        {
+            test_defs[f].type = GEOFENCE_TYPE_CIRCLE;
+            test_defs[f].center.latitude_e7 = lat;
+            test_defs[f].center.longitude_e7 = lon;
+            test_defs[f].radius_m = 50U + ((uint32_t)rand() % 500U);
+        }
+        else
+        {
+            test_defs[f].type = GEOFENCE_TYPE_POLYGON;
+            test_defs[f].vertex_count = 6;
+            test_defs[f].p_vertices = test_vertices[f];
+            for (v = 0; v < 6U; v++)
+            {
+                radius = 2000 + (rand() % 40000);
+                test_vertices[f][v].latitude_e7 = lat + (int32_t)(radius * sin(v * M_PI / 3.0));
+                test_vertices[f][v].longitude_e7 = lon + (int32_t)(radius * cos(v * M_PI / 3.0));
+            }
+        }
+    }
+}
+
+static void test_against_scan(void)
+{
+    geofence_event_t events[GEOFENCE_EVENT_LEN];
+    uint64_t grid_cycles = 0;
+    uint64_t scan_cycles = 0;
+    uint64_t start;
+    uint32_t mismatches = 0;
+    uint32_t inside_fixes = 0;
+    int32_t lat;
+    int32_t lon;
+    uint32_t size;
+    uint32_t i;
+
+    size = geofence_image_build(test_defs, TEST_FENCES, TEST_CELL_E7, test_grid_image, sizeof(test_grid_image));
+    HOST_TEST_CHECK(size != 0U);
+    HOST_TEST_CHECK(geofence_attach(&test_grid, test_grid_image));
+
+    /* One cell covering every fence */
+    size = geofence_image_build(test_defs, TEST_FENCES, 2U * TEST_AREA_E7, test_scan_image, sizeof(test_scan_image));
+    HOST_TEST_CHECK(size != 0U);
+    HOST_TEST_CHECK(geofence_attach(&test_scan, test_scan_image));
+    if (host_test_failures != 0)
+        return;
+
+    HOST_TEST_CHECK((test_scan.p_header->cols == 1U) && (test_scan.p_header->rows == 1U));
+
+    for (i = 0; i < TEST_FIXES; i++)
+    {
+        lat = TEST_ORIGIN_LAT_E7 + (rand() % TEST_AREA_E7);
+        lon = TEST_ORIGIN_LON_E7 + (rand() % TEST_AREA_E7);
+
+        start = host_test_cycles();
+        geofence_update(&test_grid, lat, lon, i);
+        grid_cycles += host_test_cycles() - start;
+
+        start = host_test_cycles();
+        geofence_update(&test_scan, lat, lon, i);
+        scan_cycles += host_test_cycles() - start;
+
+        if ((test_grid.inside_count != test_scan.inside_count)
+            || (memcmp(test_grid.inside, test_scan.inside, test_grid.inside_count * sizeof(test_grid.inside[0])) != 0))
+            mismatches++;
+        if (test_grid.inside_count > 0U)
+            inside_fixes++;
+
+        geofence_read_events(&test_grid, events, GEOFENCE_EVENT_LEN);
+        geofence_read_events(&test_scan, events, GEOFENCE_EVENT_LEN);
+    }
+
+    printf("%lu fences, grid %ux%u: %lu fixes (%lu inside a fence), %lu mismatches, "
+           "%.0f cycles/fix, linear scan %.0f cycles/fix\r\n",
+           (unsigned long)TEST_FENCES, (unsigned)test_grid.p_header->cols, (unsigned)test_grid.p_header->rows,
+           (unsigned long)TEST_FIXES, (unsigned long)inside_fixes, (unsigned long)mismatches,
+           (double)grid_cycles / TEST_FIXES, (double)scan_cycles / TEST_FIXES);
+    HOST_TEST_CHECK(mismatches == 0U);
+    HOST_TEST_CHECK(inside_fixes > 0U);
+    HOST_TEST_CHECK(test_grid.inside_overflows == 0U);
+}
+
+/* Fix from the ring centre to the east, in metres */
+static bool test_ring_update(geofence_t *p_geofence, uint32_t east_m, uint32_t *p_enters, uint32_t *p_exits)
+{
+    geofence_event_t events[GEOFENCE_EVENT_LEN];
+    uint32_t count;
+    uint32_t i;
+    bool kept_all;
+
+    /* 1e-7 degree of longitude is 0.0111 m * cos(48 deg) */
+    kept_all = geofence_update(p_geofence, 480000000, 110000000 + (int32_t)((float)east_m / 0.00744867f), 0);
+
+    *p_enters = 0;
+    *p_exits = 0;
+    count = geofence_read_events(p_geofence, events, GEOFENCE_EVENT_LEN);
+    for (i = 0; i < count; i++)
+    {
+        if (events[i].type == GEOFENCE_EVENT_ENTER)
+            (*p_enters)++;
+        else
+            (*p_exits)++;
+    }
+
+    return kept_all;
+}
+
+static bool test_ring_inside(geofence_t const *p_geofence, uint16_t id)
+{
+    uint8_t i;
+
+    for (i = 0; i < p_geofence->inside_count; i++)
+    {
+        if (p_geofence->p_fences[p_geofence->inside[i]].id == id)
+            return true;
+    }
+
+    return false;
+}
+
+/* Radii 100 m to 2 km around one point: a fix d metres out is in the fences wider than d */
+static void test_overflow(void)
+{
+    static uint32_t image[1024];
+    geofence_def_t defs[TEST_RINGS];
+    geofence_t fences;
+    uint32_t enters;
+    uint32_t exits;
+    uint32_t lost;
+    uint16_t id;
+    bool kept_all;
+
+    for (id = 0; id < TEST_RINGS; id++)
+    {
+        defs[id].id = id;
+        defs[id].type = GEOFENCE_TYPE_CIRCLE;
+        defs[id].center.latitude_e7 = 480000000;
+        defs[id].center.longitude_e7 = 110000000;
+        defs[id].radius_m = 100U * (id + 1U);
+    }
+    HOST_TEST_CHECK(geofence_image_build(defs, TEST_RINGS, 1000000U, image, sizeof(image)) != 0U);
+    HOST_TEST_CHECK(geofence_attach(&fences, image));
+    if (host_test_failures != 0)
+        return;
+
+    /* 550 m out: the 15 fences from 600 m up */
+    kept_all = test_ring_update(&fences, 550, &enters, &exits);
+    HOST_TEST_CHECK(kept_all && (fences.inside_count == 15U) && (exits == 0U));
+
+    /* Centre: 20 containing fences, the 15 tracked ones stay and one newcomer fits */
+    kept_all = test_ring_update(&fences, 0, &enters, &exits);
+    HOST_TEST_CHECK(!kept_all);
+    HOST_TEST_CHECK(fences.inside_count == GEOFENCE_MAX_INSIDE);
+    HOST_TEST_CHECK((enters == 1U) && (exits == 0U));
+    for (id = 5; id < TEST_RINGS; id++)
+        HOST_TEST_CHECK(test_ring_inside(&fences, id));
+
+    /* Staying put changes nothing, and still reports the overflow */
+    kept_all = test_ring_update(&fences, 0, &enters, &exits);
+    HOST_TEST_CHECK(!kept_all && (enters == 0U) && (exits == 0U));
+    HOST_TEST_CHECK(fences.inside_overflows == 2U);
+
+    /* 450 m out: the 16 fences from 500 m up, all of them tracked now */
+    kept_all = test_ring_update(&fences, 450, &enters, &exits);
+    HOST_TEST_CHECK(kept_all && (fences.inside_count == 16U) && (enters == 1U) && (exits == 1U));
+    for (id = 4; id < TEST_RINGS; id++)
+        HOST_TEST_CHECK(test_ring_inside(&fences, id));
+
+    /* Outside all of them: 16 exits, the queue keeps the last 8 */
+    lost = fences.events_lost;
+    kept_all = test_ring_update(&fences, 2500, &enters, &exits);
+    HOST_TEST_CHECK(kept_all && (fences.inside_count == 0U) && (exits == 8U) && ((fences.events_lost - lost) == 8U));
+
+    printf("%u nested fences: overflow reported on %lu updates, tracked fences kept\r\n",
+           (unsigned)TEST_RINGS, (unsigned long)fences.inside_overflows);
+}
+
+int main(void)
+{
+    test_build_fences();
+    test_against_scan();
+    test_overflow();
+
+    return host_test_finish("geofence");
+}
+
+#endif /* SENSORS_BUS_SIM */
@@ -0,0 +1,374 @@
+/*
+ * gnss.c
+ *
+ *  GNSS fix model built from NMEA sentences. See gnss.h.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gnss.h"
+
+typedef void (*gnss_handler_t)(gnss_fix_t *p_fix, nmea_sentence_t const *p_sentence);
+
+typedef struct st_gnss_sentence_entry
+{
+    char            type[4];        /* Sentence formatter, without talker ID */
+    uint8_t         min_fields;     /* Including the address field */
+    gnss_handler_t  handler;
+} gnss_sentence_entry_t;
+
+/*
+ * Parse "[-]iii[.fff]" into an integer scaled by 10^frac_digits. Extra
+ * fractional digits are truncated. Returns false for an empty field, or
+ * one whose scaled value does not fit an int32_t.
+ */
+static bool gnss_parse_fixed(char const *p_str, uint8_t frac_digits, int32_t *p_value)
+{
+    int64_t value = 0;
+    bool negative = false;
+    bool digits = false;
+
+    if (*p_str == '-')
+    {
+        negative = true;
+        p_str++;
+    }
+
+    while ((*p_str >= '0') && (*p_str <= '9'))
+    {
+        value = (value * 10) + (*p_str++ - '0');
+        digits = true;
+        if (value > INT32_MAX)
+            return false;
+    }
+
+    if (*p_str == '.')
+        p_str++;
+
+    while (frac_digits--)
+    {
+        value *= 10;
+        if ((*p_str >= '0') && (*p_str <= '9'))
+        {
+            value += *p_str++ - '0';
+            digits = true;
+        }
+        if (value > INT32_MAX)
+            return false;
+    }
+
+    if (!digits)
+        return false;
+
+    *p_value = (int32_t)(negative ? -value : value);
+    return true;
+}
+
+/* hhmmss[.sss] */
+static bool gnss_parse_time(char const *p_str, uint32_t *p_time_ms)
+{
+    int32_t value;
+    uint32_t hhmmss;
+
+    if (!gnss_parse_fixed(p_str, 3, &value) || (value < 0))
+        return false;
+
+    hhmmss = (uint32_t)value / 1000U;
+    *p_time_ms = ((hhmmss / 10000U) * 3600000U) + (((hhmmss / 100U) % 100U) * 60000U)
+                 + ((hhmmss % 100U) * 1000U) + ((uint32_t)value % 1000U);
+    return true;
+}
+
+/*
+ * Decode "ddmm.mmmm" (deg_digits 2) or "dddmm.mmmm" (deg_digits 3) plus
+ * hemisphere into signed 1e-7 degrees without floating point. Minutes are
+ * read to 6 decimals; minutes / 60 is rounded to the nearest 1e-7 degree.
+ * A malformed field, one beyond 90 (latitude) or 180 (longitude) degrees,
+ * or one with 60 minutes or more is rejected.
+ */
+static bool gnss_parse_coord(char const *p_ddmm, uint8_t deg_digits, char hemisphere, int32_t *p_coord_e7)
+{
+    int32_t max_degrees = (deg_digits == 2U) ? 90 : 180;
+    int32_t degrees = 0;
+    int32_t minutes_e6;
+    int32_t coord_e7;
+    uint8_t i;
+
+    if (strlen(p_ddmm) < (size_t)(deg_digits + 4U))
+        return false;
+
+    for (i = 0; i < deg_digits; i++)
+    {
+        if ((p_ddmm[i] < '0') || (p_ddmm[i] > '9'))
+            return false;
+        degrees = (degrees * 10) + (p_ddmm[i] - '0');
+    }
+
+    /* Two whole minute digits, then the decimals */
+    for (i = deg_digits; i < (deg_digits + 2U); i++)
+    {
+        if ((p_ddmm[i] < '0') || (p_ddmm[i] > '9'))
+            return false;
+    }
+    if ((p_ddmm[i] != '.') && (p_ddmm[i] != '\0'))
+        return false;
+
+    if (!gnss_parse_fixed(&p_ddmm[deg_digits], 6, &minutes_e6) || (minutes_e6 < 0) || (minutes_e6 >= 60000000))
+        return false;
+
+    if ((degrees > max_degrees) || ((degrees == max_degrees) && (minutes_e6 != 0)))
+        return false;
+
+    coord_e7 = (degrees * 10000000) + ((minutes_e6 + 3) / 6);
+
+    *p_coord_e7 = ((hemisphere == 'S') || (hemisphere == 'W')) ? -coord_e7 : coord_e7;
+    return true;
+}
+
+static void gnss_set_position(gnss_fix_t *p_fix, nmea_sentence_t const *p_sentence, uint8_t first)
+{
+    if (gnss_parse_coord(p_sentence->field[first], 2, p_sentence->field[first + 1][0], &p_fix->latitude_e7)
+        && gnss_parse_coord(p_sentence->field[first + 2], 3, p_sentence->field[first + 3][0], &p_fix->longitude_e7))
+    {
+        p_fix->valid |= GNSS_VALID_POSITION;
+        p_fix->position_updates++;
+    }
+}
+
+static void gnss_handle_gga(gnss_fix_t *p_fix, nmea_sentence_t const *p_sentence)
+{
+    int32_t value;
+
+    if (gnss_parse_time(p_sentence->field[1], &p_fix->utc_time_ms))
+        p_fix->valid |= GNSS_VALID_TIME;
+
+    p_fix->fix_quality = (uint8_t)atoi(p_sentence->field[6]);
+    if (p_fix->fix_quality == 0)
+    {
+        /* No GPS fix, keep the last known position */
+        return;
+    }
+
+    gnss_set_position(p_fix, p_sentence, 2);
+
+    p_fix->satellites_used = (uint8_t)atoi(p_sentence->field[7]);
+
+    if (gnss_parse_fixed(p_sentence->field[8], 2, &value))
+    {
+        p_fix->hdop_x100 = (uint16_t)value;
+        p_fix->valid |= GNSS_VALID_DOP;
+    }
+
+    if (gnss_parse_fixed(p_sentence->field[9], 2, &value))
+    {
+        p_fix->altitude_cm = value;
+        p_fix->valid |= GNSS_VALID_ALTITUDE;
+    }
+}
+
+static void gnss_handle_rmc(gnss_fix_t *p_fix, nmea_sentence_t const *p_sentence)
+{
+    int32_t value;
+
+    if (gnss_parse_time(p_sentence->field[1], &p_fix->utc_time_ms))
+        p_fix->valid |= GNSS_VALID_TIME;
+
+    if (gnss_parse_fixed(p_sentence->field[9], 0, &value) && (value > 0))
+    {
+        p_fix->utc_day = (uint8_t)(value / 10000);
+        p_fix->utc_month = (uint8_t)((value / 100) % 100);
+        p_fix->utc_year = (uint16_t)(2000 + (value % 100));
+        p_fix->valid |= GNSS_VALID_DATE;
+    }
+
+    if (p_sentence->field[2][0] != 'A')
+    {
+        /* Receiver warning, motion is unknown but the position is kept */
+        p_fix->fix_quality = 0;
+        p_fix->valid &= ~(GNSS_VALID_SPEED | GNSS_VALID_COURSE);
+        return;
+    }
+
+    /* RMC only says valid or not; GGA refines the quality when present */
+    if (p_fix->fix_quality == 0)
+        p_fix->fix_quality = 1;
+
+    gnss_set_position(p_fix, p_sentence, 3);
+
+    /* knots to mm/s: 1852000 / 3600 per knot, field scaled by 1000 */
+    if (gnss_parse_fixed(p_sentence->field[7], 3, &value) && (value >= 0))
+    {
+        p_fix->speed_mm_s = ((uint32_t)value * 463U) / 900U;
+        p_fix->valid |= GNSS_VALID_SPEED;
+    }
+
+    if (gnss_parse_fixed(p_sentence->field[8], 2, &value) && (value >= 0))
+    {
+        p_fix->course_cdeg = (uint16_t)value;
+        p_fix->valid |= GNSS_VALID_COURSE;
+    }
+}
+
+static void gnss_handle_vtg(gnss_fix_t *p_fix, nmea_sentence_t const *p_sentence)
+{
+    int32_t value;
+
+    if (gnss_parse_fixed(p_sentence->field[1], 2, &value) && (value >= 0))
+    {
+        p_fix->course_cdeg = (uint16_t)value;
+        p_fix->valid |= GNSS_VALID_COURSE;
+    }
+
+    /* Prefer km/h (5/18 mm/s per 0.001 km/h), fall back to knots */
+    if (gnss_parse_fixed(p_sentence->field[7], 3, &value) && (value >= 0))
+    {
+        p_fix->speed_mm_s = ((uint32_t)value * 5U) / 18U;
+        p_fix->valid |= GNSS_VALID_SPEED;
+    }
+    else if (gnss_parse_fixed(p_sentence->field[5], 3, &value) && (value >= 0))
+    {
+        p_fix->speed_mm_s = ((uint32_t)value * 463U) / 900U;
+        p_fix->valid |= GNSS_VALID_SPEED;
+    }
+}
+
+static void gnss_handle_gsa(gnss_fix_t *p_fix, nmea_sentence_t const *p_sentence)
+{
+    int32_t pdop;
+    int32_t hdop;
+    int32_t vdop;
+
+    p_fix->fix_mode = (uint8_t)atoi(p_sentence->field[2]);
+
+    if (gnss_parse_fixed(p_sentence->field[15], 2, &pdop)
+        && gnss_parse_fixed(p_sentence->field[16], 2, &hdop)
+        && gnss_parse_fixed(p_sentence->field[17], 2, &vdop))
+    {
+        p_fix->pdop_x100 = (uint16_t)pdop;
+        p_fix->hdop_x100 = (uint16_t)hdop;
+        p_fix->vdop_x100 = (uint16_t)vdop;
+        p_fix->valid |= GNSS_VALID_DOP;
+    }
+}
+
+static void gnss_handle_gsv(gnss_fix_t *p_fix, nmea_sentence_t const *p_sentence)
+{
+    char const *p_talker = p_sentence->field[0];
+    gnss_system_t system;
+    uint8_t total = 0;
+    uint8_t i;
+
+    if ((p_talker[0] == 'G') && (p_talker[1] == 'P'))
+        system = GNSS_SYSTEM_GPS;
+    else if ((p_talker[0] == 'G') && (p_talker[1] == 'L'))
+        system = GNSS_SYSTEM_GLONASS;
+    else if ((p_talker[0] == 'G') && (p_talker[1] == 'A'))
+        system = GNSS_SYSTEM_GALILEO;
+    else if (((p_talker[0] == 'G') && (p_talker[1] == 'B')) || ((p_talker[0] == 'B') && (p_talker[1] == 'D')))
+        system = GNSS_SYSTEM_BEIDOU;
+    else
+        return;
+
+    /* Every message of a GSV group repeats the satellites-in-view count */
+    p_fix->in_view[system] = (uint8_t)atoi(p_sentence->field[3]);
+
+    for (i = 0; i < GNSS_SYSTEM_COUNT; i++)
+        total = (uint8_t)(total + p_fix->in_view[i]);
+
+    p_fix->satellites_in_view = total;
+    p_fix->valid |= GNSS_VALID_SATELLITES;
+}
+
+static const gnss_sentence_entry_t gnss_sentence_table[] =
+{
+    { "GGA", 10, gnss_handle_gga },
+    { "RMC", 10, gnss_handle_rmc },
+    { "VTG",  8, gnss_handle_vtg },
+    { "GSA", 18, gnss_handle_gsa },
+    { "GSV",  4, gnss_handle_gsv },
+};
+
+void gnss_fix_init(gnss_fix_t *p_fix)
+{
+    memset(p_fix, 0, sizeof(*p_fix));
+}
+
+/*
+ * nmea_parser callback; p_context is the gnss_fix_t to merge into.
+ */
+void gnss_sentence_callback(nmea_sentence_t const *p_sentence, void *p_context)
+{
+    char const *p_address = p_sentence->field[0];
+    uint32_t i;
+
+    /* Two character talker ID plus three character formatter */
+    if (strlen(p_address) != 5)
+        return;
+
+    for (i = 0; i < (sizeof(gnss_sentence_table) / sizeof(gnss_sentence_table[0])); i++)
+    {
+        if (memcmp(&p_address[2], gnss_sentence_table[i].type, 3) == 0)
+        {
+            if (p_sentence->field_count >= gnss_sentence_table[i].min_fields)
+                gnss_sentence_table[i].handler((gnss_fix_t *)p_context, p_sentence);
+            return;
+        }
+    }
+}
+
+/*
+ * Format 1e-7 degrees as signed decimal degrees with trailing zeros removed,
+ * the same text the payload carried when coordinates were converted with
+ * gcvt(). p_buf must hold GNSS_COORD_STR_LEN bytes. Returns the length.
+ */
+uint32_t gnss_format_coord(int32_t coord_e7, char *p_buf)
+{
+    char digits[10];
+    uint32_t magnitude;
+    uint32_t whole;
+    uint32_t frac;
+    uint32_t len = 0;
+    uint32_t n = 0;
+    int32_t i;
+
+    if (coord_e7 < 0)
+    {
+        p_buf[len++] = '-';
+        magnitude = (uint32_t)(-(coord_e7 + 1)) + 1U;
+    }
+    else
+    {
+        magnitude = (uint32_t)coord_e7;
+    }
+
+    whole = magnitude / 10000000U;
+    frac = magnitude % 10000000U;
+
+    do
+    {
+        digits[n++] = (char)('0' + (whole % 10U));
+        whole /= 10U;
+    } while (whole != 0);
+
+    while (n)
+        p_buf[len++] = digits[--n];
+
+    if (frac != 0)
+    {
+        p_buf[len++] = '.';
+        for (i = 6; i >= 0; i--)
+        {
+            digits[i] = (char)('0' + (frac % 10U));
+            frac /= 10U;
+        }
+        n = 7;
+        while (digits[n - 1] == '0')
+            n--;
+        for (i = 0; i < (int32_t)n; i++)
+            p_buf[len++] = digits[i];
+    }
+
+    p_buf[len] = '\0';
+    return len;
+}
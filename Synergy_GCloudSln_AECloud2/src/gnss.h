@@ -0,0 +1,78 @@
+/*
+ * gnss.h
+ *
+ *  GNSS fix model built from NMEA GGA, RMC, VTG, GSA and GSV sentences.
+ *
+ *  Sentences are dispatched on their type through a table, whatever the
+ *  talker ID ($GP, $GN, $GL, $GA, $GB), and merged into one gnss_fix_t.
+ *  All numeric fields are scaled integers; check the matching GNSS_VALID_*
+ *  bit before using a field. Position, altitude and time are last known
+ *  values: they are kept when the receiver loses its fix, and fix_quality
+ *  (0 = no fix) plus the timestamp/age fields tell how current they are.
+ */
+
+#ifndef GNSS_H_
+#define GNSS_H_
+
+#include <stdint.h>
+#include "nmea_parser.h"
+
+/* Room for gnss_format_coord() output, e.g. "-179.1234567" */
+#define GNSS_COORD_STR_LEN      (16U)
+
+/* gnss_fix_t.valid bits */
+#define GNSS_VALID_POSITION     (1U << 0)
+#define GNSS_VALID_ALTITUDE     (1U << 1)
+#define GNSS_VALID_SPEED        (1U << 2)
+#define GNSS_VALID_COURSE       (1U << 3)
+#define GNSS_VALID_DOP          (1U << 4)
+#define GNSS_VALID_TIME         (1U << 5)
+#define GNSS_VALID_DATE         (1U << 6)
+#define GNSS_VALID_SATELLITES   (1U << 7)
+
+/* Constellations tracked separately for GSV, indexed by talker ID */
+typedef enum e_gnss_system
+{
+    GNSS_SYSTEM_GPS = 0,        /* GP */
+    GNSS_SYSTEM_GLONASS,        /* GL */
+    GNSS_SYSTEM_GALILEO,        /* GA */
+    GNSS_SYSTEM_BEIDOU,         /* GB, BD */
+    GNSS_SYSTEM_COUNT
+} gnss_system_t;
+
+typedef struct st_gnss_fix
+{
+    uint32_t valid;                     /* GNSS_VALID_* bits */
+
+    int32_t  latitude_e7;               /* Signed, 1e-7 degree, north positive */
+    int32_t  longitude_e7;              /* Signed, 1e-7 degree, east positive */
+    int32_t  altitude_cm;               /* Above mean sea level */
+
+    uint32_t speed_mm_s;                /* Over ground */
+    uint16_t course_cdeg;               /* True course, 0.01 degree */
+
+    uint16_t hdop_x100;
+    uint16_t pdop_x100;
+    uint16_t vdop_x100;
+
+    uint8_t  fix_quality;               /* GGA: 0 invalid, 1 GPS, 2 DGPS, ... */
+    uint8_t  fix_mode;                  /* GSA: 1 none, 2 2D, 3 3D */
+    uint8_t  satellites_used;
+    uint8_t  satellites_in_view;        /* Sum over all constellations */
+    uint8_t  in_view[GNSS_SYSTEM_COUNT];
+
+    uint32_t utc_time_ms;               /* Milliseconds since UTC midnight */
+    uint16_t utc_year;
+    uint8_t  utc_month;
+    uint8_t  utc_day;
+
+    uint32_t position_updates;          /* Incremented on every decoded position */
+    uint32_t timestamp;                 /* Owner's clock at the last position update */
+    uint32_t age_ms;                    /* Position age, filled in by the reader */
+} gnss_fix_t;
+
+void gnss_fix_init(gnss_fix_t *p_fix);
+void gnss_sentence_callback(nmea_sentence_t const *p_sentence, void *p_context);
+uint32_t gnss_format_coord(int32_t coord_e7, char *p_buf);
+
+#endif /* GNSS_H_ */
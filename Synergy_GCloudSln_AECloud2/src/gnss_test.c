@@ -0,0 +1,270 @@
+/*
+ * gnss_test.c
+ *
+ *  Host test of the GGA coordinate decoding in gnss.c against the
+ *  conversion read_gps_coordinates() used to do: atof() of the degree and
+ *  minute fields, a double division and gcvt() to 10 (11 from 100 degrees
+ *  of longitude) significant digits.
+ *
+ *  For random 4 and 5 decimal minute fields every *_e7 value must equal
+ *  the old string rounded to 1e-7 degree, and gnss_format_coord() must
+ *  print the old string wherever it had 7 decimals or fewer. Out-of-range
+ *  fields (degrees past 90 or 180, 60 minutes or more) must leave the last
+ *  position alone; host_test.mk builds this test with UBSan so an overflow
+ *  in the conversion fails it. Ends with the cost per sentence, old and
+ *  new.
+ *
+ *  Built by host_test.mk with SENSORS_BUS_SIM; empty in the firmware build.
+ */
+
+#if defined(SENSORS_BUS_SIM)
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gnss.h"
+#include "host_test.h"
+
+#define TEST_RANDOM_FIXES       (200000U)
+#define TEST_BENCH_FIXES        (200000U)
+
+extern char *gcvt(double number, int ndigit, char *buf);
+
+typedef struct st_test_coord
+{
+    char lat[16];
+    char ns;
+    char lon[16];
+    char ew;
+} test_coord_t;
+
+static nmea_parser_t test_parser;
+static gnss_fix_t test_fix;
+
+static uint32_t test_gga(test_coord_t const *p_coord, char *p_out)
+{
+    char body[96];
+    uint8_t csum = 0;
+    char const *p;
+
+    snprintf(body, sizeof(body), "GPGGA,123519,%s,%c,%s,%c,1,08,0.9,545.4,M,46.9,M,,",
+             p_coord->lat, p_coord->ns, p_coord->lon, p_coord->ew);
+    for (p = body; *p != '\0'; p++)
+        csum ^= (uint8_t)*p;
+
+    return (uint32_t)sprintf(p_out, "$%s*%02X\r\n", body, csum);
+}
+
+static void test_feed(test_coord_t const *p_coord)
+{
+    char line[128];
+    uint32_t len = test_gga(p_coord, line);
+
+    nmea_parser_feed(&test_parser, (uint8_t const *)line, len);
+}
+
+/* The conversion this tree used before gnss.c, sign prefix included */
+static void test_old_coord(char const *p_ddmm, uint8_t deg_digits, char hemisphere, char *p_out)
+{
+    char deg[4] = { 0 };
+    char str[32];
+    int digits = 10;
+    double x;
+
+    strncpy(deg, p_ddmm, deg_digits);
+    x = atof(deg) + (atof(p_ddmm + deg_digits) / 60.0);
+    if ((deg_digits == 3U) && (p_ddmm[0] == '1'))
+        digits++;
+    gcvt(x, digits, str);
+
+    p_out[0] = '\0';
+    if ((hemisphere == 'S') || (hemisphere == 'W'))
+        strcat(p_out, "-");
+    strcat(p_out, str);
+}
+
+static uint32_t test_decimals(char const *p_str)
+{
+    char const *p_dot = strchr(p_str, '.');
+
+    return (p_dot == NULL) ? 0U : (uint32_t)strlen(p_dot + 1);
+}
+
+static void test_random_coord(test_coord_t *p_coord, uint32_t minute_decimals)
+{
+    uint32_t scale = (minute_decimals == 4U) ? 10000U : 100000U;
+    uint32_t lat_deg = (uint32_t)rand() % 90U;
+    uint32_t lon_deg = (uint32_t)rand() % 180U;
+
+    snprintf(p_coord->lat, sizeof(p_coord->lat), "%02lu%02lu.%0*lu", (unsigned long)lat_deg,
+             (unsigned long)((uint32_t)rand() % 60U), (int)minute_decimals, (unsigned long)((uint32_t)rand() % scale));
+    snprintf(p_coord->lon, sizeof(p_coord->lon), "%03lu%02lu.%0*lu", (unsigned long)lon_deg,
+             (unsigned long)((uint32_t)rand() % 60U), (int)minute_decimals, (unsigned long)((uint32_t)rand() % scale));
+    p_coord->ns = (rand() & 1) ? 'N' : 'S';
+    p_coord->ew = (rand() & 1) ? 'E' : 'W';
+}
+
+/* One decoded coordinate against the old string */
+static bool test_compare(int32_t coord_e7, char const *p_ddmm, uint8_t deg_digits, char hemisphere,
+                         uint32_t *p_strings)
+{
+    char old_str[32];
+    char new_str[GNSS_COORD_STR_LEN];
+    bool same;
+
+    test_old_coord(p_ddmm, deg_digits, hemisphere, old_str);
+    same = (coord_e7 == (int32_t)llround(strtod(old_str, NULL) * 1e7));
+
+    if (test_decimals(old_str) <= 7U)
+    {
+        gnss_format_coord(coord_e7, new_str);
+        if (strcmp(old_str, new_str) != 0)
+        {
+            printf("format %s: old \"%s\" new \"%s\"\r\n", p_ddmm, old_str, new_str);
+            same = false;
+        }
+        (*p_strings)++;
+    }
+
+    return same;
+}
+
+static void test_bit_exact(uint32_t minute_decimals)
+{
+    test_coord_t coord;
+    uint32_t mismatches = 0;
+    uint32_t strings = 0;
+    uint32_t updates;
+    uint32_t i;
+
+    srand(minute_decimals);
+    for (i = 0; i < TEST_RANDOM_FIXES; i++)
+    {
+        test_random_coord(&coord, minute_decimals);
+        updates = test_fix.position_updates;
+        test_feed(&coord);
+        if (test_fix.position_updates != (updates + 1U))
+        {
+            mismatches++;
+            continue;
+        }
+
+        if (!test_compare(test_fix.latitude_e7, coord.lat, 2, coord.ns, &strings)
+            || !test_compare(test_fix.longitude_e7, coord.lon, 3, coord.ew, &strings))
+        {
+            if (mismatches++ < 5U)
+                printf("mismatch %s %c %s %c: %ld %ld\r\n", coord.lat, coord.ns, coord.lon, coord.ew,
+                       (long)test_fix.latitude_e7, (long)test_fix.longitude_e7);
+        }
+    }
+
+    printf("%lu-decimal minutes: %lu fixes, %lu mismatches, %lu strings compared\r\n",
+           (unsigned long)minute_decimals, (unsigned long)TEST_RANDOM_FIXES, (unsigned long)mismatches,
+           (unsigned long)strings);
+    HOST_TEST_CHECK(mismatches == 0U);
+    HOST_TEST_CHECK(strings > 0U);
+}
+
+/* Field, hemisphere, accepted, expected 1e-7 degrees */
+typedef struct st_test_edge
+{
+    test_coord_t coord;
+    bool         accepted;
+    int32_t      latitude_e7;
+    int32_t      longitude_e7;
+} test_edge_t;
+
+static test_edge_t const test_edges[] =
+{
+    { { "9000.000", 'N', "18000.000", 'E' }, true, 900000000, 1800000000 },
+    { { "9000.000", 'S', "18000.000", 'W' }, true, -900000000, -1800000000 },
+    { { "8959.99999", 'N', "17959.99999", 'E' }, true, 899999998, 1799999998 },
+    { { "0000.000", 'N', "00000.000", 'E' }, true, 0, 0 },
+    { { "4807.038", 'N', "99959.999", 'E' }, false, 0, 0 },         /* Longitude degrees past 180 */
+    { { "4807.038", 'N', "18100.000", 'E' }, false, 0, 0 },
+    { { "4807.038", 'N', "18000.001", 'E' }, false, 0, 0 },
+    { { "9100.000", 'N', "01131.000", 'E' }, false, 0, 0 },         /* Latitude degrees past 90 */
+    { { "9000.001", 'N', "01131.000", 'E' }, false, 0, 0 },
+    { { "4899.000", 'N', "01131.000", 'E' }, false, 0, 0 },         /* 99 minutes */
+    { { "4860.000", 'N', "01131.000", 'E' }, false, 0, 0 },
+    { { "4807.038", 'N', "01160.000", 'E' }, false, 0, 0 },
+    { { "4807.038", 'N', "0113X.000", 'E' }, false, 0, 0 },
+};
+
+static void test_out_of_range(void)
+{
+    test_coord_t const last = { "4807.038", 'N', "01131.000", 'E' };
+    uint32_t updates;
+    uint32_t i;
+
+    for (i = 0; i < (sizeof(test_edges) / sizeof(test_edges[0])); i++)
+    {
+        test_feed(&last);
+        updates = test_fix.position_updates;
+        test_feed(&test_edges[i].coord);
+
+        if (test_edges[i].accepted)
+        {
+            HOST_TEST_CHECK(test_fix.position_updates == (updates + 1U));
+            HOST_TEST_CHECK(test_fix.latitude_e7 == test_edges[i].latitude_e7);
+            HOST_TEST_CHECK(test_fix.longitude_e7 == test_edges[i].longitude_e7);
+        }
+        else
+        {
+            /* Dropped, the last position stays */
+            HOST_TEST_CHECK(test_fix.position_updates == updates);
+            HOST_TEST_CHECK(test_fix.latitude_e7 == 481173000);
+            HOST_TEST_CHECK(test_fix.longitude_e7 == 115166667);
+        }
+        if (host_test_failures != 0)
+        {
+            printf("edge case %s %s\r\n", test_edges[i].coord.lat, test_edges[i].coord.lon);
+            break;
+        }
+    }
+}
+
+static void test_benchmark(void)
+{
+    test_coord_t const coord = { "4807.038", 'N', "01131.000", 'E' };
+    char line[128];
+    char old_lat[32];
+    char old_lon[32];
+    uint32_t len = test_gga(&coord, line);
+    uint64_t start;
+    uint64_t new_cycles;
+    uint64_t old_cycles;
+    uint32_t i;
+
+    start = host_test_cycles();
+    for (i = 0; i < TEST_BENCH_FIXES; i++)
+        nmea_parser_feed(&test_parser, (uint8_t const *)line, len);
+    new_cycles = host_test_cycles() - start;
+
+    start = host_test_cycles();
+    for (i = 0; i < TEST_BENCH_FIXES; i++)
+    {
+        test_old_coord(coord.lat, 2, coord.ns, old_lat);
+        test_old_coord(coord.lon, 3, coord.ew, old_lon);
+        __asm volatile ("" ::: "memory");
+    }
+    old_cycles = host_test_cycles() - start;
+
+    printf("GGA sentence, framing to fix: %.0f cycles; old coordinate conversion alone: %.0f cycles\r\n",
+           (double)new_cycles / TEST_BENCH_FIXES, (double)old_cycles / TEST_BENCH_FIXES);
+}
+
+int main(void)
+{
+    gnss_fix_init(&test_fix);
+    nmea_parser_init(&test_parser, gnss_sentence_callback, &test_fix);
+
+    test_bit_exact(4);
+    test_bit_exact(5);
+    test_out_of_range();
+    test_benchmark();
+
+    return host_test_finish("gnss");
+}
+
+#endif /* SENSORS_BUS_SIM */
@@ -0,0 +1,54 @@
+/*
+ * bsp_api.h
+ *
+ *  Host stand-in for the BSP header, with the Cortex-M4 DSP intrinsics
+ *  that ahrs.c, vibration.c and sound_level.c use written out in C as the
+ *  ARM Architecture Reference Manual defines them. host_test.mk builds
+ *  those modules a second time with -D__ARM_FEATURE_DSP=1 -Ihost_dsp, so
+ *  the DSP paths can be compared with the scalar ones on the host.
+ *  Never on the firmware include path.
+ */
+
+#ifndef HOST_DSP_BSP_API_H_
+#define HOST_DSP_BSP_API_H_
+
+#include <stdint.h>
+
+/* (Ra:0 + Rn * Rm)[63:32] */
+static inline int32_t __SMMLA(int32_t op1, int32_t op2, int32_t op3)
+{
+    uint64_t result = ((uint64_t)(uint32_t)op3 << 32) + (uint64_t)((int64_t)op1 * op2);
+
+    return (int32_t)(uint32_t)(result >> 32);
+}
+
+/* Rn[15:0] * Rm[15:0] + Rn[31:16] * Rm[31:16], wrapping where the core sets Q */
+static inline uint32_t __SMUAD(uint32_t op1, uint32_t op2)
+{
+    int32_t low = (int32_t)(int16_t)op1 * (int16_t)op2;
+    int32_t high = (int32_t)(int16_t)(op1 >> 16) * (int16_t)(op2 >> 16);
+
+    return (uint32_t)low + (uint32_t)high;
+}
+
+/* Ra + Rn[15:0] * Rm[15:0] + Rn[31:16] * Rm[31:16], 64-bit */
+static inline uint64_t __SMLALD(uint32_t op1, uint32_t op2, uint64_t acc)
+{
+    int64_t low = (int32_t)(int16_t)op1 * (int16_t)op2;
+    int64_t high = (int32_t)(int16_t)(op1 >> 16) * (int16_t)(op2 >> 16);
+
+    return acc + (uint64_t)low + (uint64_t)high;
+}
+
+/* Rn[15:0] with (Rm << shift)[31:16] */
+static inline uint32_t __PKHBT(int32_t op1, int32_t op2, uint32_t shift)
+{
+    return ((uint32_t)op1 & 0x0000FFFFUL) | (((uint32_t)op2 << shift) & 0xFFFF0000UL);
+}
+
+static inline uint32_t __CLZ(uint32_t value)
+{
+    return (value == 0U) ? 32U : (uint32_t)__builtin_clz(value);
+}
+
+#endif /* HOST_DSP_BSP_API_H_ */
@@ -0,0 +1,51 @@
+/*
+ * host_test.h
+ *
+ *  Checks and a cycle counter shared by the host programs that
+ *  host_test.mk builds. Host only, never included by the firmware.
+ */
+
+#ifndef HOST_TEST_H_
+#define HOST_TEST_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+static int host_test_failures;
+
+#define HOST_TEST_CHECK(cond)                                                       \
+    do                                                                              \
+    {                                                                               \
+        if (!(cond))                                                                \
+        {                                                                           \
+            printf("FAIL %s:%d: %s\r\n", __FILE__, __LINE__, #cond);                \
+            host_test_failures++;                                                   \
+        }                                                                           \
+    } while (0)
+
+/* TSC cycles on x86, nanoseconds elsewhere; only differences are meaningful */
+static inline uint64_t host_test_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t)now.tv_sec * 1000000000U) + (uint64_t)now.tv_nsec;
+#endif
+}
+
+/* Prints the verdict, returns the exit status */
+static inline int host_test_finish(char const *p_name)
+{
+    printf("%s: %s\r\n", p_name, (host_test_failures == 0) ? "PASS" : "FAIL");
+    return (host_test_failures == 0) ? 0 : 1;
+}
+
+#endif /* HOST_TEST_H_ */
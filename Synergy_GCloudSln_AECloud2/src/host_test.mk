@@ -0,0 +1,114 @@
+# host_test.mk
+#
+#  Host builds of the portable modules against the simulated bus. Not part
+#  of the firmware build:
+#
+#      make -f host_test.mk          build and run every host test
+#      make -f host_test.mk clean
+
+CC      ?= gcc
+CFLAGS  ?= -std=gnu99 -O2 -g -Wall -Wextra
+CFLAGS  += -DSENSORS_BUS_SIM
+LDLIBS  := -lm
+UBSAN   := -fsanitize=undefined -fno-sanitize-recover=undefined
+DSP     := -D__ARM_FEATURE_DSP=1 -Ihost_dsp
+OUT     := host_test
+
+TESTS   := $(OUT)/sensor_sched_sim \
+           $(OUT)/i2c_sim_test \
+           $(OUT)/sensor_bus_replay \
+           $(OUT)/ring_buffer_test \
+           $(OUT)/gnss_test \
+           $(OUT)/geofence_test \
+           $(OUT)/nav_filter_test \
+           $(OUT)/imu_fifo_test \
+           $(OUT)/bme680_loop_sim \
+           $(OUT)/imu_wake_sim \
+           $(OUT)/boot_graph_sim \
+           $(OUT)/ahrs_test \
+           $(OUT)/sensor_agg_test \
+           $(OUT)/report_filter_replay \
+           $(OUT)/sensor_units_test \
+           $(OUT)/mag_cal_test \
+           $(OUT)/vibration_test \
+           $(OUT)/sound_level_test \
+           $(OUT)/als_range_sim
+
+.PHONY: all clean
+all: $(TESTS)
+	@for t in $(TESTS); do echo "== $$t"; ./$$t || exit 1; done
+
+$(OUT):
+	mkdir -p $@
+
+$(OUT)/sensor_sched_sim: sensor_sched_sim.c sensor_sched.c sensor_sched.h | $(OUT)
+	$(CC) $(CFLAGS) -o $@ sensor_sched_sim.c sensor_sched.c
+
+$(OUT)/i2c_sim_test: i2c_sim_test.c i2c_sim.c i2c_sim.h | $(OUT)
+	$(CC) $(CFLAGS) -o $@ i2c_sim_test.c i2c_sim.c
+
+$(OUT)/sensor_bus_replay: sensor_bus_replay.c sensor_bus.c sensor_bus.h i2c_sim.c i2c_sim.h | $(OUT)
+	$(CC) $(CFLAGS) -o $@ sensor_bus_replay.c sensor_bus.c i2c_sim.c
+
+$(OUT)/ring_buffer_test: ring_buffer_test.c ring_buffer.c nmea_parser.c host_test.h ring_buffer.h nmea_parser.h | $(OUT)
+	$(CC) $(CFLAGS) -o $@ ring_buffer_test.c ring_buffer.c nmea_parser.c $(LDLIBS)
+
+$(OUT)/gnss_test: gnss_test.c gnss.c nmea_parser.c host_test.h gnss.h nmea_parser.h | $(OUT)
+	$(CC) $(CFLAGS) $(UBSAN) -o $@ gnss_test.c gnss.c nmea_parser.c $(LDLIBS)
+
+$(OUT)/geofence_test: geofence_test.c geofence.c host_test.h geofence.h | $(OUT)
+	$(CC) $(CFLAGS) -o $@ geofence_test.c geofence.c $(LDLIBS)
+
+$(OUT)/nav_filter_test: nav_filter_test.c nav_filter.c host_test.h nav_filter.h | $(OUT)
+	$(CC) $(CFLAGS) -o $@ nav_filter_test.c nav_filter.c $(LDLIBS)
+
+$(OUT)/imu_fifo_test: imu_fifo_test.c imu_fifo.c i2c_sim.c host_test.h imu_fifo.h i2c_sim.h | $(OUT)
+	$(CC) $(CFLAGS) -o $@ imu_fifo_test.c imu_fifo.c i2c_sim.c $(LDLIBS)
+
+$(OUT)/bme680_loop_sim: bme680_loop_sim.c sensor_bus.c i2c_sim.c host_test.h sensor_bus.h i2c_sim.h | $(OUT)
+	$(CC) $(CFLAGS) -o $@ bme680_loop_sim.c sensor_bus.c i2c_sim.c $(LDLIBS)
+
+$(OUT)/imu_wake_sim: imu_wake_sim.c imu_fifo.c i2c_sim.c host_test.h imu_fifo.h i2c_sim.h | $(OUT)
+	$(CC) $(CFLAGS) -o $@ imu_wake_sim.c imu_fifo.c i2c_sim.c $(LDLIBS)
+
+$(OUT)/boot_graph_sim: boot_graph_sim.c boot_graph.c host_test.h boot_graph.h | $(OUT)
+	$(CC) $(CFLAGS) -o $@ boot_graph_sim.c boot_graph.c $(LDLIBS)
+
+$(OUT)/ahrs_dsp.o: ahrs.c ahrs.h host_dsp/bsp_api.h | $(OUT)
+	$(CC) $(CFLAGS) $(UBSAN) $(DSP) -Dahrs_init=ahrs_dsp_init -Dahrs_update=ahrs_dsp_update \
+	    -Dahrs_get_state=ahrs_dsp_get_state -c -o $@ ahrs.c
+
+$(OUT)/ahrs_test: ahrs_test.c ahrs.c $(OUT)/ahrs_dsp.o host_test.h ahrs.h | $(OUT)
+	$(CC) $(CFLAGS) $(UBSAN) -o $@ ahrs_test.c ahrs.c $(OUT)/ahrs_dsp.o $(LDLIBS)
+
+$(OUT)/sensor_agg_test: sensor_agg_test.c sensor_agg.c host_test.h sensor_agg.h | $(OUT)
+	$(CC) $(CFLAGS) -o $@ sensor_agg_test.c sensor_agg.c $(LDLIBS)
+
+$(OUT)/report_filter_replay: report_filter_replay.c report_filter.c host_test.h report_filter.h | $(OUT)
+	$(CC) $(CFLAGS) -o $@ report_filter_replay.c report_filter.c $(LDLIBS)
+
+$(OUT)/sensor_units_test: sensor_units_test.c sensor_units.c host_test.h sensor_units.h | $(OUT)
+	$(CC) $(CFLAGS) -o $@ sensor_units_test.c sensor_units.c $(LDLIBS)
+
+$(OUT)/mag_cal_test: mag_cal_test.c mag_cal.c host_test.h mag_cal.h | $(OUT)
+	$(CC) $(CFLAGS) -o $@ mag_cal_test.c mag_cal.c $(LDLIBS)
+
+$(OUT)/vibration_dsp.o: vibration.c vibration.h host_dsp/bsp_api.h | $(OUT)
+	$(CC) $(CFLAGS) $(UBSAN) $(DSP) -Dvibration_init=vibration_dsp_init -Dvibration_restart=vibration_dsp_restart \
+	    -Dvibration_add=vibration_dsp_add -Dvibration_process=vibration_dsp_process -c -o $@ vibration.c
+
+$(OUT)/vibration_test: vibration_test.c vibration.c $(OUT)/vibration_dsp.o host_test.h vibration.h | $(OUT)
+	$(CC) $(CFLAGS) $(UBSAN) -o $@ vibration_test.c vibration.c $(OUT)/vibration_dsp.o $(LDLIBS)
+
+$(OUT)/sound_level_dsp.o: sound_level.c sound_level.h host_dsp/bsp_api.h | $(OUT)
+	$(CC) $(CFLAGS) $(UBSAN) $(DSP) -Dsound_level_init=sound_level_dsp_init \
+	    -Dsound_level_process=sound_level_dsp_process -Dsound_level_read=sound_level_dsp_read -c -o $@ sound_level.c
+
+$(OUT)/sound_level_test: sound_level_test.c sound_level.c $(OUT)/sound_level_dsp.o host_test.h sound_level.h | $(OUT)
+	$(CC) $(CFLAGS) $(UBSAN) -o $@ sound_level_test.c sound_level.c $(OUT)/sound_level_dsp.o $(LDLIBS)
+
+$(OUT)/als_range_sim: als_range_sim.c als_range.c i2c_sim.c host_test.h als_range.h i2c_sim.h | $(OUT)
+	$(CC) $(CFLAGS) $(UBSAN) -o $@ als_range_sim.c als_range.c i2c_sim.c $(LDLIBS)
+
+clean:
+	rm -rf $(OUT)
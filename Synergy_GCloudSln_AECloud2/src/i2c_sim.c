@@ -0,0 +1,743 @@
+/*
+ * i2c_sim.c
+ *
+ *  Simulated I2C bus and sensor register models. See i2c_sim.h.
+ */
+
+#include <string.h>
+#include "i2c_sim.h"
+
+#define I2C_SIM_REG_LEN             (256U)
+
+/* BMI160 registers */
+#define BMI160_REG_CHIP_ID          (0x00U)
+#define BMI160_REG_PMU_STATUS       (0x03U)
+#define BMI160_REG_DATA             (0x04U)     /* Mag 0x04, gyro 0x0C, accel 0x12 */
+#define BMI160_REG_SENSORTIME       (0x18U)
+#define BMI160_REG_STATUS           (0x1BU)
+#define BMI160_REG_FIFO_LENGTH      (0x22U)
+#define BMI160_REG_FIFO_DATA        (0x24U)
+#define BMI160_REG_ACC_CONF         (0x40U)
+#define BMI160_REG_GYR_CONF         (0x42U)
+#define BMI160_REG_FIFO_DOWNS       (0x45U)
+#define BMI160_REG_FIFO_CONFIG_1    (0x47U)
+#define BMI160_REG_MAG_IF_0         (0x4BU)
+#define BMI160_REG_MAG_IF_1         (0x4CU)
+#define BMI160_REG_MAG_IF_2         (0x4DU)
+#define BMI160_REG_MAG_IF_3         (0x4EU)
+#define BMI160_REG_MAG_IF_4         (0x4FU)
+#define BMI160_REG_CMD              (0x7EU)
+#define BMI160_CHIP_ID              (0xD1U)
+#define BMI160_FIFO_LEN             (1024U)
+
+/* BMM150 registers */
+#define BMM150_REG_CHIP_ID          (0x40U)
+#define BMM150_REG_DATA             (0x42U)
+#define BMM150_REG_POWER            (0x4BU)
+#define BMM150_REG_OP_MODE          (0x4CU)
+#define BMM150_CHIP_ID              (0x32U)
+
+/* BME680 registers */
+#define BME680_REG_FIELD            (0x1DU)
+#define BME680_REG_GAS_WAIT_0       (0x64U)
+#define BME680_REG_CTRL_GAS_1       (0x71U)
+#define BME680_REG_CTRL_HUM         (0x72U)
+#define BME680_REG_CTRL_MEAS        (0x74U)
+#define BME680_REG_CHIP_ID          (0xD0U)
+#define BME680_REG_RESET            (0xE0U)
+#define BME680_CHIP_ID              (0x61U)
+#define BME680_SOFT_RESET           (0xB6U)
+
+/* ISL29035 registers */
+#define ISL29035_REG_COMMAND_I      (0x00U)
+#define ISL29035_REG_COMMAND_II     (0x01U)
+#define ISL29035_REG_DATA           (0x02U)
+#define ISL29035_REG_ID             (0x0FU)
+#define ISL29035_ID_POWER_UP        (0xA8U)     /* Device ID 0b101, BOUT set */
+
+typedef enum e_sim_dev
+{
+    SIM_DEV_BMI160 = 0,
+    SIM_DEV_BME680,
+    SIM_DEV_ISL29035,
+    SIM_DEV_OTHER,
+    SIM_DEV_COUNT
+} sim_dev_t;
+
+static i2c_sim_config_t sim_config;
+static i2c_sim_inputs_t sim_inputs;
+static uint64_t sim_now_us;
+static i2c_sim_stats_t sim_stats[SIM_DEV_COUNT];
+
+static uint8_t bmi160_regs[I2C_SIM_REG_LEN];
+static uint8_t bmi160_fifo[BMI160_FIFO_LEN];
+static uint32_t bmi160_fifo_count;
+static uint32_t bmi160_fifo_skipped;
+static uint64_t bmi160_fifo_epoch_us;
+static uint64_t bmi160_fifo_frames;
+static uint8_t bmm150_regs[I2C_SIM_REG_LEN];
+static uint8_t bme680_regs[I2C_SIM_REG_LEN];
+static uint8_t bme680_meas_index;
+static uint64_t bme680_done_us;
+static uint8_t isl29035_regs[I2C_SIM_REG_LEN];
+static uint64_t isl29035_done_us;
+
+static void sim_set_le16(uint8_t *p_regs, uint8_t reg, int32_t value)
+{
+    p_regs[reg] = (uint8_t)(value & 0xFF);
+    p_regs[reg + 1U] = (uint8_t)((value >> 8) & 0xFF);
+}
+
+static void sim_account(sim_dev_t dev, uint32_t wire_bytes, uint32_t payload, int is_read)
+{
+    uint32_t us = sim_config.overhead_us
+                  + (uint32_t)((((uint64_t)wire_bytes * 9U * 1000000U) + sim_config.bus_hz - 1U) / sim_config.bus_hz);
+
+    if (is_read)
+        sim_stats[dev].reads++;
+    else
+        sim_stats[dev].writes++;
+    sim_stats[dev].bytes += payload;
+    sim_stats[dev].bus_us += us;
+    sim_now_us += us;
+}
+
+/* BMM150 ------------------------------------------------------------------ */
+
+static void bmm150_reset(void)
+{
+    uint8_t power = bmm150_regs[BMM150_REG_POWER] & 0x01U;
+
+    memset(bmm150_regs, 0, sizeof(bmm150_regs));
+    bmm150_regs[BMM150_REG_POWER] = power;
+    bmm150_regs[BMM150_REG_OP_MODE] = 0x06U;    /* Sleep */
+
+    /* Typical trim values */
+    bmm150_regs[0x5D] = 0;                      /* dig_x1 */
+    bmm150_regs[0x5E] = 0;                      /* dig_y1 */
+    sim_set_le16(bmm150_regs, 0x62, 0);         /* dig_z4 */
+    bmm150_regs[0x64] = 26;                     /* dig_x2 */
+    bmm150_regs[0x65] = 26;                     /* dig_y2 */
+    sim_set_le16(bmm150_regs, 0x68, 763);       /* dig_z2 */
+    sim_set_le16(bmm150_regs, 0x6A, 24747);     /* dig_z1 */
+    sim_set_le16(bmm150_regs, 0x6C, 6994);      /* dig_xyz1 */
+    sim_set_le16(bmm150_regs, 0x6E, 0);         /* dig_z3 */
+    bmm150_regs[0x70] = (uint8_t)-3;            /* dig_xy2 */
+    bmm150_regs[0x71] = 29;                     /* dig_xy1 */
+}
+
+static uint8_t bmm150_read_reg(uint8_t reg)
+{
+    if (reg == BMM150_REG_CHIP_ID)
+        return (bmm150_regs[BMM150_REG_POWER] & 0x01U) ? BMM150_CHIP_ID : 0U;
+
+    if ((reg >= BMM150_REG_DATA) && (reg < (BMM150_REG_DATA + 8U)))
+    {
+        /* 13-bit x/y and 15-bit z left aligned, 14-bit Rhall with data ready */
+        bmm150_regs[0x42] = (uint8_t)((sim_inputs.mag[0] & 0x1F) << 3);
+        bmm150_regs[0x43] = (uint8_t)((sim_inputs.mag[0] >> 5) & 0xFF);
+        bmm150_regs[0x44] = (uint8_t)((sim_inputs.mag[1] & 0x1F) << 3);
+        bmm150_regs[0x45] = (uint8_t)((sim_inputs.mag[1] >> 5) & 0xFF);
+        bmm150_regs[0x46] = (uint8_t)((sim_inputs.mag[2] & 0x7F) << 1);
+        bmm150_regs[0x47] = (uint8_t)((sim_inputs.mag[2] >> 7) & 0xFF);
+        bmm150_regs[0x48] = (uint8_t)(((sim_inputs.rhall & 0x3F) << 2) | 0x01U);
+        bmm150_regs[0x49] = (uint8_t)((sim_inputs.rhall >> 6) & 0xFF);
+    }
+
+    return bmm150_regs[reg];
+}
+
+static void bmm150_write_reg(uint8_t reg, uint8_t value)
+{
+    bmm150_regs[reg] = value;
+
+    if ((reg == BMM150_REG_POWER) && (value & 0x82U))
+        bmm150_reset();
+}
+
+/* BMI160 ------------------------------------------------------------------ */
+
+static uint32_t bmi160_odr_hz(uint8_t conf)
+{
+    uint8_t odr = conf & 0x0FU;
+
+    if (odr == 0U)
+        return 0U;
+
+    return (odr >= 8U) ? (100U << (odr - 8U)) : (100U >> (8U - odr));
+}
+
+/* Header plus the gyro and accel payloads it announces */
+static uint32_t bmi160_frame_len(uint8_t header)
+{
+    return 1U + ((header & 0x08U) ? 6U : 0U) + ((header & 0x04U) ? 6U : 0U);
+}
+
+static void bmi160_fifo_reset(void)
+{
+    bmi160_fifo_count = 0;
+    bmi160_fifo_skipped = 0;
+    bmi160_fifo_epoch_us = sim_now_us;
+    bmi160_fifo_frames = 0;
+}
+
+static void bmi160_reset(void)
+{
+    memset(bmi160_regs, 0, sizeof(bmi160_regs));
+    bmi160_regs[BMI160_REG_CHIP_ID] = BMI160_CHIP_ID;
+    bmi160_regs[BMI160_REG_ACC_CONF] = 0x28U;
+    bmi160_regs[0x41] = 0x03U;
+    bmi160_regs[BMI160_REG_GYR_CONF] = 0x28U;
+    bmi160_regs[BMI160_REG_FIFO_CONFIG_1] = 0x10U;
+    bmi160_regs[BMI160_REG_MAG_IF_0] = (uint8_t)(I2C_SIM_BMM150_AUX_ADDR << 1);
+    bmi160_regs[BMI160_REG_MAG_IF_1] = 0x80U;
+    bmi160_regs[BMI160_REG_MAG_IF_2] = 0x42U;
+    bmi160_regs[BMI160_REG_MAG_IF_3] = 0x4CU;
+    bmi160_fifo_reset();
+}
+
+static uint32_t bmi160_sensortime(void)
+{
+    return (uint32_t)(((sim_now_us * 16U) / 625U) & 0x00FFFFFFU);
+}
+
+/* Queue every frame the FIFO would have collected up to now */
+static void bmi160_fifo_fill(void)
+{
+    uint8_t config = bmi160_regs[BMI160_REG_FIFO_CONFIG_1];
+    uint8_t downs = bmi160_regs[BMI160_REG_FIFO_DOWNS];
+    uint8_t pmu = bmi160_regs[BMI160_REG_PMU_STATUS];
+    uint32_t acc_hz = 0;
+    uint32_t gyr_hz = 0;
+    uint32_t frame_hz;
+    uint64_t target;
+    uint32_t frame_len;
+    uint8_t header;
+    uint8_t *p_frame;
+    uint8_t i;
+
+    if ((config & 0x40U) && ((pmu & 0x30U) == 0x10U))
+        acc_hz = bmi160_odr_hz(bmi160_regs[BMI160_REG_ACC_CONF]) >> ((downs >> 4) & 0x07U);
+    if ((config & 0x80U) && ((pmu & 0x0CU) == 0x04U))
+        gyr_hz = bmi160_odr_hz(bmi160_regs[BMI160_REG_GYR_CONF]) >> (downs & 0x07U);
+
+    frame_hz = (acc_hz > gyr_hz) ? acc_hz : gyr_hz;
+    if (frame_hz == 0U)
+    {
+        bmi160_fifo_reset();
+        return;
+    }
+
+    target = ((sim_now_us - bmi160_fifo_epoch_us) * frame_hz) / 1000000U;
+    for (; bmi160_fifo_frames < target; bmi160_fifo_frames++)
+    {
+        header = 0x80U;
+        if (gyr_hz && ((bmi160_fifo_frames % (frame_hz / gyr_hz)) == 0U))
+            header |= 0x08U;
+        if (acc_hz && ((bmi160_fifo_frames % (frame_hz / acc_hz)) == 0U))
+            header |= 0x04U;
+
+        /* Stream mode: a full FIFO drops its oldest frames */
+        while ((bmi160_fifo_count + 13U) > BMI160_FIFO_LEN)
+        {
+            frame_len = bmi160_frame_len(bmi160_fifo[0]);
+            memmove(bmi160_fifo, &bmi160_fifo[frame_len], bmi160_fifo_count - frame_len);
+            bmi160_fifo_count -= frame_len;
+            if (bmi160_fifo_skipped < 0xFFU)
+                bmi160_fifo_skipped++;
+        }
+
+        p_frame = &bmi160_fifo[bmi160_fifo_count];
+        *p_frame++ = header;
+        if (header & 0x08U)
+        {
+            for (i = 0; i < 3U; i++)
+            {
+                *p_frame++ = (uint8_t)(sim_inputs.gyro[i] & 0xFF);
+                *p_frame++ = (uint8_t)((sim_inputs.gyro[i] >> 8) & 0xFF);
+            }
+        }
+        if (header & 0x04U)
+        {
+            for (i = 0; i < 3U; i++)
+            {
+                *p_frame++ = (uint8_t)(sim_inputs.accel[i] & 0xFF);
+                *p_frame++ = (uint8_t)((sim_inputs.accel[i] >> 8) & 0xFF);
+            }
+        }
+        bmi160_fifo_count = (uint32_t)(p_frame - bmi160_fifo);
+    }
+}
+
+/* FIFO_DATA burst: skip frame, queued frames, sensortime frame, over-read */
+static void bmi160_fifo_read(uint8_t *p_data, uint16_t len)
+{
+    uint32_t pos = 0;
+    uint32_t count;
+    uint32_t consumed;
+    uint32_t frame_len;
+    uint32_t time;
+
+    if (bmi160_fifo_skipped && (len >= 2U))
+    {
+        p_data[pos++] = 0x40U;
+        p_data[pos++] = (uint8_t)bmi160_fifo_skipped;
+        bmi160_fifo_skipped = 0;
+    }
+
+    count = (bmi160_fifo_count < (len - pos)) ? bmi160_fifo_count : (len - pos);
+    memcpy(&p_data[pos], bmi160_fifo, count);
+    pos += count;
+
+    /* Only whole frames leave the FIFO; a partly read one is sent again next time */
+    for (consumed = 0; consumed < count; consumed += frame_len)
+    {
+        frame_len = bmi160_frame_len(bmi160_fifo[consumed]);
+        if ((consumed + frame_len) > count)
+            break;
+    }
+    memmove(bmi160_fifo, &bmi160_fifo[consumed], bmi160_fifo_count - consumed);
+    bmi160_fifo_count -= consumed;
+
+    if ((bmi160_fifo_count == 0U) && (bmi160_regs[BMI160_REG_FIFO_CONFIG_1] & 0x02U) && ((len - pos) >= 4U))
+    {
+        time = bmi160_sensortime();
+        p_data[pos++] = 0x44U;
+        p_data[pos++] = (uint8_t)(time & 0xFF);
+        p_data[pos++] = (uint8_t)((time >> 8) & 0xFF);
+        p_data[pos++] = (uint8_t)((time >> 16) & 0xFF);
+    }
+
+    while (pos < len)
+        p_data[pos++] = 0x80U;
+}
+
+/* Refresh data, sensortime, status and FIFO length before a read */
+static void bmi160_update(void)
+{
+    uint32_t time = bmi160_sensortime();
+    uint8_t aux_addr = bmi160_regs[BMI160_REG_MAG_IF_2];
+    uint8_t i;
+
+    /* Auto mode: the BMI160 polls the BMM150 on its own */
+    if (!(bmi160_regs[BMI160_REG_MAG_IF_1] & 0x80U))
+    {
+        for (i = 0; i < 8U; i++)
+            bmi160_regs[BMI160_REG_DATA + i] = bmm150_read_reg((uint8_t)(aux_addr + i));
+    }
+
+    for (i = 0; i < 3U; i++)
+    {
+        sim_set_le16(bmi160_regs, (uint8_t)(0x0CU + (i * 2U)), sim_inputs.gyro[i]);
+        sim_set_le16(bmi160_regs, (uint8_t)(0x12U + (i * 2U)), sim_inputs.accel[i]);
+    }
+
+    bmi160_regs[BMI160_REG_SENSORTIME] = (uint8_t)(time & 0xFF);
+    bmi160_regs[BMI160_REG_SENSORTIME + 1U] = (uint8_t)((time >> 8) & 0xFF);
+    bmi160_regs[BMI160_REG_SENSORTIME + 2U] = (uint8_t)((time >> 16) & 0xFF);
+    bmi160_regs[BMI160_REG_STATUS] = 0xF0U;     /* drdy acc/gyr/mag, nvm_rdy */
+
+    bmi160_fifo_fill();
+    sim_set_le16(bmi160_regs, BMI160_REG_FIFO_LENGTH, (int32_t)bmi160_fifo_count);
+}
+
+static void bmi160_write_reg(uint8_t reg, uint8_t value)
+{
+    uint8_t burst[] = { 1U, 2U, 6U, 8U };
+    uint8_t len;
+    uint8_t i;
+
+    bmi160_regs[reg] = value;
+
+    switch (reg)
+    {
+        case BMI160_REG_CMD:
+            if (value == 0xB6U)
+            {
+                bmi160_reset();
+            }
+            else if (value == 0xB0U)
+            {
+                bmi160_fifo_fill();
+                bmi160_fifo_reset();
+            }
+            else if ((value & 0xFCU) == 0x10U)
+            {
+                bmi160_regs[BMI160_REG_PMU_STATUS] = (uint8_t)((bmi160_regs[BMI160_REG_PMU_STATUS] & ~0x30U)
+                                                               | ((value & 0x03U) << 4));
+            }
+            else if ((value & 0xFCU) == 0x14U)
+            {
+                bmi160_regs[BMI160_REG_PMU_STATUS] = (uint8_t)((bmi160_regs[BMI160_REG_PMU_STATUS] & ~0x0CU)
+                                                               | ((value & 0x03U) << 2));
+            }
+            else if ((value & 0xFCU) == 0x18U)
+            {
+                bmi160_regs[BMI160_REG_PMU_STATUS] = (uint8_t)((bmi160_regs[BMI160_REG_PMU_STATUS] & ~0x03U)
+                                                               | (value & 0x03U));
+            }
+            break;
+
+        case BMI160_REG_FIFO_CONFIG_1:
+        case BMI160_REG_FIFO_DOWNS:
+        case BMI160_REG_ACC_CONF:
+        case BMI160_REG_GYR_CONF:
+            bmi160_fifo_reset();
+            break;
+
+        /* Manual mode aux access, as issued by bmi160_aux_read()/_write() */
+        case BMI160_REG_MAG_IF_2:
+            if (bmi160_regs[BMI160_REG_MAG_IF_1] & 0x80U)
+            {
+                len = burst[bmi160_regs[BMI160_REG_MAG_IF_1] & 0x03U];
+                for (i = 0; i < len; i++)
+                    bmi160_regs[BMI160_REG_DATA + i] = bmm150_read_reg((uint8_t)(value + i));
+                sim_stats[SIM_DEV_BMI160].aux++;
+            }
+            break;
+
+        case BMI160_REG_MAG_IF_3:
+            if (bmi160_regs[BMI160_REG_MAG_IF_1] & 0x80U)
+            {
+                bmm150_write_reg(value, bmi160_regs[BMI160_REG_MAG_IF_4]);
+                sim_stats[SIM_DEV_BMI160].aux++;
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+/* BME680 ------------------------------------------------------------------ */
+
+static void bme680_reset(void)
+{
+    memset(bme680_regs, 0, sizeof(bme680_regs));
+    bme680_regs[BME680_REG_CHIP_ID] = BME680_CHIP_ID;
+    bme680_done_us = 0;
+
+    /*
+     * Typical calibration block. With it the default inputs compensate to
+     * 25.00 degC, 1013.25 hPa and 40.0 %RH.
+     */
+    sim_set_le16(bme680_regs, 0xE9, 25900);     /* par_t1 */
+    sim_set_le16(bme680_regs, 0x8A, 26400);     /* par_t2 */
+    bme680_regs[0x8C] = 3;                      /* par_t3 */
+    sim_set_le16(bme680_regs, 0x8E, 36500);     /* par_p1 */
+    sim_set_le16(bme680_regs, 0x90, -10400);    /* par_p2 */
+    bme680_regs[0x92] = 88;                     /* par_p3 */
+    sim_set_le16(bme680_regs, 0x94, 6900);      /* par_p4 */
+    sim_set_le16(bme680_regs, 0x96, -100);      /* par_p5 */
+    bme680_regs[0x99] = 30;                     /* par_p6 */
+    bme680_regs[0x98] = 30;                     /* par_p7 */
+    sim_set_le16(bme680_regs, 0x9C, -2500);     /* par_p8 */
+    sim_set_le16(bme680_regs, 0x9E, -2100);     /* par_p9 */
+    bme680_regs[0xA0] = 30;                     /* par_p10 */
+    bme680_regs[0xE3] = 760 >> 4;               /* par_h1 = 760, par_h2 = 1020 */
+    bme680_regs[0xE2] = (uint8_t)(((1020 & 0x0F) << 4) | (760 & 0x0F));
+    bme680_regs[0xE1] = 1020 >> 4;
+    bme680_regs[0xE4] = 0;                      /* par_h3 */
+    bme680_regs[0xE5] = 45;                     /* par_h4 */
+    bme680_regs[0xE6] = 20;                     /* par_h5 */
+    bme680_regs[0xE7] = 120;                    /* par_h6 */
+    bme680_regs[0xE8] = (uint8_t)-100;          /* par_h7 */
+    bme680_regs[0xED] = (uint8_t)-30;           /* par_gh1 */
+    sim_set_le16(bme680_regs, 0xEB, -6000);     /* par_gh2 */
+    bme680_regs[0xEE] = 18;                     /* par_gh3 */
+    bme680_regs[0x00] = 42;                     /* res_heat_val */
+    bme680_regs[0x02] = 0x10;                   /* res_heat_range 1 */
+    bme680_regs[0x04] = 0x00;                   /* range_sw_err */
+}
+
+/* Forced-mode duration as bme680_get_profile_dur() computes it */
+static uint32_t bme680_meas_us(void)
+{
+    static const uint8_t cycles[] = { 0, 1, 2, 4, 8, 16, 16, 16 };
+    static const uint8_t factor[] = { 1, 4, 16, 64 };
+    uint8_t meas = bme680_regs[BME680_REG_CTRL_MEAS];
+    uint8_t wait = bme680_regs[BME680_REG_GAS_WAIT_0];
+    uint32_t us;
+
+    us = ((uint32_t)cycles[(meas >> 5) & 0x07U] + cycles[(meas >> 2) & 0x07U]
+          + cycles[bme680_regs[BME680_REG_CTRL_HUM] & 0x07U]) * 1963U;
+    us += (477U * 9U) + 500U + 1000U;
+    if (bme680_regs[BME680_REG_CTRL_GAS_1] & 0x10U)
+        us += (uint32_t)(wait & 0x3FU) * factor[wait >> 6] * 1000U;
+
+    return us;
+}
+
+/* Finish a conversion whose time has come */
+static void bme680_update(void)
+{
+    uint8_t *p_field = &bme680_regs[BME680_REG_FIELD];
+
+    if ((bme680_done_us == 0U) || (sim_now_us < bme680_done_us))
+        return;
+
+    bme680_done_us = 0;
+    bme680_regs[BME680_REG_CTRL_MEAS] &= (uint8_t)~0x03U;     /* Back to sleep */
+
+    p_field[0] = 0x80U;                                         /* new_data */
+    p_field[1] = bme680_meas_index++;
+    p_field[2] = (uint8_t)(sim_inputs.press_adc >> 12);
+    p_field[3] = (uint8_t)(sim_inputs.press_adc >> 4);
+    p_field[4] = (uint8_t)(sim_inputs.press_adc << 4);
+    p_field[5] = (uint8_t)(sim_inputs.temp_adc >> 12);
+    p_field[6] = (uint8_t)(sim_inputs.temp_adc >> 4);
+    p_field[7] = (uint8_t)(sim_inputs.temp_adc << 4);
+    p_field[8] = (uint8_t)(sim_inputs.hum_adc >> 8);
+    p_field[9] = (uint8_t)(sim_inputs.hum_adc);
+    p_field[13] = (uint8_t)(sim_inputs.gas_adc >> 2);
+    p_field[14] = (uint8_t)(((sim_inputs.gas_adc & 0x03U) << 6) | (sim_inputs.gas_range & 0x0FU));
+    if (bme680_regs[BME680_REG_CTRL_GAS_1] & 0x10U)
+        p_field[14] |= 0x30U;                                   /* gas_valid, heat_stab */
+}
+
+static void bme680_write_reg(uint8_t reg, uint8_t value)
+{
+    if ((reg == BME680_REG_RESET) && (value == BME680_SOFT_RESET))
+    {
+        bme680_reset();
+        return;
+    }
+
+    bme680_regs[reg] = value;
+
+    if ((reg == BME680_REG_CTRL_MEAS) && ((value & 0x03U) == 0x01U))
+    {
+        bme680_regs[BME680_REG_FIELD] = 0x20U;                  /* measuring */
+        bme680_done_us = sim_now_us + bme680_meas_us();
+    }
+}
+
+/* ISL29035 ---------------------------------------------------------------- */
+
+static void isl29035_reset(void)
+{
+    memset(isl29035_regs, 0, sizeof(isl29035_regs));
+    isl29035_regs[ISL29035_REG_ID] = ISL29035_ID_POWER_UP;
+    isl29035_done_us = 0;
+}
+
+/* Integration time of the COMMAND-II resolution: 16, 12, 8 and 4 bits */
+static uint32_t isl29035_conv_us(void)
+{
+    static const uint32_t conv_us[4] = { 105000U, 6500U, 410U, 26U };
+
+    return conv_us[(isl29035_regs[ISL29035_REG_COMMAND_II] >> 2) & 0x03U];
+}
+
+/*
+ * Finish a conversion whose time has come: the input scaled to the range
+ * and resolution set in COMMAND-II, clipped at full scale. ALS once powers
+ * down afterwards, ALS continuous starts the next one.
+ */
+static void isl29035_update(void)
+{
+    static const uint32_t range_lux[4] = { 1000U, 4000U, 16000U, 64000U };
+    uint8_t command_ii = isl29035_regs[ISL29035_REG_COMMAND_II];
+    uint8_t bits = (uint8_t)(16U - (4U * ((command_ii >> 2) & 0x03U)));
+    uint64_t count;
+    uint32_t conv_us;
+
+    if ((isl29035_done_us == 0U) || (sim_now_us < isl29035_done_us))
+        return;
+
+    count = ((uint64_t)sim_inputs.als_mlux << bits) / (range_lux[command_ii & 0x03U] * 1000U);
+    if (count >= (1UL << bits))
+        count = (1UL << bits) - 1U;
+    sim_set_le16(isl29035_regs, ISL29035_REG_DATA, (int32_t)count);
+
+    if ((isl29035_regs[ISL29035_REG_COMMAND_I] & 0xE0U) == 0xA0U)
+    {
+        conv_us = isl29035_conv_us();
+        isl29035_done_us += conv_us * (((sim_now_us - isl29035_done_us) / conv_us) + 1U);
+    }
+    else
+    {
+        isl29035_regs[ISL29035_REG_COMMAND_I] &= 0x1FU;
+        isl29035_done_us = 0;
+    }
+}
+
+static void isl29035_write_reg(uint8_t reg, uint8_t value)
+{
+    isl29035_regs[reg] = value;
+
+    /* ALS once or ALS continuous starts a conversion, other modes stop it */
+    if (reg == ISL29035_REG_COMMAND_I)
+        isl29035_done_us = (((value >> 5) & 0x03U) == 0x01U) ? (sim_now_us + isl29035_conv_us()) : 0U;
+}
+
+/* Bus --------------------------------------------------------------------- */
+
+static sim_dev_t sim_find(uint8_t dev_id)
+{
+    switch (dev_id)
+    {
+        case I2C_SIM_BMI160_ADDR:
+            return SIM_DEV_BMI160;
+        case I2C_SIM_BME680_ADDR:
+            return SIM_DEV_BME680;
+        case I2C_SIM_ISL29035_ADDR:
+            return SIM_DEV_ISL29035;
+        default:
+            return SIM_DEV_OTHER;
+    }
+}
+
+void i2c_sim_init(i2c_sim_config_t const *p_config)
+{
+    i2c_sim_inputs_t inputs =
+    {
+        .accel = { 0, 0, 8192 },        /* 1 g on z at +/-4 g */
+        .gyro = { 0, 0, 0 },
+        .mag = { 200, -100, 400 },
+        .rhall = 6000,
+        .temp_adc = 493816,
+        .press_adc = 346491,
+        .hum_adc = 20065,
+        .gas_adc = 512,
+        .gas_range = 4,
+        .als_mlux = 250000
+    };
+
+    sim_config = *p_config;
+    if (sim_config.bus_hz == 0U)
+        sim_config.bus_hz = 400000U;
+
+    sim_now_us = 0;
+    sim_inputs = inputs;
+    memset(sim_stats, 0, sizeof(sim_stats));
+    memset(bmm150_regs, 0, sizeof(bmm150_regs));
+
+    bmi160_reset();
+    bmm150_reset();
+    bme680_reset();
+    isl29035_reset();
+}
+
+void i2c_sim_set_inputs(i2c_sim_inputs_t const *p_inputs)
+{
+    sim_inputs = *p_inputs;
+}
+
+int8_t i2c_sim_read(uint8_t dev_id, uint8_t reg_addr, uint8_t *p_data, uint16_t len)
+{
+    sim_dev_t dev = sim_find(dev_id);
+    uint16_t i;
+
+    if (dev == SIM_DEV_OTHER)
+    {
+        sim_account(dev, 1U, 0U, 1);
+        return I2C_SIM_E_NAK;
+    }
+
+    /* Address, register, repeated start address, data */
+    sim_account(dev, 3U + len, len, 1);
+
+    switch (dev)
+    {
+        case SIM_DEV_BMI160:
+            bmi160_update();
+            if (reg_addr == BMI160_REG_FIFO_DATA)
+            {
+                bmi160_fifo_read(p_data, len);
+                return I2C_SIM_OK;
+            }
+            for (i = 0; i < len; i++)
+                p_data[i] = bmi160_regs[(uint8_t)(reg_addr + i)];
+            break;
+
+        case SIM_DEV_BME680:
+            bme680_update();
+            for (i = 0; i < len; i++)
+                p_data[i] = bme680_regs[(uint8_t)(reg_addr + i)];
+            break;
+
+        case SIM_DEV_ISL29035:
+            isl29035_update();
+            for (i = 0; i < len; i++)
+                p_data[i] = isl29035_regs[(uint8_t)(reg_addr + i)];
+            break;
+
+        default:
+            break;
+    }
+
+    return I2C_SIM_OK;
+}
+
+/*
+ * BMI160 and ISL29035 writes auto-increment. The BME680 takes the first
+ * byte for reg_addr and then register/value pairs, which is how
+ * bme680_set_regs() lays out a multi-register write.
+ */
+int8_t i2c_sim_write(uint8_t dev_id, uint8_t reg_addr, uint8_t *p_data, uint16_t len)
+{
+    sim_dev_t dev = sim_find(dev_id);
+    uint16_t i;
+
+    if (dev == SIM_DEV_OTHER)
+    {
+        sim_account(dev, 1U, 0U, 0);
+        return I2C_SIM_E_NAK;
+    }
+
+    sim_account(dev, 2U + len, len, 0);
+
+    switch (dev)
+    {
+        case SIM_DEV_BMI160:
+            for (i = 0; i < len; i++)
+                bmi160_write_reg((uint8_t)(reg_addr + i), p_data[i]);
+            break;
+
+        case SIM_DEV_BME680:
+            bme680_update();
+            if (len > 0U)
+                bme680_write_reg(reg_addr, p_data[0]);
+            for (i = 1; (i + 1U) < len; i += 2U)
+                bme680_write_reg(p_data[i], p_data[i + 1U]);
+            break;
+
+        case SIM_DEV_ISL29035:
+            isl29035_update();
+            for (i = 0; i < len; i++)
+                isl29035_write_reg((uint8_t)(reg_addr + i), p_data[i]);
+            break;
+
+        default:
+            break;
+    }
+
+    return I2C_SIM_OK;
+}
+
+void i2c_sim_delay_ms(uint32_t period)
+{
+    sim_now_us += (uint64_t)period * 1000U;
+}
+
+void i2c_sim_advance_us(uint32_t us)
+{
+    sim_now_us += us;
+}
+
+uint64_t i2c_sim_now_us(void)
+{
+    return sim_now_us;
+}
+
+/* Stats for a device address; unknown addresses share one entry */
+void i2c_sim_get_stats(uint8_t dev_id, i2c_sim_stats_t *p_stats)
+{
+    *p_stats = sim_stats[sim_find(dev_id)];
+}
+
+void i2c_sim_reset_stats(void)
+{
+    memset(sim_stats, 0, sizeof(sim_stats));
+}
@@ -0,0 +1,75 @@
+/*
+ * i2c_sim.h
+ *
+ *  Simulated I2C bus for host builds, selected with SENSORS_BUS_SIM (see
+ *  sensor_bus.h).
+ *
+ *  Register-map models of the BMI160 (with the BMM150 behind its aux
+ *  interface), the BME680 and the ISL29035 answer the same transactions the
+ *  Bosch and Intersil drivers issue on the board: chip IDs, soft reset,
+ *  power mode commands, the BMI160 FIFO and aux manual/auto modes, BME680
+ *  forced-mode conversions and the calibration blocks, and ISL29035 ALS
+ *  conversions at the range and resolution set in COMMAND-II. Other
+ *  addresses NAK.
+ *
+ *  Time is virtual. Every transaction advances the clock by the modelled
+ *  bus time (a fixed per-transaction overhead plus 9 bit times per byte
+ *  on the wire), delays advance it by their length, and a test harness can
+ *  advance it with i2c_sim_advance_us(). Each transaction is counted and
+ *  timed per device.
+ */
+
+#ifndef I2C_SIM_H_
+#define I2C_SIM_H_
+
+#include <stdint.h>
+
+#define I2C_SIM_BMI160_ADDR     (0x68U)
+#define I2C_SIM_BME680_ADDR     (0x76U)
+#define I2C_SIM_ISL29035_ADDR   (0x44U)
+#define I2C_SIM_BMM150_AUX_ADDR (0x10U)     /* On the BMI160 aux bus */
+
+#define I2C_SIM_OK              (0)
+#define I2C_SIM_E_NAK           (-2)
+
+typedef struct st_i2c_sim_config
+{
+    uint32_t bus_hz;            /* SCL frequency */
+    uint32_t overhead_us;       /* Driver and interrupt cost per transaction */
+} i2c_sim_config_t;
+
+/* What the models measure, in raw sensor units */
+typedef struct st_i2c_sim_inputs
+{
+    int16_t  accel[3];          /* BMI160 LSB */
+    int16_t  gyro[3];
+    int16_t  mag[3];            /* BMM150 raw: 13-bit x/y, 15-bit z */
+    uint16_t rhall;             /* BMM150 14-bit */
+    uint32_t temp_adc;          /* BME680 20-bit */
+    uint32_t press_adc;         /* BME680 20-bit */
+    uint16_t hum_adc;
+    uint16_t gas_adc;           /* BME680 10-bit */
+    uint8_t  gas_range;
+    uint32_t als_mlux;          /* ISL29035 illuminance, milli-lux; the count follows range and resolution */
+} i2c_sim_inputs_t;
+
+typedef struct st_i2c_sim_stats
+{
+    uint32_t reads;             /* Transactions */
+    uint32_t writes;
+    uint32_t bytes;             /* Payload bytes */
+    uint32_t bus_us;            /* Modelled bus time */
+    uint32_t aux;               /* BMI160 only: BMM150 accesses */
+} i2c_sim_stats_t;
+
+void i2c_sim_init(i2c_sim_config_t const *p_config);
+void i2c_sim_set_inputs(i2c_sim_inputs_t const *p_inputs);
+int8_t i2c_sim_read(uint8_t dev_id, uint8_t reg_addr, uint8_t *p_data, uint16_t len);
+int8_t i2c_sim_write(uint8_t dev_id, uint8_t reg_addr, uint8_t *p_data, uint16_t len);
+void i2c_sim_delay_ms(uint32_t period);
+void i2c_sim_advance_us(uint32_t us);
+uint64_t i2c_sim_now_us(void);
+void i2c_sim_get_stats(uint8_t dev_id, i2c_sim_stats_t *p_stats);
+void i2c_sim_reset_stats(void);
+
+#endif /* I2C_SIM_H_ */
@@ -0,0 +1,133 @@
+/*
+ * i2c_sim_test.c
+ *
+ *  Host regression check of the register models in i2c_sim.c. Built by
+ *  host_test.mk with SENSORS_BUS_SIM; empty in the firmware build.
+ *
+ *  Drives the models with the transactions the drivers issue: chip IDs and
+ *  the NAK of an absent address, the BMI160 FIFO filling for 50 ms, the
+ *  BMM150 ID through aux manual mode, a BME680 forced-mode conversion, and
+ *  the modelled bus time.
+ */
+
+#if defined(SENSORS_BUS_SIM)
+
+#include <stdio.h>
+#include <stdint.h>
+#include "i2c_sim.h"
+
+static int sim_test_failures;
+
+#define SIM_TEST_CHECK(cond)                                                        \
+    do                                                                              \
+    {                                                                               \
+        if (!(cond))                                                                \
+        {                                                                           \
+            printf("FAIL %s:%d: %s\r\n", __FILE__, __LINE__, #cond);                \
+            sim_test_failures++;                                                    \
+        }                                                                           \
+    } while (0)
+
+static void sim_test_write(uint8_t dev_id, uint8_t reg, uint8_t value)
+{
+    SIM_TEST_CHECK(i2c_sim_write(dev_id, reg, &value, 1) == I2C_SIM_OK);
+}
+
+static void sim_test_ids(void)
+{
+    uint8_t id = 0;
+
+    SIM_TEST_CHECK(i2c_sim_read(I2C_SIM_BMI160_ADDR, 0x00, &id, 1) == I2C_SIM_OK);
+    SIM_TEST_CHECK(id == 0xD1U);
+    SIM_TEST_CHECK(i2c_sim_read(I2C_SIM_BME680_ADDR, 0xD0, &id, 1) == I2C_SIM_OK);
+    SIM_TEST_CHECK(id == 0x61U);
+    SIM_TEST_CHECK(i2c_sim_read(I2C_SIM_ISL29035_ADDR, 0x0F, &id, 1) == I2C_SIM_OK);
+    SIM_TEST_CHECK(id == 0xA8U);
+    SIM_TEST_CHECK(i2c_sim_read(0x50, 0x00, &id, 1) == I2C_SIM_E_NAK);
+}
+
+/* Accel and gyro normal mode at 400 Hz, header-mode FIFO with accel, gyro and sensortime */
+static void sim_test_bmi160_fifo(void)
+{
+    uint8_t buf[300];
+    uint16_t len;
+
+    sim_test_write(I2C_SIM_BMI160_ADDR, 0x7E, 0x11);     /* Accel normal */
+    sim_test_write(I2C_SIM_BMI160_ADDR, 0x7E, 0x15);     /* Gyro normal */
+    sim_test_write(I2C_SIM_BMI160_ADDR, 0x40, 0x2A);     /* ACC_CONF 400 Hz */
+    sim_test_write(I2C_SIM_BMI160_ADDR, 0x42, 0x2A);     /* GYR_CONF 400 Hz */
+    sim_test_write(I2C_SIM_BMI160_ADDR, 0x47, 0xD2);     /* FIFO_CONFIG_1 */
+    i2c_sim_delay_ms(50);
+
+    SIM_TEST_CHECK(i2c_sim_read(I2C_SIM_BMI160_ADDR, 0x22, buf, 2) == I2C_SIM_OK);
+    len = (uint16_t)(buf[0] | (buf[1] << 8));
+    SIM_TEST_CHECK(len == (20U * 13U));                    /* 20 frames of header, gyro, accel */
+    if (len > (sizeof(buf) - 4U))
+        return;
+
+    SIM_TEST_CHECK(i2c_sim_read(I2C_SIM_BMI160_ADDR, 0x24, buf, (uint16_t)(len + 4U)) == I2C_SIM_OK);
+    SIM_TEST_CHECK(buf[0] == 0x8CU);                       /* Accel and gyro frame */
+    SIM_TEST_CHECK((int16_t)(buf[11] | (buf[12] << 8)) == 8192);   /* 1 g on z */
+}
+
+/* Power the BMM150 up and read its ID through the BMI160 aux manual mode */
+static void sim_test_bmm150_aux(void)
+{
+    uint8_t id = 0;
+
+    sim_test_write(I2C_SIM_BMI160_ADDR, 0x4C, 0x80);     /* MAG_IF_1: manual mode */
+    sim_test_write(I2C_SIM_BMI160_ADDR, 0x4F, 0x01);     /* MAG_IF_4: data, power on */
+    sim_test_write(I2C_SIM_BMI160_ADDR, 0x4E, 0x4B);     /* MAG_IF_3: write address */
+    sim_test_write(I2C_SIM_BMI160_ADDR, 0x4D, 0x40);     /* MAG_IF_2: read the chip ID */
+    SIM_TEST_CHECK(i2c_sim_read(I2C_SIM_BMI160_ADDR, 0x04, &id, 1) == I2C_SIM_OK);
+    SIM_TEST_CHECK(id == 0x32U);
+}
+
+/* One forced-mode conversion: measuring at once, the default inputs once it is done */
+static void sim_test_bme680_forced(void)
+{
+    uint8_t field[15];
+    uint8_t meas = 0x55U;                               /* osrs_t 2x, osrs_p 4x, forced */
+
+    sim_test_write(I2C_SIM_BME680_ADDR, 0x72, 0x01);     /* osrs_h 1x */
+    SIM_TEST_CHECK(i2c_sim_write(I2C_SIM_BME680_ADDR, 0x74, &meas, 1) == I2C_SIM_OK);
+    SIM_TEST_CHECK(i2c_sim_read(I2C_SIM_BME680_ADDR, 0x1D, field, 1) == I2C_SIM_OK);
+    SIM_TEST_CHECK(field[0] == 0x20U);                     /* measuring */
+
+    i2c_sim_delay_ms(60);
+    SIM_TEST_CHECK(i2c_sim_read(I2C_SIM_BME680_ADDR, 0x1D, field, sizeof(field)) == I2C_SIM_OK);
+    SIM_TEST_CHECK(field[0] == 0x80U);                     /* new_data */
+    SIM_TEST_CHECK((((uint32_t)field[5] << 12) | ((uint32_t)field[6] << 4) | (field[7] >> 4)) == 493816U);
+    SIM_TEST_CHECK((((uint32_t)field[2] << 12) | ((uint32_t)field[3] << 4) | (field[4] >> 4)) == 346491U);
+    SIM_TEST_CHECK((uint16_t)((field[8] << 8) | field[9]) == 20065U);
+}
+
+/* A one-byte register read is 4 bytes on the wire plus the overhead */
+static void sim_test_bus_time(void)
+{
+    i2c_sim_stats_t stats;
+    uint8_t id;
+
+    i2c_sim_reset_stats();
+    i2c_sim_read(I2C_SIM_BME680_ADDR, 0xD0, &id, 1);
+    i2c_sim_get_stats(I2C_SIM_BME680_ADDR, &stats);
+    SIM_TEST_CHECK(stats.reads == 1U);
+    SIM_TEST_CHECK(stats.bus_us == (30U + 90U));
+}
+
+int main(void)
+{
+    i2c_sim_config_t const config = { .bus_hz = 400000U, .overhead_us = 30U };
+
+    i2c_sim_init(&config);
+    sim_test_ids();
+    sim_test_bmi160_fifo();
+    sim_test_bmm150_aux();
+    sim_test_bme680_forced();
+    sim_test_bus_time();
+
+    printf("i2c_sim: %s\r\n", (sim_test_failures == 0) ? "PASS" : "FAIL");
+    return (sim_test_failures == 0) ? 0 : 1;
+}
+
+#endif /* SENSORS_BUS_SIM */
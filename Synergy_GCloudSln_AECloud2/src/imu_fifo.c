@@ -0,0 +1,222 @@
+/*
+ * imu_fifo.c
+ *
+ *  BMI160 FIFO header-mode decoder. See imu_fifo.h.
+ */
+
+#include <string.h>
+#include "imu_fifo.h"
+
+/* Frame headers, BMI160 datasheet section 2.11 */
+#define IMU_FIFO_HDR_MODE_MASK      (0xC0U)
+#define IMU_FIFO_HDR_REGULAR        (0x80U)
+#define IMU_FIFO_HDR_PARM_MAG       (0x10U)
+#define IMU_FIFO_HDR_PARM_GYRO      (0x08U)
+#define IMU_FIFO_HDR_PARM_ACCEL     (0x04U)
+#define IMU_FIFO_HDR_SKIP           (0x40U)
+#define IMU_FIFO_HDR_SENSORTIME     (0x44U)
+#define IMU_FIFO_HDR_INPUT_CONFIG   (0x48U)
+#define IMU_FIFO_HDR_OVER_READ      (0x80U)     /* Read past the fill level */
+
+#define IMU_FIFO_MAG_LEN            (8U)
+#define IMU_FIFO_AXES_LEN           (6U)
+#define IMU_FIFO_SENSORTIME_MASK    (0x00FFFFFFUL)
+#define IMU_FIFO_SENSORTIME_SIGN    (0x00800000UL)
+
+static void imu_fifo_get_axes(uint8_t const *p_data, int16_t *p_axes)
+{
+    p_axes[0] = (int16_t)(((uint16_t)p_data[1] << 8) | p_data[0]);
+    p_axes[1] = (int16_t)(((uint16_t)p_data[3] << 8) | p_data[2]);
+    p_axes[2] = (int16_t)(((uint16_t)p_data[5] << 8) | p_data[4]);
+}
+
+/*
+ * The sensortime frame is taken as the time of the last regular frame
+ * before it. Shift the samples decoded since batch_start onto that clock.
+ */
+static void imu_fifo_set_time(imu_fifo_t *p_fifo, uint32_t sensortime, uint32_t batch_start)
+{
+    uint32_t last = p_fifo->next_time - p_fifo->frame_ticks;
+    uint32_t delta;
+    uint32_t now;
+    uint32_t offset;
+    uint32_t i;
+
+    /*
+     * Extend the 24-bit counter. The previous anchor can be up to a frame
+     * late, so the predicted time may be ahead of the sensor: the difference
+     * is signed.
+     */
+    if (p_fifo->has_time)
+    {
+        delta = (sensortime - last) & IMU_FIFO_SENSORTIME_MASK;
+        if (delta & IMU_FIFO_SENSORTIME_SIGN)
+            delta |= ~IMU_FIFO_SENSORTIME_MASK;
+        now = last + delta;
+    }
+    else
+    {
+        now = sensortime;
+    }
+
+    offset = now - last;
+
+    if ((p_fifo->head - batch_start) > IMU_FIFO_RING_LEN)
+        batch_start = p_fifo->head - IMU_FIFO_RING_LEN;
+
+    for (i = batch_start; i != p_fifo->head; i++)
+        p_fifo->ring[i & (IMU_FIFO_RING_LEN - 1U)].time += offset;
+
+    p_fifo->next_time = now + p_fifo->frame_ticks;
+    p_fifo->has_time = true;
+}
+
+void imu_fifo_init(imu_fifo_t *p_fifo, uint32_t frame_rate_hz)
+{
+    memset(p_fifo, 0, sizeof(*p_fifo));
+    p_fifo->frame_ticks = IMU_FIFO_TICKS_PER_S / frame_rate_hz;
+}
+
+/*
+ * Decode one FIFO read. Returns the number of samples added. Decoding stops
+ * at the over-read marker, at a truncated frame or at an unknown header.
+ */
+uint32_t imu_fifo_decode(imu_fifo_t *p_fifo, uint8_t const *p_data, uint32_t length)
+{
+    uint32_t batch_start = p_fifo->head;
+    uint32_t pos = 0;
+    uint32_t frame_len;
+    uint8_t header;
+    uint8_t const *p_payload;
+    imu_sample_t *p_sample;
+
+    while (pos < length)
+    {
+        header = p_data[pos];
+        p_payload = &p_data[pos + 1U];
+
+        if ((header & IMU_FIFO_HDR_MODE_MASK) == IMU_FIFO_HDR_REGULAR)
+        {
+            if (header == IMU_FIFO_HDR_OVER_READ)
+                break;
+
+            frame_len = 1U;
+            if (header & IMU_FIFO_HDR_PARM_MAG)
+                frame_len += IMU_FIFO_MAG_LEN;
+            if (header & IMU_FIFO_HDR_PARM_GYRO)
+                frame_len += IMU_FIFO_AXES_LEN;
+            if (header & IMU_FIFO_HDR_PARM_ACCEL)
+                frame_len += IMU_FIFO_AXES_LEN;
+
+            if ((pos + frame_len) > length)
+            {
+                p_fifo->stats.partial++;
+                break;
+            }
+
+            /* Data order within a frame is mag, gyro, accel */
+            p_sample = &p_fifo->ring[p_fifo->head & (IMU_FIFO_RING_LEN - 1U)];
+            memset(p_sample, 0, sizeof(*p_sample));
+            p_sample->time = p_fifo->next_time;
+
+            if (header & IMU_FIFO_HDR_PARM_MAG)
+                p_payload += IMU_FIFO_MAG_LEN;
+            if (header & IMU_FIFO_HDR_PARM_GYRO)
+            {
+                imu_fifo_get_axes(p_payload, p_sample->gyro);
+                p_sample->flags |= IMU_SAMPLE_GYRO;
+                p_payload += IMU_FIFO_AXES_LEN;
+            }
+            if (header & IMU_FIFO_HDR_PARM_ACCEL)
+            {
+                imu_fifo_get_axes(p_payload, p_sample->accel);
+                p_sample->flags |= IMU_SAMPLE_ACCEL;
+            }
+
+            p_fifo->head++;
+            p_fifo->next_time += p_fifo->frame_ticks;
+            p_fifo->stats.frames++;
+        }
+        else
+        {
+            switch (header)
+            {
+                case IMU_FIFO_HDR_SKIP:
+                case IMU_FIFO_HDR_INPUT_CONFIG:
+                    frame_len = 2U;
+                    break;
+                case IMU_FIFO_HDR_SENSORTIME:
+                    frame_len = 4U;
+                    break;
+                default:
+                    p_fifo->stats.errors++;
+                    frame_len = 0U;
+                    break;
+            }
+
+            if (frame_len == 0U)
+                break;
+
+            if ((pos + frame_len) > length)
+            {
+                p_fifo->stats.partial++;
+                break;
+            }
+
+            if (header == IMU_FIFO_HDR_SKIP)
+            {
+                p_fifo->next_time += (uint32_t)p_payload[0] * p_fifo->frame_ticks;
+                p_fifo->stats.frames_skipped += p_payload[0];
+            }
+            else if (header == IMU_FIFO_HDR_SENSORTIME)
+            {
+                imu_fifo_set_time(p_fifo, (uint32_t)p_payload[0] | ((uint32_t)p_payload[1] << 8)
+                                          | ((uint32_t)p_payload[2] << 16), batch_start);
+            }
+        }
+
+        pos += frame_len;
+    }
+
+    p_fifo->stats.bytes += pos;
+
+    return p_fifo->head - batch_start;
+}
+
+/*
+ * Copy up to max_samples samples from *p_cursor onwards and advance the
+ * cursor. Returns the number copied.
+ */
+uint32_t imu_fifo_copy(imu_fifo_t const *p_fifo, uint32_t *p_cursor, imu_sample_t *p_samples, uint32_t max_samples)
+{
+    uint32_t available = p_fifo->head - *p_cursor;
+    uint32_t count;
+    uint32_t i;
+
+    if (available > IMU_FIFO_RING_LEN)
+    {
+        *p_cursor = p_fifo->head - IMU_FIFO_RING_LEN;
+        available = IMU_FIFO_RING_LEN;
+    }
+
+    count = (available < max_samples) ? available : max_samples;
+    for (i = 0; i < count; i++)
+        p_samples[i] = p_fifo->ring[(*p_cursor + i) & (IMU_FIFO_RING_LEN - 1U)];
+
+    *p_cursor += count;
+
+    return count;
+}
+
+/*
+ * Copy the newest sample. Returns the number of samples written since init,
+ * so a caller can tell whether anything arrived since it last looked; 0
+ * means the ring is empty and *p_sample is untouched.
+ */
+uint32_t imu_fifo_latest(imu_fifo_t const *p_fifo, imu_sample_t *p_sample)
+{
+    if (p_fifo->head != 0U)
+        *p_sample = p_fifo->ring[(p_fifo->head - 1U) & (IMU_FIFO_RING_LEN - 1U)];
+
+    return p_fifo->head;
+}
@@ -0,0 +1,66 @@
+/*
+ * imu_fifo.h
+ *
+ *  Decoder for BMI160 FIFO data in header mode, feeding a ring of
+ *  timestamped samples.
+ *
+ *  A burst read of the FIFO is passed to imu_fifo_decode(). Regular frames
+ *  become samples spaced one frame period apart; the sensortime frame the
+ *  BMI160 appends once the FIFO is drained anchors the batch to the sensor
+ *  clock, and skip frames (FIFO overflow) advance it. Times are in BMI160
+ *  sensortime ticks of 39.0625 us, extended to 32 bits.
+ *
+ *  The ring has a single writer. Readers keep their own cursor and call
+ *  imu_fifo_copy(); a reader that falls more than IMU_FIFO_RING_LEN samples
+ *  behind skips ahead to the oldest sample still held.
+ */
+
+#ifndef IMU_FIFO_H_
+#define IMU_FIFO_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define IMU_FIFO_RING_LEN       (512U)      /* Power of two */
+#define IMU_FIFO_TICKS_PER_S    (25600U)    /* Sensortime resolution */
+#define IMU_FIFO_TICK_S         (1.0f / 25600.0f)
+
+/* imu_sample_t.flags */
+#define IMU_SAMPLE_ACCEL        (0x01U)
+#define IMU_SAMPLE_GYRO         (0x02U)
+
+typedef struct st_imu_sample
+{
+    uint32_t time;              /* Sensortime ticks */
+    int16_t  accel[3];          /* x, y, z, raw LSB */
+    int16_t  gyro[3];
+    uint8_t  flags;
+} imu_sample_t;
+
+typedef struct st_imu_fifo_stats
+{
+    uint32_t bytes;             /* Bytes decoded */
+    uint32_t frames;            /* Regular frames decoded */
+    uint32_t frames_skipped;    /* Frames dropped by the sensor on overflow */
+    uint32_t partial;           /* Reads that ended inside a frame */
+    uint32_t errors;            /* Unknown frame headers */
+} imu_fifo_stats_t;
+
+typedef struct st_imu_fifo
+{
+    uint32_t         frame_ticks;   /* Sensortime between regular frames */
+    bool             has_time;      /* A sensortime frame has been seen */
+    uint32_t         next_time;     /* Time of the next regular frame */
+
+    imu_sample_t     ring[IMU_FIFO_RING_LEN];
+    uint32_t         head;          /* Samples written since init */
+
+    imu_fifo_stats_t stats;
+} imu_fifo_t;
+
+void imu_fifo_init(imu_fifo_t *p_fifo, uint32_t frame_rate_hz);
+uint32_t imu_fifo_decode(imu_fifo_t *p_fifo, uint8_t const *p_data, uint32_t length);
+uint32_t imu_fifo_copy(imu_fifo_t const *p_fifo, uint32_t *p_cursor, imu_sample_t *p_samples, uint32_t max_samples);
+uint32_t imu_fifo_latest(imu_fifo_t const *p_fifo, imu_sample_t *p_sample);
+
+#endif /* IMU_FIFO_H_ */
@@ -0,0 +1,422 @@
+/*
+ * imu_fifo_test.c
+ *
+ *  Host tests and benchmark of the BMI160 FIFO decoder.
+ *
+ *  Synthetic header-mode reads check sample order and values, the frame
+ *  spacing and the sensortime anchor across the 24-bit wrap, skip frames,
+ *  an anchor behind the predicted frame time, reads cut inside a frame,
+ *  unknown headers and a reader that falls behind the ring. The i2c_sim BMI160 then fills its FIFO the way
+ *  bmi160_Initialize() sets it up (1600/3200 Hz decimated to 400 Hz) and
+ *  the decoded times must stay within a period of the times the model
+ *  produced the frames, also across an overflow. Ends with the bus time of polling every sample against
+ *  draining the FIFO, and the decoder cost per frame.
+ *
+ *  Built by host_test.mk with SENSORS_BUS_SIM; empty in the firmware build.
+ */
+
+#if defined(SENSORS_BUS_SIM)
+
+#include <stdlib.h>
+#include <string.h>
+#include "host_test.h"
+#include "i2c_sim.h"
+#include "imu_fifo.h"
+
+#define TEST_RATE_HZ            (400U)      /* IMU_FIFO_RATE_HZ */
+#define TEST_FRAME_TICKS        (IMU_FIFO_TICKS_PER_S / TEST_RATE_HZ)
+#define TEST_FRAME_LEN          (13U)       /* Header, gyro, accel */
+#define TEST_NO_SKIP            (0xFFFFFFFFUL)
+#define TEST_WAKE_US            (125000U)   /* 50 frames */
+#define TEST_BENCH_READS        (20000U)
+
+static imu_fifo_t test_fifo;
+static imu_sample_t test_samples[IMU_FIFO_RING_LEN];
+static uint8_t test_buf[1100];
+
+static int16_t test_gyro(uint32_t frame, uint32_t axis)
+{
+    return (int16_t)(uint16_t)((frame * 3U) + axis);
+}
+
+static int16_t test_accel(uint32_t frame, uint32_t axis)
+{
+    return (int16_t)(uint16_t)(0U - (frame * 5U) - axis);
+}
+
+static uint32_t test_put_axes(uint32_t pos, int16_t x, int16_t y, int16_t z)
+{
+    test_buf[pos++] = (uint8_t)((uint16_t)x & 0xFFU);
+    test_buf[pos++] = (uint8_t)((uint16_t)x >> 8);
+    test_buf[pos++] = (uint8_t)((uint16_t)y & 0xFFU);
+    test_buf[pos++] = (uint8_t)((uint16_t)y >> 8);
+    test_buf[pos++] = (uint8_t)((uint16_t)z & 0xFFU);
+    test_buf[pos++] = (uint8_t)((uint16_t)z >> 8);
+
+    return pos;
+}
+
+/*
+ * A drained FIFO read: frames numbered from first, a skip frame after frame
+ * skip_after if given, the sensortime frame and an over-read marker.
+ */
+static uint32_t test_build(uint32_t frames, uint32_t first, uint32_t skip_after, uint8_t skipped, uint32_t sensortime)
+{
+    uint32_t pos = 0;
+    uint32_t n;
+    uint32_t i;
+
+    for (i = 0; i < frames; i++)
+    {
+        n = first + i;
+        test_buf[pos++] = 0x8CU;
+        pos = test_put_axes(pos, test_gyro(n, 0), test_gyro(n, 1), test_gyro(n, 2));
+        pos = test_put_axes(pos, test_accel(n, 0), test_accel(n, 1), test_accel(n, 2));
+        if (i == skip_after)
+        {
+            test_buf[pos++] = 0x40U;
+            test_buf[pos++] = skipped;
+        }
+    }
+
+    test_buf[pos++] = 0x44U;
+    test_buf[pos++] = (uint8_t)(sensortime & 0xFFU);
+    test_buf[pos++] = (uint8_t)((sensortime >> 8) & 0xFFU);
+    test_buf[pos++] = (uint8_t)((sensortime >> 16) & 0xFFU);
+    test_buf[pos++] = 0x80U;
+    test_buf[pos++] = 0x00U;
+
+    return pos;
+}
+
+static bool test_sample_is(imu_sample_t const *p_sample, uint32_t frame)
+{
+    return (p_sample->flags == (IMU_SAMPLE_ACCEL | IMU_SAMPLE_GYRO))
+           && (p_sample->gyro[0] == test_gyro(frame, 0)) && (p_sample->gyro[2] == test_gyro(frame, 2))
+           && (p_sample->accel[0] == test_accel(frame, 0)) && (p_sample->accel[2] == test_accel(frame, 2));
+}
+
+/* 2000 reads of 8 to 12 frames, starting just before the 24-bit sensortime wraps */
+static void test_sensortime_wrap(void)
+{
+    uint32_t sensortime = 0x00FFF000UL;
+    uint32_t frame = 0;
+    uint32_t cursor = 0;
+    uint32_t last_time = 0;
+    uint32_t errors = 0;
+    uint32_t frames;
+    uint32_t count;
+    uint32_t read;
+    uint32_t i;
+
+    imu_fifo_init(&test_fifo, TEST_RATE_HZ);
+    for (read = 0; read < 2000U; read++)
+    {
+        frames = 8U + (read % 5U);
+        sensortime = (sensortime + (frames * TEST_FRAME_TICKS)) & 0x00FFFFFFUL;
+
+        if (imu_fifo_decode(&test_fifo, test_buf, test_build(frames, frame, TEST_NO_SKIP, 0, sensortime)) != frames)
+            errors++;
+        count = imu_fifo_copy(&test_fifo, &cursor, test_samples, IMU_FIFO_RING_LEN);
+        if (count != frames)
+        {
+            errors++;
+            continue;
+        }
+
+        for (i = 0; i < count; i++)
+        {
+            if (!test_sample_is(&test_samples[i], frame + i))
+                errors++;
+            if ((read > 0U) && ((test_samples[i].time - last_time) != TEST_FRAME_TICKS))
+                errors++;
+            last_time = test_samples[i].time;
+        }
+        if ((last_time & 0x00FFFFFFUL) != sensortime)
+            errors++;
+        frame += frames;
+    }
+
+    printf("sensortime wrap: %lu frames in 2000 reads, last time 0x%08lX, %lu errors\r\n",
+           (unsigned long)test_fifo.stats.frames, (unsigned long)last_time, (unsigned long)errors);
+    HOST_TEST_CHECK(errors == 0U);
+    HOST_TEST_CHECK(last_time > 0x00FFFFFFUL);          /* Extended past the wrap */
+    HOST_TEST_CHECK(test_fifo.stats.partial == 0U);
+    HOST_TEST_CHECK(test_fifo.stats.errors == 0U);
+}
+
+/* Three frames lost to an overflow after the fifth: a gap of four periods */
+static void test_skip_frame(void)
+{
+    uint32_t cursor = 0;
+    uint32_t count;
+    uint32_t i;
+
+    imu_fifo_init(&test_fifo, TEST_RATE_HZ);
+    count = imu_fifo_decode(&test_fifo, test_buf, test_build(10, 0, 4, 3, 100000U));
+    HOST_TEST_CHECK(count == 10U);
+    HOST_TEST_CHECK(test_fifo.stats.frames_skipped == 3U);
+    HOST_TEST_CHECK(imu_fifo_copy(&test_fifo, &cursor, test_samples, IMU_FIFO_RING_LEN) == 10U);
+
+    for (i = 1; i < 10U; i++)
+        HOST_TEST_CHECK((test_samples[i].time - test_samples[i - 1U].time) == (((i == 5U) ? 4U : 1U) * TEST_FRAME_TICKS));
+    HOST_TEST_CHECK(test_samples[9].time == 100000U);
+}
+
+/*
+ * The first read is stamped up to a period after its last frame, so the
+ * next read's sensortime can be behind the frame times predicted from it.
+ * That is a small step back, not a wrap of the 24-bit counter.
+ */
+static void test_early_anchor(void)
+{
+    uint32_t cursor = 0;
+
+    imu_fifo_init(&test_fifo, TEST_RATE_HZ);
+    (void)imu_fifo_decode(&test_fifo, test_buf, test_build(10, 0, TEST_NO_SKIP, 0, 10000U + 60U));
+    (void)imu_fifo_decode(&test_fifo, test_buf, test_build(10, 10, TEST_NO_SKIP, 0, 10000U + (10U * TEST_FRAME_TICKS) + 5U));
+    HOST_TEST_CHECK(imu_fifo_copy(&test_fifo, &cursor, test_samples, IMU_FIFO_RING_LEN) == 20U);
+    HOST_TEST_CHECK(test_samples[19].time == (10000U + (10U * TEST_FRAME_TICKS) + 5U));
+    HOST_TEST_CHECK((test_samples[10].time - test_samples[9].time) == (TEST_FRAME_TICKS - 55U));
+
+    /* The same after a skip frame that accounts for the frames between */
+    (void)imu_fifo_decode(&test_fifo, test_buf, test_build(4, 20, 0, 6, 10000U + (20U * TEST_FRAME_TICKS) + 1U));
+    HOST_TEST_CHECK(imu_fifo_copy(&test_fifo, &cursor, test_samples, IMU_FIFO_RING_LEN) == 4U);
+    HOST_TEST_CHECK(test_samples[3].time == (10000U + (20U * TEST_FRAME_TICKS) + 1U));
+}
+
+/* A read cut inside a frame keeps the whole frames; the next read re-anchors */
+static void test_truncated(void)
+{
+    uint32_t cursor = 0;
+    uint32_t length;
+    uint32_t count;
+
+    imu_fifo_init(&test_fifo, TEST_RATE_HZ);
+    length = test_build(8, 0, TEST_NO_SKIP, 0, 5000U);
+    count = imu_fifo_decode(&test_fifo, test_buf, length - 10U);
+    HOST_TEST_CHECK(count == 7U);
+    HOST_TEST_CHECK(test_fifo.stats.partial == 1U);
+    HOST_TEST_CHECK(test_fifo.stats.bytes == (7U * TEST_FRAME_LEN));
+
+    /* A sensortime frame cut after its header */
+    length = test_build(4, 8, TEST_NO_SKIP, 0, 5000U + (12U * TEST_FRAME_TICKS));
+    HOST_TEST_CHECK(imu_fifo_decode(&test_fifo, test_buf, (4U * TEST_FRAME_LEN) + 2U) == 4U);
+    HOST_TEST_CHECK(test_fifo.stats.partial == 2U);
+
+    length = test_build(5, 12, TEST_NO_SKIP, 0, 5000U + (17U * TEST_FRAME_TICKS));
+    HOST_TEST_CHECK(imu_fifo_decode(&test_fifo, test_buf, length) == 5U);
+    count = imu_fifo_copy(&test_fifo, &cursor, test_samples, IMU_FIFO_RING_LEN);
+    HOST_TEST_CHECK(count == 16U);
+    HOST_TEST_CHECK(test_sample_is(&test_samples[15], 12U + 4U));
+    HOST_TEST_CHECK(test_samples[15].time == (5000U + (17U * TEST_FRAME_TICKS)));
+}
+
+/* An unknown header ends the read, the frames before it stay */
+static void test_unknown_header(void)
+{
+    uint32_t length;
+
+    imu_fifo_init(&test_fifo, TEST_RATE_HZ);
+    length = test_build(6, 0, TEST_NO_SKIP, 0, 5000U);
+    test_buf[3U * TEST_FRAME_LEN] = 0x50U;
+    HOST_TEST_CHECK(imu_fifo_decode(&test_fifo, test_buf, length) == 3U);
+    HOST_TEST_CHECK(test_fifo.stats.errors == 1U);
+    HOST_TEST_CHECK(test_fifo.stats.bytes == (3U * TEST_FRAME_LEN));
+}
+
+/* A reader more than a ring behind resumes at the oldest sample held */
+static void test_reader_behind(void)
+{
+    imu_sample_t latest;
+    uint32_t cursor = 0;
+    uint32_t read;
+
+    imu_fifo_init(&test_fifo, TEST_RATE_HZ);
+    for (read = 0; read < 60U; read++)
+        (void)imu_fifo_decode(&test_fifo, test_buf,
+                              test_build(10, read * 10U, TEST_NO_SKIP, 0, (read + 1U) * 10U * TEST_FRAME_TICKS));
+
+    HOST_TEST_CHECK(imu_fifo_copy(&test_fifo, &cursor, test_samples, 16) == 16U);
+    HOST_TEST_CHECK(test_sample_is(&test_samples[0], 600U - IMU_FIFO_RING_LEN));
+    HOST_TEST_CHECK(cursor == (600U - IMU_FIFO_RING_LEN + 16U));
+    HOST_TEST_CHECK(imu_fifo_latest(&test_fifo, &latest) == 600U);
+    HOST_TEST_CHECK(test_sample_is(&latest, 599U));
+}
+
+static void test_sim_write(uint8_t reg, uint8_t value)
+{
+    (void)i2c_sim_write(I2C_SIM_BMI160_ADDR, reg, &value, 1);
+}
+
+/* FIFO_LENGTH then FIFO_DATA with room for the sensortime frame, as the nav thread drains it */
+static uint32_t test_sim_drain(void)
+{
+    uint8_t length[2];
+    uint32_t fill;
+
+    (void)i2c_sim_read(I2C_SIM_BMI160_ADDR, 0x22, length, 2);
+    fill = (uint32_t)length[0] | ((uint32_t)(length[1] & 0x07U) << 8);
+    (void)i2c_sim_read(I2C_SIM_BMI160_ADDR, 0x24, test_buf, (uint16_t)(fill + 8U));
+
+    return imu_fifo_decode(&test_fifo, test_buf, fill + 8U);
+}
+
+/*
+ * Decoded times against the times the i2c_sim BMI160 produced its frames:
+ * the last frame of a read is stamped with the sensortime read out with it,
+ * which is at most one period late. The index of a sample counts the
+ * frames the sensor dropped in a skip frame ahead of it.
+ */
+static uint32_t test_sim_check(uint64_t epoch_us, uint32_t *p_cursor)
+{
+    uint32_t errors = 0;
+    uint32_t first = *p_cursor;
+    uint32_t count;
+    uint64_t frame;
+    uint32_t expected;
+    uint32_t i;
+
+    count = imu_fifo_copy(&test_fifo, p_cursor, test_samples, IMU_FIFO_RING_LEN);
+    for (i = 0; i < count; i++)
+    {
+        frame = (uint64_t)first + i + test_fifo.stats.frames_skipped;
+        expected = (uint32_t)(((epoch_us + ((frame + 1U) * (1000000U / TEST_RATE_HZ))) * 16U) / 625U);
+        if ((test_samples[i].time - expected) >= TEST_FRAME_TICKS)
+            errors++;
+        if ((test_samples[i].accel[2] != 8192) || (test_samples[i].gyro[2] != 3))
+            errors++;
+    }
+
+    return (count == 0U) ? 1U : errors;
+}
+
+/*
+ * The i2c_sim FIFO at the firmware settings. The bus is made fast enough
+ * that no frame lands during a drain, so every read ends with a sensortime
+ * frame.
+ */
+static void test_sim_fifo(void)
+{
+    i2c_sim_config_t const config = { .bus_hz = 100000000U, .overhead_us = 0U };
+    i2c_sim_inputs_t const inputs = { .accel = { 10, -20, 8192 }, .gyro = { 1, 2, 3 } };
+    uint64_t epoch_us;
+    uint32_t errors = 0;
+    uint32_t cursor = 0;
+    uint32_t wake;
+
+    i2c_sim_init(&config);
+    i2c_sim_set_inputs(&inputs);
+    imu_fifo_init(&test_fifo, TEST_RATE_HZ);
+
+    test_sim_write(0x7E, 0x11);             /* Accel normal */
+    test_sim_write(0x7E, 0x15);             /* Gyro normal */
+    test_sim_write(0x40, 0x2C);             /* ACC_CONF 1600 Hz */
+    test_sim_write(0x42, 0x2D);             /* GYR_CONF 3200 Hz */
+    test_sim_write(0x45, 0xAB);             /* FIFO_DOWNS, BMI160_FIFO_DOWNS */
+    test_sim_write(0x47, 0xD2);             /* FIFO_CONFIG_1: header, accel, gyro, sensortime */
+    epoch_us = i2c_sim_now_us();
+
+    for (wake = 0; wake < 40U; wake++)
+    {
+        i2c_sim_advance_us(TEST_WAKE_US);
+        (void)test_sim_drain();
+        errors += test_sim_check(epoch_us, &cursor);
+    }
+    HOST_TEST_CHECK(errors == 0U);
+    HOST_TEST_CHECK(test_fifo.stats.frames >= (40U * ((TEST_WAKE_US * TEST_RATE_HZ) / 1000000U)));
+    HOST_TEST_CHECK(test_fifo.stats.frames_skipped == 0U);
+
+    /* A stall long enough to overflow the 1024-byte FIFO: the oldest frames go */
+    i2c_sim_advance_us(400000U);
+    (void)test_sim_drain();
+    HOST_TEST_CHECK(test_fifo.stats.frames_skipped > 0U);
+    HOST_TEST_CHECK(test_sim_check(epoch_us, &cursor) == 0U);
+    HOST_TEST_CHECK(test_fifo.stats.partial == 0U);
+
+    printf("i2c_sim FIFO: %lu frames in 41 reads, %lu skipped on overflow, %lu errors\r\n",
+           (unsigned long)test_fifo.stats.frames, (unsigned long)test_fifo.stats.frames_skipped,
+           (unsigned long)errors);
+}
+
+/* One second at 400 Hz on the simulated bus: a 12-byte data read per sample against FIFO drains */
+static void test_bus_load(void)
+{
+    i2c_sim_config_t const config = { .bus_hz = 400000U, .overhead_us = 30U };
+    i2c_sim_stats_t polled;
+    i2c_sim_stats_t drained;
+    uint8_t data[12];
+    uint32_t i;
+
+    i2c_sim_init(&config);
+    for (i = 0; i < TEST_RATE_HZ; i++)
+    {
+        i2c_sim_advance_us(1000000U / TEST_RATE_HZ);
+        (void)i2c_sim_read(I2C_SIM_BMI160_ADDR, 0x0C, data, sizeof(data));
+    }
+    i2c_sim_get_stats(I2C_SIM_BMI160_ADDR, &polled);
+
+    i2c_sim_init(&config);
+    test_sim_write(0x7E, 0x11);
+    test_sim_write(0x7E, 0x15);
+    test_sim_write(0x40, 0x2C);
+    test_sim_write(0x42, 0x2D);
+    test_sim_write(0x45, 0xAB);
+    test_sim_write(0x47, 0xD2);
+    i2c_sim_reset_stats();
+    imu_fifo_init(&test_fifo, TEST_RATE_HZ);
+    for (i = 0; i < (1000000U / TEST_WAKE_US); i++)
+    {
+        i2c_sim_advance_us(TEST_WAKE_US);
+        (void)test_sim_drain();
+    }
+    i2c_sim_get_stats(I2C_SIM_BMI160_ADDR, &drained);
+
+    printf("400 samples/s: polled %lu reads %lu bus us, FIFO %lu reads %lu bus us\r\n",
+           (unsigned long)polled.reads, (unsigned long)polled.bus_us,
+           (unsigned long)drained.reads, (unsigned long)drained.bus_us);
+
+    /* Frames keep landing while a drain is on the bus, so at least a second's worth */
+    HOST_TEST_CHECK(test_fifo.stats.frames >= TEST_RATE_HZ);
+    HOST_TEST_CHECK(test_fifo.stats.errors == 0U);
+    HOST_TEST_CHECK(drained.reads == (2U * (1000000U / TEST_WAKE_US)));
+    HOST_TEST_CHECK(drained.bus_us < polled.bus_us);
+}
+
+/* A full FIFO of 78 frames per read */
+static void test_benchmark(void)
+{
+    uint32_t length;
+    uint64_t start;
+    uint64_t cycles;
+    uint32_t i;
+
+    imu_fifo_init(&test_fifo, TEST_RATE_HZ);
+    length = test_build(78, 0, TEST_NO_SKIP, 0, 1234U);
+
+    start = host_test_cycles();
+    for (i = 0; i < TEST_BENCH_READS; i++)
+        (void)imu_fifo_decode(&test_fifo, test_buf, length);
+    cycles = host_test_cycles() - start;
+
+    printf("decode: %.1f cycles/frame, %lu bytes/read\r\n",
+           (double)cycles / (TEST_BENCH_READS * 78.0), (unsigned long)length);
+    HOST_TEST_CHECK(test_fifo.stats.frames == (TEST_BENCH_READS * 78U));
+}
+
+int main(void)
+{
+    test_sensortime_wrap();
+    test_skip_frame();
+    test_early_anchor();
+    test_truncated();
+    test_unknown_header();
+    test_reader_behind();
+    test_sim_fifo();
+    test_bus_load();
+    test_benchmark();
+
+    return host_test_finish("imu_fifo");
+}
+
+#endif /* SENSORS_BUS_SIM */
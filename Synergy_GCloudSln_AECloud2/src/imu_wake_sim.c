@@ -0,0 +1,274 @@
+/*
+ * imu_wake_sim.c
+ *
+ *  Host utilization check of the IMU sampling, polled against interrupt
+ *  driven, on the i2c_sim BMI160 with its FIFO set up as
+ *  bmi160_Initialize() does (400 Hz frames).
+ *
+ *  Polled is the nav thread before the INT lines were used: it wakes at
+ *  NAV_RATE_HZ and drains the FIFO, reads the magnetometer every
+ *  NAV_MAG_DIVIDER wakes, and the scheduled BMM150 task reads it again
+ *  every 200 ms. Interrupt driven wakes on the FIFO watermark only; 5 s
+ *  after the device stops, the no-motion interrupt raises the watermark to
+ *  BMI160_FIFO_WATERMARK_STILL and the magnetometer is read on every drain,
+ *  and the any-motion interrupt puts it back. The BMM150 task copies the
+ *  nav thread's reading instead of using the bus.
+ *
+ *  The device moves for 10 s, is still for 20 s and moves again for 10 s,
+ *  so the no-motion interrupt comes at 15 s. Prints wake-ups, bus
+ *  transactions and bus occupancy before, during and after it, and the
+ *  host cycles the thread spends per second. Fails if the interrupt-driven
+ *  sampler loses a frame, or does not cut the wake-ups and bus time while
+ *  still.
+ *
+ *  Built by host_test.mk with SENSORS_BUS_SIM; empty in the firmware build.
+ */
+
+#if defined(SENSORS_BUS_SIM)
+
+#include <string.h>
+#include "host_test.h"
+#include "i2c_sim.h"
+#include "imu_fifo.h"
+
+#define WAKE_SIM_FRAME_US       (2500U)     /* 400 Hz */
+#define WAKE_SIM_NAV_US         (20000U)    /* NAV_RATE_HZ */
+#define WAKE_SIM_MAG_DIVIDER    (10U)       /* NAV_MAG_DIVIDER */
+#define WAKE_SIM_BMM150_US      (200000U)   /* sensors_tasks[] BMM150 period */
+#define WAKE_SIM_WTM_FRAMES     (8U)        /* BMI160_FIFO_WATERMARK, 104 bytes */
+#define WAKE_SIM_STILL_FRAMES   (60U)       /* BMI160_FIFO_WATERMARK_STILL, 768 bytes */
+#define WAKE_SIM_NO_MOTION_US   (5000000U)  /* No-motion interrupt after 5 s still */
+#define WAKE_SIM_STOP_US        (10000000U)
+#define WAKE_SIM_MOVE_US        (30000000U)
+#define WAKE_SIM_RUN_US         (40000000U)
+#define WAKE_SIM_PHASES         (3U)
+
+typedef struct st_wake_sim_phase
+{
+    char const     *name;
+    uint64_t        end_us;
+    uint32_t        wakes;
+    i2c_sim_stats_t bus;
+    uint64_t        cycles;
+} wake_sim_phase_t;
+
+static imu_fifo_t wake_sim_fifo;
+static wake_sim_phase_t wake_sim_base;         /* Counters at the start of the phase */
+static uint8_t wake_sim_buf[1100];
+
+static void wake_sim_write(uint8_t reg, uint8_t value)
+{
+    (void)i2c_sim_write(I2C_SIM_BMI160_ADDR, reg, &value, 1);
+}
+
+static void wake_sim_setup(void)
+{
+    i2c_sim_config_t const config = { .bus_hz = 400000U, .overhead_us = 30U };
+
+    i2c_sim_init(&config);
+    wake_sim_write(0x7E, 0x11);             /* Accel normal */
+    wake_sim_write(0x7E, 0x15);             /* Gyro normal */
+    wake_sim_write(0x40, 0x2C);             /* ACC_CONF 1600 Hz */
+    wake_sim_write(0x42, 0x2D);             /* GYR_CONF 3200 Hz */
+    wake_sim_write(0x45, 0xAB);             /* FIFO_DOWNS */
+    wake_sim_write(0x47, 0xD2);             /* FIFO_CONFIG_1 */
+    wake_sim_write(0x4C, 0x03);             /* Aux auto mode, 8-byte burst */
+    i2c_sim_reset_stats();
+    memset(&wake_sim_base, 0, sizeof(wake_sim_base));
+    imu_fifo_init(&wake_sim_fifo, 1000000U / WAKE_SIM_FRAME_US);
+}
+
+/* bmi160_get_fifo_data(): FIFO_LENGTH, then the fill and the sensortime frame */
+static void wake_sim_drain(void)
+{
+    uint8_t length[2];
+    uint32_t fill;
+
+    (void)i2c_sim_read(I2C_SIM_BMI160_ADDR, 0x22, length, 2);
+    fill = (uint32_t)length[0] | ((uint32_t)(length[1] & 0x07U) << 8);
+    (void)i2c_sim_read(I2C_SIM_BMI160_ADDR, 0x24, wake_sim_buf, (uint16_t)(fill + 4U));
+    (void)imu_fifo_decode(&wake_sim_fifo, wake_sim_buf, fill + 4U);
+}
+
+/* bmm150_read_data(): one auto-mode read of DATA_0..7 */
+static void wake_sim_mag(void)
+{
+    uint8_t data[8];
+
+    (void)i2c_sim_read(I2C_SIM_BMI160_ADDR, 0x04, data, sizeof(data));
+}
+
+static void wake_sim_until(uint64_t time_us)
+{
+    uint64_t now = i2c_sim_now_us();
+
+    if (time_us > now)
+        i2c_sim_advance_us((uint32_t)(time_us - now));
+}
+
+/* Close the phase that ends at the current time, if any */
+static void wake_sim_account(wake_sim_phase_t *p_phases, uint32_t *p_phase, uint32_t wakes, uint64_t cycles)
+{
+    i2c_sim_stats_t bus;
+    wake_sim_phase_t *p_out = &p_phases[*p_phase];
+
+    if (i2c_sim_now_us() < p_out->end_us)
+        return;
+
+    i2c_sim_get_stats(I2C_SIM_BMI160_ADDR, &bus);
+    p_out->wakes = wakes - wake_sim_base.wakes;
+    p_out->cycles = cycles - wake_sim_base.cycles;
+    p_out->bus.reads = bus.reads - wake_sim_base.bus.reads;
+    p_out->bus.writes = bus.writes - wake_sim_base.bus.writes;
+    p_out->bus.bytes = bus.bytes - wake_sim_base.bus.bytes;
+    p_out->bus.bus_us = bus.bus_us - wake_sim_base.bus.bus_us;
+    wake_sim_base.wakes = wakes;
+    wake_sim_base.cycles = cycles;
+    wake_sim_base.bus = bus;
+    (*p_phase)++;
+}
+
+/* Wake every NAV_RATE_HZ period, plus the scheduled BMM150 read */
+static void wake_sim_polled(wake_sim_phase_t *p_phases)
+{
+    uint64_t next_nav = WAKE_SIM_NAV_US;
+    uint64_t next_mag = WAKE_SIM_BMM150_US;
+    uint64_t cycles = 0;
+    uint64_t start;
+    uint32_t wakes = 0;
+    uint32_t phase = 0;
+
+    wake_sim_setup();
+    while (phase < WAKE_SIM_PHASES)
+    {
+        if (next_mag <= next_nav)
+        {
+            wake_sim_until(next_mag);
+            wake_sim_mag();
+            next_mag += WAKE_SIM_BMM150_US;
+        }
+        else
+        {
+            wake_sim_until(next_nav);
+            start = host_test_cycles();
+            wake_sim_drain();
+            if ((wakes % WAKE_SIM_MAG_DIVIDER) == 0U)
+                wake_sim_mag();
+            cycles += host_test_cycles() - start;
+            wakes++;
+            next_nav += WAKE_SIM_NAV_US;
+        }
+        wake_sim_account(p_phases, &phase, wakes, cycles);
+    }
+}
+
+/* Wake on the watermark and on the motion interrupts only */
+static void wake_sim_interrupt(wake_sim_phase_t *p_phases)
+{
+    uint64_t next_irq = WAKE_SIM_WTM_FRAMES * WAKE_SIM_FRAME_US;
+    uint64_t no_motion_at = WAKE_SIM_STOP_US + WAKE_SIM_NO_MOTION_US;
+    uint64_t any_motion_at = WAKE_SIM_MOVE_US;
+    uint64_t cycles = 0;
+    uint64_t start;
+    uint32_t wakes = 0;
+    uint32_t phase = 0;
+    uint32_t drains = 0;
+    bool moving = true;
+    uint8_t status[4];
+
+    wake_sim_setup();
+    while (phase < WAKE_SIM_PHASES)
+    {
+        if ((no_motion_at <= next_irq) || (any_motion_at <= next_irq))
+        {
+            /* INT2: interrupt status tells no-motion from any-motion, then the watermark and a drain */
+            wake_sim_until((no_motion_at < any_motion_at) ? no_motion_at : any_motion_at);
+            start = host_test_cycles();
+            (void)i2c_sim_read(I2C_SIM_BMI160_ADDR, 0x1C, status, sizeof(status));
+            moving = (no_motion_at > any_motion_at);
+            wake_sim_write(0x46, moving ? ((WAKE_SIM_WTM_FRAMES * 13U) / 4U) : 192U);
+            if (moving)
+                any_motion_at = UINT64_MAX;
+            else
+                no_motion_at = UINT64_MAX;
+        }
+        else
+        {
+            wake_sim_until(next_irq);
+            start = host_test_cycles();
+        }
+
+        /* The watermark counts from the drain, so the next interrupt is a batch after it */
+        wake_sim_drain();
+        if (!moving || ((drains++ % WAKE_SIM_MAG_DIVIDER) == 0U))
+            wake_sim_mag();
+        cycles += host_test_cycles() - start;
+        wakes++;
+        next_irq = i2c_sim_now_us()
+                   + ((uint64_t)(moving ? WAKE_SIM_WTM_FRAMES : WAKE_SIM_STILL_FRAMES) * WAKE_SIM_FRAME_US);
+
+        wake_sim_account(p_phases, &phase, wakes, cycles);
+    }
+}
+
+static void wake_sim_print(char const *p_mode, wake_sim_phase_t const *p_phases)
+{
+    uint64_t start_us = 0;
+    double seconds;
+    uint32_t i;
+
+    for (i = 0; i < WAKE_SIM_PHASES; i++)
+    {
+        seconds = (double)(p_phases[i].end_us - start_us) / 1e6;
+        printf("%-9s  %-7s %5.1f wakes/s %6.1f reads/s %5.1f writes/s  bus %5.2f %%  %8.0f cycles/s\r\n",
+               p_mode, p_phases[i].name, p_phases[i].wakes / seconds, p_phases[i].bus.reads / seconds,
+               p_phases[i].bus.writes / seconds, (p_phases[i].bus.bus_us / 1e4) / seconds,
+               (double)p_phases[i].cycles / seconds);
+        start_us = p_phases[i].end_us;
+    }
+}
+
+int main(void)
+{
+    wake_sim_phase_t polled[WAKE_SIM_PHASES] =
+    {
+        { .name = "0-15 s", .end_us = WAKE_SIM_STOP_US + WAKE_SIM_NO_MOTION_US },
+        { .name = "15-30 s", .end_us = WAKE_SIM_MOVE_US },
+        { .name = "30-40 s", .end_us = WAKE_SIM_RUN_US },
+    };
+    wake_sim_phase_t irq[WAKE_SIM_PHASES];
+    uint32_t polled_frames;
+
+    memcpy(irq, polled, sizeof(irq));
+
+    wake_sim_polled(polled);
+    polled_frames = wake_sim_fifo.stats.frames;
+    HOST_TEST_CHECK(wake_sim_fifo.stats.frames_skipped == 0U);
+    wake_sim_print("polled", polled);
+
+    wake_sim_interrupt(irq);
+    HOST_TEST_CHECK(wake_sim_fifo.stats.frames_skipped == 0U);
+    HOST_TEST_CHECK(wake_sim_fifo.stats.errors == 0U);
+    wake_sim_print("interrupt", irq);
+
+    /* Every frame either way, give or take the batch in the FIFO at the end */
+    printf("frames decoded: polled %lu, interrupt %lu\r\n", (unsigned long)polled_frames,
+           (unsigned long)wake_sim_fifo.stats.frames);
+    HOST_TEST_CHECK((wake_sim_fifo.stats.frames + WAKE_SIM_STILL_FRAMES) >= polled_frames);
+
+    /*
+     * About 7 drains a second while still instead of 50, and a fifth of the
+     * transactions. The FIFO payload is the same either way and dominates the
+     * bus time, so that only drops by the per-transaction overhead.
+     */
+    HOST_TEST_CHECK((irq[1].wakes * 5U) < polled[1].wakes);
+    HOST_TEST_CHECK((irq[1].bus.reads * 5U) < polled[1].bus.reads);
+    HOST_TEST_CHECK(irq[1].bus.bus_us < polled[1].bus.bus_us);
+
+    /* While moving it drains as often as polling did, without the scheduled magnetometer reads */
+    HOST_TEST_CHECK(irq[2].bus.reads < polled[2].bus.reads);
+
+    return host_test_finish("imu wake");
+}
+
+#endif /* SENSORS_BUS_SIM */
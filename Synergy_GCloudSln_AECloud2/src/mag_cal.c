@@ -0,0 +1,434 @@
+/*
+ * mag_cal.c
+ *
+ *  Incremental ellipsoid fit for magnetometer calibration. See mag_cal.h.
+ *
+ *  With y the sample about the origin, scaled by MAG_CAL_SCALE, the fit is
+ *  the least-squares solution u of
+ *
+ *    |y|^2 = u0 (x^2 + y^2 - 2z^2) + u1 (x^2 + z^2 - 2y^2)
+ *          + 2 (u2 xy + u3 xz + u4 yz + u5 x + u6 y + u7 z) + u8
+ *
+ *  which is any quadric with its trace fixed, so no sample position is
+ *  degenerate. It is rewritten as (y - c)' A (y - c) = 1, and the soft-iron
+ *  matrix is R * sqrt(A), R the radius of the sphere of equal volume.
+ */
+
+#include <math.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mag_cal.h"
+
+#define MAG_CAL_SCALE           (512.0f)        /* Raw units per fit unit */
+#define MAG_CAL_N               (9U)
+#define MAG_CAL_PACKED(r, c)    ((((r) * ((r) + 1U)) / 2U) + (c))      /* r >= c */
+#define MAG_CAL_JACOBI_SWEEPS   (12U)
+
+static void mag_cal_terms(mag_cal_t const *p_cal, int16_t const raw[3], float d[MAG_CAL_N], float *p_rhs)
+{
+    float x = (float) (raw[0] - p_cal->origin[0]) / MAG_CAL_SCALE;
+    float y = (float) (raw[1] - p_cal->origin[1]) / MAG_CAL_SCALE;
+    float z = (float) (raw[2] - p_cal->origin[2]) / MAG_CAL_SCALE;
+    float xx = x * x;
+    float yy = y * y;
+    float zz = z * z;
+
+    d[0] = (xx + yy) - (2.0f * zz);
+    d[1] = (xx + zz) - (2.0f * yy);
+    d[2] = 2.0f * x * y;
+    d[3] = 2.0f * x * z;
+    d[4] = 2.0f * y * z;
+    d[5] = 2.0f * x;
+    d[6] = 2.0f * y;
+    d[7] = 2.0f * z;
+    d[8] = 1.0f;
+    *p_rhs = xx + yy + zz;
+}
+
+void mag_cal_init(mag_cal_t *p_cal, uint16_t min_step)
+{
+    memset(p_cal, 0, sizeof(*p_cal));
+    p_cal->min_step = min_step;
+}
+
+/* Returns true if the sample was used */
+bool mag_cal_add(mag_cal_t *p_cal, int16_t const raw[3])
+{
+    float d[MAG_CAL_N];
+    float rhs;
+    int32_t dist;
+    int32_t step;
+    uint32_t r;
+    uint32_t c;
+    uint8_t i;
+
+    if (!p_cal->has_origin)
+    {
+        p_cal->has_origin = true;
+        memcpy(p_cal->origin, raw, sizeof(p_cal->origin));
+        memcpy(p_cal->lo, raw, sizeof(p_cal->lo));
+        memcpy(p_cal->hi, raw, sizeof(p_cal->hi));
+    }
+    else
+    {
+        /* Chebyshev distance; a still sensor must not outweigh the rest */
+        dist = 0;
+        for (i = 0; i < 3U; i++)
+        {
+            step = (int32_t) raw[i] - p_cal->last[i];
+            if (step < 0)
+                step = -step;
+            if (step > dist)
+                dist = step;
+        }
+        if (dist < (int32_t) p_cal->min_step)
+            return false;
+    }
+
+    memcpy(p_cal->last, raw, sizeof(p_cal->last));
+    for (i = 0; i < 3U; i++)
+    {
+        if (raw[i] < p_cal->lo[i])
+            p_cal->lo[i] = raw[i];
+        if (raw[i] > p_cal->hi[i])
+            p_cal->hi[i] = raw[i];
+    }
+
+    if (p_cal->count >= (float) MAG_CAL_WINDOW)
+    {
+        for (i = 0; i < 45U; i++)
+            p_cal->ata[i] *= 0.5f;
+        for (i = 0; i < MAG_CAL_N; i++)
+            p_cal->atb[i] *= 0.5f;
+        p_cal->btb *= 0.5f;
+        p_cal->count *= 0.5f;
+    }
+
+    mag_cal_terms(p_cal, raw, d, &rhs);
+    for (r = 0; r < MAG_CAL_N; r++)
+    {
+        for (c = 0; c <= r; c++)
+            p_cal->ata[MAG_CAL_PACKED(r, c)] += d[r] * d[c];
+        p_cal->atb[r] += d[r] * rhs;
+    }
+    p_cal->btb += rhs * rhs;
+    p_cal->count += 1.0f;
+    p_cal->accepted++;
+
+    return true;
+}
+
+/* Solve the normal equations by Cholesky; false if not positive definite */
+static bool mag_cal_cholesky(float const *p_ata, float const *p_atb, float u[MAG_CAL_N])
+{
+    float l[45];
+    float sum;
+    uint32_t r;
+    uint32_t c;
+    uint32_t k;
+
+    for (r = 0; r < MAG_CAL_N; r++)
+    {
+        for (c = 0; c <= r; c++)
+        {
+            sum = p_ata[MAG_CAL_PACKED(r, c)];
+            for (k = 0; k < c; k++)
+                sum -= l[MAG_CAL_PACKED(r, k)] * l[MAG_CAL_PACKED(c, k)];
+
+            if (r == c)
+            {
+                if (sum <= 0.0f)
+                    return false;
+                l[MAG_CAL_PACKED(r, r)] = sqrtf(sum);
+            }
+            else
+            {
+                l[MAG_CAL_PACKED(r, c)] = sum / l[MAG_CAL_PACKED(c, c)];
+            }
+        }
+    }
+
+    /* L z = b, then L' u = z */
+    for (r = 0; r < MAG_CAL_N; r++)
+    {
+        sum = p_atb[r];
+        for (k = 0; k < r; k++)
+            sum -= l[MAG_CAL_PACKED(r, k)] * u[k];
+        u[r] = sum / l[MAG_CAL_PACKED(r, r)];
+    }
+    for (r = MAG_CAL_N; r-- > 0U;)
+    {
+        sum = u[r];
+        for (k = r + 1U; k < MAG_CAL_N; k++)
+            sum -= l[MAG_CAL_PACKED(k, r)] * u[k];
+        u[r] = sum / l[MAG_CAL_PACKED(r, r)];
+    }
+
+    return true;
+}
+
+/* Eigenvalues and eigenvectors (columns of v) of a symmetric 3x3, by Jacobi rotations */
+static void mag_cal_eigen(float a[3][3], float v[3][3])
+{
+    float theta;
+    float t;
+    float c;
+    float s;
+    float tmp;
+    uint8_t sweep;
+    uint8_t p;
+    uint8_t q;
+    uint8_t k;
+
+    memset(v, 0, sizeof(float) * 9U);
+    v[0][0] = 1.0f;
+    v[1][1] = 1.0f;
+    v[2][2] = 1.0f;
+
+    for (sweep = 0; sweep < MAG_CAL_JACOBI_SWEEPS; sweep++)
+    {
+        if ((fabsf(a[0][1]) + fabsf(a[0][2]) + fabsf(a[1][2])) < 1e-9f)
+            break;
+
+        for (p = 0; p < 2U; p++)
+        {
+            for (q = (uint8_t) (p + 1U); q < 3U; q++)
+            {
+                if (a[p][q] == 0.0f)
+                    continue;
+
+                theta = (a[q][q] - a[p][p]) / (2.0f * a[p][q]);
+                t = 1.0f / (fabsf(theta) + sqrtf((theta * theta) + 1.0f));
+                if (theta < 0.0f)
+                    t = -t;
+                c = 1.0f / sqrtf((t * t) + 1.0f);
+                s = t * c;
+
+                for (k = 0; k < 3U; k++)
+                {
+                    tmp = a[k][p];
+                    a[k][p] = (c * tmp) - (s * a[k][q]);
+                    a[k][q] = (s * tmp) + (c * a[k][q]);
+                }
+                for (k = 0; k < 3U; k++)
+                {
+                    tmp = a[p][k];
+                    a[p][k] = (c * tmp) - (s * a[q][k]);
+                    a[q][k] = (s * tmp) + (c * a[q][k]);
+                }
+                for (k = 0; k < 3U; k++)
+                {
+                    tmp = v[k][p];
+                    v[k][p] = (c * tmp) - (s * v[k][q]);
+                    v[k][q] = (s * tmp) + (c * v[k][q]);
+                }
+            }
+        }
+    }
+}
+
+static int16_t mag_cal_sat16(float x)
+{
+    if (x >= 32767.0f)
+        return INT16_MAX;
+    if (x <= -32768.0f)
+        return INT16_MIN;
+    return (int16_t) lrintf(x);
+}
+
+/* Fit the accumulated samples; false, leaving p_params alone, if the fit is not usable */
+bool mag_cal_solve(mag_cal_t const *p_cal, mag_cal_params_t *p_params)
+{
+    mag_cal_params_t params;
+    float u[MAG_CAL_N];
+    float m[3][3];
+    float inv[3][3];
+    float v[3][3];
+    float b[3];
+    float c[3];
+    float lambda[3];
+    float det;
+    float s;
+    float radius;
+    float ratio;
+    float e2;
+    float sum;
+    uint32_t r;
+    uint32_t k;
+    uint8_t i;
+    uint8_t j;
+
+    if ((p_cal->accepted < MAG_CAL_MIN_SAMPLES) || !mag_cal_cholesky(p_cal->ata, p_cal->atb, u))
+        return false;
+
+    /* Quadric y' M y + 2 b' y + k = 0 */
+    m[0][0] = (u[0] + u[1]) - 1.0f;
+    m[1][1] = (u[0] - (2.0f * u[1])) - 1.0f;
+    m[2][2] = (u[1] - (2.0f * u[0])) - 1.0f;
+    m[0][1] = u[2];
+    m[0][2] = u[3];
+    m[1][2] = u[4];
+    m[1][0] = m[0][1];
+    m[2][0] = m[0][2];
+    m[2][1] = m[1][2];
+    b[0] = u[5];
+    b[1] = u[6];
+    b[2] = u[7];
+
+    inv[0][0] = (m[1][1] * m[2][2]) - (m[1][2] * m[2][1]);
+    inv[0][1] = (m[0][2] * m[2][1]) - (m[0][1] * m[2][2]);
+    inv[0][2] = (m[0][1] * m[1][2]) - (m[0][2] * m[1][1]);
+    inv[1][1] = (m[0][0] * m[2][2]) - (m[0][2] * m[2][0]);
+    inv[1][2] = (m[0][2] * m[1][0]) - (m[0][0] * m[1][2]);
+    inv[2][2] = (m[0][0] * m[1][1]) - (m[0][1] * m[1][0]);
+    inv[1][0] = inv[0][1];
+    inv[2][0] = inv[0][2];
+    inv[2][1] = inv[1][2];
+    det = (m[0][0] * inv[0][0]) + (m[0][1] * inv[1][0]) + (m[0][2] * inv[2][0]);
+    if (fabsf(det) < 1e-12f)
+        return false;
+
+    /* Centre c = -M^-1 b, then (y - c)' (M / s) (y - c) = 1 */
+    s = -u[8];
+    for (i = 0; i < 3U; i++)
+    {
+        c[i] = -((inv[i][0] * b[0]) + (inv[i][1] * b[1]) + (inv[i][2] * b[2])) / det;
+        s -= b[i] * c[i];
+    }
+    if (s == 0.0f)
+        return false;
+    for (i = 0; i < 3U; i++)
+        for (j = 0; j < 3U; j++)
+            m[i][j] /= s;
+
+    mag_cal_eigen(m, v);
+    for (i = 0; i < 3U; i++)
+    {
+        lambda[i] = m[i][i];
+        if (lambda[i] <= 0.0f)
+            return false;
+    }
+
+    /* Axis lengths are 1 / sqrt(lambda) */
+    ratio = sqrtf(fmaxf(fmaxf(lambda[0], lambda[1]), lambda[2]) / fminf(fminf(lambda[0], lambda[1]), lambda[2]));
+    if (ratio > MAG_CAL_MAX_RATIO)
+        return false;
+    radius = 1.0f / cbrtf(sqrtf(lambda[0] * lambda[1] * lambda[2]));
+
+    /* Each axis must have seen at least one radius of travel */
+    for (i = 0; i < 3U; i++)
+        if ((float) (p_cal->hi[i] - p_cal->lo[i]) < (radius * MAG_CAL_SCALE))
+            return false;
+
+    /* Residual of |y|^2 is about 2 R times the radial error */
+    e2 = p_cal->btb;
+    for (r = 0; r < MAG_CAL_N; r++)
+    {
+        e2 -= 2.0f * u[r] * p_cal->atb[r];
+        sum = 0.0f;
+        for (k = 0; k < MAG_CAL_N; k++)
+            sum += p_cal->ata[(r >= k) ? MAG_CAL_PACKED(r, k) : MAG_CAL_PACKED(k, r)] * u[k];
+        e2 += u[r] * sum;
+    }
+    e2 = (e2 > 0.0f) ? (e2 / p_cal->count) : 0.0f;
+    sum = (1000.0f * sqrtf(e2)) / (2.0f * radius * radius);
+    if (sum > (float) MAG_CAL_MAX_ERROR)
+        return false;
+
+    memset(&params, 0, sizeof(params));
+    params.magic = MAG_CAL_MAGIC;
+    params.error = (uint16_t) lrintf(sum);
+    params.field = (uint16_t) lrintf(fminf(radius * MAG_CAL_SCALE, 65535.0f));
+    for (i = 0; i < 3U; i++)
+    {
+        params.offset[i] = mag_cal_sat16((float) p_cal->origin[i] + (c[i] * MAG_CAL_SCALE));
+        for (j = 0; j < 3U; j++)
+        {
+            sum = 0.0f;
+            for (k = 0; k < 3U; k++)
+                sum += v[i][k] * sqrtf(lambda[k]) * v[j][k];
+            params.soft[i][j] = mag_cal_sat16(sum * radius * (float) (1L << MAG_CAL_Q));
+        }
+    }
+    mag_cal_seal(&params);
+
+    *p_params = params;
+    return true;
+}
+
+/* out = soft * (raw - offset); identity if p_params is not valid */
+void mag_cal_apply(mag_cal_params_t const *p_params, int16_t const raw[3], int16_t out[3])
+{
+    int32_t d[3];
+    int32_t sum;
+    uint8_t i;
+
+    if (p_params->magic != MAG_CAL_MAGIC)
+    {
+        memcpy(out, raw, sizeof(int16_t) * 3U);
+        return;
+    }
+
+    for (i = 0; i < 3U; i++)
+        d[i] = (int32_t) raw[i] - p_params->offset[i];
+
+    for (i = 0; i < 3U; i++)
+    {
+        sum = (p_params->soft[i][0] * d[0]) + (p_params->soft[i][1] * d[1]) + (p_params->soft[i][2] * d[2]);
+        sum = (sum + (1L << (MAG_CAL_Q - 1))) >> MAG_CAL_Q;
+        out[i] = (sum > INT16_MAX) ? INT16_MAX : ((sum < INT16_MIN) ? INT16_MIN : (int16_t) sum);
+    }
+}
+
+/* FNV-1a over the image before the checksum */
+static uint32_t mag_cal_checksum(mag_cal_params_t const *p_params)
+{
+    uint8_t const *p = (uint8_t const *) p_params;
+    uint32_t hash = 2166136261UL;
+    uint32_t i;
+
+    for (i = 0; i < offsetof(mag_cal_params_t, checksum); i++)
+        hash = (hash ^ p[i]) * 16777619UL;
+
+    return hash;
+}
+
+void mag_cal_seal(mag_cal_params_t *p_params)
+{
+    p_params->checksum = mag_cal_checksum(p_params);
+}
+
+/* An image read back from flash is usable */
+bool mag_cal_valid(mag_cal_params_t const *p_params)
+{
+    return (p_params->magic == MAG_CAL_MAGIC) && (p_params->checksum == mag_cal_checksum(p_params));
+}
+
+/* Largest change between two calibrations, 1/1000 of the field */
+uint32_t mag_cal_difference(mag_cal_params_t const *p_a, mag_cal_params_t const *p_b)
+{
+    uint32_t diff = 0;
+    uint32_t d;
+    uint16_t field = (p_a->field > 0U) ? p_a->field : 1U;
+    uint8_t i;
+    uint8_t j;
+
+    if ((p_a->magic != MAG_CAL_MAGIC) || (p_b->magic != MAG_CAL_MAGIC))
+        return UINT32_MAX;
+
+    for (i = 0; i < 3U; i++)
+    {
+        d = (uint32_t) abs(p_a->offset[i] - p_b->offset[i]) * 1000U / field;
+        if (d > diff)
+            diff = d;
+        for (j = 0; j < 3U; j++)
+        {
+            d = (uint32_t) abs(p_a->soft[i][j] - p_b->soft[i][j]) * 1000U >> MAG_CAL_Q;
+            if (d > diff)
+                diff = d;
+        }
+    }
+
+    return diff;
+}
@@ -0,0 +1,65 @@
+/*
+ * mag_cal.h
+ *
+ *  Hard- and soft-iron magnetometer calibration from streaming samples.
+ *
+ *  Every sample that moved far enough from the last accepted one adds to
+ *  the normal equations of an ellipsoid fit, a fixed 54 multiply-adds;
+ *  nothing else is kept per sample. The sums are halved when they reach
+ *  MAG_CAL_WINDOW samples, so old orientations fade out and a changed
+ *  installation is re-learned. mag_cal_solve() fits the general ellipsoid
+ *  (nine parameters, trace constrained) and checks that the samples cover
+ *  it, that it is close to a sphere and that the residual is small.
+ *
+ *  The result maps a raw sample to a sphere of the same volume: a hard-iron
+ *  offset and a symmetric soft-iron matrix, applied in integer arithmetic.
+ *  mag_cal_params_t is the image kept in internal flash.
+ */
+
+#ifndef MAG_CAL_H_
+#define MAG_CAL_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define MAG_CAL_MAGIC           (0x4D43414CUL)  /* "MCAL" */
+#define MAG_CAL_WINDOW          (1024U)         /* Samples before the sums are halved */
+#define MAG_CAL_MIN_SAMPLES     (64U)
+#define MAG_CAL_MAX_RATIO       (2.0f)          /* Longest over shortest ellipsoid axis */
+#define MAG_CAL_MAX_ERROR       (50U)           /* RMS residual, 1/1000 of the field */
+#define MAG_CAL_Q               (14)            /* Soft-iron matrix fraction bits */
+
+typedef struct st_mag_cal_params
+{
+    uint32_t magic;             /* MAG_CAL_MAGIC when valid */
+    int16_t  offset[3];         /* Hard iron, raw units */
+    int16_t  soft[3][3];        /* Soft iron, Q14 */
+    uint16_t field;             /* Sphere radius after correction, raw units */
+    uint16_t error;             /* RMS fit residual, 1/1000 of the field */
+    uint32_t checksum;          /* Over everything above */
+} mag_cal_params_t;
+
+typedef struct st_mag_cal
+{
+    uint16_t min_step;          /* Distance from the last accepted sample, raw units */
+    bool     has_origin;
+    int16_t  origin[3];         /* First sample; sums are about it */
+    int16_t  last[3];
+    int16_t  lo[3];             /* Extent of the accepted samples */
+    int16_t  hi[3];
+    float    ata[45];           /* Normal matrix, packed lower triangle */
+    float    atb[9];
+    float    btb;
+    float    count;             /* Weight of the sums */
+    uint32_t accepted;
+} mag_cal_t;
+
+void mag_cal_init(mag_cal_t *p_cal, uint16_t min_step);
+bool mag_cal_add(mag_cal_t *p_cal, int16_t const raw[3]);
+bool mag_cal_solve(mag_cal_t const *p_cal, mag_cal_params_t *p_params);
+void mag_cal_apply(mag_cal_params_t const *p_params, int16_t const raw[3], int16_t out[3]);
+bool mag_cal_valid(mag_cal_params_t const *p_params);
+void mag_cal_seal(mag_cal_params_t *p_params);
+uint32_t mag_cal_difference(mag_cal_params_t const *p_a, mag_cal_params_t const *p_b);
+
+#endif /* MAG_CAL_H_ */
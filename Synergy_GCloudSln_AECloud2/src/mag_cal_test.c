@@ -0,0 +1,333 @@
+/*
+ * mag_cal_test.c
+ *
+ *  Host check of the magnetometer calibration on synthetic samples: a
+ *  field of known strength seen from random orientations through a known
+ *  soft-iron matrix and hard-iron offset, with noise. Each fit must find
+ *  the offset to a raw unit, map the field onto a sphere and bring the
+ *  heading of a level device within half a degree. Soft iron beyond
+ *  MAG_CAL_MAX_RATIO and a device turned only about one axis must give no
+ *  fit. A changed installation must be re-learned within 10000 samples,
+ *  and a flash image with a flipped bit must be rejected.
+ *
+ *  Ends with the cost of adding a sample, solving and applying.
+ *
+ *  Built by host_test.mk with SENSORS_BUS_SIM; empty in the firmware build.
+ */
+
+#if defined(SENSORS_BUS_SIM)
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "host_test.h"
+#include "mag_cal.h"
+
+#define TEST_DIP_Z              (-0.866)    /* Field 60 degrees below the horizon */
+#define TEST_EVAL_SAMPLES       (20000U)
+#define TEST_BENCH_SAMPLES      (1000000U)
+#define TEST_BENCH_SOLVES       (10000U)
+
+typedef enum e_test_motion
+{
+    TEST_MOTION_RANDOM = 0,     /* Tumbled through every orientation */
+    TEST_MOTION_YAW,            /* Level, turning about the vertical only */
+    TEST_MOTION_THEN_STILL      /* Tumbled, then left on a desk */
+} test_motion_t;
+
+typedef struct st_test_install
+{
+    char const   *name;
+    double        soft[3][3];
+    double        hard[3];
+    double        field;        /* Raw units */
+    double        noise;        /* Raw units, per axis */
+    uint32_t      samples;
+    test_motion_t motion;
+    bool          fits;
+} test_install_t;
+
+/* Standard normal, Box-Muller */
+static double test_gauss(void)
+{
+    double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+    double v = (rand() + 1.0) / (RAND_MAX + 2.0);
+
+    return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+/* Uniform on the unit sphere */
+static void test_direction(double dir[3])
+{
+    double z = ((2.0 * rand()) / RAND_MAX) - 1.0;
+    double t = (2.0 * M_PI * rand()) / RAND_MAX;
+    double r = sqrt(1.0 - (z * z));
+
+    dir[0] = r * cos(t);
+    dir[1] = r * sin(t);
+    dir[2] = z;
+}
+
+/* raw = soft * field * dir + hard + noise */
+static void test_raw(test_install_t const *p_install, double const dir[3], double noise, int16_t raw[3])
+{
+    double m;
+    uint32_t i;
+    uint32_t j;
+
+    for (i = 0; i < 3U; i++)
+    {
+        m = p_install->hard[i] + (noise * test_gauss());
+        for (j = 0; j < 3U; j++)
+            m += p_install->soft[i][j] * dir[j] * p_install->field;
+        raw[i] = (int16_t)lround(m);
+    }
+}
+
+static void test_feed(mag_cal_t *p_cal, test_install_t const *p_install)
+{
+    double dir[3];
+    double yaw = 0.0;
+    int16_t raw[3];
+    uint32_t k;
+
+    for (k = 0; k < p_install->samples; k++)
+    {
+        if ((p_install->motion == TEST_MOTION_YAW)
+            || ((p_install->motion == TEST_MOTION_THEN_STILL) && (k >= (p_install->samples / 2U))))
+        {
+            yaw += (p_install->motion == TEST_MOTION_YAW) ? 0.05 : 0.0;
+            dir[0] = 0.5 * cos(yaw);
+            dir[1] = 0.5 * sin(yaw);
+            dir[2] = TEST_DIP_Z;
+        }
+        else
+        {
+            test_direction(dir);
+        }
+        test_raw(p_install, dir, p_install->noise, raw);
+        (void)mag_cal_add(p_cal, raw);
+    }
+}
+
+/* Largest heading error of a level device turned through a full circle, degrees */
+static double test_heading_error(mag_cal_params_t const *p_params, test_install_t const *p_install)
+{
+    double dir[3];
+    double a;
+    double err;
+    double worst = 0.0;
+    int16_t raw[3];
+    int16_t out[3];
+    uint32_t k;
+
+    for (k = 0; k < 360U; k++)
+    {
+        a = k * M_PI / 180.0;
+        dir[0] = 0.5 * cos(a);
+        dir[1] = -0.5 * sin(a);
+        dir[2] = TEST_DIP_Z;
+        test_raw(p_install, dir, 0.0, raw);
+        if (p_params != NULL)
+            mag_cal_apply(p_params, raw, out);
+        else
+            memcpy(out, raw, sizeof(out));
+
+        err = fabs(remainder(atan2(out[1], out[0]) - atan2(dir[1], dir[0]), 2.0 * M_PI)) * 180.0 / M_PI;
+        worst = fmax(worst, err);
+    }
+
+    return worst;
+}
+
+static void test_install(test_install_t const *p_install, mag_cal_params_t *p_params)
+{
+    mag_cal_t cal;
+    double dir[3];
+    double magnitude;
+    double sum = 0.0;
+    double sum_sq = 0.0;
+    double mean;
+    double spread;
+    double offset_err = 0.0;
+    int16_t raw[3];
+    int16_t out[3];
+    bool fits;
+    uint32_t k;
+    uint32_t i;
+
+    mag_cal_init(&cal, (uint16_t)(p_install->field * 0.04));
+    test_feed(&cal, p_install);
+    fits = mag_cal_solve(&cal, p_params);
+    HOST_TEST_CHECK(fits == p_install->fits);
+    if (!fits)
+    {
+        printf("%-34s no fit, %lu samples accepted\r\n", p_install->name, (unsigned long)cal.accepted);
+        return;
+    }
+
+    for (k = 0; k < TEST_EVAL_SAMPLES; k++)
+    {
+        test_direction(dir);
+        test_raw(p_install, dir, 0.0, raw);
+        mag_cal_apply(p_params, raw, out);
+        magnitude = sqrt(((double)out[0] * out[0]) + ((double)out[1] * out[1]) + ((double)out[2] * out[2]));
+        sum += magnitude;
+        sum_sq += magnitude * magnitude;
+    }
+    mean = sum / TEST_EVAL_SAMPLES;
+    spread = sqrt((sum_sq / TEST_EVAL_SAMPLES) - (mean * mean)) / mean;
+    for (i = 0; i < 3U; i++)
+        offset_err = fmax(offset_err, fabs(p_params->offset[i] - p_install->hard[i]));
+
+    printf("%-34s offset %.0f LSB, |m| spread %.2f %%, heading %5.1f -> %.2f deg, fit %u/1000\r\n",
+           p_install->name, offset_err, 100.0 * spread, test_heading_error(NULL, p_install),
+           test_heading_error(p_params, p_install), p_params->error);
+
+    HOST_TEST_CHECK(offset_err <= 1.0);
+    HOST_TEST_CHECK(spread < 0.002);
+    HOST_TEST_CHECK(test_heading_error(p_params, p_install) < 0.5);
+    HOST_TEST_CHECK(p_params->error <= MAG_CAL_MAX_ERROR);
+}
+
+/*
+ * Moved to a new mount: the old sums halve every MAG_CAL_WINDOW / 2 samples,
+ * and with the offsets a third of the field apart the old weight has to
+ * fall well below 1 % before the fit passes again.
+ */
+static void test_relearn(test_install_t const *p_before, test_install_t const *p_after)
+{
+    mag_cal_t cal;
+    mag_cal_params_t before;
+    mag_cal_params_t after;
+    double offset_err = 0.0;
+    uint32_t i;
+
+    mag_cal_init(&cal, (uint16_t)(p_before->field * 0.04));
+    test_feed(&cal, p_before);
+    HOST_TEST_CHECK(mag_cal_solve(&cal, &before));
+    test_feed(&cal, p_after);
+    HOST_TEST_CHECK(mag_cal_solve(&cal, &after));
+
+    for (i = 0; i < 3U; i++)
+        offset_err = fmax(offset_err, fabs(after.offset[i] - p_after->hard[i]));
+    printf("re-learned after a new mount: moved %lu/1000, offset %.0f LSB from the new one\r\n",
+           (unsigned long)mag_cal_difference(&before, &after), offset_err);
+    HOST_TEST_CHECK(mag_cal_difference(&before, &after) > 20U);
+    HOST_TEST_CHECK(offset_err <= (p_after->field * 0.02));
+}
+
+static void test_image(mag_cal_params_t const *p_params)
+{
+    mag_cal_params_t image = *p_params;
+
+    mag_cal_seal(&image);
+    HOST_TEST_CHECK(mag_cal_valid(&image));
+    HOST_TEST_CHECK(mag_cal_difference(&image, p_params) == 0U);
+
+    image.soft[1][2] ^= 0x0001;
+    HOST_TEST_CHECK(!mag_cal_valid(&image));
+
+    image = *p_params;
+    mag_cal_seal(&image);
+    image.magic = 0U;
+    HOST_TEST_CHECK(!mag_cal_valid(&image));
+    HOST_TEST_CHECK(mag_cal_difference(&image, p_params) == UINT32_MAX);
+}
+
+static void test_benchmark(mag_cal_params_t const *p_params)
+{
+    static int16_t samples[4096][3];
+    test_install_t const install =
+    {
+        .soft = { { 1.0, 0.0, 0.0 }, { 0.0, 1.0, 0.0 }, { 0.0, 0.0, 1.0 } },
+        .hard = { 350.0, 0.0, 0.0 },
+        .field = 800.0,
+    };
+    mag_cal_t cal;
+    mag_cal_params_t params;
+    volatile int32_t sink = 0;
+    double dir[3];
+    int16_t out[3];
+    uint64_t start;
+    uint64_t add_cycles;
+    uint64_t solve_cycles;
+    uint64_t apply_cycles;
+    uint32_t k;
+
+    for (k = 0; k < 4096U; k++)
+    {
+        test_direction(dir);
+        test_raw(&install, dir, 0.0, samples[k]);
+    }
+
+    mag_cal_init(&cal, 30U);
+    start = host_test_cycles();
+    for (k = 0; k < TEST_BENCH_SAMPLES; k++)
+        (void)mag_cal_add(&cal, samples[k & 4095U]);
+    add_cycles = host_test_cycles() - start;
+
+    start = host_test_cycles();
+    for (k = 0; k < TEST_BENCH_SOLVES; k++)
+        (void)mag_cal_solve(&cal, &params);
+    solve_cycles = host_test_cycles() - start;
+
+    start = host_test_cycles();
+    for (k = 0; k < TEST_BENCH_SAMPLES; k++)
+    {
+        mag_cal_apply(p_params, samples[k & 4095U], out);
+        sink += out[0];
+    }
+    apply_cycles = host_test_cycles() - start;
+
+    printf("%.0f cycles/add, %.0f cycles/solve, %.0f cycles/apply\r\n", (double)add_cycles / TEST_BENCH_SAMPLES,
+           (double)solve_cycles / TEST_BENCH_SOLVES, (double)apply_cycles / TEST_BENCH_SAMPLES);
+}
+
+int main(void)
+{
+    static test_install_t const installs[] =
+    {
+        { "clean sphere", { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } }, { 0, 0, 0 }, 800, 0, 3000,
+          TEST_MOTION_RANDOM, true },
+        { "hard iron", { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } }, { 350, -220, 610 }, 800, 3, 3000,
+          TEST_MOTION_RANDOM, true },
+        { "hard and soft iron", { { 1.15, 0.08, -0.05 }, { 0.08, 0.9, 0.06 }, { -0.05, 0.06, 1.02 } },
+          { 350, -220, 610 }, 800, 3, 3000, TEST_MOTION_RANDOM, true },
+        { "soft iron ratio 1.74, big offset", { { 1.3, 0.15, 0 }, { 0.15, 0.85, 0.1 }, { 0, 0.1, 1.1 } },
+          { -900, 1200, -400 }, 600, 3, 3000, TEST_MOTION_RANDOM, true },
+        { "soft iron ratio 2.04", { { 1.4, 0.2, 0 }, { 0.2, 0.8, 0.1 }, { 0, 0.1, 1.1 } },
+          { -900, 1200, -400 }, 600, 3, 3000, TEST_MOTION_RANDOM, false },
+        { "noise sigma 15", { { 1.15, 0.08, -0.05 }, { 0.08, 0.9, 0.06 }, { -0.05, 0.06, 1.02 } },
+          { 350, -220, 610 }, 800, 15, 3000, TEST_MOTION_RANDOM, true },
+        { "weak field, 400 LSB", { { 1.15, 0.08, -0.05 }, { 0.08, 0.9, 0.06 }, { -0.05, 0.06, 1.02 } },
+          { 350, -220, 610 }, 400, 3, 3000, TEST_MOTION_RANDOM, true },
+        { "turned about the vertical only", { { 1.15, 0.08, -0.05 }, { 0.08, 0.9, 0.06 }, { -0.05, 0.06, 1.02 } },
+          { 350, -220, 610 }, 800, 3, 3000, TEST_MOTION_YAW, false },
+        { "tumbled, then still", { { 1.15, 0.08, -0.05 }, { 0.08, 0.9, 0.06 }, { -0.05, 0.06, 1.02 } },
+          { 350, -220, 610 }, 800, 3, 20000, TEST_MOTION_THEN_STILL, true },
+        { "100k samples", { { 1.15, 0.08, -0.05 }, { 0.08, 0.9, 0.06 }, { -0.05, 0.06, 1.02 } },
+          { 350, -220, 610 }, 800, 3, 100000, TEST_MOTION_RANDOM, true },
+    };
+    test_install_t moved = installs[3];
+    mag_cal_params_t params;
+    mag_cal_params_t fitted;
+    uint32_t i;
+
+    srand(5);
+    for (i = 0; i < (sizeof(installs) / sizeof(installs[0])); i++)
+    {
+        test_install(&installs[i], &params);
+        if (i == 2U)
+            fitted = params;
+    }
+
+    moved.samples = 10000U;
+    test_relearn(&installs[2], &moved);
+    test_image(&fitted);
+    test_benchmark(&fitted);
+
+    return host_test_finish("mag_cal");
+}
+
+#endif /* SENSORS_BUS_SIM */
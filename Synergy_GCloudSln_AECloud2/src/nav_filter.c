@@ -0,0 +1,203 @@
+/*
+ * nav_filter.c
+ *
+ *  Single-precision GPS/IMU Kalman filter. See nav_filter.h.
+ */
+
+#include <math.h>
+#include <string.h>
+#include "nav_filter.h"
+
+#define NAV_M_PER_E7_LAT    (0.0111319491f)     /* Metres per 1e-7 degree of latitude */
+#define NAV_E7_TO_RAD       (1.745329252e-9f)
+#define NAV_PI              (3.14159265f)
+#define NAV_INIT_VEL_VAR    (100.0f)            /* (10 m/s)^2 before the first velocity */
+#define NAV_INIT_BIAS_VAR   (0.0025f)           /* (0.05 rad/s)^2 */
+
+static float nav_wrap_pi(float angle)
+{
+    while (angle >= NAV_PI)
+        angle -= 2.0f * NAV_PI;
+    while (angle < -NAV_PI)
+        angle += 2.0f * NAV_PI;
+
+    return angle;
+}
+
+/* Constant-acceleration step, Q from white acceleration noise q = sigma^2 */
+static void nav_axis_predict(nav_axis_t *p_axis, float accel, float dt, float q)
+{
+    float dt2 = dt * dt;
+
+    p_axis->pos += (p_axis->vel * dt) + (0.5f * accel * dt2);
+    p_axis->vel += accel * dt;
+
+    p_axis->p00 += (2.0f * dt * p_axis->p01) + (dt2 * p_axis->p11) + (0.25f * q * dt2 * dt2);
+    p_axis->p01 += (dt * p_axis->p11) + (0.5f * q * dt2 * dt);
+    p_axis->p11 += q * dt2;
+}
+
+static void nav_axis_update_pos(nav_axis_t *p_axis, float z, float r)
+{
+    float s = p_axis->p00 + r;
+    float k0 = p_axis->p00 / s;
+    float k1 = p_axis->p01 / s;
+    float y = z - p_axis->pos;
+
+    p_axis->pos += k0 * y;
+    p_axis->vel += k1 * y;
+    p_axis->p11 -= k1 * p_axis->p01;
+    p_axis->p01 *= 1.0f - k0;
+    p_axis->p00 *= 1.0f - k0;
+}
+
+static void nav_axis_update_vel(nav_axis_t *p_axis, float z, float r)
+{
+    float s = p_axis->p11 + r;
+    float k0 = p_axis->p01 / s;
+    float k1 = p_axis->p11 / s;
+    float y = z - p_axis->vel;
+
+    p_axis->pos += k0 * y;
+    p_axis->vel += k1 * y;
+    p_axis->p00 -= k0 * p_axis->p01;
+    p_axis->p01 *= 1.0f - k1;
+    p_axis->p11 *= 1.0f - k1;
+}
+
+void nav_filter_init(nav_filter_t *p_nav, nav_config_t const *p_config)
+{
+    memset(p_nav, 0, sizeof(*p_nav));
+    p_nav->config = *p_config;
+}
+
+/*
+ * Propagate the state by dt seconds with body frame horizontal acceleration
+ * (m/s^2) and yaw rate (rad/s, clockwise positive). Call at the output rate.
+ */
+void nav_filter_predict(nav_filter_t *p_nav, float accel_fwd, float accel_right, float yaw_rate, float dt)
+{
+    nav_config_t const *p_cfg = &p_nav->config;
+    float sin_h;
+    float cos_h;
+    float a_east = 0.0f;
+    float a_north = 0.0f;
+    float q;
+
+    if (dt <= 0.0f)
+        return;
+
+    if (p_nav->has_heading)
+    {
+        p_nav->heading = nav_wrap_pi(p_nav->heading + ((yaw_rate - p_nav->gyro_bias) * dt));
+
+        p_nav->h_p00 += (-2.0f * dt * p_nav->h_p01) + (dt * dt * p_nav->h_p11)
+                        + (p_cfg->gyro_noise * p_cfg->gyro_noise * dt * dt);
+        p_nav->h_p01 -= dt * p_nav->h_p11;
+        p_nav->h_p11 += p_cfg->gyro_bias_noise * p_cfg->gyro_bias_noise * dt;
+
+        /* Without a heading the acceleration cannot be put in the local frame */
+        sin_h = sinf(p_nav->heading);
+        cos_h = cosf(p_nav->heading);
+        a_north = (accel_fwd * cos_h) - (accel_right * sin_h);
+        a_east = (accel_fwd * sin_h) + (accel_right * cos_h);
+    }
+
+    if (p_nav->has_origin)
+    {
+        q = p_cfg->accel_noise * p_cfg->accel_noise;
+        nav_axis_predict(&p_nav->east, a_east, dt, q);
+        nav_axis_predict(&p_nav->north, a_north, dt, q);
+    }
+
+    p_nav->predictions++;
+}
+
+/* Correct with a magnetometer heading, rad clockwise from north */
+void nav_filter_update_heading(nav_filter_t *p_nav, float heading)
+{
+    float r = p_nav->config.mag_noise * p_nav->config.mag_noise;
+    float s;
+    float k0;
+    float k1;
+    float y;
+
+    if (!p_nav->has_heading)
+    {
+        p_nav->has_heading = true;
+        p_nav->heading = nav_wrap_pi(heading);
+        p_nav->gyro_bias = 0.0f;
+        p_nav->h_p00 = r;
+        p_nav->h_p01 = 0.0f;
+        p_nav->h_p11 = NAV_INIT_BIAS_VAR;
+        return;
+    }
+
+    s = p_nav->h_p00 + r;
+    k0 = p_nav->h_p00 / s;
+    k1 = p_nav->h_p01 / s;
+    y = nav_wrap_pi(heading - p_nav->heading);
+
+    p_nav->heading = nav_wrap_pi(p_nav->heading + (k0 * y));
+    p_nav->gyro_bias += k1 * y;
+    p_nav->h_p11 -= k1 * p_nav->h_p01;
+    p_nav->h_p01 *= 1.0f - k0;
+    p_nav->h_p00 *= 1.0f - k0;
+}
+
+/*
+ * Correct with a GNSS fix. speed (m/s) and course (rad, clockwise from
+ * north) are used when vel_valid is set.
+ */
+void nav_filter_update_gps(nav_filter_t *p_nav, int32_t latitude_e7, int32_t longitude_e7, float hdop,
+                           bool vel_valid, float speed, float course)
+{
+    nav_config_t const *p_cfg = &p_nav->config;
+    float r_pos = (hdop * p_cfg->gps_uere) * (hdop * p_cfg->gps_uere);
+    float r_vel = p_cfg->gps_vel_noise * p_cfg->gps_vel_noise;
+    float x;
+    float y;
+
+    if (!p_nav->has_origin)
+    {
+        p_nav->has_origin = true;
+        p_nav->origin_lat_e7 = latitude_e7;
+        p_nav->origin_lon_e7 = longitude_e7;
+        p_nav->m_per_e7_lon = NAV_M_PER_E7_LAT * cosf((float)latitude_e7 * NAV_E7_TO_RAD);
+
+        memset(&p_nav->east, 0, sizeof(p_nav->east));
+        memset(&p_nav->north, 0, sizeof(p_nav->north));
+        p_nav->east.p00 = r_pos;
+        p_nav->north.p00 = r_pos;
+        p_nav->east.p11 = NAV_INIT_VEL_VAR;
+        p_nav->north.p11 = NAV_INIT_VEL_VAR;
+    }
+    else
+    {
+        x = (float)((int64_t)longitude_e7 - p_nav->origin_lon_e7) * p_nav->m_per_e7_lon;
+        y = (float)((int64_t)latitude_e7 - p_nav->origin_lat_e7) * NAV_M_PER_E7_LAT;
+        nav_axis_update_pos(&p_nav->east, x, r_pos);
+        nav_axis_update_pos(&p_nav->north, y, r_pos);
+    }
+
+    if (vel_valid)
+    {
+        nav_axis_update_vel(&p_nav->east, speed * sinf(course), r_vel);
+        nav_axis_update_vel(&p_nav->north, speed * cosf(course), r_vel);
+    }
+
+    p_nav->gps_updates++;
+}
+
+void nav_filter_get_state(nav_filter_t const *p_nav, nav_state_t *p_state)
+{
+    p_state->valid = p_nav->has_origin;
+    p_state->latitude_e7 = p_nav->origin_lat_e7 + (int32_t)lroundf(p_nav->north.pos / NAV_M_PER_E7_LAT);
+    p_state->longitude_e7 = p_nav->origin_lon_e7;
+    if (p_nav->m_per_e7_lon > 0.0f)
+        p_state->longitude_e7 += (int32_t)lroundf(p_nav->east.pos / p_nav->m_per_e7_lon);
+    p_state->vel_east = p_nav->east.vel;
+    p_state->vel_north = p_nav->north.vel;
+    p_state->heading = p_nav->heading;
+    p_state->pos_sigma_m = sqrtf(p_nav->east.p00 + p_nav->north.p00);
+}
@@ -0,0 +1,86 @@
+/*
+ * nav_filter.h
+ *
+ *  Single-precision GPS/IMU Kalman filter for smoothed position and
+ *  velocity between GNSS fixes.
+ *
+ *  The filter is split into three decoupled two-state filters so every step
+ *  is closed-form 2x2 arithmetic on the M4F FPU:
+ *   - heading and gyro bias, predicted from the yaw rate and corrected by
+ *     magnetometer heading;
+ *   - east and north position/velocity, predicted from the horizontal
+ *     acceleration rotated by the heading and corrected by GNSS position
+ *     and velocity.
+ *  The body frame is x forward, y right, with the device mounted level;
+ *  heading is clockwise from north.
+ */
+
+#ifndef NAV_FILTER_H_
+#define NAV_FILTER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct st_nav_config
+{
+    float accel_noise;          /* Acceleration process noise, m/s^2 */
+    float gyro_noise;           /* Yaw rate noise, rad/s */
+    float gyro_bias_noise;      /* Yaw rate bias random walk, rad/s/sqrt(s) */
+    float mag_noise;            /* Magnetometer heading noise, rad */
+    float gps_uere;             /* GNSS range error, scaled by HDOP, m */
+    float gps_vel_noise;        /* GNSS velocity noise, m/s */
+} nav_config_t;
+
+/* Position and velocity along one local axis */
+typedef struct st_nav_axis
+{
+    float pos;
+    float vel;
+    float p00;
+    float p01;
+    float p11;
+} nav_axis_t;
+
+typedef struct st_nav_filter
+{
+    nav_config_t config;
+
+    bool         has_origin;
+    int32_t      origin_lat_e7;     /* Local frame origin, the first GNSS fix */
+    int32_t      origin_lon_e7;
+    float        m_per_e7_lon;
+
+    nav_axis_t   east;
+    nav_axis_t   north;
+
+    bool         has_heading;
+    float        heading;           /* rad, [-pi, pi) */
+    float        gyro_bias;         /* rad/s */
+    float        h_p00;
+    float        h_p01;
+    float        h_p11;
+
+    uint32_t     predictions;
+    uint32_t     gps_updates;
+} nav_filter_t;
+
+typedef struct st_nav_state
+{
+    bool     valid;                 /* False until the first GNSS fix */
+    int32_t  latitude_e7;
+    int32_t  longitude_e7;
+    float    vel_east;              /* m/s */
+    float    vel_north;             /* m/s */
+    float    heading;               /* rad, clockwise from north */
+    float    pos_sigma_m;           /* 1-sigma horizontal position uncertainty */
+    uint32_t time_ms;
+} nav_state_t;
+
+void nav_filter_init(nav_filter_t *p_nav, nav_config_t const *p_config);
+void nav_filter_predict(nav_filter_t *p_nav, float accel_fwd, float accel_right, float yaw_rate, float dt);
+void nav_filter_update_heading(nav_filter_t *p_nav, float heading);
+void nav_filter_update_gps(nav_filter_t *p_nav, int32_t latitude_e7, int32_t longitude_e7, float hdop,
+                           bool vel_valid, float speed, float course);
+void nav_filter_get_state(nav_filter_t const *p_nav, nav_state_t *p_state);
+
+#endif /* NAV_FILTER_H_ */
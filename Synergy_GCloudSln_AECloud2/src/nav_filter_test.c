@@ -0,0 +1,138 @@
+/*
+ * nav_filter_test.c
+ *
+ *  Host replay of the nav filter along a simulated turning track: ten
+ *  minutes at 10 m/s on a 200 m radius, the IMU at NAV_RATE_HZ with noise
+ *  and a 0.02 rad/s gyro bias, magnetometer heading every NAV_MAG_DIVIDER
+ *  steps and a 1 Hz GNSS fix with 3 m of noise, configured as
+ *  sensors_init() does.
+ *
+ *  Halfway between fixes, after a minute to settle, the fused position
+ *  must be well inside the raw fix error and the gyro bias must be found.
+ *  Ends with the cost per predict step and per GNSS update.
+ *
+ *  Built by host_test.mk with SENSORS_BUS_SIM; empty in the firmware build.
+ */
+
+#if defined(SENSORS_BUS_SIM)
+
+#include <math.h>
+#include <stdlib.h>
+#include "host_test.h"
+#include "nav_filter.h"
+
+#define TEST_RATE_HZ            (50U)           /* NAV_RATE_HZ */
+#define TEST_MAG_DIVIDER        (10U)           /* NAV_MAG_DIVIDER */
+#define TEST_SECONDS            (600U)
+#define TEST_SETTLE_S           (60U)
+#define TEST_SPEED              (10.0)          /* m/s */
+#define TEST_YAW_RATE           (0.05)          /* rad/s, clockwise */
+#define TEST_GYRO_BIAS          (0.02)          /* rad/s */
+#define TEST_GPS_SIGMA          (3.0)           /* m per axis */
+#define TEST_ORIGIN_LAT_E7      (370000000)
+#define TEST_ORIGIN_LON_E7      (-1220000000)
+#define TEST_M_PER_E7_LAT       (0.0111319491)
+
+/* Standard normal, Box-Muller */
+static double test_gauss(void)
+{
+    double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+    double v = (rand() + 1.0) / (RAND_MAX + 2.0);
+
+    return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+int main(void)
+{
+    nav_config_t const config =
+    {
+        .accel_noise = 0.5f,
+        .gyro_noise = 0.01f,
+        .gyro_bias_noise = 0.001f,
+        .mag_noise = 0.1f,
+        .gps_uere = 5.0f,
+        .gps_vel_noise = 0.3f
+    };
+    double const dt = 1.0 / TEST_RATE_HZ;
+    double const m_per_e7_lon = TEST_M_PER_E7_LAT * cos(37.0 * M_PI / 180.0);
+    nav_filter_t nav;
+    nav_state_t state;
+    double east = 0.0;
+    double north = 0.0;
+    double heading = 0.0;
+    double gps_east;
+    double gps_north;
+    double err_east;
+    double err_north;
+    double fused_sq = 0.0;
+    double gps_sq = 0.0;
+    double fused_rms;
+    double gps_rms;
+    uint32_t samples = 0;
+    uint64_t predict_cycles = 0;
+    uint64_t gps_cycles = 0;
+    uint64_t start;
+    uint32_t step;
+
+    srand(2);
+    nav_filter_init(&nav, &config);
+
+    for (step = 0; step < (TEST_SECONDS * TEST_RATE_HZ); step++)
+    {
+        heading += TEST_YAW_RATE * dt;
+        east += TEST_SPEED * sin(heading) * dt;
+        north += TEST_SPEED * cos(heading) * dt;
+
+        /* Level mount: no forward acceleration, centripetal to the right */
+        start = host_test_cycles();
+        nav_filter_predict(&nav, (float)(0.05 * test_gauss()),
+                           (float)((TEST_SPEED * TEST_YAW_RATE) + (0.05 * test_gauss())),
+                           (float)(TEST_YAW_RATE + TEST_GYRO_BIAS + (0.005 * test_gauss())), (float)dt);
+        predict_cycles += host_test_cycles() - start;
+
+        if ((step % TEST_MAG_DIVIDER) == 0U)
+            nav_filter_update_heading(&nav, (float)(remainder(heading, 2.0 * M_PI) + (0.1 * test_gauss())));
+
+        if ((step % TEST_RATE_HZ) == 0U)
+        {
+            gps_east = east + (TEST_GPS_SIGMA * test_gauss());
+            gps_north = north + (TEST_GPS_SIGMA * test_gauss());
+
+            start = host_test_cycles();
+            nav_filter_update_gps(&nav, TEST_ORIGIN_LAT_E7 + (int32_t)lround(gps_north / TEST_M_PER_E7_LAT),
+                                  TEST_ORIGIN_LON_E7 + (int32_t)lround(gps_east / m_per_e7_lon), 1.0f, true,
+                                  (float)TEST_SPEED, (float)remainder(heading, 2.0 * M_PI));
+            gps_cycles += host_test_cycles() - start;
+
+            if (step >= (TEST_SETTLE_S * TEST_RATE_HZ))
+                gps_sq += ((gps_east - east) * (gps_east - east)) + ((gps_north - north) * (gps_north - north));
+        }
+
+        /* Halfway to the next fix, where the output has to stand on the IMU */
+        if ((step >= (TEST_SETTLE_S * TEST_RATE_HZ)) && ((step % TEST_RATE_HZ) == (TEST_RATE_HZ / 2U)))
+        {
+            nav_filter_get_state(&nav, &state);
+            HOST_TEST_CHECK(state.valid);
+            err_east = ((state.longitude_e7 - TEST_ORIGIN_LON_E7) * m_per_e7_lon) - east;
+            err_north = ((state.latitude_e7 - TEST_ORIGIN_LAT_E7) * TEST_M_PER_E7_LAT) - north;
+            fused_sq += (err_east * err_east) + (err_north * err_north);
+            samples++;
+        }
+    }
+
+    fused_rms = sqrt(fused_sq / samples);
+    gps_rms = sqrt(gps_sq / samples);
+    printf("%lu s turning track: fused %.2f m rms between fixes, raw fixes %.2f m rms, gyro bias %.4f rad/s (true %.2f)\r\n",
+           (unsigned long)TEST_SECONDS, fused_rms, gps_rms, nav.gyro_bias, TEST_GYRO_BIAS);
+    printf("%.0f cycles/predict, %.0f cycles/GNSS update\r\n",
+           (double)predict_cycles / nav.predictions, (double)gps_cycles / nav.gps_updates);
+
+    HOST_TEST_CHECK(nav.predictions == (TEST_SECONDS * TEST_RATE_HZ));
+    HOST_TEST_CHECK(nav.gps_updates == TEST_SECONDS);
+    HOST_TEST_CHECK(fused_rms < (0.5 * gps_rms));
+    HOST_TEST_CHECK(fabs(nav.gyro_bias - TEST_GYRO_BIAS) < 0.005);
+
+    return host_test_finish("nav_filter");
+}
+
+#endif /* SENSORS_BUS_SIM */
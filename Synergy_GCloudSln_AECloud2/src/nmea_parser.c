@@ -0,0 +1,151 @@
+/*
+ * nmea_parser.c
+ *
+ *  Incremental NMEA 0183 sentence framer. See nmea_parser.h.
+ */
+
+#include <string.h>
+#include "nmea_parser.h"
+
+static int8_t nmea_hex_value(uint8_t ch)
+{
+    if ((ch >= '0') && (ch <= '9'))
+        return (int8_t)(ch - '0');
+    if ((ch >= 'A') && (ch <= 'F'))
+        return (int8_t)(ch - 'A' + 10);
+    if ((ch >= 'a') && (ch <= 'f'))
+        return (int8_t)(ch - 'a' + 10);
+
+    return -1;
+}
+
+/*
+ * Split the validated sentence body in place at each ',' and pass it on.
+ */
+static void nmea_dispatch(nmea_parser_t *p_parser)
+{
+    nmea_sentence_t sentence;
+    char *p = p_parser->buf;
+
+    p_parser->buf[p_parser->len] = '\0';
+
+    sentence.field_count = 0;
+    sentence.field[sentence.field_count++] = p;
+
+    while (*p != '\0')
+    {
+        if (*p == ',')
+        {
+            *p = '\0';
+            if (sentence.field_count >= NMEA_MAX_FIELDS)
+                break;
+            sentence.field[sentence.field_count++] = p + 1;
+        }
+        p++;
+    }
+
+    p_parser->sentences++;
+
+    if (p_parser->callback != NULL)
+        p_parser->callback(&sentence, p_parser->p_context);
+}
+
+void nmea_parser_init(nmea_parser_t *p_parser, nmea_sentence_cb_t callback, void *p_context)
+{
+    memset(p_parser, 0, sizeof(*p_parser));
+    p_parser->callback = callback;
+    p_parser->p_context = p_context;
+}
+
+void nmea_parser_reset(nmea_parser_t *p_parser)
+{
+    p_parser->state = NMEA_STATE_IDLE;
+    p_parser->len = 0;
+}
+
+/*
+ * Consume len bytes and return the number of complete, checksum-valid
+ * sentences delivered to the callback. A '$' always starts a new sentence,
+ * so the parser resynchronises on the next sentence after any corruption.
+ */
+uint32_t nmea_parser_feed(nmea_parser_t *p_parser, uint8_t const *p_data, uint32_t len)
+{
+    uint32_t delivered = 0;
+    int8_t nibble;
+    uint8_t ch;
+
+    while (len--)
+    {
+        ch = *p_data++;
+
+        if (ch == '$')
+        {
+            if (p_parser->state != NMEA_STATE_IDLE)
+                p_parser->framing_errors++;
+
+            p_parser->state = NMEA_STATE_BODY;
+            p_parser->len = 0;
+            p_parser->csum = 0;
+            continue;
+        }
+
+        switch (p_parser->state)
+        {
+            case NMEA_STATE_IDLE:
+                break;
+
+            case NMEA_STATE_BODY:
+                if (ch == '*')
+                {
+                    p_parser->state = NMEA_STATE_CSUM_HI;
+                }
+                else if ((ch == '\r') || (ch == '\n') || (p_parser->len >= (NMEA_MAX_SENTENCE_LEN - 6U)))
+                {
+                    /* Missing checksum or runaway sentence */
+                    p_parser->framing_errors++;
+                    p_parser->state = NMEA_STATE_IDLE;
+                }
+                else
+                {
+                    p_parser->csum ^= ch;
+                    p_parser->buf[p_parser->len++] = (char)ch;
+                }
+                break;
+
+            case NMEA_STATE_CSUM_HI:
+                nibble = nmea_hex_value(ch);
+                if (nibble < 0)
+                {
+                    p_parser->framing_errors++;
+                    p_parser->state = NMEA_STATE_IDLE;
+                    break;
+                }
+                p_parser->csum_rx = (uint8_t)(nibble << 4);
+                p_parser->state = NMEA_STATE_CSUM_LO;
+                break;
+
+            case NMEA_STATE_CSUM_LO:
+                p_parser->state = NMEA_STATE_IDLE;
+                nibble = nmea_hex_value(ch);
+                if (nibble < 0)
+                {
+                    p_parser->framing_errors++;
+                    break;
+                }
+                if ((uint8_t)(p_parser->csum_rx | (uint8_t)nibble) != p_parser->csum)
+                {
+                    p_parser->csum_errors++;
+                    break;
+                }
+                nmea_dispatch(p_parser);
+                delivered++;
+                break;
+
+            default:
+                p_parser->state = NMEA_STATE_IDLE;
+                break;
+        }
+    }
+
+    return delivered;
+}
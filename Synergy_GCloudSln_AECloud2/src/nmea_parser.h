@@ -0,0 +1,60 @@
+/*
+ * nmea_parser.h
+ *
+ *  Incremental NMEA 0183 sentence framer.
+ *
+ *  Bytes are pushed in whatever chunks the GPS UART delivers them; the parser
+ *  keeps its state between calls, validates the "*hh" checksum and hands each
+ *  complete sentence, split into fields, to a callback. It has no RTOS or SSP
+ *  dependencies so the same file builds for the target and for a Linux host.
+ */
+
+#ifndef NMEA_PARSER_H_
+#define NMEA_PARSER_H_
+
+#include <stdint.h>
+
+/* NMEA 0183 limits a sentence to 82 characters including '$' and <CR><LF> */
+#define NMEA_MAX_SENTENCE_LEN   (82U)
+
+/* GSV carries the most fields: address + 3 + 4 satellites * 4 (+ signal id) */
+#define NMEA_MAX_FIELDS         (24U)
+
+typedef enum e_nmea_state
+{
+    NMEA_STATE_IDLE = 0,        /* Waiting for '$' */
+    NMEA_STATE_BODY,            /* Collecting address and fields up to '*' */
+    NMEA_STATE_CSUM_HI,         /* Expecting first checksum hex digit */
+    NMEA_STATE_CSUM_LO          /* Expecting second checksum hex digit */
+} nmea_state_t;
+
+typedef struct st_nmea_sentence
+{
+    /* field[0] is the address (e.g. "GPGGA"), empty fields are "" */
+    char const *field[NMEA_MAX_FIELDS];
+    uint8_t     field_count;
+} nmea_sentence_t;
+
+typedef void (*nmea_sentence_cb_t)(nmea_sentence_t const *p_sentence, void *p_context);
+
+typedef struct st_nmea_parser
+{
+    nmea_state_t        state;
+    uint8_t             len;
+    uint8_t             csum;
+    uint8_t             csum_rx;
+    char                buf[NMEA_MAX_SENTENCE_LEN + 1];
+    nmea_sentence_cb_t  callback;
+    void               *p_context;
+
+    /* Statistics, never reset by the parser itself */
+    uint32_t            sentences;      /* Sentences delivered to the callback */
+    uint32_t            csum_errors;    /* Sentences dropped on checksum mismatch */
+    uint32_t            framing_errors; /* Overlong or unterminated sentences */
+} nmea_parser_t;
+
+void nmea_parser_init(nmea_parser_t *p_parser, nmea_sentence_cb_t callback, void *p_context);
+void nmea_parser_reset(nmea_parser_t *p_parser);
+uint32_t nmea_parser_feed(nmea_parser_t *p_parser, uint8_t const *p_data, uint32_t len);
+
+#endif /* NMEA_PARSER_H_ */
@@ -0,0 +1,130 @@
+/*
+ * report_filter.c
+ *
+ *  Dead-band, rate-of-change and heartbeat reporting. See report_filter.h.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "report_filter.h"
+
+static uint32_t report_abs_diff(int32_t a, int32_t b)
+{
+    return (a > b) ? ((uint32_t) a - (uint32_t) b) : ((uint32_t) b - (uint32_t) a);
+}
+
+void report_filter_init(report_filter_t *p_filter, report_channel_t *p_channels, uint8_t channel_count)
+{
+    uint8_t i;
+
+    if (channel_count > REPORT_CHANNEL_MAX)
+        channel_count = REPORT_CHANNEL_MAX;
+
+    p_filter->p_channels = p_channels;
+    p_filter->channel_count = channel_count;
+
+    for (i = 0; i < channel_count; i++)
+    {
+        p_channels[i].reported = false;
+        p_channels[i].rate_refs = 0;
+        memset(&p_channels[i].stats, 0, sizeof(p_channels[i].stats));
+    }
+}
+
+/* Returns the channels to publish; reported channels take value and time as their new reference */
+uint32_t report_filter_check(report_filter_t *p_filter, int32_t const *p_values, uint32_t valid_mask,
+                             uint32_t now_ms)
+{
+    report_channel_t *p_ch;
+    uint32_t mask = 0;
+    uint32_t change;
+    uint32_t dt_ms;
+    bool report;
+    uint8_t i;
+
+    for (i = 0; i < p_filter->channel_count; i++)
+    {
+        p_ch = &p_filter->p_channels[i];
+        if ((valid_mask & (1UL << i)) == 0U)
+        {
+            p_ch->rate_refs = 0;
+            continue;
+        }
+
+        p_ch->stats.checks++;
+        report = !p_ch->reported;
+
+        if (p_ch->reported)
+        {
+            change = report_abs_diff(p_ch->report_value, p_values[i]);
+            if ((change > 0U) && (change >= (uint32_t) p_ch->deadband))
+            {
+                p_ch->stats.deadband++;
+                report = true;
+            }
+
+            if ((p_ch->heartbeat_ms > 0U) && ((now_ms - p_ch->report_ms) >= p_ch->heartbeat_ms))
+            {
+                p_ch->stats.heartbeat++;
+                report = true;
+            }
+        }
+
+        /* Age the rate references one window at a time */
+        if (p_ch->rate_refs == 0U)
+        {
+            p_ch->next_value = p_values[i];
+            p_ch->next_ms = now_ms;
+            p_ch->rate_refs = 1U;
+        }
+        else if ((now_ms - p_ch->next_ms) >= p_ch->rate_window_ms)
+        {
+            p_ch->ref_value = p_ch->next_value;
+            p_ch->ref_ms = p_ch->next_ms;
+            p_ch->next_value = p_values[i];
+            p_ch->next_ms = now_ms;
+            p_ch->rate_refs = 2U;
+        }
+
+        if ((p_ch->rate_per_min > 0) && (p_ch->rate_refs == 2U) && p_ch->reported
+            && (p_ch->report_value != p_values[i]))
+        {
+            change = report_abs_diff(p_ch->ref_value, p_values[i]);
+            dt_ms = now_ms - p_ch->ref_ms;
+            if (((uint64_t) change * 60000U) >= ((uint64_t) (uint32_t) p_ch->rate_per_min * dt_ms))
+            {
+                p_ch->stats.rate++;
+                report = true;
+            }
+        }
+
+        if (report)
+        {
+            p_ch->reported = true;
+            p_ch->report_value = p_values[i];
+            p_ch->report_ms = now_ms;
+            p_ch->stats.reports++;
+            mask |= 1UL << i;
+        }
+    }
+
+    return mask;
+}
+
+void report_filter_print(report_filter_t const *p_filter, void (*p_print)(char const *p_str))
+{
+    char str[128];
+    report_channel_t const *p_ch;
+    uint8_t i;
+
+    p_print("\r\nChannel      Checks  Reports  Deadband  Rate  Heartbeat\r\n");
+    for (i = 0; i < p_filter->channel_count; i++)
+    {
+        p_ch = &p_filter->p_channels[i];
+        snprintf(str, sizeof(str), "%-11s  %6lu  %7lu  %8lu  %4lu  %9lu\r\n", p_ch->name,
+                 (unsigned long)p_ch->stats.checks, (unsigned long)p_ch->stats.reports,
+                 (unsigned long)p_ch->stats.deadband, (unsigned long)p_ch->stats.rate,
+                 (unsigned long)p_ch->stats.heartbeat);
+        p_print(str);
+    }
+}
@@ -0,0 +1,78 @@
+/*
+ * report_filter.h
+ *
+ *  Report-by-exception for slowly changing channels.
+ *
+ *  report_filter_check() takes the latest value of every channel and
+ *  returns a bitmask of the channels worth publishing. A channel is
+ *  reported when it has moved by its dead-band since it was last reported,
+ *  when it changes faster than its rate limit, or when its heartbeat has
+ *  elapsed. The rate is taken against a sample between one and two rate
+ *  windows old, so sensor noise between close checks does not trigger it;
+ *  it reports a steady drift before a wide dead-band would. A channel
+ *  without a valid value is never reported, and a gap restarts its rate.
+ *
+ *  Values are integers in the channel's own units, time comes from the
+ *  caller, so the filter runs unchanged on the host for replays.
+ */
+
+#ifndef REPORT_FILTER_H_
+#define REPORT_FILTER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define REPORT_CHANNEL_MAX          (32U)
+
+/* sensors_data_t.report_mask bits: the field changed and should be published */
+typedef enum e_report_field
+{
+    REPORT_FIELD_TEMPERATURE = 0,
+    REPORT_FIELD_HUMIDITY,
+    REPORT_FIELD_PRESSURE,
+    REPORT_FIELD_COUNT
+} report_field_t;
+
+#define REPORT_FIELD(id)            (1UL << (id))
+#define REPORT_FIELD_ALL            ((1UL << REPORT_FIELD_COUNT) - 1UL)
+
+typedef struct st_report_channel_stats
+{
+    uint32_t checks;            /* Checks with a valid value */
+    uint32_t deadband;          /* Reports by cause; one report can count twice */
+    uint32_t rate;
+    uint32_t heartbeat;
+    uint32_t reports;
+} report_channel_stats_t;
+
+typedef struct st_report_channel
+{
+    char const *name;
+    int32_t     deadband;           /* Change since the last report, 0 reports every change */
+    int32_t     rate_per_min;       /* Change per minute, 0 disables */
+    uint32_t    rate_window_ms;     /* Shortest span the rate is measured over */
+    uint32_t    heartbeat_ms;       /* Longest silence, 0 disables */
+
+    bool        reported;           /* A value has been reported */
+    int32_t     report_value;
+    uint32_t    report_ms;
+    uint8_t     rate_refs;          /* Valid entries below */
+    int32_t     ref_value;          /* Rate reference, at least one window old */
+    uint32_t    ref_ms;
+    int32_t     next_value;         /* Becomes the reference one window later */
+    uint32_t    next_ms;
+    report_channel_stats_t stats;
+} report_channel_t;
+
+typedef struct st_report_filter
+{
+    report_channel_t *p_channels;   /* Channel i is bit i of the mask */
+    uint8_t           channel_count;
+} report_filter_t;
+
+void report_filter_init(report_filter_t *p_filter, report_channel_t *p_channels, uint8_t channel_count);
+uint32_t report_filter_check(report_filter_t *p_filter, int32_t const *p_values, uint32_t valid_mask,
+                             uint32_t now_ms);
+void report_filter_print(report_filter_t const *p_filter, void (*p_print)(char const *p_str));
+
+#endif /* REPORT_FILTER_H_ */
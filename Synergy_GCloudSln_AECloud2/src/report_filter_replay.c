@@ -0,0 +1,194 @@
+/*
+ * report_filter_replay.c
+ *
+ *  Host replay of report-by-exception on a synthetic 24 h indoor trace,
+ *  with the channel settings sensors.c uses: diurnal temperature, humidity
+ *  and pressure, HVAC ripple, sensor noise, a window opened for 30 minutes
+ *  at 14:00 and a 60 s BME680 outage at 10:00. No recorded device logs are
+ *  in the tree, so the trace stands in for one.
+ *
+ *  Replayed at 1, 5 and 60 s publish periods, each run must save at least
+ *  90 % of the environmental field bytes (JSON of the
+ *  "temperature":72.53, form), keep the last reported value within a
+ *  dead-band of the true one, report every channel at least once a
+ *  heartbeat (plus the outage), never report a stale channel, and catch
+ *  the window opening through the rate limit. A flat noisy hour must not
+ *  trip the rate.
+ *
+ *  Built by host_test.mk with SENSORS_BUS_SIM; empty in the firmware build.
+ */
+
+#if defined(SENSORS_BUS_SIM)
+
+#include <math.h>
+#include <stdlib.h>
+#include "host_test.h"
+#include "report_filter.h"
+
+#define REPLAY_DAY_S            (86400U)
+#define REPLAY_RATE_WINDOW_MS   (60000U)        /* REPORT_RATE_WINDOW_MS */
+#define REPLAY_HEARTBEAT_MS     (900000U)       /* REPORT_HEARTBEAT_MS */
+#define REPLAY_STALE_FROM_S     (36000U)
+#define REPLAY_STALE_TO_S       (36060U)
+
+/* "temperature":72.53, "humidity":45.21, "pressure":1013.25, */
+static uint32_t const replay_field_bytes[REPORT_FIELD_COUNT] = { 20U, 17U, 19U };
+
+/* Standard normal, Box-Muller */
+static double replay_gauss(void)
+{
+    double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+    double v = (rand() + 1.0) / (RAND_MAX + 2.0);
+
+    return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+/* sensors_report_channels[] */
+static void replay_channels(report_channel_t *p_channels)
+{
+    report_channel_t const channels[REPORT_FIELD_COUNT] =
+    {
+        [REPORT_FIELD_TEMPERATURE] = { .name = "Temp", .deadband = 20, .rate_per_min = 50,
+                                       .rate_window_ms = REPLAY_RATE_WINDOW_MS, .heartbeat_ms = REPLAY_HEARTBEAT_MS },
+        [REPORT_FIELD_HUMIDITY]    = { .name = "Humidity", .deadband = 1000, .rate_per_min = 3000,
+                                       .rate_window_ms = REPLAY_RATE_WINDOW_MS, .heartbeat_ms = REPLAY_HEARTBEAT_MS },
+        [REPORT_FIELD_PRESSURE]    = { .name = "Pressure", .deadband = 50, .rate_per_min = 100,
+                                       .rate_window_ms = REPLAY_RATE_WINDOW_MS, .heartbeat_ms = REPLAY_HEARTBEAT_MS },
+    };
+    uint32_t i;
+
+    for (i = 0; i < REPORT_FIELD_COUNT; i++)
+        p_channels[i] = channels[i];
+}
+
+/* Raw BME680 units: 0.01 degC, 0.001 %RH, Pa */
+static void replay_trace(uint32_t t, int32_t *p_values)
+{
+    double const h = t / 3600.0;
+    double temperature = 21.0 + (1.5 * sin(((h - 9.0) / 24.0) * 2.0 * M_PI)) + (0.3 * sin((t / 2400.0) * 2.0 * M_PI))
+                         + (0.02 * replay_gauss());
+    double humidity = 45.0 + (5.0 * sin(((h - 3.0) / 24.0) * 2.0 * M_PI)) + (0.3 * replay_gauss());
+    double pressure = 101325.0 + (150.0 * sin((h / 24.0) * 2.0 * M_PI)) + (2.0 * replay_gauss());
+    double open = 0.0;
+
+    /* Window open at 14:00 for 30 min, the room recovers over the next 90 */
+    if ((h >= 14.0) && (h < 14.5))
+        open = fmin((h - 14.0) * 12.0, 1.0);
+    else if ((h >= 14.5) && (h < 16.0))
+        open = fmax(1.0 - ((h - 14.5) / 1.5), 0.0);
+    temperature -= 3.0 * open;
+    humidity += 10.0 * open;
+
+    p_values[REPORT_FIELD_TEMPERATURE] = (int32_t)lround(temperature * 100.0);
+    p_values[REPORT_FIELD_HUMIDITY] = (int32_t)lround(humidity * 1000.0);
+    p_values[REPORT_FIELD_PRESSURE] = (int32_t)lround(pressure);
+}
+
+static void replay_day(uint32_t period_s)
+{
+    report_channel_t channels[REPORT_FIELD_COUNT];
+    report_filter_t filter;
+    int32_t values[REPORT_FIELD_COUNT];
+    int32_t reported[REPORT_FIELD_COUNT] = { 0 };
+    uint32_t last_report_s[REPORT_FIELD_COUNT] = { 0 };
+    int32_t worst_error[REPORT_FIELD_COUNT] = { 0 };
+    uint32_t worst_gap_s[REPORT_FIELD_COUNT] = { 0 };
+    uint32_t full_bytes = 0;
+    uint32_t rbe_bytes = 0;
+    uint32_t stale_reports = 0;
+    uint32_t valid;
+    uint32_t mask;
+    uint32_t t;
+    uint32_t i;
+
+    srand(11);
+    replay_channels(channels);
+    report_filter_init(&filter, channels, REPORT_FIELD_COUNT);
+
+    for (t = 0; t < REPLAY_DAY_S; t += period_s)
+    {
+        replay_trace(t, values);
+        valid = ((t >= REPLAY_STALE_FROM_S) && (t < REPLAY_STALE_TO_S)) ? 0U : REPORT_FIELD_ALL;
+        mask = report_filter_check(&filter, values, valid, t * 1000U);
+        stale_reports += (mask & ~valid) ? 1U : 0U;
+
+        for (i = 0; i < REPORT_FIELD_COUNT; i++)
+        {
+            if (valid & REPORT_FIELD(i))
+                full_bytes += replay_field_bytes[i];
+
+            if (mask & REPORT_FIELD(i))
+            {
+                rbe_bytes += replay_field_bytes[i];
+                reported[i] = values[i];
+                last_report_s[i] = t;
+            }
+            else if ((t - last_report_s[i]) > worst_gap_s[i])
+            {
+                worst_gap_s[i] = t - last_report_s[i];
+            }
+
+            if ((valid & REPORT_FIELD(i)) && (abs(values[i] - reported[i]) > worst_error[i]))
+                worst_error[i] = abs(values[i] - reported[i]);
+        }
+    }
+
+    printf("%2lu s: field bytes %lu -> %lu (%.1f %% saved)\r\n", (unsigned long)period_s,
+           (unsigned long)full_bytes, (unsigned long)rbe_bytes, (100.0 * (full_bytes - rbe_bytes)) / full_bytes);
+    for (i = 0; i < REPORT_FIELD_COUNT; i++)
+    {
+        printf("      %-8s %5lu reports (dead-band %lu, rate %lu, heartbeat %lu), error %ld of %ld, "
+               "longest silence %lu s\r\n",
+               channels[i].name, (unsigned long)channels[i].stats.reports, (unsigned long)channels[i].stats.deadband,
+               (unsigned long)channels[i].stats.rate, (unsigned long)channels[i].stats.heartbeat,
+               (long)worst_error[i], (long)channels[i].deadband, (unsigned long)worst_gap_s[i]);
+
+        /* A heartbeat falling in the outage goes out when the channel is back */
+        HOST_TEST_CHECK(worst_error[i] < channels[i].deadband);
+        HOST_TEST_CHECK((worst_gap_s[i] * 1000U)
+                        <= (REPLAY_HEARTBEAT_MS + ((REPLAY_STALE_TO_S - REPLAY_STALE_FROM_S + period_s) * 1000U)));
+    }
+
+    HOST_TEST_CHECK((rbe_bytes * 10U) <= full_bytes);
+    HOST_TEST_CHECK(stale_reports == 0U);
+
+    /* The window opening cools the room by 0.6 degC a minute */
+    HOST_TEST_CHECK(channels[REPORT_FIELD_TEMPERATURE].stats.rate > 0U);
+}
+
+/* An hour of flat temperature with 0.05 degC noise, checked every second */
+static void replay_noise(void)
+{
+    report_channel_t channels[REPORT_FIELD_COUNT];
+    report_filter_t filter;
+    int32_t values[REPORT_FIELD_COUNT];
+    uint32_t t;
+
+    srand(5);
+    replay_channels(channels);
+    report_filter_init(&filter, channels, REPORT_FIELD_COUNT);
+    for (t = 0; t < 3600U; t++)
+    {
+        values[REPORT_FIELD_TEMPERATURE] = (int32_t)lround(2100.0 + (5.0 * replay_gauss()));
+        values[REPORT_FIELD_HUMIDITY] = 45000;
+        values[REPORT_FIELD_PRESSURE] = 101325;
+        (void)report_filter_check(&filter, values, REPORT_FIELD_ALL, t * 1000U);
+    }
+
+    printf("flat noisy hour: %lu temperature reports, %lu by rate\r\n",
+           (unsigned long)channels[REPORT_FIELD_TEMPERATURE].stats.reports,
+           (unsigned long)channels[REPORT_FIELD_TEMPERATURE].stats.rate);
+    HOST_TEST_CHECK(channels[REPORT_FIELD_TEMPERATURE].stats.rate == 0U);
+}
+
+int main(void)
+{
+    replay_day(1U);
+    replay_day(5U);
+    replay_day(60U);
+    replay_noise();
+
+    return host_test_finish("report_filter");
+}
+
+#endif /* SENSORS_BUS_SIM */
@@ -0,0 +1,88 @@
+/*
+ * ring_buffer.c
+ *
+ *  Single-producer/single-consumer byte ring. See ring_buffer.h.
+ */
+
+#include "ring_buffer.h"
+
+void ring_buffer_init(ring_buffer_t *p_ring, uint8_t *p_storage, uint32_t size)
+{
+    p_ring->p_storage = p_storage;
+    p_ring->mask = size - 1U;
+    p_ring->head = 0;
+    p_ring->tail = 0;
+    p_ring->overruns = 0;
+}
+
+/*
+ * Store one byte. Returns 1 on success, 0 if the ring was full and the byte
+ * was dropped.
+ */
+uint32_t ring_buffer_put(ring_buffer_t *p_ring, uint8_t data)
+{
+    uint32_t head = p_ring->head;
+
+    if ((head - p_ring->tail) > p_ring->mask)
+    {
+        p_ring->overruns++;
+        return 0;
+    }
+
+    p_ring->p_storage[head & p_ring->mask] = data;
+    RING_BUFFER_BARRIER();
+    p_ring->head = head + 1U;
+
+    return 1;
+}
+
+/*
+ * Return the length of the largest contiguous free span and point *pp_span at
+ * it. A DMA producer fills (part of) the span and then calls
+ * ring_buffer_commit() with the number of bytes written.
+ */
+uint32_t ring_buffer_write_span(ring_buffer_t *p_ring, uint8_t **pp_span)
+{
+    uint32_t head = p_ring->head;
+    uint32_t offset = head & p_ring->mask;
+    uint32_t free_len = (p_ring->mask + 1U) - (head - p_ring->tail);
+    uint32_t to_end = (p_ring->mask + 1U) - offset;
+
+    *pp_span = &p_ring->p_storage[offset];
+
+    return (free_len < to_end) ? free_len : to_end;
+}
+
+void ring_buffer_commit(ring_buffer_t *p_ring, uint32_t len)
+{
+    RING_BUFFER_BARRIER();
+    p_ring->head += len;
+}
+
+uint32_t ring_buffer_count(ring_buffer_t const *p_ring)
+{
+    return p_ring->head - p_ring->tail;
+}
+
+/*
+ * Return the length of the largest contiguous readable span and point
+ * *pp_span at it. The data stays valid until ring_buffer_release().
+ */
+uint32_t ring_buffer_read_span(ring_buffer_t *p_ring, uint8_t const **pp_span)
+{
+    uint32_t tail = p_ring->tail;
+    uint32_t offset = tail & p_ring->mask;
+    uint32_t used = p_ring->head - tail;
+    uint32_t to_end = (p_ring->mask + 1U) - offset;
+
+    RING_BUFFER_BARRIER();
+    *pp_span = &p_ring->p_storage[offset];
+
+    return (used < to_end) ? used : to_end;
+}
+
+void ring_buffer_release(ring_buffer_t *p_ring, uint32_t len)
+{
+    RING_BUFFER_BARRIER();
+    p_ring->tail += len;
+}
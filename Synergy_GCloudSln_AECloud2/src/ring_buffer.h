@@ -0,0 +1,43 @@
+/*
+ * ring_buffer.h
+ *
+ *  Single-producer/single-consumer byte ring.
+ *
+ *  The producer is an ISR (or DMA completion) and the consumer a thread, so no
+ *  locking is needed: each side only writes its own index. Both sides work on
+ *  contiguous spans of the storage, so data is never copied between them.
+ *  The storage size must be a power of two.
+ */
+
+#ifndef RING_BUFFER_H_
+#define RING_BUFFER_H_
+
+#include <stdint.h>
+
+/* Compiler barrier, enough on a single core Cortex-M */
+#ifndef RING_BUFFER_BARRIER
+#define RING_BUFFER_BARRIER()   __asm volatile ("" ::: "memory")
+#endif
+
+typedef struct st_ring_buffer
+{
+    uint8_t          *p_storage;
+    uint32_t          mask;       /* size - 1 */
+    volatile uint32_t head;       /* Free running, written by producer only */
+    volatile uint32_t tail;       /* Free running, written by consumer only */
+    volatile uint32_t overruns;   /* Bytes dropped because the ring was full */
+} ring_buffer_t;
+
+void ring_buffer_init(ring_buffer_t *p_ring, uint8_t *p_storage, uint32_t size);
+
+/* Producer side */
+uint32_t ring_buffer_put(ring_buffer_t *p_ring, uint8_t data);
+uint32_t ring_buffer_write_span(ring_buffer_t *p_ring, uint8_t **pp_span);
+void ring_buffer_commit(ring_buffer_t *p_ring, uint32_t len);
+
+/* Consumer side */
+uint32_t ring_buffer_count(ring_buffer_t const *p_ring);
+uint32_t ring_buffer_read_span(ring_buffer_t *p_ring, uint8_t const **pp_span);
+void ring_buffer_release(ring_buffer_t *p_ring, uint32_t len);
+
+#endif /* RING_BUFFER_H_ */
@@ -0,0 +1,257 @@
+/*
+ * ring_buffer_test.c
+ *
+ *  Host test of the GPS UART path: a simulated UART producer feeds the ring
+ *  the way gps_uart_callback() does, byte by byte from the ISR, or in DMA
+ *  blocks through write_span/commit, while the consumer drains it in spans
+ *  into the NMEA parser at random points. Every sentence must arrive once,
+ *  in order and intact; a full ring must count its overruns and the parser
+ *  resynchronise after them.
+ *
+ *  Then cycles per byte against a model of the old path, one g_gps_queue
+ *  message per byte handed to the parser one at a time. The model has no
+ *  ThreadX, so it leaves out the queue's interrupt lockout and the context
+ *  switch per message and understates the old cost.
+ *
+ *  Built by host_test.mk with SENSORS_BUS_SIM; empty in the firmware build.
+ */
+
+#if defined(SENSORS_BUS_SIM)
+
+#include <stdlib.h>
+#include <string.h>
+#include "host_test.h"
+#include "nmea_parser.h"
+#include "ring_buffer.h"
+
+#define TEST_RING_LEN           (512U)      /* GPS_RX_RING_LEN */
+#define TEST_SENTENCES          (2000U)
+#define TEST_BENCH_SENTENCES    (200000U)
+
+typedef struct st_test_sink
+{
+    uint32_t expected;                      /* Index of the next sentence */
+    uint32_t received;
+    uint32_t out_of_order;
+} test_sink_t;
+
+static uint8_t test_storage[TEST_RING_LEN];
+
+/* A GGA sentence whose UTC field carries its index */
+static uint32_t test_sentence(uint32_t index, char *p_out)
+{
+    char body[80];
+    uint8_t csum = 0;
+    char const *p;
+
+    snprintf(body, sizeof(body), "GPGGA,%06lu.00,4807.038,N,01131.000,E,1,08,0.9,545.4,M,46.9,M,,",
+             (unsigned long)(index % 1000000U));
+    for (p = body; *p != '\0'; p++)
+        csum ^= (uint8_t)*p;
+
+    return (uint32_t)sprintf(p_out, "$%s*%02X\r\n", body, csum);
+}
+
+static void test_sentence_cb(nmea_sentence_t const *p_sentence, void *p_context)
+{
+    test_sink_t *p_sink = (test_sink_t *)p_context;
+    uint32_t index = (uint32_t)strtoul(p_sentence->field[1], NULL, 10);
+
+    if (index != p_sink->expected)
+        p_sink->out_of_order++;
+    p_sink->expected = index + 1U;
+    p_sink->received++;
+}
+
+/* read_gps_coordinates(): hand every queued span to the parser */
+static void test_drain(ring_buffer_t *p_ring, nmea_parser_t *p_parser)
+{
+    uint8_t const *p_span;
+    uint32_t len;
+
+    while ((len = ring_buffer_read_span(p_ring, &p_span)) > 0U)
+    {
+        nmea_parser_feed(p_parser, p_span, len);
+        ring_buffer_release(p_ring, len);
+    }
+}
+
+/* The UART delivers each sentence in random bursts, the consumer wakes at random */
+static void test_producer(bool dma)
+{
+    ring_buffer_t ring;
+    nmea_parser_t parser;
+    test_sink_t sink = { 0 };
+    char line[96];
+    uint32_t line_len;
+    uint32_t pos;
+    uint32_t burst;
+    uint32_t done;
+    uint32_t span_len;
+    uint8_t *p_span;
+    uint32_t i;
+
+    ring_buffer_init(&ring, test_storage, sizeof(test_storage));
+    nmea_parser_init(&parser, test_sentence_cb, &sink);
+    srand(dma ? 2U : 1U);
+
+    for (i = 0; i < TEST_SENTENCES; i++)
+    {
+        line_len = test_sentence(i, line);
+        for (pos = 0; pos < line_len; pos += burst)
+        {
+            burst = 1U + ((uint32_t)rand() % 32U);
+            if (burst > (line_len - pos))
+                burst = line_len - pos;
+
+            if (dma)
+            {
+                /* A block may straddle the end of the storage */
+                for (done = 0; done < burst; done += span_len)
+                {
+                    span_len = ring_buffer_write_span(&ring, &p_span);
+                    if (span_len > (burst - done))
+                        span_len = burst - done;
+                    memcpy(p_span, &line[pos + done], span_len);
+                    ring_buffer_commit(&ring, span_len);
+                }
+            }
+            else
+            {
+                for (done = 0; done < burst; done++)
+                    ring_buffer_put(&ring, (uint8_t)line[pos + done]);
+            }
+
+            /* The parser thread wakes at random, and always well before the ring fills */
+            if (((rand() % 4) == 0) || (ring_buffer_count(&ring) > (TEST_RING_LEN / 2U)))
+                test_drain(&ring, &parser);
+        }
+    }
+    test_drain(&ring, &parser);
+
+    printf("%s producer: %lu sentences, %lu out of order, csum %lu, framing %lu, overruns %lu\r\n",
+           dma ? "DMA" : "ISR", (unsigned long)sink.received, (unsigned long)sink.out_of_order,
+           (unsigned long)parser.csum_errors, (unsigned long)parser.framing_errors,
+           (unsigned long)ring.overruns);
+    HOST_TEST_CHECK(sink.received == TEST_SENTENCES);
+    HOST_TEST_CHECK(sink.out_of_order == 0U);
+    HOST_TEST_CHECK(parser.csum_errors == 0U);
+    HOST_TEST_CHECK(parser.framing_errors == 0U);
+    HOST_TEST_CHECK(ring.overruns == 0U);
+}
+
+/* A stalled consumer: the ring fills, the excess is counted and parsing recovers */
+static void test_overrun(void)
+{
+    ring_buffer_t ring;
+    nmea_parser_t parser;
+    test_sink_t sink = { 0 };
+    char line[96];
+    uint32_t line_len;
+    uint32_t offered = 0;
+    uint32_t stored = 0;
+    uint32_t pos;
+    uint32_t i;
+
+    ring_buffer_init(&ring, test_storage, sizeof(test_storage));
+    nmea_parser_init(&parser, test_sentence_cb, &sink);
+
+    for (i = 0; i < 10U; i++)
+    {
+        line_len = test_sentence(i, line);
+        for (pos = 0; pos < line_len; pos++)
+            stored += ring_buffer_put(&ring, (uint8_t)line[pos]);
+        offered += line_len;
+    }
+    HOST_TEST_CHECK(stored == TEST_RING_LEN);
+    HOST_TEST_CHECK(ring.overruns == (offered - TEST_RING_LEN));
+    test_drain(&ring, &parser);
+
+    /* Whole sentences before the overrun, none made up from the torn one */
+    HOST_TEST_CHECK(sink.received == (TEST_RING_LEN / line_len));
+    HOST_TEST_CHECK(sink.out_of_order == 0U);
+
+    sink.expected = 100U;
+    for (i = 100U; i < 110U; i++)
+    {
+        line_len = test_sentence(i, line);
+        for (pos = 0; pos < line_len; pos++)
+            ring_buffer_put(&ring, (uint8_t)line[pos]);
+        test_drain(&ring, &parser);
+    }
+    HOST_TEST_CHECK(sink.received == ((TEST_RING_LEN / line_len) + 10U));
+    HOST_TEST_CHECK(sink.out_of_order == 0U);
+}
+
+/* One 4-byte queue message per character, as g_gps_queue carried them */
+typedef struct st_test_queue
+{
+    uint32_t msg[TEST_RING_LEN];
+    uint32_t head;
+    uint32_t tail;
+} test_queue_t;
+
+static void test_benchmark(void)
+{
+    static test_queue_t queue;
+    ring_buffer_t ring;
+    nmea_parser_t parser;
+    test_sink_t sink = { 0 };
+    char line[96];
+    uint32_t line_len = test_sentence(123519U, line);
+    uint64_t bytes = (uint64_t)line_len * TEST_BENCH_SENTENCES;
+    uint64_t start;
+    uint64_t ring_cycles;
+    uint64_t queue_cycles;
+    uint32_t pos;
+    uint32_t msg;
+    uint8_t byte;
+    uint32_t i;
+
+    ring_buffer_init(&ring, test_storage, sizeof(test_storage));
+    nmea_parser_init(&parser, test_sentence_cb, &sink);
+    start = host_test_cycles();
+    for (i = 0; i < TEST_BENCH_SENTENCES; i++)
+    {
+        for (pos = 0; pos < line_len; pos++)
+            ring_buffer_put(&ring, (uint8_t)line[pos]);
+        test_drain(&ring, &parser);
+    }
+    ring_cycles = host_test_cycles() - start;
+    HOST_TEST_CHECK(sink.received == TEST_BENCH_SENTENCES);
+
+    sink.received = 0;
+    nmea_parser_init(&parser, test_sentence_cb, &sink);
+    start = host_test_cycles();
+    for (i = 0; i < TEST_BENCH_SENTENCES; i++)
+    {
+        for (pos = 0; pos < line_len; pos++)
+        {
+            queue.msg[queue.head++ % TEST_RING_LEN] = (uint32_t)(uint8_t)line[pos];
+            __asm volatile ("" ::: "memory");
+        }
+        while (queue.tail != queue.head)
+        {
+            msg = queue.msg[queue.tail++ % TEST_RING_LEN];
+            byte = (uint8_t)msg;
+            nmea_parser_feed(&parser, &byte, 1);
+        }
+    }
+    queue_cycles = host_test_cycles() - start;
+    HOST_TEST_CHECK(sink.received == TEST_BENCH_SENTENCES);
+
+    printf("ring + span parse: %.1f cycles/byte, per-byte queue model: %.1f cycles/byte\r\n",
+           (double)ring_cycles / (double)bytes, (double)queue_cycles / (double)bytes);
+}
+
+int main(void)
+{
+    test_producer(false);
+    test_producer(true);
+    test_overrun();
+    test_benchmark();
+
+    return host_test_finish("ring_buffer");
+}
+
+#endif /* SENSORS_BUS_SIM */
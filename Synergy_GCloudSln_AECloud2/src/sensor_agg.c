@@ -0,0 +1,87 @@
+/*
+ * sensor_agg.c
+ *
+ *  Windowed min/max/mean/stddev/RMS. See sensor_agg.h.
+ */
+
+#include <math.h>
+#include <string.h>
+#include "sensor_agg.h"
+
+void sensor_agg_reset(sensor_agg_t *p_agg)
+{
+    memset(p_agg, 0, sizeof(*p_agg));
+}
+
+void sensor_agg_add(sensor_agg_t *p_agg, int32_t value)
+{
+    float delta;
+
+    if (p_agg->count == 0U)
+    {
+        p_agg->count = 1U;
+        p_agg->origin = value;
+        p_agg->min = value;
+        p_agg->max = value;
+        p_agg->mean = 0.0f;
+        p_agg->m2 = 0.0f;
+        return;
+    }
+
+    if (value < p_agg->min)
+        p_agg->min = value;
+    if (value > p_agg->max)
+        p_agg->max = value;
+
+    p_agg->count++;
+    delta = (float) (value - p_agg->origin) - p_agg->mean;
+    p_agg->mean += delta / (float) p_agg->count;
+    p_agg->m2 += delta * ((float) (value - p_agg->origin) - p_agg->mean);
+}
+
+/* Chan et al. pairwise combination, p_src re-based on p_dst's origin */
+void sensor_agg_merge(sensor_agg_t *p_dst, sensor_agg_t const *p_src)
+{
+    float delta;
+    float n;
+
+    if (p_src->count == 0U)
+        return;
+
+    if (p_dst->count == 0U)
+    {
+        *p_dst = *p_src;
+        return;
+    }
+
+    if (p_src->min < p_dst->min)
+        p_dst->min = p_src->min;
+    if (p_src->max > p_dst->max)
+        p_dst->max = p_src->max;
+
+    n = (float) p_dst->count + (float) p_src->count;
+    delta = (float) (p_src->origin - p_dst->origin) + p_src->mean - p_dst->mean;
+    p_dst->mean += delta * ((float) p_src->count / n);
+    p_dst->m2 += p_src->m2 + (delta * delta * (((float) p_dst->count * (float) p_src->count) / n));
+    p_dst->count += p_src->count;
+}
+
+void sensor_agg_get(sensor_agg_t const *p_agg, sensor_agg_stats_t *p_stats)
+{
+    float variance;
+
+    memset(p_stats, 0, sizeof(*p_stats));
+    if (p_agg->count == 0U)
+        return;
+
+    variance = p_agg->m2 / (float) p_agg->count;
+    if (variance < 0.0f)
+        variance = 0.0f;
+
+    p_stats->count = p_agg->count;
+    p_stats->min = p_agg->min;
+    p_stats->max = p_agg->max;
+    p_stats->mean = (float) p_agg->origin + p_agg->mean;
+    p_stats->stddev = sqrtf(variance);
+    p_stats->rms = sqrtf(variance + (p_stats->mean * p_stats->mean));
+}
@@ -0,0 +1,67 @@
+/*
+ * sensor_agg.h
+ *
+ *  Windowed aggregation of sensor streams: count, min, max, mean, standard
+ *  deviation and RMS of every sample between two publishes, in O(1) memory
+ *  per channel.
+ *
+ *  Mean and spread use Welford's update in single precision, taken about the
+ *  window's first sample so that a large constant level (pressure in Pa,
+ *  accel z at 1 g) does not cost precision. Two windows combine with
+ *  sensor_agg_merge(), so a producer can aggregate a batch without a lock
+ *  and merge it into the shared window once.
+ *
+ *  Values are in the channel's raw integer units, see sensor_agg_channel_t.
+ *  Within a window they must stay within +/-2^30 of the first sample.
+ */
+
+#ifndef SENSOR_AGG_H_
+#define SENSOR_AGG_H_
+
+#include <stdint.h>
+
+typedef enum e_sensor_agg_channel
+{
+    SENSOR_AGG_ACCEL_X = 0,     /* BMI160 LSB */
+    SENSOR_AGG_ACCEL_Y,
+    SENSOR_AGG_ACCEL_Z,
+    SENSOR_AGG_GYRO_X,
+    SENSOR_AGG_GYRO_Y,
+    SENSOR_AGG_GYRO_Z,
+    SENSOR_AGG_MAG_X,           /* BMM150 compensated */
+    SENSOR_AGG_MAG_Y,
+    SENSOR_AGG_MAG_Z,
+    SENSOR_AGG_TEMPERATURE,     /* BME680, 0.01 degC */
+    SENSOR_AGG_HUMIDITY,        /* BME680, 0.001 %RH */
+    SENSOR_AGG_PRESSURE,        /* BME680, Pa */
+    SENSOR_AGG_LIGHT,           /* ISL29035, milli-lux */
+    SENSOR_AGG_CHANNELS
+} sensor_agg_channel_t;
+
+typedef struct st_sensor_agg
+{
+    uint32_t count;
+    int32_t  origin;            /* First sample; mean is relative to it */
+    int32_t  min;
+    int32_t  max;
+    float    mean;
+    float    m2;                /* Sum of squared deviations from the mean */
+} sensor_agg_t;
+
+/* All zero when the window had no samples */
+typedef struct st_sensor_agg_stats
+{
+    uint32_t count;
+    int32_t  min;
+    int32_t  max;
+    float    mean;
+    float    stddev;            /* Population, divides by count */
+    float    rms;
+} sensor_agg_stats_t;
+
+void sensor_agg_reset(sensor_agg_t *p_agg);
+void sensor_agg_add(sensor_agg_t *p_agg, int32_t value);
+void sensor_agg_merge(sensor_agg_t *p_dst, sensor_agg_t const *p_src);
+void sensor_agg_get(sensor_agg_t const *p_agg, sensor_agg_stats_t *p_stats);
+
+#endif /* SENSOR_AGG_H_ */
@@ -0,0 +1,161 @@
+/*
+ * sensor_agg_test.c
+ *
+ *  Host accuracy check of the window aggregates against a long double
+ *  reference, on streams shaped like the real channels: accel at 1 g,
+ *  vibration, pressure in Pa with noise and with drift, humidity, a
+ *  constant temperature and an hour of gyro at 400 Hz. Each stream is
+ *  aggregated sample by sample and again as the nav thread does it, in
+ *  batches of 1 to 16 merged into the window.
+ *
+ *  count, min and max must be exact; mean within 1e-3 of a standard
+ *  deviation, stddev within 1e-4 and RMS within 2e-4 relative. The hour of
+ *  gyro is the loosest: single-precision Welford steps shrink below an ulp
+ *  of the mean once the count is in the millions.
+ *
+ *  Built by host_test.mk with SENSORS_BUS_SIM; empty in the firmware build.
+ */
+
+#if defined(SENSORS_BUS_SIM)
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "host_test.h"
+#include "sensor_agg.h"
+
+#define TEST_BATCH_MAX          (16)
+
+typedef struct st_test_stream
+{
+    char const *name;
+    uint32_t    count;
+    double      level;
+    double      sigma;
+    double      drift;      /* Over the whole window */
+} test_stream_t;
+
+/* Standard normal, Box-Muller */
+static double test_gauss(void)
+{
+    double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+    double v = (rand() + 1.0) / (RAND_MAX + 2.0);
+
+    return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+static void test_stream(test_stream_t const *p_stream, bool merged)
+{
+    int32_t *p_values = malloc(p_stream->count * sizeof(*p_values));
+    sensor_agg_t window;
+    sensor_agg_t batch;
+    sensor_agg_stats_t stats;
+    long double sum = 0.0L;
+    long double sum_sq = 0.0L;
+    long double mean;
+    long double stddev;
+    long double rms;
+    int32_t min = INT32_MAX;
+    int32_t max = INT32_MIN;
+    int batch_size = 0;
+    double mean_err;
+    double stddev_err;
+    double rms_err;
+    uint32_t i;
+
+    HOST_TEST_CHECK(p_values != NULL);
+    if (p_values == NULL)
+        return;
+
+    sensor_agg_reset(&window);
+    sensor_agg_reset(&batch);
+    for (i = 0; i < p_stream->count; i++)
+    {
+        p_values[i] = (int32_t)lround(p_stream->level + ((p_stream->drift * i) / p_stream->count)
+                                      + (p_stream->sigma * test_gauss()));
+        sum += p_values[i];
+        min = (p_values[i] < min) ? p_values[i] : min;
+        max = (p_values[i] > max) ? p_values[i] : max;
+
+        if (merged)
+        {
+            sensor_agg_add(&batch, p_values[i]);
+            if (++batch_size >= (1 + (rand() % TEST_BATCH_MAX)))
+            {
+                sensor_agg_merge(&window, &batch);
+                sensor_agg_reset(&batch);
+                batch_size = 0;
+            }
+        }
+        else
+        {
+            sensor_agg_add(&window, p_values[i]);
+        }
+    }
+    if (merged)
+        sensor_agg_merge(&window, &batch);
+
+    mean = sum / p_stream->count;
+    for (i = 0; i < p_stream->count; i++)
+        sum_sq += (p_values[i] - mean) * (p_values[i] - mean);
+    stddev = sqrtl(sum_sq / p_stream->count);
+    rms = sqrtl((sum_sq / p_stream->count) + (mean * mean));
+    free(p_values);
+
+    sensor_agg_get(&window, &stats);
+    mean_err = (double)(fabsl(stats.mean - mean) / ((stddev > 0.0L) ? stddev : 1.0L));
+    stddev_err = (double)((stddev > 0.0L) ? (fabsl(stats.stddev - stddev) / stddev) : fabsl(stats.stddev));
+    rms_err = (double)(fabsl(stats.rms - rms) / rms);
+
+    printf("%-30s %7lu %-7s mean %.1e sd, stddev %.1e, rms %.1e\r\n", p_stream->name,
+           (unsigned long)p_stream->count, merged ? "merged" : "direct", mean_err, stddev_err, rms_err);
+
+    HOST_TEST_CHECK(stats.count == p_stream->count);
+    HOST_TEST_CHECK((stats.min == min) && (stats.max == max));
+    HOST_TEST_CHECK(mean_err < 1e-3);
+    HOST_TEST_CHECK(stddev_err < 1e-4);
+    HOST_TEST_CHECK(rms_err < 2e-4);
+}
+
+int main(void)
+{
+    static test_stream_t const streams[] =
+    {
+        { "accel z 1 g, 20 LSB noise", 24000U, 8192.0, 20.0, 0.0 },
+        { "accel x, 3000 LSB vibration", 240000U, 0.0, 3000.0, 0.0 },
+        { "pressure Pa, 3 Pa noise", 3600U, 101325.0, 3.0, 0.0 },
+        { "pressure Pa, 200 Pa drift", 3600U, 101325.0, 3.0, 200.0 },
+        { "humidity 0.001 %RH", 3600U, 45000.0, 50.0, 0.0 },
+        { "temperature 0.01 C, constant", 3600U, 2345.0, 0.0, 0.0 },
+        { "gyro, 1 hour at 400 Hz", 1440000U, -12.0, 4.0, 0.0 },
+    };
+    sensor_agg_t empty;
+    sensor_agg_t window;
+    sensor_agg_t before;
+    sensor_agg_stats_t stats;
+    uint32_t i;
+
+    srand(3);
+    for (i = 0; i < (sizeof(streams) / sizeof(streams[0])); i++)
+    {
+        test_stream(&streams[i], false);
+        test_stream(&streams[i], true);
+    }
+
+    /* An empty window reads as zeros, and merging one changes nothing */
+    sensor_agg_reset(&empty);
+    sensor_agg_get(&empty, &stats);
+    HOST_TEST_CHECK((stats.count == 0U) && (stats.min == 0) && (stats.max == 0));
+    HOST_TEST_CHECK((stats.mean == 0.0f) && (stats.stddev == 0.0f) && (stats.rms == 0.0f));
+
+    sensor_agg_reset(&window);
+    sensor_agg_add(&window, 101325);
+    sensor_agg_add(&window, 101330);
+    before = window;
+    sensor_agg_merge(&window, &empty);
+    HOST_TEST_CHECK(memcmp(&window, &before, sizeof(window)) == 0);
+
+    return host_test_finish("sensor_agg");
+}
+
+#endif /* SENSORS_BUS_SIM */
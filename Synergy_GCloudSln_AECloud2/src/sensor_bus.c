@@ -0,0 +1,237 @@
+/*
+ * sensor_bus.c
+ *
+ *  Instrumented sensor bus with read coalescing. See sensor_bus.h.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#if !defined(SENSORS_BUS_SIM)
+#include "MQTT_Config.h"
+#include "MQTT_Thread.h"
+#include "sensors.h"
+#endif
+#include "sensor_bus.h"
+
+typedef struct st_sensor_bus_window
+{
+    uint8_t dev_id;
+    uint8_t first_reg;
+    uint8_t len;
+    bool    valid;
+    uint8_t served;             /* Registers handed out since the fetch, bit per register */
+    uint8_t data[SENSOR_BUS_WINDOW_LEN];
+} sensor_bus_window_t;
+
+static sensor_bus_stats_t sensor_bus_stats[SENSOR_BUS_DEV_MAX];
+static uint8_t sensor_bus_dev_count;
+static sensor_bus_window_t sensor_bus_windows[SENSOR_BUS_WINDOW_MAX];
+static uint8_t sensor_bus_window_count;
+static bool sensor_bus_bursting;
+
+/* Stats slot for a device, allocated on first use; NULL once the table is full */
+static sensor_bus_stats_t *sensor_bus_find_stats(uint8_t dev_id)
+{
+    uint8_t i;
+
+    for (i = 0; i < sensor_bus_dev_count; i++)
+    {
+        if (sensor_bus_stats[i].dev_id == dev_id)
+            return &sensor_bus_stats[i];
+    }
+
+    if (sensor_bus_dev_count >= SENSOR_BUS_DEV_MAX)
+        return NULL;
+
+    sensor_bus_stats[sensor_bus_dev_count].dev_id = dev_id;
+    return &sensor_bus_stats[sensor_bus_dev_count++];
+}
+
+static void sensor_bus_account(uint8_t dev_id, bool is_read, uint16_t len, uint32_t start, int8_t status)
+{
+    sensor_bus_stats_t *p_stats = sensor_bus_find_stats(dev_id);
+    uint32_t us = (SENSOR_BUS_CLOCK() - start) / SENSOR_BUS_CLOCK_PER_US;
+
+    if (p_stats == NULL)
+        return;
+
+    if (is_read)
+        p_stats->reads++;
+    else
+        p_stats->writes++;
+    p_stats->bytes += len;
+    p_stats->bus_us += us;
+    if (us > p_stats->worst_us)
+        p_stats->worst_us = us;
+    if (status != 0)
+        p_stats->errors++;
+}
+
+static int8_t sensor_bus_transfer_read(uint8_t dev_id, uint8_t reg_addr, uint8_t *p_data, uint16_t len)
+{
+    uint32_t start = SENSOR_BUS_CLOCK();
+    int8_t status = SENSOR_BUS_READ(dev_id, reg_addr, p_data, len);
+
+    sensor_bus_account(dev_id, true, len, start, status);
+    return status;
+}
+
+/* Window holding all of [reg_addr, reg_addr + len) while a burst is open */
+static sensor_bus_window_t *sensor_bus_find_window(uint8_t dev_id, uint8_t reg_addr, uint16_t len)
+{
+    uint8_t i;
+
+    if (!sensor_bus_bursting)
+        return NULL;
+
+    for (i = 0; i < sensor_bus_window_count; i++)
+    {
+        if ((sensor_bus_windows[i].dev_id == dev_id) && (reg_addr >= sensor_bus_windows[i].first_reg)
+            && (((uint32_t)reg_addr + len) <= ((uint32_t)sensor_bus_windows[i].first_reg + sensor_bus_windows[i].len)))
+            return &sensor_bus_windows[i];
+    }
+
+    return NULL;
+}
+
+void sensor_bus_init(void)
+{
+#if !defined(SENSORS_BUS_SIM)
+    /* Cycle counter for transaction timing */
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+
+    sensor_bus_window_count = 0;
+    sensor_bus_bursting = false;
+    sensor_bus_reset_stats();
+}
+
+/*
+ * Registers first_reg to first_reg + len - 1 may be read in one burst.
+ * Only list registers without read side effects (no FIFO ports, no
+ * clear-on-read status).
+ */
+bool sensor_bus_add_window(uint8_t dev_id, uint8_t first_reg, uint8_t len)
+{
+    sensor_bus_window_t *p_window;
+
+    if ((sensor_bus_window_count >= SENSOR_BUS_WINDOW_MAX) || (len == 0U) || (len > SENSOR_BUS_WINDOW_LEN))
+        return false;
+
+    p_window = &sensor_bus_windows[sensor_bus_window_count++];
+    p_window->dev_id = dev_id;
+    p_window->first_reg = first_reg;
+    p_window->len = len;
+    p_window->valid = false;
+
+    return true;
+}
+
+/* Call with the bus held; the burst ends before the bus is released */
+void sensor_bus_burst_begin(void)
+{
+    sensor_bus_bursting = true;
+}
+
+void sensor_bus_burst_end(void)
+{
+    uint8_t i;
+
+    sensor_bus_bursting = false;
+    for (i = 0; i < sensor_bus_window_count; i++)
+        sensor_bus_windows[i].valid = false;
+}
+
+int8_t sensor_bus_read(uint8_t dev_id, uint8_t reg_addr, uint8_t *p_data, uint16_t len)
+{
+    sensor_bus_window_t *p_window = sensor_bus_find_window(dev_id, reg_addr, len);
+    sensor_bus_stats_t *p_stats;
+    uint8_t offset;
+    uint8_t mask;
+    int8_t status;
+
+    if (p_window == NULL)
+        return sensor_bus_transfer_read(dev_id, reg_addr, p_data, len);
+
+    offset = (uint8_t)(reg_addr - p_window->first_reg);
+    mask = (uint8_t)(((1U << len) - 1U) << offset);
+
+    if (!p_window->valid || (p_window->served & mask))
+    {
+        status = sensor_bus_transfer_read(dev_id, p_window->first_reg, p_window->data, p_window->len);
+        p_window->valid = (status == 0);
+        p_window->served = 0;
+        if (status != 0)
+            return status;
+    }
+    else
+    {
+        p_stats = sensor_bus_find_stats(dev_id);
+        if (p_stats != NULL)
+            p_stats->merged++;
+    }
+
+    memcpy(p_data, &p_window->data[offset], len);
+    p_window->served |= mask;
+
+    return 0;
+}
+
+int8_t sensor_bus_write(uint8_t dev_id, uint8_t reg_addr, uint8_t *p_data, uint16_t len)
+{
+    uint32_t start;
+    int8_t status;
+    uint8_t i;
+
+    for (i = 0; i < sensor_bus_window_count; i++)
+    {
+        if (sensor_bus_windows[i].dev_id == dev_id)
+            sensor_bus_windows[i].valid = false;
+    }
+
+    start = SENSOR_BUS_CLOCK();
+    status = SENSOR_BUS_WRITE(dev_id, reg_addr, p_data, len);
+    sensor_bus_account(dev_id, false, len, start, status);
+
+    return status;
+}
+
+bool sensor_bus_get_stats(uint8_t dev_id, sensor_bus_stats_t *p_stats)
+{
+    uint8_t i;
+
+    for (i = 0; i < sensor_bus_dev_count; i++)
+    {
+        if (sensor_bus_stats[i].dev_id == dev_id)
+        {
+            *p_stats = sensor_bus_stats[i];
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void sensor_bus_reset_stats(void)
+{
+    memset(sensor_bus_stats, 0, sizeof(sensor_bus_stats));
+    sensor_bus_dev_count = 0;
+}
+
+void sensor_bus_print(void (*print_fn)(const char *msg))
+{
+    char line[128];
+    uint8_t i;
+
+    for (i = 0; i < sensor_bus_dev_count; i++)
+    {
+        snprintf(line, sizeof(line), "I2C 0x%02X: %lu rd %lu wr %lu B %lu us (worst %lu) %lu merged %lu err\r\n",
+                 sensor_bus_stats[i].dev_id,
+                 (unsigned long)sensor_bus_stats[i].reads, (unsigned long)sensor_bus_stats[i].writes,
+                 (unsigned long)sensor_bus_stats[i].bytes, (unsigned long)sensor_bus_stats[i].bus_us,
+                 (unsigned long)sensor_bus_stats[i].worst_us, (unsigned long)sensor_bus_stats[i].merged,
+                 (unsigned long)sensor_bus_stats[i].errors);
+        print_fn(line);
+    }
+}
@@ -0,0 +1,75 @@
+/*
+ * sensor_bus.h
+ *
+ *  Bus layer under the sensor drivers' read/write/delay_ms hooks.
+ *
+ *  sensor_bus_read() and sensor_bus_write() are the driver hooks. They
+ *  count transactions, payload bytes and wall time per device address, and
+ *  can merge adjacent register reads: a window registered with
+ *  sensor_bus_add_window() covers registers the device returns in one
+ *  auto-increment burst without side effects. Between
+ *  sensor_bus_burst_begin() and sensor_bus_burst_end(), the first read
+ *  inside a window fetches the whole window and later reads are served from
+ *  it. A write to the device, or a second read of the same register (a
+ *  poll), goes back to the bus.
+ *
+ *  On the board the backend is the SSP I2C wrappers on g_i2c0, timed with
+ *  the DWT cycle counter. Building with SENSORS_BUS_SIM routes it to the
+ *  register-map models in i2c_sim.c so the drivers can run on a host. The
+ *  sim clock is virtual; a host harness advances it from its own tick with
+ *  i2c_sim_advance_us().
+ */
+
+#ifndef SENSOR_BUS_H_
+#define SENSOR_BUS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#if defined(SENSORS_BUS_SIM)
+
+#include "i2c_sim.h"
+
+#define SENSOR_BUS_READ         i2c_sim_read
+#define SENSOR_BUS_WRITE        i2c_sim_write
+#define SENSOR_BUS_DELAY_MS     i2c_sim_delay_ms
+#define SENSOR_BUS_CLOCK()      ((uint32_t)i2c_sim_now_us())
+#define SENSOR_BUS_CLOCK_PER_US (1U)
+
+#else
+
+#define SENSOR_BUS_READ         synergy_i2c_read
+#define SENSOR_BUS_WRITE        synergy_i2c_write
+#define SENSOR_BUS_DELAY_MS     synergy_delay_ms
+#define SENSOR_BUS_CLOCK()      (DWT->CYCCNT)
+#define SENSOR_BUS_CLOCK_PER_US (SystemCoreClock / 1000000U)
+
+#endif
+
+#define SENSOR_BUS_DEV_MAX      (4U)    /* Device addresses with stats */
+#define SENSOR_BUS_WINDOW_MAX   (4U)
+#define SENSOR_BUS_WINDOW_LEN   (8U)    /* Registers per window */
+
+typedef struct st_sensor_bus_stats
+{
+    uint8_t  dev_id;
+    uint32_t reads;             /* Read transactions */
+    uint32_t writes;
+    uint32_t bytes;             /* Payload bytes */
+    uint32_t bus_us;            /* Wall time in transactions */
+    uint32_t worst_us;
+    uint32_t merged;            /* Reads served from a window, no transaction */
+    uint32_t errors;
+} sensor_bus_stats_t;
+
+void sensor_bus_init(void);
+bool sensor_bus_add_window(uint8_t dev_id, uint8_t first_reg, uint8_t len);
+void sensor_bus_burst_begin(void);
+void sensor_bus_burst_end(void);
+int8_t sensor_bus_read(uint8_t dev_id, uint8_t reg_addr, uint8_t *p_data, uint16_t len);
+int8_t sensor_bus_write(uint8_t dev_id, uint8_t reg_addr, uint8_t *p_data, uint16_t len);
+bool sensor_bus_get_stats(uint8_t dev_id, sensor_bus_stats_t *p_stats);
+void sensor_bus_reset_stats(void);
+void sensor_bus_print(void (*print_fn)(const char *msg));
+
+#endif /* SENSOR_BUS_H_ */
@@ -0,0 +1,310 @@
+/*
+ * sensor_bus_replay.c
+ *
+ *  Host replay of the drivers' bus transactions through sensor_bus.c
+ *  against the i2c_sim models, with and without the read windows that
+ *  sensors_init() registers. Built by host_test.mk with SENSORS_BUS_SIM;
+ *  empty in the firmware build.
+ *
+ *  The Bosch driver sources are not in this tree. The traces below are
+ *  transcribed from their call sequences: bme680_Initialize() inside its
+ *  boot-step burst, and the nav thread's motion wake (interrupt status,
+ *  FIFO length, FIFO data). Fails unless the coalesced run saves the reads
+ *  the windows were sized for and returns the same init data as the plain
+ *  one.
+ *
+ *  The magnetometer part counts the transactions per bmm150_read_data()
+ *  call: the aux set-up it used to redo on every sample (the
+ *  bmi160_config_aux_mode() and bmi160_set_aux_auto_mode() sequence of the
+ *  BMI160 API, steady state) against the single auto-mode burst read it
+ *  does now. Both must return the same magnetometer data.
+ */
+
+#if defined(SENSORS_BUS_SIM)
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdint.h>
+#include "sensor_bus.h"
+
+#define REPLAY_BME680           (0x76U)
+#define REPLAY_BMI160           (0x68U)
+#define REPLAY_WAKES            (20U)
+#define REPLAY_WAKE_US          (120000U)   /* 48 frames at 400 Hz */
+#define REPLAY_MAG_READS        (25U)
+#define REPLAY_MAG_US           (200000U)   /* The nav thread's 5 Hz magnetometer read */
+
+typedef enum e_replay_op
+{
+    REPLAY_READ,
+    REPLAY_WRITE,
+    REPLAY_DELAY_MS,
+    REPLAY_BURST_BEGIN,
+    REPLAY_BURST_END,
+    REPLAY_FIFO_READ,                   /* FIFO_DATA, length from the last FIFO_LENGTH read */
+} replay_op_t;
+
+typedef struct st_replay_step
+{
+    replay_op_t    op;
+    uint8_t        dev_id;
+    uint8_t        reg;
+    uint16_t       len;                 /* Bytes, or ms for REPLAY_DELAY_MS */
+    uint8_t const *p_data;              /* Write payload */
+} replay_step_t;
+
+static uint8_t const replay_soft_reset[] = { 0xB6 };
+static uint8_t const replay_heater[] = { 0x73, 0x64, 0x59 };
+static uint8_t const replay_sensor_settings[] = { 0x08, 0x74, 0x6C, 0x72, 0x02, 0x71, 0x10 };
+static uint8_t const replay_power_mode[] = { 0x6D };
+static uint8_t const replay_acc_normal[] = { 0x11 };
+static uint8_t const replay_gyr_normal[] = { 0x15 };
+static uint8_t const replay_odr_400[] = { 0x2A };
+static uint8_t const replay_fifo_config[] = { 0xD2 };
+static uint8_t const replay_aux_odr[] = { 0x08 };
+static uint8_t const replay_aux_if[] = { 0x20, 0x03 };                      /* BMM150 at 0x10, auto, 8-byte burst */
+static uint8_t const replay_aux_addr[] = { 0x42 };
+
+/* bme680_init(), the heater profile, bme680_set_sensor_settings() and bme680_set_sensor_mode() */
+static replay_step_t const replay_bme680_init[] =
+{
+    { REPLAY_BURST_BEGIN, 0, 0, 0, NULL },
+    { REPLAY_WRITE, REPLAY_BME680, 0xE0, 1, replay_soft_reset },            /* bme680_soft_reset() */
+    { REPLAY_DELAY_MS, 0, 0, 10, NULL },
+    { REPLAY_READ, REPLAY_BME680, 0xD0, 1, NULL },                          /* Chip ID */
+    { REPLAY_READ, REPLAY_BME680, 0x89, 25, NULL },                         /* get_calib_data() */
+    { REPLAY_READ, REPLAY_BME680, 0xE1, 16, NULL },
+    { REPLAY_READ, REPLAY_BME680, 0x02, 1, NULL },                          /* res_heat_range */
+    { REPLAY_READ, REPLAY_BME680, 0x00, 1, NULL },                          /* res_heat_val */
+    { REPLAY_READ, REPLAY_BME680, 0x04, 1, NULL },                          /* range_sw_err */
+    { REPLAY_WRITE, REPLAY_BME680, 0x5A, 3, replay_heater },                /* set_gas_config() */
+    { REPLAY_READ, REPLAY_BME680, 0x74, 1, NULL },                          /* bme680_set_sensor_settings() */
+    { REPLAY_READ, REPLAY_BME680, 0x75, 1, NULL },
+    { REPLAY_READ, REPLAY_BME680, 0x74, 1, NULL },
+    { REPLAY_READ, REPLAY_BME680, 0x72, 1, NULL },
+    { REPLAY_READ, REPLAY_BME680, 0x71, 1, NULL },
+    { REPLAY_WRITE, REPLAY_BME680, 0x75, 7, replay_sensor_settings },
+    { REPLAY_READ, REPLAY_BME680, 0x74, 1, NULL },                          /* bme680_set_sensor_mode() */
+    { REPLAY_WRITE, REPLAY_BME680, 0x74, 1, replay_power_mode },
+    { REPLAY_BURST_END, 0, 0, 0, NULL },
+};
+
+/* Accel and gyro at 400 Hz into a header-mode FIFO, as bmi160_Initialize() leaves it */
+static replay_step_t const replay_bmi160_setup[] =
+{
+    { REPLAY_WRITE, REPLAY_BMI160, 0x7E, 1, replay_acc_normal },
+    { REPLAY_WRITE, REPLAY_BMI160, 0x7E, 1, replay_gyr_normal },
+    { REPLAY_WRITE, REPLAY_BMI160, 0x40, 1, replay_odr_400 },
+    { REPLAY_WRITE, REPLAY_BMI160, 0x42, 1, replay_odr_400 },
+    { REPLAY_WRITE, REPLAY_BMI160, 0x47, 1, replay_fifo_config },
+};
+
+/* nav_update_motion() and bmi160_get_fifo_data() */
+static replay_step_t const replay_motion_wake[] =
+{
+    { REPLAY_BURST_BEGIN, 0, 0, 0, NULL },
+    { REPLAY_READ, REPLAY_BMI160, 0x1C, 4, NULL },                          /* INT_STATUS_0..3 */
+    { REPLAY_READ, REPLAY_BMI160, 0x22, 2, NULL },                          /* FIFO_LENGTH */
+    { REPLAY_FIFO_READ, REPLAY_BMI160, 0x24, 0, NULL },
+    { REPLAY_BURST_END, 0, 0, 0, NULL },
+};
+
+/* bmi160_config_aux_mode() then bmi160_set_aux_auto_mode(), which bmm150_read_data() used to run per sample */
+static replay_step_t const replay_aux_setup[] =
+{
+    { REPLAY_READ, REPLAY_BMI160, 0x4C, 1, NULL },                          /* bmi160_config_aux_mode() */
+    { REPLAY_READ, REPLAY_BMI160, 0x44, 1, NULL },                          /* config_aux_odr() */
+    { REPLAY_WRITE, REPLAY_BMI160, 0x44, 1, replay_aux_odr },
+    { REPLAY_DELAY_MS, 0, 0, 10, NULL },
+    { REPLAY_WRITE, REPLAY_BMI160, 0x4B, 2, replay_aux_if },
+    { REPLAY_DELAY_MS, 0, 0, 10, NULL },
+    { REPLAY_WRITE, REPLAY_BMI160, 0x4D, 1, replay_aux_addr },              /* bmi160_set_aux_auto_mode() */
+    { REPLAY_DELAY_MS, 0, 0, 10, NULL },
+    { REPLAY_READ, REPLAY_BMI160, 0x44, 1, NULL },                          /* config_aux_odr() */
+    { REPLAY_WRITE, REPLAY_BMI160, 0x44, 1, replay_aux_odr },
+    { REPLAY_DELAY_MS, 0, 0, 10, NULL },
+    { REPLAY_READ, REPLAY_BMI160, 0x4C, 1, NULL },                          /* bmi160_config_aux_mode() */
+    { REPLAY_READ, REPLAY_BMI160, 0x44, 1, NULL },
+    { REPLAY_WRITE, REPLAY_BMI160, 0x44, 1, replay_aux_odr },
+    { REPLAY_DELAY_MS, 0, 0, 10, NULL },
+    { REPLAY_WRITE, REPLAY_BMI160, 0x4B, 2, replay_aux_if },
+    { REPLAY_DELAY_MS, 0, 0, 10, NULL },
+};
+
+/* bmi160_read_aux_data_auto_mode(): DATA_0..7 */
+static replay_step_t const replay_aux_read[] =
+{
+    { REPLAY_READ, REPLAY_BMI160, 0x04, 8, NULL },
+};
+
+static uint8_t replay_buf[1100];
+static uint16_t replay_fifo_len;
+static uint32_t replay_hash;            /* FNV-1a of the data read */
+
+static void replay_run(replay_step_t const *p_steps, size_t count)
+{
+    uint8_t payload[16];
+    uint16_t len;
+    uint16_t i;
+
+    for (; count > 0U; count--, p_steps++)
+    {
+        switch (p_steps->op)
+        {
+            case REPLAY_READ:
+            case REPLAY_FIFO_READ:
+                len = (p_steps->op == REPLAY_FIFO_READ) ? replay_fifo_len : p_steps->len;
+                if (len > sizeof(replay_buf))
+                    len = sizeof(replay_buf);
+                sensor_bus_read(p_steps->dev_id, p_steps->reg, replay_buf, len);
+                if ((p_steps->op == REPLAY_READ) && (p_steps->reg == 0x22U) && (len == 2U))
+                    replay_fifo_len = (uint16_t)(replay_buf[0] | (replay_buf[1] << 8));
+                for (i = 0; i < len; i++)
+                    replay_hash = (replay_hash ^ replay_buf[i]) * 16777619U;
+                break;
+
+            case REPLAY_WRITE:
+                for (i = 0; (i < p_steps->len) && (i < sizeof(payload)); i++)
+                    payload[i] = p_steps->p_data[i];
+                sensor_bus_write(p_steps->dev_id, p_steps->reg, payload, i);
+                break;
+
+            case REPLAY_DELAY_MS:
+                i2c_sim_delay_ms(p_steps->len);
+                break;
+
+            case REPLAY_BURST_BEGIN:
+                sensor_bus_burst_begin();
+                break;
+
+            case REPLAY_BURST_END:
+                sensor_bus_burst_end();
+                break;
+        }
+    }
+}
+
+#define REPLAY_RUN(steps)   replay_run((steps), sizeof(steps) / sizeof((steps)[0]))
+
+typedef struct st_replay_result
+{
+    sensor_bus_stats_t init;
+    uint32_t           init_hash;
+    sensor_bus_stats_t wakes;
+} replay_result_t;
+
+static void replay_pass(bool windows, replay_result_t *p_result)
+{
+    i2c_sim_config_t const config = { .bus_hz = 400000U, .overhead_us = 30U };
+    uint32_t i;
+
+    i2c_sim_init(&config);
+    sensor_bus_init();
+    if (windows)
+    {
+        /* As sensors_init() registers them */
+        sensor_bus_add_window(REPLAY_BME680, 0x00, 5);
+        sensor_bus_add_window(REPLAY_BME680, 0x70, 6);
+        sensor_bus_add_window(REPLAY_BMI160, 0x1C, 8);
+    }
+
+    replay_hash = 2166136261U;
+    REPLAY_RUN(replay_bme680_init);
+    p_result->init_hash = replay_hash;
+    sensor_bus_get_stats(REPLAY_BME680, &p_result->init);
+
+    REPLAY_RUN(replay_bmi160_setup);
+    sensor_bus_reset_stats();
+    for (i = 0; i < REPLAY_WAKES; i++)
+    {
+        i2c_sim_advance_us(REPLAY_WAKE_US);
+        REPLAY_RUN(replay_motion_wake);
+    }
+    sensor_bus_get_stats(REPLAY_BMI160, &p_result->wakes);
+
+    printf("%-9s  BME680 init: %2lu reads %2lu merged %5lu us   %u motion wakes: %2lu reads %2lu merged %6lu us\r\n",
+           windows ? "coalesced" : "plain",
+           (unsigned long)p_result->init.reads, (unsigned long)p_result->init.merged,
+           (unsigned long)p_result->init.bus_us, (unsigned)REPLAY_WAKES,
+           (unsigned long)p_result->wakes.reads, (unsigned long)p_result->wakes.merged,
+           (unsigned long)p_result->wakes.bus_us);
+}
+
+typedef struct st_replay_mag
+{
+    sensor_bus_stats_t bus;
+    uint32_t           data_hash;       /* FNV-1a of DATA_0..7 per read */
+    uint32_t           call_us;         /* Bus time and delays per call */
+} replay_mag_t;
+
+static void replay_mag(bool setup_each_read, replay_mag_t *p_result)
+{
+    i2c_sim_config_t const config = { .bus_hz = 400000U, .overhead_us = 30U };
+    i2c_sim_inputs_t inputs = { .rhall = 6000U };
+    uint64_t call_us = 0;
+    uint64_t start;
+    uint32_t i;
+    uint8_t b;
+
+    i2c_sim_init(&config);
+    sensor_bus_init();
+
+    /* bmm150_Initialize() */
+    REPLAY_RUN(replay_aux_setup);
+    sensor_bus_reset_stats();
+
+    p_result->data_hash = 2166136261U;
+    for (i = 0; i < REPLAY_MAG_READS; i++)
+    {
+        inputs.mag[0] = (int16_t)(100 + (int32_t)i);
+        inputs.mag[1] = (int16_t)(-200 - (int32_t)i);
+        inputs.mag[2] = (int16_t)(300 + (2 * (int32_t)i));
+        i2c_sim_set_inputs(&inputs);
+        i2c_sim_advance_us(REPLAY_MAG_US);
+
+        start = i2c_sim_now_us();
+        if (setup_each_read)
+            REPLAY_RUN(replay_aux_setup);
+        REPLAY_RUN(replay_aux_read);
+        call_us += i2c_sim_now_us() - start;
+
+        for (b = 0; b < 8U; b++)
+            p_result->data_hash = (p_result->data_hash ^ replay_buf[b]) * 16777619U;
+    }
+    sensor_bus_get_stats(REPLAY_BMI160, &p_result->bus);
+    p_result->call_us = (uint32_t)(call_us / REPLAY_MAG_READS);
+
+    printf("%-9s  %u BMM150 reads: %3lu reads %3lu writes %5lu bus us, %5lu us per call\r\n",
+           setup_each_read ? "per-read" : "auto", (unsigned)REPLAY_MAG_READS,
+           (unsigned long)p_result->bus.reads, (unsigned long)p_result->bus.writes,
+           (unsigned long)p_result->bus.bus_us, (unsigned long)p_result->call_us);
+}
+
+int main(void)
+{
+    replay_result_t plain;
+    replay_result_t coalesced;
+    replay_mag_t per_read;
+    replay_mag_t auto_mode;
+    bool pass;
+
+    replay_pass(false, &plain);
+    replay_pass(true, &coalesced);
+    replay_mag(true, &per_read);
+    replay_mag(false, &auto_mode);
+
+    /* Five init reads served from the windows, and the FIFO length on each wake */
+    pass = (plain.init.reads == 12U) && (coalesced.init.reads == 7U) &&
+           (plain.wakes.reads == (3U * REPLAY_WAKES)) && (coalesced.wakes.reads == (2U * REPLAY_WAKES)) &&
+           (coalesced.init_hash == plain.init_hash) && (coalesced.init.bus_us < plain.init.bus_us);
+
+    /* Six reads, six writes and 60 ms of delays per sample down to one burst read */
+    pass = pass && (per_read.bus.reads == (6U * REPLAY_MAG_READS)) && (per_read.bus.writes == (6U * REPLAY_MAG_READS)) &&
+           (auto_mode.bus.reads == REPLAY_MAG_READS) && (auto_mode.bus.writes == 0U) &&
+           (auto_mode.data_hash == per_read.data_hash) && (auto_mode.call_us < per_read.call_us);
+
+    printf("sensor_bus replay: %s\r\n", pass ? "PASS" : "FAIL");
+    return pass ? 0 : 1;
+}
+
+#endif /* SENSORS_BUS_SIM */
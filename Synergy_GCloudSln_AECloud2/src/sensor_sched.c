@@ -0,0 +1,128 @@
+/*
+ * sensor_sched.c
+ *
+ *  Rate-monotonic sampling scheduler. See sensor_sched.h.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "sensor_sched.h"
+
+/*
+ * Rate-monotonic priority is the table order. Tasks are released together
+ * at init.
+ */
+void sensor_sched_init(sensor_sched_t *p_sched, sensor_task_t *p_tasks, uint8_t task_count,
+                       uint32_t (*now_ms)(void))
+{
+    sensor_task_t task;
+    uint32_t now = now_ms();
+    uint8_t i;
+    uint8_t j;
+
+    /* Insertion sort, a handful of tasks */
+    for (i = 1; i < task_count; i++)
+    {
+        task = p_tasks[i];
+        for (j = i; (j > 0) && (p_tasks[j - 1U].period_ms > task.period_ms); j--)
+            p_tasks[j] = p_tasks[j - 1U];
+        p_tasks[j] = task;
+    }
+
+    for (i = 0; i < task_count; i++)
+    {
+        p_tasks[i].release_ms = now;
+        memset(&p_tasks[i].stats, 0, sizeof(p_tasks[i].stats));
+    }
+
+    p_sched->p_tasks = p_tasks;
+    p_sched->task_count = task_count;
+    p_sched->now_ms = now_ms;
+}
+
+/*
+ * Run the highest priority released task, if any. Returns the time in ms
+ * until the next release, 0 if another task is already due.
+ */
+uint32_t sensor_sched_run(sensor_sched_t *p_sched)
+{
+    sensor_task_t *p_task = NULL;
+    uint32_t now = p_sched->now_ms();
+    uint32_t start;
+    uint32_t finish;
+    uint32_t elapsed;
+    uint32_t wait = UINT32_MAX;
+    int32_t until;
+    uint8_t i;
+
+    for (i = 0; i < p_sched->task_count; i++)
+    {
+        if ((int32_t)(now - p_sched->p_tasks[i].release_ms) >= 0)
+        {
+            p_task = &p_sched->p_tasks[i];
+            break;
+        }
+    }
+
+    if (p_task != NULL)
+    {
+        start = now;
+        if (p_task->read(p_task->p_context) != 0)
+            p_task->stats.failures++;
+        finish = p_sched->now_ms();
+
+        p_task->stats.runs++;
+
+        elapsed = start - p_task->release_ms;
+        p_task->stats.jitter_sum_ms += elapsed;
+        if (elapsed > p_task->stats.jitter_max_ms)
+            p_task->stats.jitter_max_ms = elapsed;
+
+        elapsed = finish - p_task->release_ms;
+        if (elapsed > p_task->stats.response_max_ms)
+            p_task->stats.response_max_ms = elapsed;
+        if (elapsed > p_task->deadline_ms)
+            p_task->stats.deadline_misses++;
+
+        /* Keep the release grid; drop releases that have already passed */
+        p_task->release_ms += p_task->period_ms;
+        while ((int32_t)(finish - p_task->release_ms) >= (int32_t)p_task->period_ms)
+        {
+            p_task->release_ms += p_task->period_ms;
+            p_task->stats.releases_lost++;
+        }
+
+        now = finish;
+    }
+
+    for (i = 0; i < p_sched->task_count; i++)
+    {
+        until = (int32_t)(p_sched->p_tasks[i].release_ms - now);
+        if (until <= 0)
+            return 0;
+        if ((uint32_t)until < wait)
+            wait = (uint32_t)until;
+    }
+
+    return wait;
+}
+
+void sensor_sched_print(sensor_sched_t const *p_sched, void (*p_print)(char const *p_str))
+{
+    char str[128];
+    sensor_task_t const *p_task;
+    uint8_t i;
+
+    p_print("\r\nTask      Period(ms)  Runs  Fails  Misses  Lost  Jitter avg/max(ms)  Resp max(ms)\r\n");
+    for (i = 0; i < p_sched->task_count; i++)
+    {
+        p_task = &p_sched->p_tasks[i];
+        snprintf(str, sizeof(str), "%-8s  %10lu  %4lu  %5lu  %6lu  %4lu  %8lu/%-9lu  %12lu\r\n", p_task->name,
+                 (unsigned long)p_task->period_ms, (unsigned long)p_task->stats.runs,
+                 (unsigned long)p_task->stats.failures, (unsigned long)p_task->stats.deadline_misses,
+                 (unsigned long)p_task->stats.releases_lost,
+                 (unsigned long)(p_task->stats.runs ? (p_task->stats.jitter_sum_ms / p_task->stats.runs) : 0U),
+                 (unsigned long)p_task->stats.jitter_max_ms, (unsigned long)p_task->stats.response_max_ms);
+        p_print(str);
+    }
+}
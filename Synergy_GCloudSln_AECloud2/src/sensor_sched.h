@@ -0,0 +1,60 @@
+/*
+ * sensor_sched.h
+ *
+ *  Rate-monotonic sampling scheduler.
+ *
+ *  Each sensor registers a period, a deadline relative to its release and a
+ *  read function. sensor_sched_run() runs the released task with the
+ *  shortest period, one task per call, so a slow sensor delays a faster one
+ *  by at most one read. Reads are not pre-empted by the scheduler.
+ *
+ *  The scheduler has no RTOS dependency: time comes from the now_ms hook.
+ *  On the host, pass a virtual clock and let the read functions advance it
+ *  to simulate sensor latency; the statistics are then exact.
+ */
+
+#ifndef SENSOR_SCHED_H_
+#define SENSOR_SCHED_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Returns 0 on success */
+typedef int32_t (*sensor_sched_read_t)(void *p_context);
+
+typedef struct st_sensor_task_stats
+{
+    uint32_t runs;
+    uint32_t failures;          /* Read function returned non-zero */
+    uint32_t deadline_misses;   /* Finished later than deadline_ms after release */
+    uint32_t releases_lost;     /* Whole periods skipped after an overrun */
+    uint32_t jitter_max_ms;     /* Start minus release */
+    uint32_t jitter_sum_ms;
+    uint32_t response_max_ms;   /* Finish minus release */
+} sensor_task_stats_t;
+
+typedef struct st_sensor_task
+{
+    char const          *name;
+    uint32_t             period_ms;
+    uint32_t             deadline_ms;
+    sensor_sched_read_t  read;
+    void                *p_context;
+
+    uint32_t             release_ms;    /* Next release */
+    sensor_task_stats_t  stats;
+} sensor_task_t;
+
+typedef struct st_sensor_sched
+{
+    sensor_task_t *p_tasks;         /* Sorted by period, shortest first */
+    uint8_t        task_count;
+    uint32_t     (*now_ms)(void);
+} sensor_sched_t;
+
+void sensor_sched_init(sensor_sched_t *p_sched, sensor_task_t *p_tasks, uint8_t task_count,
+                       uint32_t (*now_ms)(void));
+uint32_t sensor_sched_run(sensor_sched_t *p_sched);
+void sensor_sched_print(sensor_sched_t const *p_sched, void (*p_print)(char const *p_str));
+
+#endif /* SENSOR_SCHED_H_ */
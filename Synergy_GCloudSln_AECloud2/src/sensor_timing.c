@@ -0,0 +1,165 @@
+/*
+ * sensor_timing.c
+ *
+ *  Per-sensor time budgets and latency instrumentation. See sensor_timing.h.
+ */
+
+#include "MQTT_Config.h"
+#include "MQTT_Thread.h"
+#include "sensor_timing.h"
+#include "sensor_bus.h"
+
+#define SENSOR_MS_TO_TICKS(ms)  ((((ULONG)(ms) * TX_TIMER_TICKS_PER_SECOND) + 999U) / 1000U)
+#define SENSOR_TICKS_TO_MS(t)   ((uint32_t)(((t) * 1000U) / TX_TIMER_TICKS_PER_SECOND))
+
+#if !defined(SENSORS_BUS_SIM)
+void synergy_delay_ms(uint32_t period);
+#endif
+
+static sensor_timing_t sensor_timing[SENSOR_ID_COUNT] =
+{
+    [SENSOR_ID_BMI160]   = { .name = "BMI160",   .budget_ticks = SENSOR_MS_TO_TICKS(20) },
+    [SENSOR_ID_BME680]   = { .name = "BME680",   .budget_ticks = SENSOR_MS_TO_TICKS(20) },
+    [SENSOR_ID_BMM150]   = { .name = "BMM150",   .budget_ticks = SENSOR_MS_TO_TICKS(20) },
+    [SENSOR_ID_GPS]      = { .name = "GPS",      .budget_ticks = SENSOR_MS_TO_TICKS(10) },
+    [SENSOR_ID_ISL29035] = { .name = "ISL29035", .budget_ticks = SENSOR_MS_TO_TICKS(10) },
+    [SENSOR_ID_VIBRATION] = { .name = "Vibration", .budget_ticks = SENSOR_MS_TO_TICKS(20) },
+};
+
+static TX_THREAD * volatile sensor_sampling_thread;   /* Thread whose reads a demo stop cancels */
+static volatile bool sensor_cancelled;
+
+void sensor_timing_set_budget(sensor_id_t id, uint32_t budget_ms)
+{
+    sensor_timing[id].budget_ticks = SENSOR_MS_TO_TICKS(budget_ms);
+}
+
+/*
+ * Make the calling thread's reads and delays cancellable by a demo stop,
+ * or stop that. Outside such a section they always run to completion.
+ */
+void sensor_timing_sampling(bool active)
+{
+    sensor_cancelled = false;
+    sensor_sampling_thread = active ? tx_thread_identify() : NULL;
+}
+
+/* The caller is the thread a demo stop cancels */
+static bool sensor_timing_cancellable(void)
+{
+    return (sensor_sampling_thread != NULL) && (tx_thread_identify() == sensor_sampling_thread);
+}
+
+/* Peek at DEMO_STOP_FLAG without consuming it */
+bool sensor_timing_stop_requested(void)
+{
+    ULONG flags;
+
+    return (tx_event_flags_get(&g_user_event_flags, DEMO_STOP_FLAG, TX_OR, &flags, TX_NO_WAIT) == TX_SUCCESS);
+}
+
+/*
+ * Returns true if the sensor should be read now; the bus (if any) is then
+ * held until sensor_timing_end().
+ */
+bool sensor_timing_begin(sensor_id_t id, TX_MUTEX *p_bus)
+{
+    sensor_timing_t *p_timing = &sensor_timing[id];
+
+    if (sensor_timing_cancellable() && (sensor_cancelled || sensor_timing_stop_requested()))
+    {
+        sensor_cancelled = true;
+        p_timing->skips++;
+        return false;
+    }
+
+    if (p_timing->backoff)
+    {
+        p_timing->backoff--;
+        p_timing->skips++;
+        return false;
+    }
+
+    p_timing->start = tx_time_get();
+
+    if ((p_bus != NULL) && (tx_mutex_get(p_bus, p_timing->budget_ticks) != TX_SUCCESS))
+    {
+        p_timing->skips++;
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Returns false if the read was cut short by a demo stop, in which case the
+ * data must be treated as stale.
+ */
+bool sensor_timing_end(sensor_id_t id, TX_MUTEX *p_bus)
+{
+    sensor_timing_t *p_timing = &sensor_timing[id];
+    ULONG elapsed;
+
+    if (p_bus != NULL)
+        tx_mutex_put(p_bus);
+
+    elapsed = tx_time_get() - p_timing->start;
+    p_timing->last_ticks = elapsed;
+    p_timing->reads++;
+    if (elapsed > p_timing->worst_ticks)
+        p_timing->worst_ticks = elapsed;
+
+    if (elapsed > p_timing->budget_ticks)
+    {
+        p_timing->overruns++;
+        p_timing->backoff = SENSOR_OVERRUN_BACKOFF;
+    }
+
+    return !(sensor_timing_cancellable() && sensor_cancelled);
+}
+
+/*
+ * Driver delay_ms hook. On the cancellable thread, waits on DEMO_STOP_FLAG
+ * instead of sleeping so a stop request ends the wait.
+ */
+void sensor_timing_delay_ms(uint32_t period)
+{
+    ULONG flags;
+    ULONG ticks;
+
+    if (!sensor_timing_cancellable())
+    {
+        SENSOR_BUS_DELAY_MS(period);
+        return;
+    }
+
+    if (sensor_cancelled)
+        return;
+
+    ticks = SENSOR_MS_TO_TICKS(period);
+    if (ticks == 0)
+        ticks = 1;
+
+    if (tx_event_flags_get(&g_user_event_flags, DEMO_STOP_FLAG, TX_OR, &flags, ticks) == TX_SUCCESS)
+        sensor_cancelled = true;
+}
+
+void sensor_timing_report(void)
+{
+    char str[96];
+    uint32_t i;
+
+    print_to_console("\r\nSensor     Budget(ms)  Last(ms)  Worst(ms)  Reads  Overruns  Skips\r\n");
+    for (i = 0; i < SENSOR_ID_COUNT; i++)
+    {
+        sensor_timing_t const *p_timing = &sensor_timing[i];
+
+        snprintf(str, sizeof(str), "%-9s  %10lu  %8lu  %9lu  %5lu  %8lu  %5lu\r\n", p_timing->name,
+                 (unsigned long)SENSOR_TICKS_TO_MS(p_timing->budget_ticks),
+                 (unsigned long)SENSOR_TICKS_TO_MS(p_timing->last_ticks),
+                 (unsigned long)SENSOR_TICKS_TO_MS(p_timing->worst_ticks),
+                 (unsigned long)p_timing->reads, (unsigned long)p_timing->overruns,
+                 (unsigned long)p_timing->skips);
+        print_to_console(str);
+    }
+}
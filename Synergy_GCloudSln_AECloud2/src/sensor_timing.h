@@ -0,0 +1,62 @@
+/*
+ * sensor_timing.h
+ *
+ *  Per-sensor time budgets and latency instrumentation for sensor reads.
+ *
+ *  Each sensor read is bracketed by sensor_timing_begin()/_end(). A sensor
+ *  is skipped, and its value left stale, when the I2C bus cannot be had
+ *  within its budget or for a few passes after it overran its budget.
+ *
+ *  Demo stop only concerns the publishing thread: between
+ *  sensor_timing_sampling(true) and (false), reads on the calling thread
+ *  are skipped once DEMO_STOP_FLAG is set, and driver delays through
+ *  sensor_timing_delay_ms() on that thread return early on it. Other
+ *  threads (the sensor and nav threads) always read and delay in full.
+ */
+
+#ifndef SENSOR_TIMING_H_
+#define SENSOR_TIMING_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "tx_api.h"
+
+typedef enum e_sensor_id
+{
+    SENSOR_ID_BMI160 = 0,
+    SENSOR_ID_BME680,
+    SENSOR_ID_BMM150,
+    SENSOR_ID_GPS,
+    SENSOR_ID_ISL29035,
+    SENSOR_ID_VIBRATION,
+    SENSOR_ID_COUNT
+} sensor_id_t;
+
+/* sensors_data_t.stale_mask bits: the last read of the sensor failed or was skipped */
+#define SENSOR_STALE(id)            (1UL << (id))
+#define SENSOR_STALE_ALL            ((1UL << SENSOR_ID_COUNT) - 1UL)
+
+#define SENSOR_OVERRUN_BACKOFF      (4U)    /* Passes skipped after an overrun */
+
+typedef struct st_sensor_timing
+{
+    char const *name;
+    ULONG       budget_ticks;
+    ULONG       start;
+    ULONG       last_ticks;
+    ULONG       worst_ticks;
+    uint32_t    reads;
+    uint32_t    overruns;           /* Reads that took longer than the budget */
+    uint32_t    skips;              /* Reads not attempted */
+    uint8_t     backoff;
+} sensor_timing_t;
+
+void sensor_timing_set_budget(sensor_id_t id, uint32_t budget_ms);
+void sensor_timing_sampling(bool active);
+bool sensor_timing_stop_requested(void);
+bool sensor_timing_begin(sensor_id_t id, TX_MUTEX *p_bus);
+bool sensor_timing_end(sensor_id_t id, TX_MUTEX *p_bus);
+void sensor_timing_delay_ms(uint32_t period);
+void sensor_timing_report(void);
+
+#endif /* SENSOR_TIMING_H_ */
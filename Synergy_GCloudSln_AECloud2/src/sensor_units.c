@@ -0,0 +1,72 @@
+/*
+ * sensor_units.c
+ *
+ *  Integer unit conversion and formatting. See sensor_units.h.
+ */
+
+#include "sensor_units.h"
+
+/* num / den rounded half away from zero, den > 0 */
+static int32_t sensor_units_div_round(int32_t num, int32_t den)
+{
+    return (num >= 0) ? ((num + (den / 2)) / den) : -((-num + (den / 2)) / den);
+}
+
+/* 0.01 degC to 0.01 degF; x * 9 / 5 never ends in exactly half */
+int32_t sensor_units_cdegf(int32_t cdegc)
+{
+    return sensor_units_div_round(cdegc * 9, 5) + 3200;
+}
+
+int32_t sensor_units_accel_mg(int16_t lsb)
+{
+    return sensor_units_div_round((int32_t) lsb * 1000, SENSOR_UNITS_ACCEL_LSB_PER_G);
+}
+
+int32_t sensor_units_gyro_mdps(int16_t lsb)
+{
+    return sensor_units_div_round((int32_t) lsb * 10000, SENSOR_UNITS_GYRO_LSB_PER_10_DPS);
+}
+
+/*
+ * Format value * 10^-decimals with exactly that many decimals, e.g. 7253
+ * with 2 as "72.53". p_buf must hold SENSOR_UNITS_STR_LEN bytes. Returns
+ * the length.
+ */
+uint32_t sensor_units_format(int32_t value, uint8_t decimals, char *p_buf)
+{
+    char digits[11];
+    uint32_t magnitude;
+    uint32_t len = 0;
+    uint32_t n = 0;
+
+    if (decimals > 9U)
+        decimals = 9U;
+
+    if (value < 0)
+    {
+        p_buf[len++] = '-';
+        magnitude = (uint32_t)(-(value + 1)) + 1U;
+    }
+    else
+    {
+        magnitude = (uint32_t)value;
+    }
+
+    /* Least significant first, at least one digit before the point */
+    do
+    {
+        digits[n++] = (char)('0' + (magnitude % 10U));
+        magnitude /= 10U;
+    } while ((magnitude != 0) || (n <= decimals));
+
+    while (n)
+    {
+        p_buf[len++] = digits[--n];
+        if ((n == decimals) && (n != 0))
+            p_buf[len++] = '.';
+    }
+
+    p_buf[len] = '\0';
+    return len;
+}
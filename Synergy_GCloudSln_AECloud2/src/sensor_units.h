@@ -0,0 +1,38 @@
+/*
+ * sensor_units.h
+ *
+ *  Integer sensor values and their conversion to text for the payload.
+ *
+ *  Readings stay in the sensor's own fixed-point units from the driver to
+ *  the payload builder; conversion to display units happens only when a
+ *  field is serialized, in integer arithmetic. The Cortex-M4F FPU has no
+ *  double precision, so the double conversions these replace ran in the
+ *  software floating-point library.
+ */
+
+#ifndef SENSOR_UNITS_H_
+#define SENSOR_UNITS_H_
+
+#include <stdint.h>
+
+/* BMI160 ranges set in bmi160_Initialize() */
+#define SENSOR_UNITS_ACCEL_LSB_PER_G        (8192)      /* +/-4 g */
+#define SENSOR_UNITS_GYRO_LSB_PER_10_DPS    (164)       /* +/-2000 dps */
+
+/* Room for any sensor_units_format() output, e.g. "-2147483.648" */
+#define SENSOR_UNITS_STR_LEN                (13U)
+
+/* BME680 output, as the driver reports it */
+typedef struct st_sensor_env
+{
+    int32_t  temperature_cdegc;     /* 0.01 degC */
+    uint32_t humidity_mrh;          /* 0.001 %RH */
+    uint32_t pressure_pa;           /* Pa */
+} sensor_env_t;
+
+int32_t sensor_units_cdegf(int32_t cdegc);
+int32_t sensor_units_accel_mg(int16_t lsb);
+int32_t sensor_units_gyro_mdps(int16_t lsb);
+uint32_t sensor_units_format(int32_t value, uint8_t decimals, char *p_buf);
+
+#endif /* SENSOR_UNITS_H_ */
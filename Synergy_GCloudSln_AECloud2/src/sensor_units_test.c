@@ -0,0 +1,166 @@
+/*
+ * sensor_units_test.c
+ *
+ *  Host equivalence check of the integer unit conversions against the
+ *  double code they replace, over every value the drivers can report:
+ *   - temperature, the original convert_celsius_2_Fahrenheit() printed
+ *     with two decimals, against sensor_units_cdegf() and
+ *     sensor_units_format(), and against the double member read_sensor()
+ *     still fills;
+ *   - humidity and pressure, the original divisions against the
+ *     formatted integers;
+ *   - accel mg and gyro mdps against the rounded double conversion.
+ *  Then the formatter's edge cases and the cost per reading of both paths.
+ *
+ *  Built by host_test.mk with SENSORS_BUS_SIM; empty in the firmware build.
+ */
+
+#if defined(SENSORS_BUS_SIM)
+
+#include <math.h>
+#include <string.h>
+#include "host_test.h"
+#include "sensor_units.h"
+
+#define TEST_TEXT_LEN           (32U)
+#define TEST_BENCH_READINGS     (10000000UL)
+
+/* sensors.c before the integer units */
+static double convert_celsius_2_Fahrenheit(double temp_celsius)
+{
+    return (((temp_celsius * 9) / 5) + 32);
+}
+
+static void test_temperature(void)
+{
+    char original[TEST_TEXT_LEN];
+    char member[TEST_TEXT_LEN];
+    char formatted[SENSOR_UNITS_STR_LEN];
+    double temp_value;
+    uint32_t differ = 0;
+    uint32_t member_differ = 0;
+    int32_t t;
+
+    for (t = INT16_MIN; t <= INT16_MAX; t++)
+    {
+        temp_value = (int16_t)t / 100.0f;
+        snprintf(original, sizeof(original), "%.2f", convert_celsius_2_Fahrenheit(temp_value));
+        snprintf(member, sizeof(member), "%.2f", (double)sensor_units_cdegf(t) / 100.0);
+        (void)sensor_units_format(sensor_units_cdegf(t), 2, formatted);
+
+        /* The double printed -0.00 for -17.78 C, just above -32 F * 5 / 9 */
+        if ((strcmp(original, formatted) != 0)
+            && !((strcmp(original, "-0.00") == 0) && (strcmp(formatted, "0.00") == 0)))
+            differ++;
+        if (strcmp(member, formatted) != 0)
+            member_differ++;
+    }
+    printf("temperature: %lu of 65536 differ from the original, %lu from the double member\r\n",
+           (unsigned long)differ, (unsigned long)member_differ);
+    HOST_TEST_CHECK(differ == 0U);
+    HOST_TEST_CHECK(member_differ == 0U);
+}
+
+static void test_decimal(char const *p_name, uint32_t from, uint32_t to, uint8_t decimals)
+{
+    char original[TEST_TEXT_LEN];
+    char formatted[SENSOR_UNITS_STR_LEN];
+    uint32_t differ = 0;
+    uint32_t value;
+
+    for (value = from; value <= to; value++)
+    {
+        if (decimals == 3U)
+            snprintf(original, sizeof(original), "%.3f", ((double)value / 1000.0f));
+        else
+            snprintf(original, sizeof(original), "%.2f", ((double)value / 100.0f));
+        (void)sensor_units_format((int32_t)value, decimals, formatted);
+        if (strcmp(original, formatted) != 0)
+            differ++;
+    }
+    printf("%s: %lu of %lu differ\r\n", p_name, (unsigned long)differ, (unsigned long)(to - from + 1U));
+    HOST_TEST_CHECK(differ == 0U);
+}
+
+static void test_imu(void)
+{
+    uint32_t differ = 0;
+    int32_t lsb;
+
+    for (lsb = INT16_MIN; lsb <= INT16_MAX; lsb++)
+    {
+        if ((lround((lsb * 1000.0) / SENSOR_UNITS_ACCEL_LSB_PER_G) != sensor_units_accel_mg((int16_t)lsb))
+            || (lround((lsb * 10000.0) / SENSOR_UNITS_GYRO_LSB_PER_10_DPS) != sensor_units_gyro_mdps((int16_t)lsb)))
+            differ++;
+    }
+    printf("accel mg and gyro mdps: %lu of 65536 differ\r\n", (unsigned long)differ);
+    HOST_TEST_CHECK(differ == 0U);
+}
+
+static void test_format_edges(void)
+{
+    static struct
+    {
+        int32_t     value;
+        uint8_t     decimals;
+        char const *p_text;
+    } const cases[] =
+    {
+        { 0, 0, "0" }, { -1, 0, "-1" }, { 0, 2, "0.00" }, { -1, 2, "-0.01" }, { 99, 2, "0.99" },
+        { -100, 2, "-1.00" }, { 7253, 2, "72.53" }, { 45210, 3, "45.210" },
+        { INT32_MAX, 3, "2147483.647" }, { INT32_MIN, 3, "-2147483.648" }, { 1, 12, "0.000000001" },
+    };
+    char formatted[SENSOR_UNITS_STR_LEN];
+    uint32_t len;
+    uint32_t i;
+
+    for (i = 0; i < (sizeof(cases) / sizeof(cases[0])); i++)
+    {
+        len = sensor_units_format(cases[i].value, cases[i].decimals, formatted);
+        HOST_TEST_CHECK(strcmp(formatted, cases[i].p_text) == 0);
+        HOST_TEST_CHECK(len == strlen(cases[i].p_text));
+    }
+}
+
+/* Host cycles only; the target's double path is software floating point */
+static void test_benchmark(void)
+{
+    volatile double double_sink = 0.0;
+    volatile uint32_t int_sink = 0;
+    double temp_value;
+    uint64_t start;
+    uint64_t double_cycles;
+    uint64_t int_cycles;
+    uint32_t k;
+
+    start = host_test_cycles();
+    for (k = 0; k < TEST_BENCH_READINGS; k++)
+    {
+        temp_value = (int16_t)(k & 8191U) / 100.0f;
+        double_sink += convert_celsius_2_Fahrenheit(temp_value) + ((double)(k & 65535U) / 1000.0f)
+                       + ((double)(k | 65536U) / 100.0f);
+    }
+    double_cycles = host_test_cycles() - start;
+
+    start = host_test_cycles();
+    for (k = 0; k < TEST_BENCH_READINGS; k++)
+        int_sink += (uint32_t)sensor_units_cdegf((int32_t)(k & 8191U)) + (k & 65535U) + (k | 65536U);
+    int_cycles = host_test_cycles() - start;
+
+    printf("%.1f cycles per reading in double, %.1f in integer units\r\n", (double)double_cycles / TEST_BENCH_READINGS,
+           (double)int_cycles / TEST_BENCH_READINGS);
+}
+
+int main(void)
+{
+    test_temperature();
+    test_decimal("humidity", 0U, 100000U, 3U);
+    test_decimal("pressure", 30000U, 110000U, 2U);
+    test_imu();
+    test_format_edges();
+    test_benchmark();
+
+    return host_test_finish("sensor_units");
+}
+
+#endif /* SENSORS_BUS_SIM */
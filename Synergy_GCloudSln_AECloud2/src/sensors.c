@@ -9,6 +9,26 @@
 #include "MQTT_Thread.h"
 #include <math.h>
 #include "sensors.h"
+#include "nmea_parser.h"
+#include "gnss.h"
+#include "ring_buffer.h"
+#include "trajectory.h"
+#include "geofence.h"
+#include "nav_filter.h"
+#include "sensor_timing.h"
+#include "imu_fifo.h"
+#include "sensor_sched.h"
+#include "sensor_bus.h"
+#include "boot_graph.h"
+#include "ahrs.h"
+#include "sensor_agg.h"
+#include "report_filter.h"
+#include "sensor_units.h"
+#include "mag_cal.h"
+#include "vibration.h"
+#include "sound_level.h"
+#include "als_range.h"
+#include "internal_flash.h"
 
 struct bmi160_dev bmi160;
 struct bme680_dev gas_sensor;
@@ -17,7 +37,247 @@ struct isl29035_dev isl_dev;
 
 
 char gps_raw_string[400];
-void bmm150_read_data(struct bmi160_dev *bmi160_info, struct bmm150_dev *bmm150_info, uint8_t *mag_data);
+
+/* BEGIN ADDED */
+
+#define GPS_RX_RING_LEN             (512U)  /* Power of two, ~1 s of NMEA output at 9600 baud */
+#define GPS_PARSER_STACK_SIZE       (1024U)
+#define GPS_PARSER_PRIORITY         (10U)
+#define GPS_PARSER_WAIT_TICKS       (50U)   /* Drain the ring even without line ends */
+#define GPS_RX_LINE_FLAG            (0x00000001UL)
+
+/* Trajectory compression, see trajectory.h */
+#define GPS_TRACK_TOLERANCE_M       (10.0f)
+#define GPS_TRACK_MIN_DISTANCE_M    (5.0f)
+#define GPS_TRACK_MIN_TURN_CDEG     (1500U)     /* 15 degrees */
+#define GPS_TRACK_HEARTBEAT_MS      (300000U)   /* 5 minutes */
+
+static uint8_t gps_rx_storage[GPS_RX_RING_LEN];
+static ring_buffer_t gps_rx_ring;
+static nmea_parser_t gps_parser;
+static gnss_fix_t gps_fix;      /* Merged from every sentence, parser thread only */
+static gnss_fix_t gps_cache;    /* Last known fix, guarded by gps_cache_mutex */
+static trajectory_t gps_track;  /* Significant points, guarded by gps_cache_mutex */
+static geofence_t gps_fences;   /* Enter/exit events, guarded by gps_cache_mutex */
+static TX_MUTEX gps_cache_mutex;
+static TX_EVENT_FLAGS_GROUP gps_rx_events;
+static TX_THREAD gps_parser_thread;
+static uint8_t gps_parser_stack[GPS_PARSER_STACK_SIZE];
+
+/* Geofence image (see geofence.h), linked into flash when fences are in use */
+extern uint32_t const geofence_image[] __attribute__((weak));
+
+/* GPS/IMU fusion, see nav_filter.h */
+#define NAV_RATE_HZ                 (50U)   /* Fused position/velocity output rate */
+#define NAV_MAG_DIVIDER             (10U)   /* Magnetometer heading every Nth step */
+#define NAV_THREAD_STACK_SIZE       (1536U)
+#define NAV_THREAD_PRIORITY         (9U)
+
+/* Orientation, see ahrs.h */
+#define AHRS_KP                     (0.5f)
+#define AHRS_KI                     (0.01f)
+
+/* BMI160 scale for the ranges set in bmi160_Initialize() */
+#define BMI160_ACCEL_MSS_PER_LSB    (9.80665f / 8192.0f)        /* +/-4 g */
+#define BMI160_GYRO_RADS_PER_LSB    (0.0174532925f / 16.4f)     /* +/-2000 dps */
+
+/*
+ * BMI160 FIFO, see imu_fifo.h. The FIFO decimates the 1600 Hz accel and
+ * 3200 Hz gyro (filtered) to IMU_FIFO_RATE_HZ, which keeps the bus load of
+ * draining it to about an eighth of the 400 kHz I2C bandwidth.
+ */
+#define IMU_FIFO_RATE_HZ            (400U)
+#define BMI160_FIFO_DOWNS           (0xABU)     /* acc: /4 filtered, gyr: /8 filtered */
+#define BMI160_FIFO_FRAME_LEN       (13U)       /* Header, gyro, accel */
+#define BMI160_FIFO_WATERMARK       ((BMI160_FIFO_FRAME_LEN * (IMU_FIFO_RATE_HZ / NAV_RATE_HZ)) / 4U)
+#define BMI160_FIFO_BUF_LEN         (1024U + 8U)    /* Whole FIFO plus sensortime frame */
+#define IMU_FIFO_WTM_FLAG           (0x00000001UL)
+#define NAV_BATCH_LEN               (32U)
+
+/*
+ * Any-motion and no-motion on INT2. While the device is still the
+ * watermark is raised so the nav thread wakes about 7 times a second
+ * instead of NAV_RATE_HZ; the first movement restores it.
+ */
+#define BMI160_FIFO_WATERMARK_STILL (192U)      /* 768 bytes, ~150 ms of frames */
+#define BMI160_ANY_MOTION_THR       (5U)        /* 7.81 mg/LSB at +/-4 g */
+#define BMI160_NO_MOTION_THR        (5U)
+#define BMI160_NO_MOTION_DUR        (3U)        /* (n + 1) * 1.28 s */
+#define IMU_MOTION_FLAG             (0x00000002UL)
+#define NAV_IRQ_WATCHDOG_TICKS      (TX_TIMER_TICKS_PER_SECOND / 2U)
+
+static TX_MUTEX sensors_i2c_mutex;  /* Serialises driver calls on g_i2c0 */
+static nav_filter_t nav_filter;     /* Nav thread only */
+static nav_state_t nav_state;       /* Latest fused output, guarded by nav_state_mutex */
+static TX_MUTEX nav_state_mutex;
+static ahrs_t imu_ahrs;             /* Nav thread only */
+static ahrs_state_t imu_orientation;    /* Latest orientation, guarded by nav_state_mutex */
+static TX_THREAD nav_thread;
+static uint8_t nav_thread_stack[NAV_THREAD_STACK_SIZE];
+
+static struct bmi160_fifo_frame bmi160_fifo;
+static uint8_t bmi160_fifo_buf[BMI160_FIFO_BUF_LEN];
+static imu_fifo_t imu_fifo;         /* Written by the nav thread, guarded by imu_fifo_mutex */
+static TX_MUTEX imu_fifo_mutex;
+static TX_EVENT_FLAGS_GROUP imu_fifo_events;
+static imu_sample_t nav_batch[NAV_BATCH_LEN];
+static uint32_t sensors_imu_seen;   /* imu_fifo.head at the last scheduled IMU read */
+static volatile uint32_t imu_irq_count;     /* BMI160 interrupts taken */
+static bool imu_moving = true;              /* Nav thread only */
+static struct bmm150_mag_data imu_mag;      /* Last nav thread magnetometer read, guarded by imu_fifo_mutex */
+static uint32_t imu_mag_count;
+static uint32_t sensors_mag_seen;
+
+/*
+ * Magnetometer calibration, see mag_cal.h. The nav thread fits and applies
+ * it; the sensor thread keeps the flash copy, MAG_CAL_CFG in internal
+ * flash, current.
+ */
+#define MAG_CAL_STEP                (24U)       /* 1.5 uT between accepted samples */
+#define MAG_CAL_SOLVE_EVERY         (32U)       /* Accepted samples between fits */
+#define MAG_CAL_SAVE_CHANGE         (20U)       /* 2 % of the field */
+#define MAG_CAL_SAVE_MIN_MS         (600000U)   /* Flash writes at most every 10 minutes */
+
+static mag_cal_t imu_mag_cal;                   /* Nav thread only */
+static mag_cal_params_t imu_mag_params;         /* Applied, nav thread only after boot */
+static mag_cal_params_t sensors_mag_fit;        /* Latest fit, guarded by imu_fifo_mutex */
+static mag_cal_params_t sensors_mag_saved;      /* Flash copy, sensor thread only after boot */
+static uint32_t sensors_mag_save_ms;
+
+/* Publish window aggregates, see sensor_agg.h */
+static sensor_agg_t sensors_agg[SENSOR_AGG_CHANNELS];   /* Guarded by sensors_agg_mutex */
+static TX_MUTEX sensors_agg_mutex;
+static uint32_t sensors_agg_start_ms;                   /* Start of the window, read_sensor() only */
+static sensor_agg_t nav_agg[SENSOR_AGG_MAG_Z + 1];      /* Current drain, nav thread only */
+
+/* Report-by-exception for the BME680 fields, see report_filter.h; units as sensor_agg.h */
+#define REPORT_TEMPERATURE_DEADBAND (20)        /* 0.2 degC */
+#define REPORT_TEMPERATURE_RATE     (50)        /* 0.5 degC/min */
+#define REPORT_HUMIDITY_DEADBAND    (1000)      /* 1 %RH */
+#define REPORT_HUMIDITY_RATE        (3000)      /* 3 %RH/min */
+#define REPORT_PRESSURE_DEADBAND    (50)        /* 0.5 hPa */
+#define REPORT_PRESSURE_RATE        (100)       /* 1 hPa/min */
+#define REPORT_RATE_WINDOW_MS       (60000U)
+#define REPORT_HEARTBEAT_MS         (900000U)   /* 15 minutes */
+
+static report_channel_t sensors_report_channels[REPORT_FIELD_COUNT] =
+{
+    [REPORT_FIELD_TEMPERATURE] = { .name = "Temp", .deadband = REPORT_TEMPERATURE_DEADBAND,
+                                   .rate_per_min = REPORT_TEMPERATURE_RATE, .rate_window_ms = REPORT_RATE_WINDOW_MS,
+                                   .heartbeat_ms = REPORT_HEARTBEAT_MS },
+    [REPORT_FIELD_HUMIDITY]    = { .name = "Humidity", .deadband = REPORT_HUMIDITY_DEADBAND,
+                                   .rate_per_min = REPORT_HUMIDITY_RATE, .rate_window_ms = REPORT_RATE_WINDOW_MS,
+                                   .heartbeat_ms = REPORT_HEARTBEAT_MS },
+    [REPORT_FIELD_PRESSURE]    = { .name = "Pressure", .deadband = REPORT_PRESSURE_DEADBAND,
+                                   .rate_per_min = REPORT_PRESSURE_RATE, .rate_window_ms = REPORT_RATE_WINDOW_MS,
+                                   .heartbeat_ms = REPORT_HEARTBEAT_MS },
+};
+static report_filter_t sensors_report;                  /* read_sensor() only */
+
+/*
+ * Vibration spectrum of the FIFO accel stream, see vibration.h. The FIFO
+ * rate puts Nyquist at 200 Hz, with the BMI160's filtered decimation as
+ * the anti-alias filter. A jump in sensortime of more than one and a half
+ * frames restarts the window.
+ */
+#define VIBRATION_GAP_TICKS         ((3U * IMU_FIFO_TICKS_PER_S) / (2U * IMU_FIFO_RATE_HZ))
+
+static vibration_config_t const sensors_vibration_cfg =
+{
+    .rate_hz = IMU_FIFO_RATE_HZ,
+    .lsb_per_g = SENSOR_UNITS_ACCEL_LSB_PER_G,
+    .band_edges_hz = { 2, 10, 25, 50, 100, 150, 200 }
+};
+static vibration_t sensors_vibration;                   /* Sensor thread only */
+static imu_sample_t sensors_vibration_batch[NAV_BATCH_LEN];     /* Sensor thread only */
+static uint32_t sensors_vibration_cursor;
+static uint32_t sensors_vibration_time;                 /* Sensortime of the last sample added */
+
+static bool bme680_pending;         /* A forced-mode conversion is running */
+static ULONG bme680_trigger_time;
+
+/* Ambient light, see als_range.h */
+static als_range_t sensors_als;     /* Sensor thread only once sensors_als_ready is set */
+static bool sensors_als_ready;      /* Set by isl29035_Initialize() */
+
+/*
+ * Microphone level, see sound_level.h. init_mic() leaves the ADC converting
+ * the microphone at SOUND_LEVEL_RATE_HZ. The g_transfer_mic DMAC instance,
+ * activated by the ADC scan end, moves each result into one half of
+ * mic_dma_buf while the mic thread processes the other half.
+ */
+#define MIC_THREAD_STACK_SIZE       (1024U)
+#define MIC_THREAD_PRIORITY         (10U)   /* Between the nav and sensor threads, a block is due every 16 ms */
+#define MIC_BLOCK_FLAG              (0x00000001UL)
+#define MIC_ADC_MID                 (2048)  /* 12-bit ADC, the microphone biased at mid-scale */
+#define MIC_ADC_SHIFT               (4)     /* To int16 */
+#define MIC_BLOCK_US                ((SOUND_LEVEL_BLOCK_LEN * 1000000U) / SOUND_LEVEL_RATE_HZ)
+
+static sound_level_config_t const mic_level_cfg =
+{
+    .full_scale_db_x10 = 1200,      /* Microphone sensitivity and ADC gain; calibrate per board */
+    .threshold_db_x10 = 850,
+    .hysteresis_db_x10 = 30,
+    .impulse_db_x10 = 200,
+    .impulse_min_db_x10 = 700,
+    .impulse_holdoff_ms = 250
+};
+static uint16_t mic_dma_buf[2][SOUND_LEVEL_BLOCK_LEN];  /* DMAC ping-pong, block n fills half n & 1 */
+static volatile uint32_t mic_dma_blocks;                /* Blocks the DMAC completed */
+static int16_t mic_block[SOUND_LEVEL_BLOCK_LEN];        /* Mic thread only */
+static sound_level_t mic_level;                         /* Guarded by mic_level_mutex */
+static TX_MUTEX mic_level_mutex;
+static TX_EVENT_FLAGS_GROUP mic_events;
+static TX_THREAD mic_thread;
+static uint8_t mic_thread_stack[MIC_THREAD_STACK_SIZE];
+static bool mic_ready;              /* The pipeline is running */
+static uint32_t mic_lost;           /* Blocks overwritten before processing, guarded by mic_level_mutex */
+static uint32_t mic_cycles_max;     /* Per block, guarded by mic_level_mutex */
+static uint64_t mic_cycles_sum;
+
+/* Sampling scheduler, see sensor_sched.h */
+#define SENSOR_THREAD_STACK_SIZE    (2048U)
+#define SENSOR_THREAD_PRIORITY      (11U)   /* Below the nav thread */
+
+static sensors_data_t sensors_snapshot;     /* Latest readings, guarded by sensors_snapshot_mutex */
+static TX_MUTEX sensors_snapshot_mutex;
+static sensor_sched_t sensors_sched;
+static TX_THREAD sensor_thread;
+static uint8_t sensor_thread_stack[SENSOR_THREAD_STACK_SIZE];
+
+static int32_t sensors_read_imu(void *p_context);
+static int32_t sensors_read_env(void *p_context);
+static int32_t sensors_read_mag(void *p_context);
+static int32_t sensors_read_vibration(void *p_context);
+static int32_t sensors_read_light(void *p_context);
+static int32_t sensors_save_mag_cal(void *p_context);
+static void sensor_thread_entry(ULONG thread_input);
+void sensors_print_stats(void);
+
+/* Rate-monotonic priority follows the period */
+static sensor_task_t sensors_tasks[] =
+{
+    { .name = "BMI160", .period_ms = 100,  .deadline_ms = 20, .read = sensors_read_imu },
+    { .name = "BMM150", .period_ms = 200,  .deadline_ms = 50, .read = sensors_read_mag },
+    { .name = "Vibration", .period_ms = 250, .deadline_ms = 50, .read = sensors_read_vibration },
+    { .name = "ISL29035", .period_ms = 250, .deadline_ms = 20, .read = sensors_read_light },
+    { .name = "BME680", .period_ms = 1000, .deadline_ms = 100, .read = sensors_read_env },
+    { .name = "MagCal", .period_ms = 60000, .deadline_ms = 1000, .read = sensors_save_mag_cal },
+};
+
+void gps_uart_callback(uart_callback_args_t *p_args);
+void bmi160_fifo_irq_callback(external_irq_callback_args_t *p_args);
+void bmi160_motion_irq_callback(external_irq_callback_args_t *p_args);
+static void gps_parser_thread_entry(ULONG thread_input);
+static void nav_thread_entry(ULONG thread_input);
+void mic_dma_callback(transfer_callback_args_t *p_args);
+static void mic_thread_entry(ULONG thread_input);
+
+/* END ADDED */
+
+/* BEGIN MODIFIED */
+int8_t bmm150_read_data(struct bmi160_dev *bmi160_info, struct bmm150_dev *bmm150_info, uint8_t *mag_data);
+/* END MODIFIED */
 
 /*wrapper function to match the signature of bmm150.read */
 static int8_t bmi160_aux_rd(uint8_t id, uint8_t reg_addr, uint8_t *aux_data, uint16_t len)
@@ -43,6 +303,68 @@ static int8_t bmi160_aux_wr(uint8_t id, uint8_t reg_addr, uint8_t *aux_data, uin
     return rslt;
 }
 
+/* BEGIN ADDED */
+
+/* In BMM150 Mag data starts from register address 0x42 */
+#define BMM150_AUX_DATA_ADDR        (0x42U)
+#define BMM150_AUX_ODR              (8U)    /* Represents polling rate in 100 Hz */
+
+/* Set once the BMI160 is polling the BMM150 on its own; cleared on a read error */
+static bool bmm150_auto_mode;
+
+/*
+ * Put the BMI160 aux interface in auto mode so it copies the BMM150 data
+ * registers into its own DATA_0..7 at aux_odr. Only needed at start-up and
+ * after a failed read.
+ */
+static int8_t bmm150_aux_auto_start(struct bmi160_dev *bmi160_info)
+{
+    uint8_t aux_addr = BMM150_AUX_DATA_ADDR;
+    int8_t status;
+
+    bmi160_info->aux_cfg.aux_odr = BMM150_AUX_ODR;
+    status = bmi160_config_aux_mode(bmi160_info);
+    if (status == BMI160_OK)
+        status = bmi160_set_aux_auto_mode(&aux_addr, bmi160_info);
+
+    bmm150_auto_mode = (status == BMI160_OK);
+
+    return status;
+}
+
+/*
+ * One burst read of the BMI160 aux data registers plus compensation. The
+ * aux set-up is only redone if the previous read failed.
+ */
+int8_t bmm150_read_data(struct bmi160_dev *bmi160_info, struct bmm150_dev *bmm150_info, uint8_t *mag_data)
+{
+    int8_t status;
+
+    if (!bmm150_auto_mode)
+    {
+        status = bmm150_aux_auto_start(bmi160_info);
+        if (status != BMI160_OK)
+            return status;
+    }
+
+    /* Reading data from BMI160 data registers */
+    status = bmi160_read_aux_data_auto_mode(mag_data, bmi160_info);
+    if (status != BMI160_OK)
+    {
+        bmm150_auto_mode = false;
+        return status;
+    }
+
+    /* Compensating the raw mag data available from the BMM150 API */
+    return bmm150_aux_mag_data(mag_data, bmm150_info);
+}
+
+/* END ADDED */
+
+#if 0
+
+/* ORIGINAL CODE */
+
 void bmm150_read_data(struct bmi160_dev *bmi160_info, struct bmm150_dev *bmm150_info, uint8_t *mag_data)
 {
     /* In BMM150 Mag data starts from register address 0x42 */
@@ -63,6 +385,8 @@ void bmm150_read_data(struct bmi160_dev *bmi160_info, struct bmm150_dev *bmm150_
     bmm150_aux_mag_data(mag_data, bmm150_info);
 }
 
+#endif
+
 static int8_t isl29035_Initialize(void)
 {
     int8_t status = 0;
@@ -70,9 +394,9 @@ static int8_t isl29035_Initialize(void)
     /* ISL29035 Sensor Initialization */
     isl_dev.id = ISL29035_I2C_ADDR;
     isl_dev.interface = ISL29035_I2C_INTF;
-    isl_dev.read = synergy_i2c_read;
-    isl_dev.write = synergy_i2c_write;
-    isl_dev.delay_ms = synergy_delay_ms;
+    isl_dev.read = sensor_bus_read;
+    isl_dev.write = sensor_bus_write;
+    isl_dev.delay_ms = sensor_timing_delay_ms;
 
     status = isl29035_init(&isl_dev);
     if( status != ISL29035_OK)
@@ -88,9 +412,111 @@ static int8_t isl29035_Initialize(void)
         return status;
     }
 
+    /* BEGIN ADDED */
+
+    /* Auto-ranging one-shot conversions from here on, see sensors_read_light() */
+    als_range_config_t const als_cfg =
+    {
+        .dev_id = ISL29035_I2C_ADDR,
+        .read = sensor_bus_read,
+        .write = sensor_bus_write
+    };
+
+    als_range_init(&sensors_als, &als_cfg);
+    sensors_als_ready = true;
+
+    /* END ADDED */
+
     return status;
 }
 
+/* BEGIN ADDED */
+
+/*
+ * Header-mode FIFO with accel, gyro and sensortime frames, decimated to
+ * IMU_FIFO_RATE_HZ. INT1 pulses (active high) when the watermark is reached,
+ * one nav step's worth of frames.
+ */
+static int8_t bmi160_fifo_Initialize(void)
+{
+    struct bmi160_int_settg int_config;
+    int8_t status;
+
+    bmi160_fifo.data = bmi160_fifo_buf;
+    bmi160_fifo.length = sizeof(bmi160_fifo_buf);
+    bmi160.fifo = &bmi160_fifo;
+
+    status = bmi160_set_fifo_config(BMI160_FIFO_HEADER | BMI160_FIFO_ACCEL | BMI160_FIFO_GYRO | BMI160_FIFO_TIME,
+                                    BMI160_ENABLE, &bmi160);
+    if (status == BMI160_OK)
+        status = bmi160_set_fifo_down(BMI160_FIFO_DOWNS, &bmi160);
+    if (status == BMI160_OK)
+        status = bmi160_set_fifo_wm(BMI160_FIFO_WATERMARK, &bmi160);
+    if (status != BMI160_OK)
+        return status;
+
+    memset(&int_config, 0, sizeof(int_config));
+    int_config.int_channel = BMI160_INT_CHANNEL_1;
+    int_config.int_type = BMI160_ACC_GYRO_FIFO_WATERMARK_INT;
+    int_config.int_pin_settg.output_en = BMI160_ENABLE;
+    int_config.int_pin_settg.output_mode = BMI160_DISABLE;     /* Push-pull */
+    int_config.int_pin_settg.output_type = BMI160_ENABLE;      /* Active high */
+    int_config.int_pin_settg.edge_ctrl = BMI160_ENABLE;
+    int_config.int_pin_settg.input_en = BMI160_DISABLE;
+    int_config.int_pin_settg.latch_dur = BMI160_LATCH_DUR_NONE;
+    int_config.fifo_WTM_int_en = BMI160_ENABLE;
+    status = bmi160_set_int_config(&int_config, &bmi160);
+    if (status != BMI160_OK)
+        return status;
+
+    return bmi160_set_fifo_flush(&bmi160);
+}
+
+/*
+ * Any-motion and slow/no-motion on INT2 (active high). The nav thread
+ * reads the interrupt status to tell them apart.
+ */
+static int8_t bmi160_motion_Initialize(void)
+{
+    struct bmi160_int_settg int_config;
+    int8_t status;
+
+    memset(&int_config, 0, sizeof(int_config));
+    int_config.int_channel = BMI160_INT_CHANNEL_2;
+    int_config.int_pin_settg.output_en = BMI160_ENABLE;
+    int_config.int_pin_settg.output_mode = BMI160_DISABLE;     /* Push-pull */
+    int_config.int_pin_settg.output_type = BMI160_ENABLE;      /* Active high */
+    int_config.int_pin_settg.edge_ctrl = BMI160_ENABLE;
+    int_config.int_pin_settg.input_en = BMI160_DISABLE;
+    int_config.int_pin_settg.latch_dur = BMI160_LATCH_DUR_NONE;
+
+    int_config.int_type = BMI160_ACC_ANY_MOTION_INT;
+    int_config.int_type_cfg.acc_any_motion_int.anymotion_en = BMI160_ENABLE;
+    int_config.int_type_cfg.acc_any_motion_int.anymotion_x = BMI160_ENABLE;
+    int_config.int_type_cfg.acc_any_motion_int.anymotion_y = BMI160_ENABLE;
+    int_config.int_type_cfg.acc_any_motion_int.anymotion_z = BMI160_ENABLE;
+    int_config.int_type_cfg.acc_any_motion_int.anymotion_dur = 0;
+    int_config.int_type_cfg.acc_any_motion_int.anymotion_data_src = 0;     /* Filtered data */
+    int_config.int_type_cfg.acc_any_motion_int.anymotion_thr = BMI160_ANY_MOTION_THR;
+    status = bmi160_set_int_config(&int_config, &bmi160);
+    if (status != BMI160_OK)
+        return status;
+
+    memset(&int_config.int_type_cfg, 0, sizeof(int_config.int_type_cfg));
+    int_config.int_type = BMI160_ACC_SLOW_NO_MOTION_INT;
+    int_config.int_type_cfg.acc_no_motion_int.no_motion_x = BMI160_ENABLE;
+    int_config.int_type_cfg.acc_no_motion_int.no_motion_y = BMI160_ENABLE;
+    int_config.int_type_cfg.acc_no_motion_int.no_motion_z = BMI160_ENABLE;
+    int_config.int_type_cfg.acc_no_motion_int.no_motion_dur = BMI160_NO_MOTION_DUR;
+    int_config.int_type_cfg.acc_no_motion_int.no_motion_sel = BMI160_ENABLE;   /* No-motion, not slow-motion */
+    int_config.int_type_cfg.acc_no_motion_int.no_motion_src = 0;               /* Filtered data */
+    int_config.int_type_cfg.acc_no_motion_int.no_motion_thres = BMI160_NO_MOTION_THR;
+
+    return bmi160_set_int_config(&int_config, &bmi160);
+}
+
+/* END ADDED */
+
 static int8_t bmi160_Initialize(void)
 {
     int8_t status;
@@ -98,9 +524,9 @@ static int8_t bmi160_Initialize(void)
     /* BMI160 Sensor Initialization */
     bmi160.id = BMI160_I2C_ADDR;
     bmi160.interface = BMI160_I2C_INTF;
-    bmi160.read = synergy_i2c_read;
-    bmi160.write = synergy_i2c_write;
-    bmi160.delay_ms = synergy_delay_ms;
+    bmi160.read = sensor_bus_read;
+    bmi160.write = sensor_bus_write;
+    bmi160.delay_ms = sensor_timing_delay_ms;
 
     status = bmi160_init(&bmi160);
     if( status != BMI160_OK)
@@ -129,6 +555,18 @@ static int8_t bmi160_Initialize(void)
     if( status != BMI160_OK)
         APP_ERR_TRAP(status);
 
+    /* BEGIN ADDED */
+
+    status = bmi160_fifo_Initialize();
+    if( status != BMI160_OK)
+        APP_ERR_TRAP(status);
+
+    status = bmi160_motion_Initialize();
+    if( status != BMI160_OK)
+        APP_ERR_TRAP(status);
+
+    /* END ADDED */
+
     return status;
 }
 
@@ -149,7 +587,7 @@ static int8_t bmm150_Initialize(void)
     bmm150.dev_id = BMM150_DEFAULT_I2C_ADDRESS;
     /* Ensure that sensor.aux_cfg.aux_i2c_addr = bmm150.id
        for proper sensor operation */
-    bmm150.delay_ms = synergy_delay_ms;
+    bmm150.delay_ms = sensor_timing_delay_ms;
     bmm150.intf = BMM150_I2C_INTF;
 
     /* Initialize the auxiliary sensor interface */
@@ -173,9 +611,22 @@ static int8_t bmm150_Initialize(void)
     if( status != BMM150_OK)
         APP_ERR_TRAP(status);
 
+    /* BEGIN ADDED */
+
+    /* Auto mode is configured once here, bmm150_read_data() only reads */
+    status = bmm150_aux_auto_start(&bmi160);
+    if( status != BMI160_OK)
+        APP_ERR_TRAP(status);
+
+    /* END ADDED */
+
     return status;
 }
 
+#if 0
+
+/* ORIGINAL CODE */
+
 /*
  * Convert the units for temperature from celcius to Fahrenheit
  */
@@ -184,14 +635,59 @@ static double convert_celsius_2_Fahrenheit(double temp_celsius)
     return (((temp_celsius * 9) / 5) + 32);
 }
 
+#endif
+
 static ssp_err_t gps_Initialize(void)
 {
     ssp_err_t result = SSP_SUCCESS;
 
+    /* BEGIN ADDED */
+
+    traj_config_t const track_cfg =
+    {
+        .tolerance_m = GPS_TRACK_TOLERANCE_M,
+        .min_distance_m = GPS_TRACK_MIN_DISTANCE_M,
+        .min_turn_cdeg = GPS_TRACK_MIN_TURN_CDEG,
+        .max_interval_ms = GPS_TRACK_HEARTBEAT_MS
+    };
+
+    /* END ADDED */
+
     print_to_console("Initializing GPS: ");
 
+    /* BEGIN ADDED */
+
+    /* The ring must be ready before gps_init() opens the UART */
+    ring_buffer_init(&gps_rx_ring, gps_rx_storage, sizeof(gps_rx_storage));
+    gnss_fix_init(&gps_fix);
+    gnss_fix_init(&gps_cache);
+    trajectory_init(&gps_track, &track_cfg);
+    if ((geofence_image != NULL) && !geofence_attach(&gps_fences, geofence_image)) {
+        print_to_console("invalid geofence image, ");
+    }
+    nmea_parser_init(&gps_parser, gnss_sentence_callback, &gps_fix);
+
+    if ((tx_mutex_create(&gps_cache_mutex, (CHAR *)"GPS Cache Mutex", TX_NO_INHERIT) != TX_SUCCESS)
+        || (tx_event_flags_create(&gps_rx_events, (CHAR *)"GPS Rx Events") != TX_SUCCESS)) {
+        return SSP_ERR_INTERNAL;
+    }
+
+    /* END ADDED */
+
     result = gps_init();
 
+    /* BEGIN ADDED */
+
+    if (result == SSP_SUCCESS) {
+        if (tx_thread_create(&gps_parser_thread, (CHAR *)"GPS Parser Thread", gps_parser_thread_entry, 0,
+                             gps_parser_stack, sizeof(gps_parser_stack), GPS_PARSER_PRIORITY,
+                             GPS_PARSER_PRIORITY, TX_NO_TIME_SLICE, TX_AUTO_START) != TX_SUCCESS) {
+            result = SSP_ERR_INTERNAL;
+        }
+    }
+
+    /* END ADDED */
+
     return result;
 }
 
@@ -203,9 +699,9 @@ static int8_t bme680_Initialize(void)
     /* BME680 Sensor Initialization */
     gas_sensor.dev_id = BME680_I2C_ADDR_PRIMARY;
     gas_sensor.intf = BME680_I2C_INTF;
-    gas_sensor.read = synergy_i2c_read;
-    gas_sensor.write = synergy_i2c_write;
-    gas_sensor.delay_ms = synergy_delay_ms;
+    gas_sensor.read = sensor_bus_read;
+    gas_sensor.write = sensor_bus_write;
+    gas_sensor.delay_ms = sensor_timing_delay_ms;
 
     status = bme680_init(&gas_sensor);
     if( status != BME680_OK)
@@ -246,11 +742,345 @@ static int8_t bme680_Initialize(void)
      * measurement is complete */
     bme680_get_profile_dur(&gas_sensor.meas_period, &gas_sensor);
 
+    /* BEGIN ADDED */
+
+    /* Setting forced mode above started the first conversion */
+    bme680_pending = true;
+    bme680_trigger_time = tx_time_get();
+
+    /* END ADDED */
+
+    return status;
+}
+
+/* BEGIN ADDED */
+
+/* Start a forced-mode conversion; the result is picked up by bme680_collect() */
+static int8_t bme680_trigger(void)
+{
+    int8_t status;
+
+    gas_sensor.power_mode = BME680_FORCED_MODE;
+    status = bme680_set_sensor_mode(&gas_sensor);
+
+    bme680_pending = (status == BME680_OK);
+    bme680_trigger_time = tx_time_get();
+
+    return status;
+}
+
+/*
+ * Read the conversion in flight once meas_period has passed and start the
+ * next one straight away, so the conversion time overlaps the rest of the
+ * sampling loop instead of stalling it. Returns BME680_W_NO_NEW_DATA,
+ * without a bus transaction, while the conversion is still running.
+ */
+static int8_t bme680_collect(struct bme680_field_data *p_data)
+{
+    ULONG wait = (((ULONG)gas_sensor.meas_period * TX_TIMER_TICKS_PER_SECOND) + 999U) / 1000U;
+    int8_t status;
+
+    if (!bme680_pending)
+    {
+        status = bme680_trigger();
+        return (status == BME680_OK) ? BME680_W_NO_NEW_DATA : status;
+    }
+
+    if ((tx_time_get() - bme680_trigger_time) < wait)
+        return BME680_W_NO_NEW_DATA;
+
+    status = bme680_get_sensor_data(p_data, &gas_sensor);
+    if (status == BME680_W_NO_NEW_DATA)
+        return status;      /* Still converting, try again next pass */
+
+    bme680_trigger();
+
+    return status;
+}
+
+/* END ADDED */
+
+/* BEGIN ADDED */
+
+static ssp_err_t nav_Initialize(void)
+{
+    nav_config_t const nav_cfg =
+    {
+        .accel_noise = 0.5f,
+        .gyro_noise = 0.01f,
+        .gyro_bias_noise = 0.001f,
+        .mag_noise = 0.1f,
+        .gps_uere = 5.0f,
+        .gps_vel_noise = 0.3f
+    };
+
+    ahrs_config_t const ahrs_cfg =
+    {
+        .gyro_rads_per_lsb = BMI160_GYRO_RADS_PER_LSB,
+        .kp = AHRS_KP,
+        .ki = AHRS_KI
+    };
+
+    nav_filter_init(&nav_filter, &nav_cfg);
+    memset(&nav_state, 0, sizeof(nav_state));
+    ahrs_init(&imu_ahrs, &ahrs_cfg);
+    ahrs_get_state(&imu_ahrs, &imu_orientation);
+    memset(sensors_agg, 0, sizeof(sensors_agg));
+    memset(nav_agg, 0, sizeof(nav_agg));
+    imu_fifo_init(&imu_fifo, IMU_FIFO_RATE_HZ);
+
+    if (tx_mutex_create(&imu_fifo_mutex, (CHAR *)"IMU FIFO Mutex", TX_INHERIT) != TX_SUCCESS)
+        return SSP_ERR_INTERNAL;
+
+    if (tx_event_flags_create(&imu_fifo_events, (CHAR *)"IMU FIFO Events") != TX_SUCCESS)
+        return SSP_ERR_INTERNAL;
+
+    if (tx_mutex_create(&nav_state_mutex, (CHAR *)"Nav State Mutex", TX_NO_INHERIT) != TX_SUCCESS)
+        return SSP_ERR_INTERNAL;
+
+    if (tx_mutex_create(&sensors_agg_mutex, (CHAR *)"Sensors Aggregate Mutex", TX_INHERIT) != TX_SUCCESS)
+        return SSP_ERR_INTERNAL;
+
+    if (tx_thread_create(&nav_thread, (CHAR *)"Nav Thread", nav_thread_entry, 0, nav_thread_stack,
+                         sizeof(nav_thread_stack), NAV_THREAD_PRIORITY, NAV_THREAD_PRIORITY,
+                         TX_NO_TIME_SLICE, TX_AUTO_START) != TX_SUCCESS)
+        return SSP_ERR_INTERNAL;
+
+    return SSP_SUCCESS;
+}
+
+/*
+ * Start from the calibration saved in flash, if there is a valid one, so
+ * headings are right from the first sample. Without one the nav thread
+ * uses raw readings until its first fit; a missing calibration is not a
+ * boot failure.
+ */
+static ssp_err_t sensors_mag_cal_Initialize(void)
+{
+    mag_cal_params_t params;
+
+    mag_cal_init(&imu_mag_cal, MAG_CAL_STEP);
+    memset(&imu_mag_params, 0, sizeof(imu_mag_params));
+    memset(&sensors_mag_fit, 0, sizeof(sensors_mag_fit));
+    memset(&sensors_mag_saved, 0, sizeof(sensors_mag_saved));
+
+    if ((int_storage_read((uint8_t *)&params, sizeof(params), MAG_CAL_CFG, 0) == SSP_SUCCESS)
+        && mag_cal_valid(&params))
+    {
+        imu_mag_params = params;
+        sensors_mag_saved = params;
+    }
+
+    return SSP_SUCCESS;
+}
+
+static uint32_t sensors_now_ms(void)
+{
+    return (uint32_t)(((uint64_t)tx_time_get() * 1000U) / TX_TIMER_TICKS_PER_SECOND);
+}
+
+/* Start the mic thread, then the DMAC on the first half of the ping-pong */
+static ssp_err_t mic_level_Initialize(void)
+{
+    ssp_err_t ssp_err;
+
+    sound_level_init(&mic_level, &mic_level_cfg, sensors_now_ms());
+    mic_dma_blocks = 0;
+
+    if (tx_mutex_create(&mic_level_mutex, (CHAR *)"Mic Level Mutex", TX_INHERIT) != TX_SUCCESS)
+        return SSP_ERR_INTERNAL;
+
+    if (tx_event_flags_create(&mic_events, (CHAR *)"Mic Events") != TX_SUCCESS)
+        return SSP_ERR_INTERNAL;
+
+    if (tx_thread_create(&mic_thread, (CHAR *)"Mic Thread", mic_thread_entry, 0, mic_thread_stack,
+                         sizeof(mic_thread_stack), MIC_THREAD_PRIORITY, MIC_THREAD_PRIORITY,
+                         TX_NO_TIME_SLICE, TX_AUTO_START) != TX_SUCCESS)
+        return SSP_ERR_INTERNAL;
+
+    ssp_err = g_transfer_mic.p_api->open(g_transfer_mic.p_ctrl, g_transfer_mic.p_cfg);
+    if (ssp_err == SSP_SUCCESS)
+        ssp_err = g_transfer_mic.p_api->reset(g_transfer_mic.p_ctrl, NULL, mic_dma_buf[0], SOUND_LEVEL_BLOCK_LEN);
+    if (ssp_err != SSP_SUCCESS)
+        return ssp_err;
+
+    mic_ready = true;
+
+    return SSP_SUCCESS;
+}
+
+static ssp_err_t sensors_sched_Initialize(void)
+{
+    memset(&sensors_snapshot, 0, sizeof(sensors_snapshot));
+    sensors_snapshot.stale_mask = SENSOR_STALE_ALL;
+    report_filter_init(&sensors_report, sensors_report_channels, REPORT_FIELD_COUNT);
+    vibration_init(&sensors_vibration, &sensors_vibration_cfg);
+
+    if (tx_mutex_create(&sensors_snapshot_mutex, (CHAR *)"Sensors Snapshot Mutex", TX_INHERIT) != TX_SUCCESS)
+        return SSP_ERR_INTERNAL;
+
+    sensor_sched_init(&sensors_sched, sensors_tasks, (uint8_t)(sizeof(sensors_tasks) / sizeof(sensors_tasks[0])),
+                      sensors_now_ms);
+
+    if (tx_thread_create(&sensor_thread, (CHAR *)"Sensor Thread", sensor_thread_entry, 0, sensor_thread_stack,
+                         sizeof(sensor_thread_stack), SENSOR_THREAD_PRIORITY, SENSOR_THREAD_PRIORITY,
+                         TX_NO_TIME_SLICE, TX_AUTO_START) != TX_SUCCESS)
+        return SSP_ERR_INTERNAL;
+
+    return SSP_SUCCESS;
+}
+
+/* END ADDED */
+
+/* BEGIN ADDED */
+
+/* Boot graph resource: one driver on g_i2c0 at a time */
+#define SENSORS_BOOT_I2C            (1UL << 0)
+
+typedef struct st_sensors_boot_step
+{
+    int8_t     (*driver_init)(void);    /* Runs with the bus held, or */
+    ssp_err_t  (*service_init)(void);
+    char const  *fail_msg;
+} sensors_boot_step_t;
+
+static sensors_boot_step_t const sensors_boot_bme680 = { bme680_Initialize, NULL, "BME680 Sensor Init Failed !!!\r\n" };
+static sensors_boot_step_t const sensors_boot_bmi160 = { bmi160_Initialize, NULL, "BMI160 Sensor Init Failed !!!\r\n" };
+static sensors_boot_step_t const sensors_boot_bmm150 = { bmm150_Initialize, NULL, "BMM150 Sensor Init Failed !!!\r\n" };
+static sensors_boot_step_t const sensors_boot_isl29035 = { isl29035_Initialize, NULL, "ISL29035 Sensor Init Failed !!!\r\n" };
+static sensors_boot_step_t const sensors_boot_gps = { NULL, gps_Initialize, "GPS Init Failed !!!\r\n" };
+static sensors_boot_step_t const sensors_boot_mic = { NULL, init_mic, "Mic Init Failed !!!\r\n" };
+static sensors_boot_step_t const sensors_boot_mic_level = { NULL, mic_level_Initialize, "Mic Level Init Failed !!!\r\n" };
+static sensors_boot_step_t const sensors_boot_magcal = { NULL, sensors_mag_cal_Initialize, "Mag Cal Init Failed !!!\r\n" };
+static sensors_boot_step_t const sensors_boot_nav = { NULL, nav_Initialize, "Nav Init Failed !!!\r\n" };
+static sensors_boot_step_t const sensors_boot_sched = { NULL, sensors_sched_Initialize, "Sensor Scheduler Init Failed !!!\r\n" };
+
+/* Open g_i2c0 and set up the bus layer before any driver runs */
+static int32_t sensors_boot_i2c(void *p_context)
+{
+    ssp_err_t ssp_err = SSP_SUCCESS;
+
+    SSP_PARAMETER_NOT_USED(p_context);
+
+#if !defined(SENSORS_BUS_SIM)
+    /* Open I2C driver instance */
+    ssp_err = g_i2c0.p_api->open(g_i2c0.p_ctrl, g_i2c0.p_cfg);
+    if(ssp_err != SSP_SUCCESS)
+    {
+        print_to_console("Unable to Open I2C driver\r\n");
+        return ssp_err;
+    }
+#endif
+
+    /* The drivers, the nav thread and the sensor thread share the bus */
+    if (tx_mutex_create(&sensors_i2c_mutex, (CHAR *)"Sensors I2C Mutex", TX_INHERIT) != TX_SUCCESS)
+        return SSP_ERR_INTERNAL;
+
+    /*
+     * Registers the drivers read one after another with no side effects:
+     * BME680 heater calibration, BME680 control block, BMI160 interrupt
+     * status through FIFO length.
+     */
+    sensor_bus_init();
+    sensor_bus_add_window(BME680_I2C_ADDR_PRIMARY, 0x00, 5);
+    sensor_bus_add_window(BME680_I2C_ADDR_PRIMARY, 0x70, 6);
+    sensor_bus_add_window(BMI160_I2C_ADDR, 0x1C, 8);
+
+    return ssp_err;
+}
+
+/*
+ * One init step. Driver steps hold the bus, since the nav thread may
+ * already be using it, and merge adjacent reads while they run.
+ */
+static int32_t sensors_boot_run(void *p_context)
+{
+    sensors_boot_step_t const *p_step = (sensors_boot_step_t const *) p_context;
+    int32_t status;
+
+    if (p_step->driver_init != NULL)
+    {
+        tx_mutex_get(&sensors_i2c_mutex, TX_WAIT_FOREVER);
+        sensor_bus_burst_begin();
+        status = p_step->driver_init();
+        sensor_bus_burst_end();
+        tx_mutex_put(&sensors_i2c_mutex);
+    }
+    else
+    {
+        status = p_step->service_init();
+    }
+
+    if (status != 0)
+        print_to_console(p_step->fail_msg);
+
     return status;
 }
 
+/*
+ * Add the sensor init steps to a boot graph. The bus drivers run one at a
+ * time after the bus is open, the BMM150 after the BMI160 that hosts it.
+ * GPS waits for gps_depends (the BG96 bring-up, which must come first);
+ * the mic has no dependencies, and its level pipeline starts after it and
+ * the bus layer, which starts the cycle counter. The saved magnetometer
+ * calibration is loaded once storage_depends (internal flash) is up.
+ * Fusion starts once the IMU, magnetometer, calibration and GPS are up,
+ * and sampling once fusion and the BME680 are.
+ */
+void init_sensors_stages(boot_graph_t *p_graph, uint32_t gps_depends, uint32_t storage_depends)
+{
+    uint8_t i2c;
+    uint8_t bme680;
+    uint8_t bmi160;
+    uint8_t bmm150;
+    uint8_t gps;
+    uint8_t mic;
+    uint8_t magcal;
+    uint8_t nav;
+
+    i2c = boot_graph_add(p_graph, "I2C", sensors_boot_i2c, NULL, 0, SENSORS_BOOT_I2C);
+    bme680 = boot_graph_add(p_graph, "BME680", sensors_boot_run, (void *) &sensors_boot_bme680,
+                            BOOT_STAGE(i2c), SENSORS_BOOT_I2C);
+    bmi160 = boot_graph_add(p_graph, "BMI160", sensors_boot_run, (void *) &sensors_boot_bmi160,
+                            BOOT_STAGE(i2c), SENSORS_BOOT_I2C);
+    bmm150 = boot_graph_add(p_graph, "BMM150", sensors_boot_run, (void *) &sensors_boot_bmm150,
+                            BOOT_STAGE(bmi160), SENSORS_BOOT_I2C);
+    boot_graph_add(p_graph, "ISL29035", sensors_boot_run, (void *) &sensors_boot_isl29035,
+                   BOOT_STAGE(i2c), SENSORS_BOOT_I2C);
+    gps = boot_graph_add(p_graph, "GPS", sensors_boot_run, (void *) &sensors_boot_gps, gps_depends, 0);
+    mic = boot_graph_add(p_graph, "Mic", sensors_boot_run, (void *) &sensors_boot_mic, 0, 0);
+    boot_graph_add(p_graph, "MicLevel", sensors_boot_run, (void *) &sensors_boot_mic_level,
+                   BOOT_STAGE(mic) | BOOT_STAGE(i2c), 0);
+    magcal = boot_graph_add(p_graph, "MagCal", sensors_boot_run, (void *) &sensors_boot_magcal,
+                            storage_depends, 0);
+    nav = boot_graph_add(p_graph, "Nav", sensors_boot_run, (void *) &sensors_boot_nav,
+                         BOOT_STAGE(bmi160) | BOOT_STAGE(bmm150) | BOOT_STAGE(gps) | BOOT_STAGE(magcal), 0);
+    boot_graph_add(p_graph, "Sampling", sensors_boot_run, (void *) &sensors_boot_sched,
+                   BOOT_STAGE(bme680) | BOOT_STAGE(nav), 0);
+}
+
+/* END ADDED */
+
 ssp_err_t init_sensors(void)
 {
+    /* BEGIN ADDED */
+
+    // Same steps as the boot graph, in order on the calling thread. The
+    // console thread runs them in parallel with the BG96 bring-up instead.
+
+    static boot_graph_t graph;
+
+    boot_graph_init(&graph, sensors_now_ms);
+    init_sensors_stages(&graph, 0, 0);
+
+    return (ssp_err_t) boot_graph_run_serial(&graph);
+
+    /* END ADDED */
+
+#if 0
+
+    /* ORIGINAL CODE */
+
     ssp_err_t ssp_err = SSP_SUCCESS;
     int8_t status = 0;
 
@@ -312,108 +1142,389 @@ ssp_err_t init_sensors(void)
     }
 
     return ssp_err;
+#endif
 }
 
+/* BEGIN ADDED */
 
-void read_gps_coordinates(sensors_data_t *sens)
+/*
+ * GPS UART callback. Received characters go straight into gps_rx_ring from
+ * the ISR, instead of one g_gps_queue message (and potential context switch)
+ * per character. The SCI has no idle-line interrupt, so per-character
+ * reception keeps sentence latency at zero; a DTC/DMA receiver can fill the
+ * ring in blocks through ring_buffer_write_span()/ring_buffer_commit().
+ */
+void gps_uart_callback(uart_callback_args_t *p_args)
 {
-    /* BEGIN ADDED */
+    if (p_args->event == UART_EVENT_RX_CHAR) {
+        ring_buffer_put(&gps_rx_ring, (uint8_t) p_args->data);
+
+        /* Wake the parser once per sentence rather than per character */
+        if (p_args->data == '\n') {
+            tx_event_flags_set(&gps_rx_events, GPS_RX_LINE_FLAG, TX_OR);
+        }
+    }
+}
+
+/*
+ * GPS parser thread. Drains the receive ring into the NMEA parser and
+ * publishes the merged fix to gps_cache, so read_sensor() never waits on
+ * the GNSS UART.
+ */
+static void gps_parser_thread_entry(ULONG thread_input)
+{
+    uint8_t const *p_span;
+    uint32_t count;
+    uint32_t sentences;
+    uint32_t updates;
+    traj_point_t point;
+    bool moved;
+    ULONG events;
 
-    char sentence[120];
-    char str[80];
-    char ch;
-    UINT retval;
-    int index;
+    SSP_PARAMETER_NOT_USED(thread_input);
 
-    // Initialize values to empty string
+    while (1) {
+        tx_event_flags_get(&gps_rx_events, GPS_RX_LINE_FLAG, TX_OR_CLEAR, &events, GPS_PARSER_WAIT_TICKS);
 
-    sens->latitude[0] = '\0';
-    sens->longitude[0] = '\0';
+        updates = gps_fix.position_updates;
+        sentences = 0;
 
-    // Remove all but the last 120 chars (or less) of the incoming buffer.
+        while ((count = ring_buffer_read_span(&gps_rx_ring, &p_span)) > 0) {
+            sentences += nmea_parser_feed(&gps_parser, p_span, count);
+            ring_buffer_release(&gps_rx_ring, count);
+        }
 
-    if (g_gps_queue.tx_queue_enqueued > 120) {
-        UINT remaining = g_gps_queue.tx_queue_enqueued - 120;
-        while (remaining--) {
-            retval = tx_queue_receive(&g_gps_queue, &ch, TX_NO_WAIT);
+        if (sentences == 0) {
+            continue;
         }
-    } else {
-        do {
-            tx_thread_sleep(50);
-        } while (g_gps_queue.tx_queue_enqueued < 120);
+
+        moved = (gps_fix.position_updates != updates) && (gps_fix.fix_quality > 0);
+        if (moved) {
+            gps_fix.timestamp = tx_time_get();
+
+            point.latitude_e7 = gps_fix.latitude_e7;
+            point.longitude_e7 = gps_fix.longitude_e7;
+            point.time_ms = (uint32_t)(((uint64_t)gps_fix.timestamp * 1000U) / TX_TIMER_TICKS_PER_SECOND);
+            point.course_cdeg = (gps_fix.valid & GNSS_VALID_COURSE) ? gps_fix.course_cdeg : 0;
+        }
+
+        tx_mutex_get(&gps_cache_mutex, TX_WAIT_FOREVER);
+        gps_cache = gps_fix;
+        if (moved) {
+            trajectory_add(&gps_track, &point);
+            /* More containing fences than it tracks shows as overflows in "demo stats" */
+            (void) geofence_update(&gps_fences, point.latitude_e7, point.longitude_e7, point.time_ms);
+        }
+        tx_mutex_put(&gps_cache_mutex);
     }
+}
+
+/*
+ * BMI160 INT1, FIFO watermark. Set as the callback of the external IRQ
+ * instance on the INT1 pin.
+ */
+void bmi160_fifo_irq_callback(external_irq_callback_args_t *p_args)
+{
+    SSP_PARAMETER_NOT_USED(p_args);
+
+    imu_irq_count++;
+    tx_event_flags_set(&imu_fifo_events, IMU_FIFO_WTM_FLAG, TX_OR);
+}
 
-    // Find beginning of next GPS sentence
+/* BMI160 INT2, any-motion or no-motion. Callback of the INT2 IRQ instance */
+void bmi160_motion_irq_callback(external_irq_callback_args_t *p_args)
+{
+    SSP_PARAMETER_NOT_USED(p_args);
 
-    do {
-        retval = tx_queue_receive(&g_gps_queue, &ch, TX_NO_WAIT);
-    } while (ch != '$');
+    imu_irq_count++;
+    tx_event_flags_set(&imu_fifo_events, IMU_MOTION_FLAG, TX_OR);
+}
 
-    // Save the sentence
+/*
+ * DMAC transfer end, one half of mic_dma_buf is full. Set as the callback
+ * of g_transfer_mic. The DMAC goes on to the other half at once, so the
+ * mic thread has a whole block time for this one.
+ */
+void mic_dma_callback(transfer_callback_args_t *p_args)
+{
+    SSP_PARAMETER_NOT_USED(p_args);
 
-    index = 0;
-    sentence[index++] = ch;
+    mic_dma_blocks++;
+    g_transfer_mic.p_api->reset(g_transfer_mic.p_ctrl, NULL, mic_dma_buf[mic_dma_blocks & 1U],
+                                SOUND_LEVEL_BLOCK_LEN);
+    tx_event_flags_set(&mic_events, MIC_BLOCK_FLAG, TX_OR);
+}
 
-    do {
-        retval = tx_queue_receive(&g_gps_queue, &ch, TX_NO_WAIT);
-        if (retval == TX_SUCCESS) {
-            sentence[index++] = ch;
-        } else {
-            tx_thread_sleep(50);
-            ch = 0;
+/*
+ * Mic thread. Takes the newest full half of the ping-pong; if it fell
+ * more than a block behind, the blocks in between were overwritten and
+ * are counted lost. Cycles per block go to the "demo stats" report.
+ */
+static void mic_thread_entry(ULONG thread_input)
+{
+    ULONG events;
+    uint32_t done = 0;
+    uint32_t ready;
+    uint32_t start;
+    uint32_t cycles;
+    uint16_t const *p_adc;
+    uint32_t n;
+
+    SSP_PARAMETER_NOT_USED(thread_input);
+
+    while (1) {
+        tx_event_flags_get(&mic_events, MIC_BLOCK_FLAG, TX_OR_CLEAR, &events, TX_WAIT_FOREVER);
+
+        ready = mic_dma_blocks;
+        if (ready == done) {
+            continue;
         }
-    } while (ch != '*');
+        p_adc = mic_dma_buf[(ready - 1U) & 1U];
 
-    sentence[index] = '\0';  // terminate the string
+        tx_mutex_get(&mic_level_mutex, TX_WAIT_FOREVER);
+        mic_lost += (ready - done) - 1U;
+        done = ready;
 
-    // Check if this is a GPGGA sentence
+        start = SENSOR_BUS_CLOCK();
+        for (n = 0; n < SOUND_LEVEL_BLOCK_LEN; n++) {
+            mic_block[n] = (int16_t) (((int32_t) p_adc[n] - MIC_ADC_MID) * (1 << MIC_ADC_SHIFT));
+        }
+        sound_level_process(&mic_level, mic_block, sensors_now_ms());
+        cycles = SENSOR_BUS_CLOCK() - start;
 
-    if (strncmp(sentence, "$GPGGA", 6) != 0) {
-        return;
+        mic_cycles_sum += cycles;
+        if (cycles > mic_cycles_max) {
+            mic_cycles_max = cycles;
+        }
+        tx_mutex_put(&mic_level_mutex);
     }
+}
 
-    // Parse the sentence into fields
-
-    char *tokens[18];
-    unsigned token_count = 0;
+/*
+ * Follow an INT2 edge: any-motion restores the normal watermark, no-motion
+ * raises it. Called with the bus held.
+ */
+static void nav_update_motion(void)
+{
+    union bmi160_int_status int_status;
 
-    char *running = sentence;
+    if (bmi160_get_int_status(BMI160_INT_STATUS_ALL, &int_status, &bmi160) != BMI160_OK) {
+        return;
+    }
 
-    tokens[token_count] = strsep(&running, ",");
-    while (tokens[token_count] != NULL && token_count < sizeof(tokens)/sizeof(tokens[0])) {
-        tokens[++token_count] = strsep(&running, ",");
+    if (int_status.bit.anym && !imu_moving) {
+        imu_moving = true;
+        bmi160_set_fifo_wm(BMI160_FIFO_WATERMARK, &bmi160);
+    } else if (int_status.bit.nomo && imu_moving) {
+        imu_moving = false;
+        bmi160_set_fifo_wm(BMI160_FIFO_WATERMARK_STILL, &bmi160);
     }
+}
 
-    if (token_count >= 6 && tokens[6][0] < '1') {
-        /* No GPS fix */
-        return;
+/*
+ * Nav thread. Sleeps until a BMI160 interrupt: drains the FIFO on each
+ * watermark (about NAV_RATE_HZ while moving), reads the magnetometer every
+ * NAV_MAG_DIVIDER drains, runs the fusion filter once per FIFO sample and
+ * corrects it with every new GNSS fix, giving position and velocity
+ * between 1 Hz fixes. The orientation filter runs on the same samples.
+ * The BMI160 is taken as x forward, y left, z up.
+ */
+static void nav_thread_entry(ULONG thread_input)
+{
+    uint8_t mag_data[8];
+    gnss_fix_t fix;
+    nav_state_t state;
+    ahrs_state_t orientation;
+    ULONG period = TX_TIMER_TICKS_PER_SECOND / NAV_RATE_HZ;
+    ULONG events;
+    ULONG now;
+    uint32_t step = 0;
+    uint32_t seen_updates = 0;
+    uint32_t cursor = 0;
+    uint32_t count;
+    uint32_t i;
+    uint32_t ch;
+    uint32_t last_time = 0;
+    bool has_last = false;
+    int8_t status;
+    bool mag_read;
+    int16_t mag_x = 0;
+    int16_t mag_y = 0;
+    int16_t mag_raw[3] = { 0, 0, 0 };
+    int16_t mag_xyz[3] = { 0, 0, 0 };
+    mag_cal_params_t mag_fit;
+    bool mag_fit_new = false;
+    bool ahrs_mag = false;
+    float dt;
+
+    SSP_PARAMETER_NOT_USED(thread_input);
+
+    if (period == 0) {
+        period = 1;
     }
 
-    if (strlen(tokens[2]) >= 6 && strlen(tokens[4]) >= 7) {
-        char deg[4];
-        double x;
-        int digits = 10;
-        extern char *gcvt(double,int,char *);
-        // Extract latitude value
-        strncpy(deg, tokens[2], 2);
-        deg[2] = '\0';
-        x = atof(deg) + (atof(tokens[2]+2) / 60.0);
-        gcvt(x, digits, str);
-        if (tokens[3][0] == 'S') {
-            strcat(sens->latitude, "-");
+    while (1) {
+        /*
+         * Poll at the nav rate until the first interrupt shows the INT pins
+         * are wired; after that the timeout is only a watchdog.
+         */
+        events = 0;
+        tx_event_flags_get(&imu_fifo_events, IMU_FIFO_WTM_FLAG | IMU_MOTION_FLAG, TX_OR_CLEAR, &events,
+                           (imu_irq_count > 0) ? NAV_IRQ_WATCHDOG_TICKS : period);
+
+        /* Still: drains are already ~7 Hz, read the magnetometer each time */
+        mag_read = ((step++ % NAV_MAG_DIVIDER) == 0) || !imu_moving;
+
+        tx_mutex_get(&sensors_i2c_mutex, TX_WAIT_FOREVER);
+        if (events & IMU_MOTION_FLAG) {
+            /* Interrupt status and FIFO length in one read */
+            sensor_bus_burst_begin();
+            nav_update_motion();
+        }
+        bmi160_fifo.data = bmi160_fifo_buf;
+        bmi160_fifo.length = sizeof(bmi160_fifo_buf);
+        status = bmi160_get_fifo_data(&bmi160);
+        sensor_bus_burst_end();
+        if (mag_read) {
+            mag_read = (bmm150_read_data(&bmi160, &bmm150, &mag_data[0]) == BMM150_OK);
+            mag_raw[0] = bmm150.data.x;
+            mag_raw[1] = bmm150.data.y;
+            mag_raw[2] = bmm150.data.z;
+            ahrs_mag = mag_read;
+        }
+        tx_mutex_put(&sensors_i2c_mutex);
+
+        if (mag_read) {
+            /* The fit learns from raw samples; everything downstream sees them corrected */
+            if (mag_cal_add(&imu_mag_cal, mag_raw) && ((imu_mag_cal.accepted % MAG_CAL_SOLVE_EVERY) == 0U)
+                && mag_cal_solve(&imu_mag_cal, &mag_fit)) {
+                imu_mag_params = mag_fit;
+                mag_fit_new = true;
+            }
+            mag_cal_apply(&imu_mag_params, mag_raw, mag_xyz);
+            mag_x = mag_xyz[0];
+            mag_y = mag_xyz[1];
+
+            sensor_agg_add(&nav_agg[SENSOR_AGG_MAG_X], mag_xyz[0]);
+            sensor_agg_add(&nav_agg[SENSOR_AGG_MAG_Y], mag_xyz[1]);
+            sensor_agg_add(&nav_agg[SENSOR_AGG_MAG_Z], mag_xyz[2]);
+        }
+
+        now = tx_time_get();
+
+        tx_mutex_get(&imu_fifo_mutex, TX_WAIT_FOREVER);
+        if (status == BMI160_OK) {
+            imu_fifo_decode(&imu_fifo, bmi160_fifo_buf, bmi160_fifo.length);
+        }
+        if (mag_read) {
+            imu_mag.x = mag_xyz[0];
+            imu_mag.y = mag_xyz[1];
+            imu_mag.z = mag_xyz[2];
+            imu_mag_count++;
         }
-        strcat(sens->latitude, str);
-        strncpy(deg, tokens[4], 3);
-        deg[3] = '\0';
-        x = atof(deg) + (atof(tokens[4]+3) / 60.0);
-        if (tokens[4][0] == '1') {
-            digits++;
+        if (mag_fit_new) {
+            sensors_mag_fit = mag_fit;
+            mag_fit_new = false;
         }
-        gcvt(x, digits, str);
-        if (tokens[5][0] == 'W') {
-            strcat(sens->longitude, "-");
+        tx_mutex_put(&imu_fifo_mutex);
+
+        /* Only this thread writes imu_fifo, so reading it needs no lock */
+        while ((count = imu_fifo_copy(&imu_fifo, &cursor, nav_batch, NAV_BATCH_LEN)) > 0) {
+            for (i = 0; i < count; i++) {
+                if ((nav_batch[i].flags & (IMU_SAMPLE_ACCEL | IMU_SAMPLE_GYRO))
+                    != (IMU_SAMPLE_ACCEL | IMU_SAMPLE_GYRO)) {
+                    continue;
+                }
+
+                for (ch = 0; ch < 3U; ch++) {
+                    sensor_agg_add(&nav_agg[SENSOR_AGG_ACCEL_X + ch], nav_batch[i].accel[ch]);
+                    sensor_agg_add(&nav_agg[SENSOR_AGG_GYRO_X + ch], nav_batch[i].gyro[ch]);
+                }
+
+                /* A gap (FIFO overflow, first sensortime frame) restarts dt */
+                dt = (float)(nav_batch[i].time - last_time) * IMU_FIFO_TICK_S;
+                if (has_last && (dt < 0.1f)) {
+                    nav_filter_predict(&nav_filter,
+                                       (float) nav_batch[i].accel[0] * BMI160_ACCEL_MSS_PER_LSB,
+                                       -(float) nav_batch[i].accel[1] * BMI160_ACCEL_MSS_PER_LSB,
+                                       -(float) nav_batch[i].gyro[2] * BMI160_GYRO_RADS_PER_LSB,
+                                       dt);
+
+                    /* Orientation in the BMI160 frame; a new mag sample goes with the next step */
+                    ahrs_update(&imu_ahrs, nav_batch[i].gyro, nav_batch[i].accel, ahrs_mag ? mag_xyz : NULL,
+                                ((nav_batch[i].time - last_time) * 625U) / 16U);
+                    ahrs_mag = false;
+                }
+                last_time = nav_batch[i].time;
+                has_last = true;
+            }
         }
-        strcat(sens->longitude, str);
+
+        /* Every drained sample goes into the publish window, one lock per drain */
+        tx_mutex_get(&sensors_agg_mutex, TX_WAIT_FOREVER);
+        for (ch = 0; ch <= SENSOR_AGG_MAG_Z; ch++) {
+            sensor_agg_merge(&sensors_agg[ch], &nav_agg[ch]);
+            sensor_agg_reset(&nav_agg[ch]);
+        }
+        tx_mutex_put(&sensors_agg_mutex);
+
+        if (mag_read && ((mag_x != 0) || (mag_y != 0))) {
+            nav_filter_update_heading(&nav_filter, atan2f((float) mag_y, (float) mag_x));
+        }
+
+        tx_mutex_get(&gps_cache_mutex, TX_WAIT_FOREVER);
+        fix = gps_cache;
+        tx_mutex_put(&gps_cache_mutex);
+
+        if ((fix.position_updates != seen_updates) && (fix.fix_quality > 0)) {
+            seen_updates = fix.position_updates;
+            nav_filter_update_gps(&nav_filter, fix.latitude_e7, fix.longitude_e7,
+                                  (fix.valid & GNSS_VALID_DOP) ? ((float) fix.hdop_x100 / 100.0f) : 1.0f,
+                                  (fix.valid & (GNSS_VALID_SPEED | GNSS_VALID_COURSE))
+                                      == (GNSS_VALID_SPEED | GNSS_VALID_COURSE),
+                                  (float) fix.speed_mm_s / 1000.0f,
+                                  (float) fix.course_cdeg * (0.0174532925f / 100.0f));
+        }
+
+        nav_filter_get_state(&nav_filter, &state);
+        state.time_ms = (uint32_t)(((uint64_t) now * 1000U) / TX_TIMER_TICKS_PER_SECOND);
+        ahrs_get_state(&imu_ahrs, &orientation);
+
+        tx_mutex_get(&nav_state_mutex, TX_WAIT_FOREVER);
+        nav_state = state;
+        imu_orientation = orientation;
+        tx_mutex_put(&nav_state_mutex);
+    }
+}
+
+/* END ADDED */
+
+void read_gps_coordinates(sensors_data_t *sens)
+{
+    /* BEGIN ADDED */
+
+    // Copy the last known fix published by the GPS parser thread, plus the
+    // significant track points and geofence enter/exit events queued since
+    // the previous call. This never waits on the UART; the cache mutex is
+    // only held for the copies.
+
+    tx_mutex_get(&gps_cache_mutex, TX_WAIT_FOREVER);
+    sens->gnss = gps_cache;
+    sens->track_count = (uint8_t) trajectory_read(&gps_track, sens->track, TRAJECTORY_OUT_LEN);
+    sens->fence_event_count = (uint8_t) geofence_read_events(&gps_fences, sens->fence_events, GEOFENCE_EVENT_LEN);
+    tx_mutex_put(&gps_cache_mutex);
+
+    if (sens->gnss.valid & GNSS_VALID_POSITION) {
+        sens->gnss.age_ms = (uint32_t)(((uint64_t)(tx_time_get() - sens->gnss.timestamp) * 1000U)
+                                       / TX_TIMER_TICKS_PER_SECOND);
+
+        // The payload still carries decimal degree strings
+        gnss_format_coord(sens->gnss.latitude_e7, sens->latitude);
+        gnss_format_coord(sens->gnss.longitude_e7, sens->longitude);
+    } else {
+        sens->gnss.age_ms = UINT32_MAX;
+        sens->latitude[0] = '\0';
+        sens->longitude[0] = '\0';
     }
 
     return;
@@ -548,8 +1659,409 @@ void read_gps_coordinates(sensors_data_t *sens)
 #endif
 }
 
+/* BEGIN ADDED */
+
+/*
+ * Sensor thread. Runs the sampling scheduler; each read function below is
+ * one scheduled task and publishes into sensors_snapshot. Every read keeps
+ * the time budget of sensor_timing.h. A demo stop only stops the
+ * publisher, so sampling carries on through it.
+ */
+static void sensor_thread_entry(ULONG thread_input)
+{
+    uint32_t wait_ms;
+
+    SSP_PARAMETER_NOT_USED(thread_input);
+
+    while (1) {
+        wait_ms = sensor_sched_run(&sensors_sched);
+
+        if (wait_ms > 0) {
+            tx_thread_sleep((((ULONG) wait_ms * TX_TIMER_TICKS_PER_SECOND) + 999U) / 1000U);
+        }
+    }
+}
+
+/* Mark a sensor fresh or stale in the snapshot */
+static void sensors_set_stale(sensor_id_t id, bool stale)
+{
+    if (stale) {
+        sensors_snapshot.stale_mask |= SENSOR_STALE(id);
+    } else {
+        sensors_snapshot.stale_mask &= ~SENSOR_STALE(id);
+    }
+}
+
+/*
+ * Accel and gyro come from the FIFO ring the nav thread fills, so this
+ * only waits for the ring, never for the bus. Stale if no new sample
+ * arrived since the last run.
+ */
+static int32_t sensors_read_imu(void *p_context)
+{
+    imu_sample_t imu_sample = { 0 };
+    uint32_t imu_seen;
+    bool fresh = false;
+
+    SSP_PARAMETER_NOT_USED(p_context);
+
+    if (sensor_timing_begin(SENSOR_ID_BMI160, &imu_fifo_mutex)) {
+        imu_seen = imu_fifo_latest(&imu_fifo, &imu_sample);
+        fresh = (imu_seen != sensors_imu_seen);
+        sensors_imu_seen = imu_seen;
+        fresh = sensor_timing_end(SENSOR_ID_BMI160, &imu_fifo_mutex) && fresh;
+    }
+
+    tx_mutex_get(&sensors_snapshot_mutex, TX_WAIT_FOREVER);
+    if (fresh) {
+        sensors_snapshot.accel.x_axis = imu_sample.accel[0];
+        sensors_snapshot.accel.y_axis = imu_sample.accel[1];
+        sensors_snapshot.accel.z_axis = imu_sample.accel[2];
+
+        sensors_snapshot.gyro.x_axis = imu_sample.gyro[0];
+        sensors_snapshot.gyro.y_axis = imu_sample.gyro[1];
+        sensors_snapshot.gyro.z_axis = imu_sample.gyro[2];
+    }
+    sensors_set_stale(SENSOR_ID_BMI160, !fresh);
+    tx_mutex_put(&sensors_snapshot_mutex);
+
+    return fresh ? 0 : -1;
+}
+
+/* Collect the BME680 conversion started on the previous run */
+static int32_t sensors_read_env(void *p_context)
+{
+    struct bme680_field_data bme_data;
+    int8_t status = BME680_E_COM_FAIL;
+
+    SSP_PARAMETER_NOT_USED(p_context);
+
+    if (sensor_timing_begin(SENSOR_ID_BME680, &sensors_i2c_mutex)) {
+        status = bme680_collect(&bme_data);
+        if (!sensor_timing_end(SENSOR_ID_BME680, &sensors_i2c_mutex)) {
+            status = BME680_E_COM_FAIL;
+        }
+    }
+
+    tx_mutex_get(&sensors_snapshot_mutex, TX_WAIT_FOREVER);
+    if (status == BME680_OK) {
+        /* Driver units; the payload builder converts, see sensor_units.h */
+        sensors_snapshot.env.temperature_cdegc = bme_data.temperature;
+        sensors_snapshot.env.humidity_mrh = bme_data.humidity;
+        sensors_snapshot.env.pressure_pa = bme_data.pressure;
+    }
+    sensors_set_stale(SENSOR_ID_BME680, status != BME680_OK);
+    tx_mutex_put(&sensors_snapshot_mutex);
+
+    if (status == BME680_OK) {
+        tx_mutex_get(&sensors_agg_mutex, TX_WAIT_FOREVER);
+        sensor_agg_add(&sensors_agg[SENSOR_AGG_TEMPERATURE], bme_data.temperature);
+        sensor_agg_add(&sensors_agg[SENSOR_AGG_HUMIDITY], (int32_t) bme_data.humidity);
+        sensor_agg_add(&sensors_agg[SENSOR_AGG_PRESSURE], (int32_t) bme_data.pressure);
+        tx_mutex_put(&sensors_agg_mutex);
+    }
+
+    return status;
+}
+
+/*
+ * Collect the ISL29035 conversion started on a previous run; als_range
+ * then starts the next one at the range and integration time this reading
+ * calls for. A run that finds it still integrating, or saturated, leaves
+ * the last reading in place and marks it stale.
+ */
+static int32_t sensors_read_light(void *p_context)
+{
+    als_reading_t reading;
+    int8_t status = ALS_RANGE_E_COM_FAIL;
+
+    SSP_PARAMETER_NOT_USED(p_context);
+
+    if (sensors_als_ready && sensor_timing_begin(SENSOR_ID_ISL29035, &sensors_i2c_mutex)) {
+        status = als_range_collect(&sensors_als, &reading, sensors_now_ms());
+        if (!sensor_timing_end(SENSOR_ID_ISL29035, &sensors_i2c_mutex)) {
+            status = ALS_RANGE_E_COM_FAIL;
+        }
+    }
+
+    tx_mutex_get(&sensors_snapshot_mutex, TX_WAIT_FOREVER);
+    if (status == ALS_RANGE_OK) {
+        sensors_snapshot.light = reading;
+    }
+    sensors_set_stale(SENSOR_ID_ISL29035, status != ALS_RANGE_OK);
+    tx_mutex_put(&sensors_snapshot_mutex);
+
+    if (status == ALS_RANGE_OK) {
+        tx_mutex_get(&sensors_agg_mutex, TX_WAIT_FOREVER);
+        sensor_agg_add(&sensors_agg[SENSOR_AGG_LIGHT], (int32_t) reading.lux_milli);
+        tx_mutex_put(&sensors_agg_mutex);
+    }
+
+    return status;
+}
+
+/*
+ * Add every accel sample the nav thread decoded since the last run to the
+ * vibration window and publish the result of each window that fills. The
+ * FIFO ring holds 1.28 s, so a run every 250 ms misses nothing unless the
+ * thread is held off; the gap then restarts the window.
+ *
+ * Timed without a bus: the ring mutex is only held for each copy, not for
+ * the FFT. Stale when skipped, or when no accel sample arrived since the
+ * last run; an overrun skips the next SENSOR_OVERRUN_BACKOFF runs, which
+ * the ring still covers.
+ */
+static int32_t sensors_read_vibration(void *p_context)
+{
+    vibration_result_t result;
+    imu_sample_t const *p_sample;
+    bool fed = false;
+    bool windowed = false;
+    uint32_t count;
+    uint32_t i;
+
+    SSP_PARAMETER_NOT_USED(p_context);
+
+    if (sensor_timing_begin(SENSOR_ID_VIBRATION, NULL)) {
+        do {
+            tx_mutex_get(&imu_fifo_mutex, TX_WAIT_FOREVER);
+            count = imu_fifo_copy(&imu_fifo, &sensors_vibration_cursor, sensors_vibration_batch, NAV_BATCH_LEN);
+            tx_mutex_put(&imu_fifo_mutex);
+
+            for (i = 0; i < count; i++) {
+                p_sample = &sensors_vibration_batch[i];
+                if (!(p_sample->flags & IMU_SAMPLE_ACCEL)) {
+                    continue;
+                }
+
+                if ((p_sample->time - sensors_vibration_time) > VIBRATION_GAP_TICKS) {
+                    vibration_restart(&sensors_vibration);
+                }
+                sensors_vibration_time = p_sample->time;
+                fed = true;
+
+                if (vibration_add(&sensors_vibration, p_sample->accel)) {
+                    vibration_process(&sensors_vibration, &result);
+                    windowed = true;
+                }
+            }
+        } while (count == NAV_BATCH_LEN);
+        fed = sensor_timing_end(SENSOR_ID_VIBRATION, NULL) && fed;
+    }
+
+    tx_mutex_get(&sensors_snapshot_mutex, TX_WAIT_FOREVER);
+    if (fed && windowed) {
+        sensors_snapshot.vibration = result;
+    }
+    sensors_set_stale(SENSOR_ID_VIBRATION, !fed);
+    tx_mutex_put(&sensors_snapshot_mutex);
+
+    return fed ? 0 : -1;
+}
+
+/*
+ * Write the nav thread's latest magnetometer fit to flash when there is
+ * none saved yet, or when it moved by MAG_CAL_SAVE_CHANGE and the last
+ * write is MAG_CAL_SAVE_MIN_MS old, so a drifting fit does not wear the
+ * flash out.
+ */
+static int32_t sensors_save_mag_cal(void *p_context)
+{
+    mag_cal_params_t fit;
+    uint32_t now = sensors_now_ms();
+
+    SSP_PARAMETER_NOT_USED(p_context);
+
+    tx_mutex_get(&imu_fifo_mutex, TX_WAIT_FOREVER);
+    fit = sensors_mag_fit;
+    tx_mutex_put(&imu_fifo_mutex);
+
+    if (!mag_cal_valid(&fit)) {
+        return 0;
+    }
+    if (mag_cal_valid(&sensors_mag_saved)
+        && ((mag_cal_difference(&fit, &sensors_mag_saved) < MAG_CAL_SAVE_CHANGE)
+            || ((now - sensors_mag_save_ms) < MAG_CAL_SAVE_MIN_MS))) {
+        return 0;
+    }
+
+    if (int_storage_write((uint8_t *)&fit, sizeof(fit), MAG_CAL_CFG, 0) != SSP_SUCCESS) {
+        return -1;
+    }
+    sensors_mag_saved = fit;
+    sensors_mag_save_ms = now;
+
+    return 0;
+}
+
+/*
+ * The nav thread reads the magnetometer with its FIFO drains, so this
+ * only copies its latest reading. Stale if none arrived since the last run.
+ */
+static int32_t sensors_read_mag(void *p_context)
+{
+    struct bmm150_mag_data mag = { 0 };
+    bool fresh = false;
+
+    SSP_PARAMETER_NOT_USED(p_context);
+
+    if (sensor_timing_begin(SENSOR_ID_BMM150, &imu_fifo_mutex)) {
+        mag = imu_mag;
+        fresh = (imu_mag_count != sensors_mag_seen);
+        sensors_mag_seen = imu_mag_count;
+        fresh = sensor_timing_end(SENSOR_ID_BMM150, &imu_fifo_mutex) && fresh;
+    }
+
+    tx_mutex_get(&sensors_snapshot_mutex, TX_WAIT_FOREVER);
+    if (fresh) {
+        sensors_snapshot.mag.x = mag.x;
+        sensors_snapshot.mag.y = mag.y;
+        sensors_snapshot.mag.z = mag.z;
+    }
+    sensors_set_stale(SENSOR_ID_BMM150, !fresh);
+    tx_mutex_put(&sensors_snapshot_mutex);
+
+    return fresh ? 0 : -1;
+}
+
+/* Mic blocks and their cost against the time one block takes to arrive */
+static void mic_print_stats(void)
+{
+    char str[96];
+    uint32_t budget = MIC_BLOCK_US * SENSOR_BUS_CLOCK_PER_US;
+    uint32_t blocks;
+    uint32_t avg;
+    uint32_t use;
+
+    if (!mic_ready)
+        return;
+
+    tx_mutex_get(&mic_level_mutex, TX_WAIT_FOREVER);
+    blocks = mic_level.blocks;
+    avg = blocks ? (uint32_t) (mic_cycles_sum / blocks) : 0U;
+    use = (uint32_t) (((uint64_t)mic_cycles_max * 10000U) / budget);     /* 0.01 % */
+    print_to_console("\r\nMic blocks  Lost  Clipped  Cycles avg/max   Budget  Max(%)\r\n");
+    snprintf(str, sizeof(str), "%10lu  %4lu  %7lu  %7lu/%-7lu  %7lu  %3lu.%02lu\r\n", (unsigned long)blocks,
+             (unsigned long)mic_lost, (unsigned long)mic_level.clipped, (unsigned long)avg,
+             (unsigned long)mic_cycles_max, (unsigned long)budget,
+             (unsigned long)(use / 100U), (unsigned long)(use % 100U));
+    tx_mutex_put(&mic_level_mutex);
+    print_to_console(str);
+}
+
+/* Per-sensor latency, scheduling and bus statistics, "demo stats" */
+void sensors_print_stats(void)
+{
+    sensor_timing_report();
+    sensor_sched_print(&sensors_sched, print_to_console);
+    sensor_bus_print(print_to_console);
+    report_filter_print(&sensors_report, print_to_console);
+    tx_mutex_get(&gps_cache_mutex, TX_WAIT_FOREVER);
+    geofence_print(&gps_fences, print_to_console);
+    tx_mutex_put(&gps_cache_mutex);
+    if (sensors_als_ready)
+        als_range_print(&sensors_als, print_to_console);
+    mic_print_stats();
+}
+
+/* END ADDED */
+
 void read_sensor(sensors_data_t *sens)
 {
+    /* BEGIN ADDED */
+
+    int32_t env_raw[REPORT_FIELD_COUNT];
+    uint32_t now_ms;
+    uint8_t ch;
+
+    // The sensor thread samples each sensor at its own rate (see
+    // sensors_tasks); this only copies the latest snapshot, so it never
+    // waits on the bus. stale_mask flags sensors whose last scheduled read
+    // failed or was skipped.
+
+    tx_mutex_get(&sensors_snapshot_mutex, TX_WAIT_FOREVER);
+    sens->accel = sensors_snapshot.accel;
+    sens->gyro = sensors_snapshot.gyro;
+    sens->env = sensors_snapshot.env;
+    sens->mag = sensors_snapshot.mag;
+    sens->vibration = sensors_snapshot.vibration;
+    sens->light = sensors_snapshot.light;
+    sens->stale_mask = sensors_snapshot.stale_mask | SENSOR_STALE(SENSOR_ID_GPS);
+    tx_mutex_put(&sensors_snapshot_mutex);
+
+#if !defined(SENSORS_NO_DOUBLE_FIELDS)
+    // The payload builder prints the double members; define
+    // SENSORS_NO_DOUBLE_FIELDS once it formats sens->env instead
+    sens->temperature = (double) sensor_units_cdegf(sens->env.temperature_cdegc) / 100.0;
+    sens->humidity = (double) sens->env.humidity_mrh / 1000.0;
+    sens->pressure = (double) sens->env.pressure_pa / 100.0;
+#endif
+
+    // Environmental fields worth publishing: moved past their dead-band,
+    // changing fast, or due a heartbeat. The payload skips the others.
+
+    env_raw[REPORT_FIELD_TEMPERATURE] = sens->env.temperature_cdegc;
+    env_raw[REPORT_FIELD_HUMIDITY] = (int32_t) sens->env.humidity_mrh;
+    env_raw[REPORT_FIELD_PRESSURE] = (int32_t) sens->env.pressure_pa;
+    sens->report_mask = report_filter_check(&sensors_report, env_raw,
+                                            (sens->stale_mask & SENSOR_STALE(SENSOR_ID_BME680)) ? 0U : REPORT_FIELD_ALL,
+                                            sensors_now_ms());
+
+    // Latest fused position and velocity, and orientation
+
+    tx_mutex_get(&nav_state_mutex, TX_WAIT_FOREVER);
+    sens->nav = nav_state;
+    sens->ahrs = imu_orientation;
+    tx_mutex_put(&nav_state_mutex);
+
+    // Statistics of every sample since the previous call; this call
+    // closes the window and starts the next one
+
+    tx_mutex_get(&sensors_agg_mutex, TX_WAIT_FOREVER);
+    for (ch = 0; ch < SENSOR_AGG_CHANNELS; ch++)
+    {
+        sensor_agg_get(&sensors_agg[ch], &sens->agg[ch]);
+        sensor_agg_reset(&sensors_agg[ch]);
+    }
+    now_ms = sensors_now_ms();
+    sens->agg_window_ms = now_ms - sensors_agg_start_ms;
+    sensors_agg_start_ms = now_ms;
+    tx_mutex_put(&sensors_agg_mutex);
+
+    // Sound levels and events since the previous call; this call closes
+    // the window and starts the next one
+
+    if (mic_ready)
+    {
+        tx_mutex_get(&mic_level_mutex, TX_WAIT_FOREVER);
+        sound_level_read(&mic_level, &sens->sound, sensors_now_ms());
+        tx_mutex_put(&mic_level_mutex);
+    }
+    else
+    {
+        memset(&sens->sound, 0, sizeof(sens->sound));
+    }
+
+    // GPS only copies the parser thread's cache; timed for the report and
+    // skipped once a demo stop is pending
+
+    sensor_timing_sampling(true);
+    if (sensor_timing_begin(SENSOR_ID_GPS, NULL))
+    {
+        read_gps_coordinates(sens);
+        if (sensor_timing_end(SENSOR_ID_GPS, NULL))
+            sens->stale_mask &= ~SENSOR_STALE(SENSOR_ID_GPS);
+    }
+    sensor_timing_sampling(false);
+
+    return;
+
+    /* END ADDED */
+
+#if 0
+
+    /* ORIGINAL CODE */
+
     bmi160_data accel_data;
     bmi160_data gyro_data;
     uint8_t mag_data[8];
@@ -588,5 +2100,6 @@ void read_sensor(sensors_data_t *sens)
 
     //Read GPS data
     read_gps_coordinates(sens);
-}
 
+#endif
+}
@@ -0,0 +1,256 @@
+/*
+ * sound_level.c
+ *
+ *  A-weighted sound level meter. See sound_level.h.
+ */
+
+#include <math.h>
+#include <string.h>
+#include "sound_level.h"
+
+#if defined(__ARM_FEATURE_DSP) && (__ARM_FEATURE_DSP == 1) && !defined(SOUND_LEVEL_SCALAR)
+
+#include "bsp_api.h"    /* CMSIS intrinsics */
+
+/* acc + p[0]^2 + p[1]^2, two int16 in one SMLALD */
+static inline uint64_t sound_level_sumsq2(uint64_t acc, int16_t const *p)
+{
+    uint32_t pair;
+
+    memcpy(&pair, p, sizeof(pair));
+    return (uint64_t) __SMLALD(pair, pair, acc);
+}
+
+#else
+
+static inline uint64_t sound_level_sumsq2(uint64_t acc, int16_t const *p)
+{
+    return acc + (uint64_t) (((int32_t) p[0] * p[0]) + ((int32_t) p[1] * p[1]));
+}
+
+#endif
+
+#define SOUND_LEVEL_GUARD_BITS      (14)        /* Filter data below the int16 LSB */
+#define SOUND_LEVEL_COEF_BITS       (30)
+#define SOUND_LEVEL_BLOCK_MS        ((SOUND_LEVEL_BLOCK_LEN * 1000U) / SOUND_LEVEL_RATE_HZ)
+#define SOUND_LEVEL_SETTLE_BLOCKS   (16U)       /* Filter start-up, no levels or events */
+#define SOUND_LEVEL_FAST_SHIFT      (3)         /* 16 ms / 125 ms */
+#define SOUND_LEVEL_SLOW_SHIFT      (6)         /* 16 ms / 1 s */
+#define SOUND_LEVEL_FULL_SCALE      (32767.0f * 32767.0f * 0.5f)    /* Mean square of a full-scale sine */
+
+/*
+ * A-weighting at 16 kHz, b0, b1, b2, -a1, -a2 in Q30. The two high-pass
+ * sections are the bilinear transform of the 20.6 Hz and 107.7/737.9 Hz
+ * poles; the low-pass section is fitted to the 12.2 kHz poles below
+ * Nyquist and carries the 0 dB gain at 1 kHz. Within 0.25 dB of IEC 61672
+ * from 10 Hz to 7.5 kHz.
+ */
+static const int32_t sound_level_coef[SOUND_LEVEL_SECTIONS][5] =
+{
+    { 1073741824, INT32_MIN, 1073741824, 2130182185, -1056510057 },
+    { 1073741824, INT32_MIN, 1073741824, 1831277025,  -768785805 },
+    { 1004966149, 643178335,  102908534, -515396076,   -61847529 }
+};
+
+/* One section over the block in place, direct form I */
+static void sound_level_biquad(int32_t const *p_coef, int32_t *p_state, int32_t *p_data)
+{
+    int32_t x1 = p_state[0];
+    int32_t x2 = p_state[1];
+    int32_t y1 = p_state[2];
+    int32_t y2 = p_state[3];
+    int32_t x0;
+    int64_t acc;
+    uint32_t n;
+
+    for (n = 0; n < SOUND_LEVEL_BLOCK_LEN; n++)
+    {
+        x0 = p_data[n];
+        acc = (int64_t) 1 << (SOUND_LEVEL_COEF_BITS - 1);
+        acc += (int64_t) p_coef[0] * x0;
+        acc += (int64_t) p_coef[1] * x1;
+        acc += (int64_t) p_coef[2] * x2;
+        acc += (int64_t) p_coef[3] * y1;
+        acc += (int64_t) p_coef[4] * y2;
+
+        x2 = x1;
+        x1 = x0;
+        y2 = y1;
+        y1 = (int32_t) (acc >> SOUND_LEVEL_COEF_BITS);
+        p_data[n] = y1;
+    }
+
+    p_state[0] = x1;
+    p_state[1] = x2;
+    p_state[2] = y1;
+    p_state[3] = y2;
+}
+
+/* Level in 0.1 dB of a mean square given relative to a full-scale sine */
+static int16_t sound_level_db(sound_level_t const *p_level, float ratio)
+{
+    float db = (100.0f * log10f((ratio > 1e-12f) ? ratio : 1e-12f)) + (float) p_level->cfg.full_scale_db_x10;
+
+    if (db >= (float) INT16_MAX)
+        return INT16_MAX;
+    if (db <= (float) INT16_MIN)
+        return INT16_MIN;
+    return (int16_t) lrintf(db);
+}
+
+/* A mean square relative to a full-scale sine, from a level in 0.1 dB */
+static float sound_level_ratio(sound_level_t const *p_level, int32_t db_x10)
+{
+    return powf(10.0f, (float) (db_x10 - p_level->cfg.full_scale_db_x10) / 100.0f);
+}
+
+static void sound_level_event(sound_level_t *p_level, sound_event_type_t type, int16_t level_db_x10,
+                              uint32_t start_ms, uint32_t duration_ms)
+{
+    sound_event_t *p_event;
+
+    if (p_level->event_count >= SOUND_LEVEL_EVENT_LEN)
+    {
+        p_level->events_lost++;
+        return;
+    }
+
+    p_event = &p_level->events[p_level->event_count++];
+    p_event->type = (uint8_t) type;
+    p_event->level_db_x10 = level_db_x10;
+    p_event->start_ms = start_ms;
+    p_event->duration_ms = duration_ms;
+}
+
+void sound_level_init(sound_level_t *p_level, sound_level_config_t const *p_cfg, uint32_t now_ms)
+{
+    memset(p_level, 0, sizeof(*p_level));
+    p_level->cfg = *p_cfg;
+
+    /* Event levels as mean squares, so blocks are compared without a logarithm */
+    p_level->threshold_on = (uint64_t) (sound_level_ratio(p_level, p_cfg->threshold_db_x10)
+                                        * SOUND_LEVEL_FULL_SCALE * 65536.0f);
+    p_level->threshold_off = (uint64_t) (sound_level_ratio(p_level, p_cfg->threshold_db_x10 - p_cfg->hysteresis_db_x10)
+                                         * SOUND_LEVEL_FULL_SCALE * 65536.0f);
+    p_level->impulse_min = (uint64_t) (sound_level_ratio(p_level, p_cfg->impulse_min_db_x10) * SOUND_LEVEL_FULL_SCALE);
+    p_level->impulse_ratio_q8 = (uint32_t) (powf(10.0f, (float) p_cfg->impulse_db_x10 / 100.0f) * 256.0f);
+    p_level->window_start_ms = now_ms;
+}
+
+/* One block of SOUND_LEVEL_BLOCK_LEN samples, now_ms the time of its end */
+void sound_level_process(sound_level_t *p_level, int16_t const *p_block, uint32_t now_ms)
+{
+    uint64_t energy = 0;
+    uint64_t ms;
+    uint64_t peak_sq;
+    uint32_t peak = 0;
+    uint32_t mag;
+    int32_t y;
+    uint32_t n;
+    uint8_t s;
+
+    for (n = 0; n < SOUND_LEVEL_BLOCK_LEN; n++)
+        p_level->work[n] = (int32_t) p_block[n] * (1L << SOUND_LEVEL_GUARD_BITS);
+
+    for (s = 0; s < SOUND_LEVEL_SECTIONS; s++)
+        sound_level_biquad(sound_level_coef[s], p_level->state[s], p_level->work);
+
+    for (n = 0; n < SOUND_LEVEL_BLOCK_LEN; n++)
+    {
+        y = (p_level->work[n] + (1L << (SOUND_LEVEL_GUARD_BITS - 1))) >> SOUND_LEVEL_GUARD_BITS;
+        if ((y > INT16_MAX) || (y < -INT16_MAX))
+        {
+            y = (y > 0) ? INT16_MAX : -INT16_MAX;
+            p_level->clipped++;
+        }
+        p_level->weighted[n] = (int16_t) y;
+
+        mag = (uint32_t) ((y < 0) ? -y : y);
+        if (mag > peak)
+            peak = mag;
+    }
+
+    for (n = 0; n < SOUND_LEVEL_BLOCK_LEN; n += 2U)
+        energy = sound_level_sumsq2(energy, &p_level->weighted[n]);
+
+    p_level->blocks++;
+    ms = (energy << 16) / SOUND_LEVEL_BLOCK_LEN;
+    peak_sq = (uint64_t) peak * peak;
+
+    if (p_level->blocks <= SOUND_LEVEL_SETTLE_BLOCKS)
+    {
+        /* Prime the time weightings, nothing is measured yet */
+        p_level->fast = ms;
+        p_level->slow = ms;
+        p_level->window_start_ms = now_ms;
+        return;
+    }
+
+    /* Impulse: against the background before this block */
+    if ((p_level->cfg.impulse_db_x10 > 0) && (peak_sq >= p_level->impulse_min)
+        && ((peak_sq << 16) >= ((p_level->slow >> 8) * p_level->impulse_ratio_q8))
+        && ((p_level->impulse_ms == 0) || ((now_ms - p_level->impulse_ms) >= p_level->cfg.impulse_holdoff_ms)))
+    {
+        sound_level_event(p_level, SOUND_EVENT_IMPULSE, sound_level_db(p_level, (float) peak_sq / SOUND_LEVEL_FULL_SCALE),
+                          now_ms - SOUND_LEVEL_BLOCK_MS, 0);
+        p_level->impulse_ms = (now_ms != 0) ? now_ms : 1U;
+    }
+
+    /* Exponential time weightings, one step per block */
+    p_level->fast = p_level->fast - (p_level->fast >> SOUND_LEVEL_FAST_SHIFT) + (ms >> SOUND_LEVEL_FAST_SHIFT);
+    p_level->slow = p_level->slow - (p_level->slow >> SOUND_LEVEL_SLOW_SHIFT) + (ms >> SOUND_LEVEL_SLOW_SHIFT);
+
+    /* Threshold: reported once LAF is back below it by the hysteresis */
+    if (!p_level->active)
+    {
+        if (p_level->fast >= p_level->threshold_on)
+        {
+            p_level->active = true;
+            p_level->active_start_ms = now_ms;
+            p_level->active_max = p_level->fast;
+        }
+    }
+    else
+    {
+        if (p_level->fast > p_level->active_max)
+            p_level->active_max = p_level->fast;
+
+        if (p_level->fast < p_level->threshold_off)
+        {
+            p_level->active = false;
+            sound_level_event(p_level, SOUND_EVENT_THRESHOLD,
+                              sound_level_db(p_level, (float) p_level->active_max / (SOUND_LEVEL_FULL_SCALE * 65536.0f)),
+                              p_level->active_start_ms, now_ms - p_level->active_start_ms);
+        }
+    }
+
+    p_level->sum += energy;
+    p_level->samples += SOUND_LEVEL_BLOCK_LEN;
+    if (p_level->fast > p_level->fast_max)
+        p_level->fast_max = p_level->fast;
+    if (peak > p_level->peak)
+        p_level->peak = peak;
+}
+
+/* Levels and events since the previous read; starts the next window */
+void sound_level_read(sound_level_t *p_level, sound_level_result_t *p_result, uint32_t now_ms)
+{
+    float leq = (p_level->samples > 0) ? ((float) p_level->sum / (float) p_level->samples) : 0.0f;
+
+    p_result->leq_db_x10 = sound_level_db(p_level, leq / SOUND_LEVEL_FULL_SCALE);
+    p_result->max_db_x10 = sound_level_db(p_level, (float) p_level->fast_max / (SOUND_LEVEL_FULL_SCALE * 65536.0f));
+    p_result->peak_db_x10 = sound_level_db(p_level, ((float) p_level->peak * (float) p_level->peak)
+                                                    / SOUND_LEVEL_FULL_SCALE);
+    p_result->window_ms = now_ms - p_level->window_start_ms;
+    p_result->event_active = p_level->active;
+    p_result->event_count = p_level->event_count;
+    memcpy(p_result->events, p_level->events, sizeof(p_result->events));
+    p_result->events_lost = p_level->events_lost;
+
+    p_level->window_start_ms = now_ms;
+    p_level->sum = 0;
+    p_level->samples = 0;
+    p_level->fast_max = 0;
+    p_level->peak = 0;
+    p_level->event_count = 0;
+}
@@ -0,0 +1,106 @@
+/*
+ * sound_level.h
+ *
+ *  A-weighted sound level meter and acoustic event detector, fed one block
+ *  of microphone samples at a time.
+ *
+ *  Each block goes through the A-weighting filter, three biquads in direct
+ *  form I with Q30 coefficients and 64-bit accumulators (one SMLAL per tap
+ *  on the Cortex-M4). The weighted block is kept as int16, and its energy
+ *  comes from dual 16-bit multiply-accumulates (SMLALD) with the DSP
+ *  extension; the portable path gives bit-identical results, define
+ *  SOUND_LEVEL_SCALAR to force it. Levels follow IEC 61672: LAeq over the
+ *  publish window, LAFmax (fast, 125 ms) and LApeak.
+ *
+ *  Two kinds of event are detected per block without any logarithm:
+ *  threshold, while LAF stays above a level (reported when it drops back
+ *  below by the hysteresis), and impulse, a block peak well above the LAS
+ *  (slow, 1 s) background. Times come from the caller, so the meter runs
+ *  unchanged on the host against recorded audio.
+ */
+
+#ifndef SOUND_LEVEL_H_
+#define SOUND_LEVEL_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SOUND_LEVEL_RATE_HZ     (16000U)    /* The A-weighting coefficients are for this rate */
+#define SOUND_LEVEL_BLOCK_LEN   (256U)      /* 16 ms */
+#define SOUND_LEVEL_SECTIONS    (3U)
+#define SOUND_LEVEL_EVENT_LEN   (8U)
+
+typedef enum e_sound_event_type
+{
+    SOUND_EVENT_THRESHOLD = 0,
+    SOUND_EVENT_IMPULSE
+} sound_event_type_t;
+
+typedef struct st_sound_event
+{
+    uint8_t  type;              /* sound_event_type_t */
+    int16_t  level_db_x10;      /* Threshold: LAFmax during the event; impulse: LApeak */
+    uint32_t start_ms;
+    uint32_t duration_ms;       /* 0 for impulses */
+} sound_event_t;
+
+typedef struct st_sound_level_config
+{
+    int16_t  full_scale_db_x10;     /* dB SPL of a full-scale sine: microphone and front end */
+    int16_t  threshold_db_x10;      /* LAF that starts a threshold event */
+    uint16_t hysteresis_db_x10;     /* Drop below the threshold that ends it */
+    uint16_t impulse_db_x10;        /* Block LApeak over LAS for an impulse, 0 disables */
+    int16_t  impulse_min_db_x10;    /* And the least LApeak for one */
+    uint16_t impulse_holdoff_ms;    /* Quiet time after an impulse */
+} sound_level_config_t;
+
+typedef struct st_sound_level_result
+{
+    int16_t  leq_db_x10;        /* LAeq over the window */
+    int16_t  max_db_x10;        /* LAFmax */
+    int16_t  peak_db_x10;       /* LApeak */
+    uint32_t window_ms;
+    bool     event_active;      /* A threshold event is still running */
+    uint8_t  event_count;       /* Events that ended in the window */
+    sound_event_t events[SOUND_LEVEL_EVENT_LEN];
+    uint32_t events_lost;       /* Dropped on a full queue since init */
+} sound_level_result_t;
+
+typedef struct st_sound_level
+{
+    sound_level_config_t cfg;
+    int32_t  state[SOUND_LEVEL_SECTIONS][4];    /* x[n-1], x[n-2], y[n-1], y[n-2] */
+    int32_t  work[SOUND_LEVEL_BLOCK_LEN];       /* Filter data, int16 scaled by 2^14 */
+    int16_t  weighted[SOUND_LEVEL_BLOCK_LEN];
+    uint32_t blocks;
+    uint32_t clipped;           /* Weighted samples saturated to int16 */
+
+    /* Mean squares of the weighted samples, Q16 */
+    uint64_t fast;              /* LAF */
+    uint64_t slow;              /* LAS, the impulse background */
+    uint64_t threshold_on;
+    uint64_t threshold_off;
+    uint64_t impulse_min;       /* Peak squared, not Q16 */
+    uint32_t impulse_ratio_q8;  /* Peak squared over LAS */
+    uint32_t impulse_ms;        /* Time of the last impulse */
+
+    /* Publish window */
+    uint32_t window_start_ms;
+    uint64_t sum;               /* Sum of squares */
+    uint32_t samples;
+    uint64_t fast_max;
+    uint32_t peak;
+
+    bool     active;            /* Threshold event running */
+    uint32_t active_start_ms;
+    uint64_t active_max;
+    uint8_t  event_count;
+    sound_event_t events[SOUND_LEVEL_EVENT_LEN];
+    uint32_t events_lost;
+} sound_level_t;
+
+void sound_level_init(sound_level_t *p_level, sound_level_config_t const *p_cfg, uint32_t now_ms);
+void sound_level_process(sound_level_t *p_level, int16_t const *p_block, uint32_t now_ms);
+void sound_level_read(sound_level_t *p_level, sound_level_result_t *p_result, uint32_t now_ms);
+
+#endif /* SOUND_LEVEL_H_ */
@@ -0,0 +1,442 @@
+/*
+ * sound_level_test.c
+ *
+ *  Host checks of the sound level meter with the mic_level_cfg settings,
+ *  on audio generated at SOUND_LEVEL_RATE_HZ:
+ *   - -20 dBFS tones at the octave centres from 31.5 Hz to 6.3 kHz read
+ *     100 dB plus the IEC 61672 A-weighting within 0.2 dB;
+ *   - 1 kHz at -20 dBFS reads LAeq 100.0 dB and LApeak 103.0 dB;
+ *   - silence reads 0 dB with no events;
+ *   - a noise floor with a 2 s tone and three clicks gives the threshold
+ *     events and the impulses, the second click inside the holdoff;
+ *   - a full event queue counts what it drops;
+ *   - the DSP path, built with host_dsp/bsp_api.h, is bit-identical to the
+ *     portable path, full-scale blocks included.
+ *  Ends with the cost of a block on both paths.
+ *
+ *  16 kHz mono 16-bit WAV files named on the command line, e.g. recorded
+ *  on the board, are replayed afterwards and their levels and events
+ *  printed.
+ *
+ *  Built by host_test.mk with SENSORS_BUS_SIM; empty in the firmware build.
+ */
+
+#if defined(SENSORS_BUS_SIM)
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "host_test.h"
+#include "sound_level.h"
+
+#define TEST_BLOCK_MS           ((SOUND_LEVEL_BLOCK_LEN * 1000U) / SOUND_LEVEL_RATE_HZ)
+#define TEST_FULL_SCALE         (32767.0)
+#define TEST_DSP_BLOCKS         (100000U)
+#define TEST_BENCH_BLOCKS       (200000U)
+#define TEST_WAV_HEADER_LEN     (12U)
+#define TEST_WAV_CHUNK_LEN      (8U)
+
+/* The same meter built with -D__ARM_FEATURE_DSP=1 and these names */
+void sound_level_dsp_init(sound_level_t *p_level, sound_level_config_t const *p_cfg, uint32_t now_ms);
+void sound_level_dsp_process(sound_level_t *p_level, int16_t const *p_block, uint32_t now_ms);
+void sound_level_dsp_read(sound_level_t *p_level, sound_level_result_t *p_result, uint32_t now_ms);
+
+/* mic_level_cfg */
+static sound_level_config_t const test_cfg =
+{
+    .full_scale_db_x10 = 1200,
+    .threshold_db_x10 = 850,
+    .hysteresis_db_x10 = 30,
+    .impulse_db_x10 = 200,
+    .impulse_min_db_x10 = 700,
+    .impulse_holdoff_ms = 250
+};
+
+static sound_level_t test_level;
+static sound_level_t test_dsp;
+
+typedef struct st_test_audio
+{
+    int16_t *p_samples;
+    uint32_t count;
+} test_audio_t;
+
+/* Standard normal, Box-Muller */
+static double test_gauss(void)
+{
+    double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+    double v = (rand() + 1.0) / (RAND_MAX + 2.0);
+
+    return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+static int16_t test_clip(double value)
+{
+    return (int16_t)lround(fmax(fmin(value, INT16_MAX), INT16_MIN));
+}
+
+static bool test_alloc(test_audio_t *p_audio, double seconds)
+{
+    p_audio->count = (uint32_t)(seconds * SOUND_LEVEL_RATE_HZ);
+    p_audio->p_samples = calloc(p_audio->count, sizeof(int16_t));
+    HOST_TEST_CHECK(p_audio->p_samples != NULL);
+
+    return (p_audio->p_samples != NULL);
+}
+
+/* Adds a sine of dbfs (of a full-scale sine) from from_s for seconds */
+static void test_add_tone(test_audio_t *p_audio, double freq_hz, double dbfs, double from_s, double seconds)
+{
+    double const amplitude = TEST_FULL_SCALE * pow(10.0, dbfs / 20.0);
+    uint32_t const first = (uint32_t)(from_s * SOUND_LEVEL_RATE_HZ);
+    uint32_t n;
+
+    for (n = 0; (n < (uint32_t)(seconds * SOUND_LEVEL_RATE_HZ)) && ((first + n) < p_audio->count); n++)
+    {
+        p_audio->p_samples[first + n] = test_clip(p_audio->p_samples[first + n]
+                                                  + (amplitude * sin((2.0 * M_PI * freq_hz * n) / SOUND_LEVEL_RATE_HZ)));
+    }
+}
+
+/* A decaying 2 kHz click of half full scale, 8 ms long */
+static void test_add_click(test_audio_t *p_audio, double at_s)
+{
+    uint32_t const first = (uint32_t)(at_s * SOUND_LEVEL_RATE_HZ);
+    uint32_t n;
+
+    for (n = 0; (n < 128U) && ((first + n) < p_audio->count); n++)
+    {
+        p_audio->p_samples[first + n] = test_clip(p_audio->p_samples[first + n]
+                                                  + (0.5 * TEST_FULL_SCALE * exp(-(double)n / 16.0)
+                                                     * sin((2.0 * M_PI * 2000.0 * n) / SOUND_LEVEL_RATE_HZ)));
+    }
+}
+
+/* Every whole block, then one read covering them all */
+static void test_run(test_audio_t const *p_audio, sound_level_result_t *p_result)
+{
+    uint32_t now_ms = 0;
+    uint32_t n;
+
+    sound_level_init(&test_level, &test_cfg, 0U);
+    for (n = 0; (n + SOUND_LEVEL_BLOCK_LEN) <= p_audio->count; n += SOUND_LEVEL_BLOCK_LEN)
+    {
+        now_ms += TEST_BLOCK_MS;
+        sound_level_process(&test_level, &p_audio->p_samples[n], now_ms);
+    }
+    sound_level_read(&test_level, p_result, now_ms);
+}
+
+static void test_print(char const *p_name, sound_level_result_t const *p_result)
+{
+    uint32_t i;
+
+    printf("%-18s LAeq %5.1f, LAFmax %5.1f, LApeak %5.1f dB over %lu ms, %u events\r\n", p_name,
+           p_result->leq_db_x10 / 10.0, p_result->max_db_x10 / 10.0, p_result->peak_db_x10 / 10.0,
+           (unsigned long)p_result->window_ms, p_result->event_count);
+    for (i = 0; i < p_result->event_count; i++)
+    {
+        printf("    %-9s at %5lu ms for %4lu ms, %.1f dB\r\n",
+               (p_result->events[i].type == SOUND_EVENT_IMPULSE) ? "impulse" : "threshold",
+               (unsigned long)p_result->events[i].start_ms, (unsigned long)p_result->events[i].duration_ms,
+               p_result->events[i].level_db_x10 / 10.0);
+    }
+}
+
+/* IEC 61672-1 A-weighting at the octave centres, dB */
+static void test_weighting(void)
+{
+    static struct
+    {
+        double freq_hz;
+        double weight_db;
+    } const octaves[] =
+    {
+        { 31.5, -39.4 }, { 63.0, -26.2 }, { 125.0, -16.1 }, { 250.0, -8.6 }, { 500.0, -3.2 },
+        { 1000.0, 0.0 }, { 2000.0, 1.2 }, { 4000.0, 1.0 }, { 6300.0, -0.1 },
+    };
+    sound_level_result_t result;
+    test_audio_t audio;
+    char name[24];
+    double error;
+    double worst = 0.0;
+    uint32_t i;
+
+    for (i = 0; i < (sizeof(octaves) / sizeof(octaves[0])); i++)
+    {
+        if (!test_alloc(&audio, 3.0))
+            return;
+        test_add_tone(&audio, octaves[i].freq_hz, -20.0, 0.0, 3.0);
+        test_run(&audio, &result);
+        free(audio.p_samples);
+
+        snprintf(name, sizeof(name), "%.1f Hz -20 dBFS", octaves[i].freq_hz);
+        test_print(name, &result);
+        error = fabs((result.leq_db_x10 / 10.0) - (100.0 + octaves[i].weight_db));
+        worst = fmax(worst, error);
+        HOST_TEST_CHECK(error < 0.25);
+
+        if (octaves[i].freq_hz == 1000.0)
+        {
+            HOST_TEST_CHECK(result.leq_db_x10 == 1000);
+            HOST_TEST_CHECK(result.max_db_x10 == 1000);
+            HOST_TEST_CHECK(result.peak_db_x10 == 1030);
+        }
+    }
+    printf("A-weighting: LAeq within %.1f dB of IEC 61672\r\n", worst);
+}
+
+static void test_silence(void)
+{
+    sound_level_result_t result;
+    test_audio_t audio;
+
+    if (!test_alloc(&audio, 2.0))
+        return;
+    test_run(&audio, &result);
+    free(audio.p_samples);
+
+    test_print("silence", &result);
+    HOST_TEST_CHECK((result.leq_db_x10 == 0) && (result.max_db_x10 == 0) && (result.peak_db_x10 == 0));
+    HOST_TEST_CHECK((result.event_count == 0U) && !result.event_active);
+}
+
+/*
+ * -50 dBFS noise (70 dB), a 500 Hz tone at -15 dBFS from 3 to 5 s and
+ * clicks at 7.0, 7.1 and 9.0 s. The tone's onset is an impulse over the
+ * noise and starts a threshold event; each counted click leaves the fast
+ * level above the threshold for a few hundred ms; the 7.1 s click is inside
+ * the holdoff of the one before.
+ */
+static void test_events(void)
+{
+    static struct
+    {
+        sound_event_type_t type;
+        uint32_t           start_ms;
+        uint32_t           min_ms;
+        uint32_t           max_ms;
+    } const expected[] =
+    {
+        { SOUND_EVENT_IMPULSE, 3000U, 0U, 0U }, { SOUND_EVENT_THRESHOLD, 3000U, 2000U, 3000U },
+        { SOUND_EVENT_IMPULSE, 7000U, 0U, 0U }, { SOUND_EVENT_THRESHOLD, 7000U, 100U, 1000U },
+        { SOUND_EVENT_IMPULSE, 9000U, 0U, 0U }, { SOUND_EVENT_THRESHOLD, 9000U, 100U, 1000U },
+    };
+    sound_level_result_t result;
+    test_audio_t audio;
+    sound_event_t const *p_event;
+    uint32_t n;
+    uint32_t i;
+
+    if (!test_alloc(&audio, 12.0))
+        return;
+    for (n = 0; n < audio.count; n++)
+        audio.p_samples[n] = test_clip(TEST_FULL_SCALE * pow(10.0, -50.0 / 20.0) * test_gauss());
+    test_add_tone(&audio, 500.0, -15.0, 3.0, 2.0);
+    test_add_click(&audio, 7.0);
+    test_add_click(&audio, 7.1);
+    test_add_click(&audio, 9.0);
+    test_run(&audio, &result);
+    free(audio.p_samples);
+
+    test_print("events", &result);
+    HOST_TEST_CHECK(result.event_count == (sizeof(expected) / sizeof(expected[0])));
+    HOST_TEST_CHECK(!result.event_active && (result.events_lost == 0U));
+    for (i = 0; (i < result.event_count) && (i < (sizeof(expected) / sizeof(expected[0]))); i++)
+    {
+        p_event = &result.events[i];
+        HOST_TEST_CHECK(p_event->type == expected[i].type);
+        HOST_TEST_CHECK(abs((int32_t)p_event->start_ms - (int32_t)expected[i].start_ms) <= (int32_t)TEST_BLOCK_MS);
+        HOST_TEST_CHECK((p_event->duration_ms >= expected[i].min_ms) && (p_event->duration_ms <= expected[i].max_ms));
+        HOST_TEST_CHECK(p_event->level_db_x10 >= test_cfg.threshold_db_x10);
+    }
+}
+
+/* Twenty clicks a second apart and no read in between */
+static void test_queue_full(void)
+{
+    sound_level_result_t result;
+    test_audio_t audio;
+    uint32_t i;
+
+    if (!test_alloc(&audio, 21.0))
+        return;
+    for (i = 1; i <= 20U; i++)
+        test_add_click(&audio, i);
+    test_run(&audio, &result);
+    free(audio.p_samples);
+
+    printf("20 clicks unread: %u events kept, %lu lost\r\n", result.event_count,
+           (unsigned long)result.events_lost);
+    HOST_TEST_CHECK(result.event_count == SOUND_LEVEL_EVENT_LEN);
+    HOST_TEST_CHECK(result.events_lost == (40U - SOUND_LEVEL_EVENT_LEN));
+}
+
+/* Random blocks from silent to full scale through both builds, read now and then */
+static void test_dsp_identical(void)
+{
+    sound_level_result_t portable;
+    sound_level_result_t dsp;
+    int16_t block[SOUND_LEVEL_BLOCK_LEN];
+    uint32_t mismatches = 0;
+    uint32_t now_ms = 0;
+    uint32_t k;
+    uint32_t n;
+
+    /* sound_level_result_t has padding; clear it so memcmp() sees only the members */
+    memset(&portable, 0, sizeof(portable));
+    memset(&dsp, 0, sizeof(dsp));
+    sound_level_init(&test_level, &test_cfg, 0U);
+    sound_level_dsp_init(&test_dsp, &test_cfg, 0U);
+    for (k = 0; k < TEST_DSP_BLOCKS; k++)
+    {
+        for (n = 0; n < SOUND_LEVEL_BLOCK_LEN; n++)
+        {
+            if ((k % 7U) == 0U)
+                block[n] = (rand() & 1) ? INT16_MAX : INT16_MIN;
+            else
+                block[n] = (int16_t)((rand() & 0xFFFF) >> (k & 15U));
+        }
+        now_ms += TEST_BLOCK_MS;
+        sound_level_process(&test_level, block, now_ms);
+        sound_level_dsp_process(&test_dsp, block, now_ms);
+        if (memcmp(&test_level, &test_dsp, sizeof(test_level)) != 0)
+        {
+            mismatches++;
+            memcpy(&test_dsp, &test_level, sizeof(test_dsp));
+        }
+
+        if ((k % 64U) == 63U)
+        {
+            sound_level_read(&test_level, &portable, now_ms);
+            sound_level_dsp_read(&test_dsp, &dsp, now_ms);
+            if (memcmp(&portable, &dsp, sizeof(portable)) != 0)
+                mismatches++;
+        }
+    }
+    printf("DSP path: %lu mismatches with the portable path over %lu blocks, %lu samples clipped\r\n",
+           (unsigned long)mismatches, (unsigned long)TEST_DSP_BLOCKS, (unsigned long)test_level.clipped);
+    HOST_TEST_CHECK(mismatches == 0U);
+}
+
+/* Host cycles; the emulated intrinsics say nothing of the target's cost */
+static void test_benchmark(void)
+{
+    int16_t block[SOUND_LEVEL_BLOCK_LEN];
+    uint64_t start;
+    uint64_t portable_cycles;
+    uint64_t dsp_cycles;
+    uint32_t k;
+
+    for (k = 0; k < SOUND_LEVEL_BLOCK_LEN; k++)
+        block[k] = test_clip(3000.0 * test_gauss());
+    sound_level_init(&test_level, &test_cfg, 0U);
+    sound_level_dsp_init(&test_dsp, &test_cfg, 0U);
+
+    start = host_test_cycles();
+    for (k = 0; k < TEST_BENCH_BLOCKS; k++)
+        sound_level_process(&test_level, block, k * TEST_BLOCK_MS);
+    portable_cycles = host_test_cycles() - start;
+
+    start = host_test_cycles();
+    for (k = 0; k < TEST_BENCH_BLOCKS; k++)
+        sound_level_dsp_process(&test_dsp, block, k * TEST_BLOCK_MS);
+    dsp_cycles = host_test_cycles() - start;
+
+    printf("%.0f cycles/block portable, %.0f with the emulated DSP intrinsics\r\n",
+           (double)portable_cycles / TEST_BENCH_BLOCKS, (double)dsp_cycles / TEST_BENCH_BLOCKS);
+}
+
+static uint32_t test_le(uint8_t const *p, uint32_t len)
+{
+    uint32_t value = 0;
+
+    while (len-- > 0U)
+        value = (value << 8) | p[len];
+
+    return value;
+}
+
+/* The data chunk of a 16 kHz mono 16-bit PCM WAV file, little-endian host */
+static bool test_wav_load(char const *p_path, test_audio_t *p_audio)
+{
+    FILE *p_file = fopen(p_path, "rb");
+    uint8_t header[TEST_WAV_CHUNK_LEN + 16U];
+    uint32_t len;
+    bool format = false;
+
+    p_audio->p_samples = NULL;
+    if (p_file == NULL)
+        return false;
+
+    if ((fread(header, 1U, TEST_WAV_HEADER_LEN, p_file) != TEST_WAV_HEADER_LEN)
+        || (memcmp(header, "RIFF", 4U) != 0) || (memcmp(&header[8], "WAVE", 4U) != 0))
+    {
+        fclose(p_file);
+        return false;
+    }
+
+    while (fread(header, 1U, TEST_WAV_CHUNK_LEN, p_file) == TEST_WAV_CHUNK_LEN)
+    {
+        len = test_le(&header[4], 4U);
+        if ((memcmp(header, "fmt ", 4U) == 0) && (len >= 16U))
+        {
+            if (fread(&header[TEST_WAV_CHUNK_LEN], 1U, 16U, p_file) != 16U)
+                break;
+            format = (test_le(&header[TEST_WAV_CHUNK_LEN], 2U) == 1U)
+                     && (test_le(&header[TEST_WAV_CHUNK_LEN + 2U], 2U) == 1U)
+                     && (test_le(&header[TEST_WAV_CHUNK_LEN + 4U], 4U) == SOUND_LEVEL_RATE_HZ)
+                     && (test_le(&header[TEST_WAV_CHUNK_LEN + 14U], 2U) == 16U);
+            len -= 16U;
+        }
+        else if ((memcmp(header, "data", 4U) == 0) && format)
+        {
+            p_audio->count = len / sizeof(int16_t);
+            p_audio->p_samples = malloc(len);
+            if ((p_audio->p_samples != NULL)
+                && (fread(p_audio->p_samples, sizeof(int16_t), p_audio->count, p_file) != p_audio->count))
+            {
+                free(p_audio->p_samples);
+                p_audio->p_samples = NULL;
+            }
+            break;
+        }
+
+        if (fseek(p_file, (long)(len + (len & 1U)), SEEK_CUR) != 0)
+            break;
+    }
+    fclose(p_file);
+
+    return (p_audio->p_samples != NULL);
+}
+
+int main(int argc, char **argv)
+{
+    sound_level_result_t result;
+    test_audio_t audio;
+    int i;
+
+    srand(24);
+    test_weighting();
+    test_silence();
+    test_events();
+    test_queue_full();
+    test_dsp_identical();
+    test_benchmark();
+
+    for (i = 1; i < argc; i++)
+    {
+        if (!test_wav_load(argv[i], &audio))
+        {
+            printf("%s: not a 16 kHz mono 16-bit PCM WAV file\r\n", argv[i]);
+            continue;
+        }
+        test_run(&audio, &result);
+        free(audio.p_samples);
+        test_print(argv[i], &result);
+    }
+
+    return host_test_finish("sound_level");
+}
+
+#endif /* SENSORS_BUS_SIM */
@@ -0,0 +1,179 @@
+/*
+ * trajectory.c
+ *
+ *  On-device trajectory compression for GNSS fixes. See trajectory.h.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trajectory.h"
+
+#define TRAJ_M_PER_E7_LAT   (0.0111319491f)     /* Metres per 1e-7 degree of latitude */
+#define TRAJ_E7_TO_RAD      (1.745329252e-9f)
+
+static void traj_set_anchor(trajectory_t *p_traj, traj_point_t const *p_point)
+{
+    p_traj->anchor = *p_point;
+    p_traj->m_per_e7_lon = TRAJ_M_PER_E7_LAT * cosf((float)p_point->latitude_e7 * TRAJ_E7_TO_RAD);
+    p_traj->window_count = 0;
+    p_traj->window_error_m = 0.0f;
+}
+
+/* Local east/north metres of a point relative to another */
+static void traj_offset(trajectory_t const *p_traj, traj_point_t const *p_from, traj_point_t const *p_to,
+                        float *p_x, float *p_y)
+{
+    *p_x = (float)((int64_t)p_to->longitude_e7 - p_from->longitude_e7) * p_traj->m_per_e7_lon;
+    *p_y = (float)((int64_t)p_to->latitude_e7 - p_from->latitude_e7) * TRAJ_M_PER_E7_LAT;
+}
+
+/* Distance of (wx, wy) from the segment (0, 0)-(px, py) */
+static float traj_segment_distance(float wx, float wy, float px, float py)
+{
+    float len2 = (px * px) + (py * py);
+    float t = 0.0f;
+    float dx;
+    float dy;
+
+    if (len2 > 0.0f)
+    {
+        t = ((wx * px) + (wy * py)) / len2;
+        if (t < 0.0f)
+            t = 0.0f;
+        else if (t > 1.0f)
+            t = 1.0f;
+    }
+
+    dx = wx - (t * px);
+    dy = wy - (t * py);
+
+    return sqrtf((dx * dx) + (dy * dy));
+}
+
+static void traj_emit(trajectory_t *p_traj, traj_point_t const *p_point)
+{
+    uint8_t slot = (uint8_t)((p_traj->out_head + p_traj->out_count) % TRAJECTORY_OUT_LEN);
+
+    p_traj->out[slot] = *p_point;
+
+    if (p_traj->out_count == TRAJECTORY_OUT_LEN)
+    {
+        /* Reader fell behind, drop the oldest point */
+        p_traj->out_head = (uint8_t)((p_traj->out_head + 1U) % TRAJECTORY_OUT_LEN);
+        p_traj->stats.points_lost++;
+    }
+    else
+    {
+        p_traj->out_count++;
+    }
+
+    p_traj->stats.points_out++;
+}
+
+static void traj_commit(trajectory_t *p_traj, traj_point_t const *p_point, float error_m)
+{
+    if (error_m > p_traj->stats.max_error_m)
+        p_traj->stats.max_error_m = error_m;
+
+    traj_emit(p_traj, p_point);
+    traj_set_anchor(p_traj, p_point);
+}
+
+void trajectory_init(trajectory_t *p_traj, traj_config_t const *p_config)
+{
+    memset(p_traj, 0, sizeof(*p_traj));
+    p_traj->config = *p_config;
+}
+
+void trajectory_add(trajectory_t *p_traj, traj_point_t const *p_point)
+{
+    traj_config_t const *p_cfg = &p_traj->config;
+    traj_point_t pivot;
+    float px;
+    float py;
+    float wx;
+    float wy;
+    float d;
+    float max_d = 0.0f;
+    uint32_t turn;
+    bool heartbeat;
+    uint8_t i;
+
+    p_traj->stats.points_in++;
+
+    if (!p_traj->has_anchor)
+    {
+        p_traj->has_anchor = true;
+        p_traj->last = *p_point;
+        traj_emit(p_traj, p_point);
+        traj_set_anchor(p_traj, p_point);
+        return;
+    }
+
+    heartbeat = (p_cfg->max_interval_ms != 0)
+                && ((p_point->time_ms - p_traj->anchor.time_ms) >= p_cfg->max_interval_ms);
+
+    /* Dead-band around the last accepted fix */
+    traj_offset(p_traj, &p_traj->last, p_point, &px, &py);
+    turn = (uint32_t)abs((int32_t)p_point->course_cdeg - (int32_t)p_traj->last.course_cdeg);
+    if (turn > 18000U)
+        turn = 36000U - turn;
+
+    if (!heartbeat && (((px * px) + (py * py)) < (p_cfg->min_distance_m * p_cfg->min_distance_m))
+        && (turn < p_cfg->min_turn_cdeg))
+    {
+        p_traj->stats.points_deadband++;
+        return;
+    }
+
+    p_traj->last = *p_point;
+
+    /* Can the segment anchor -> new fix still stand in for every buffered fix? */
+    traj_offset(p_traj, &p_traj->anchor, p_point, &px, &py);
+    for (i = 0; i < p_traj->window_count; i++)
+    {
+        traj_offset(p_traj, &p_traj->anchor, &p_traj->window[i], &wx, &wy);
+        d = traj_segment_distance(wx, wy, px, py);
+        if (d > max_d)
+            max_d = d;
+    }
+
+    if ((max_d > p_cfg->tolerance_m) || (p_traj->window_count == TRAJECTORY_WINDOW_LEN))
+    {
+        /* No: the newest buffered fix becomes a significant point */
+        pivot = p_traj->window[p_traj->window_count - 1U];
+        traj_commit(p_traj, &pivot, p_traj->window_error_m);
+        max_d = 0.0f;
+
+        heartbeat = (p_cfg->max_interval_ms != 0)
+                    && ((p_point->time_ms - p_traj->anchor.time_ms) >= p_cfg->max_interval_ms);
+    }
+
+    if (heartbeat)
+    {
+        traj_commit(p_traj, p_point, max_d);
+        return;
+    }
+
+    p_traj->window[p_traj->window_count++] = *p_point;
+    p_traj->window_error_m = max_d;
+}
+
+/*
+ * Copy out up to max_points emitted points, oldest first, and remove them.
+ * Returns the number copied.
+ */
+uint32_t trajectory_read(trajectory_t *p_traj, traj_point_t *p_points, uint32_t max_points)
+{
+    uint32_t count = 0;
+
+    while ((count < max_points) && (p_traj->out_count > 0))
+    {
+        p_points[count++] = p_traj->out[p_traj->out_head];
+        p_traj->out_head = (uint8_t)((p_traj->out_head + 1U) % TRAJECTORY_OUT_LEN);
+        p_traj->out_count--;
+    }
+
+    return count;
+}
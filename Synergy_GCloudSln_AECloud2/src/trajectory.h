@@ -0,0 +1,71 @@
+/*
+ * trajectory.h
+ *
+ *  On-device trajectory compression for GNSS fixes.
+ *
+ *  Each fix first passes a distance/heading dead-band, so a parked asset
+ *  produces no points. Fixes that pass are simplified with a streaming
+ *  (opening window) Douglas-Peucker: a point is only emitted once the
+ *  straight line from the previous emitted point can no longer represent
+ *  the buffered fixes within tolerance_m. A heartbeat emits the current
+ *  position at least every max_interval_ms.
+ */
+
+#ifndef TRAJECTORY_H_
+#define TRAJECTORY_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define TRAJECTORY_WINDOW_LEN   (32U)   /* Candidate fixes held before forcing a point */
+#define TRAJECTORY_OUT_LEN      (8U)    /* Emitted points held for the reader */
+
+typedef struct st_traj_point
+{
+    int32_t  latitude_e7;
+    int32_t  longitude_e7;
+    uint32_t time_ms;
+    uint16_t course_cdeg;
+} traj_point_t;
+
+typedef struct st_traj_config
+{
+    float    tolerance_m;       /* Maximum cross-track error of dropped fixes */
+    float    min_distance_m;    /* Dead-band radius around the last accepted fix */
+    uint16_t min_turn_cdeg;     /* Course change that bypasses the dead-band */
+    uint32_t max_interval_ms;   /* Heartbeat, 0 to disable */
+} traj_config_t;
+
+typedef struct st_traj_stats
+{
+    uint32_t points_in;         /* Fixes offered */
+    uint32_t points_deadband;   /* Fixes dropped by the dead-band */
+    uint32_t points_out;        /* Points emitted */
+    uint32_t points_lost;       /* Emitted points overwritten before being read */
+    float    max_error_m;       /* Worst cross-track error of a dropped fix */
+} traj_stats_t;
+
+typedef struct st_trajectory
+{
+    traj_config_t   config;
+    traj_stats_t    stats;
+
+    bool            has_anchor;
+    traj_point_t    anchor;             /* Last emitted point */
+    traj_point_t    last;               /* Last fix accepted by the dead-band */
+    float           m_per_e7_lon;       /* Metres per 1e-7 degree of longitude at anchor */
+    float           window_error_m;     /* Worst error if the window's last point is emitted */
+
+    traj_point_t    window[TRAJECTORY_WINDOW_LEN];
+    uint8_t         window_count;
+
+    traj_point_t    out[TRAJECTORY_OUT_LEN];
+    uint8_t         out_head;
+    uint8_t         out_count;
+} trajectory_t;
+
+void trajectory_init(trajectory_t *p_traj, traj_config_t const *p_config);
+void trajectory_add(trajectory_t *p_traj, traj_point_t const *p_point);
+uint32_t trajectory_read(trajectory_t *p_traj, traj_point_t *p_points, uint32_t max_points);
+
+#endif /* TRAJECTORY_H_ */
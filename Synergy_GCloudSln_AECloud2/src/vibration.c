@@ -0,0 +1,338 @@
+/*
+ * vibration.c
+ *
+ *  Fixed-point vibration spectrum. See vibration.h.
+ */
+
+#include <math.h>
+#include <string.h>
+#include "vibration.h"
+
+#if defined(__ARM_FEATURE_DSP) && (__ARM_FEATURE_DSP == 1) && !defined(VIBRATION_SCALAR)
+
+#include "bsp_api.h"    /* CMSIS intrinsics */
+
+/* acc + high word of a * b */
+#define VIBRATION_MLA(acc, a, b)    ((int32_t) __SMMLA((a), (b), (acc)))
+
+#else
+
+#define VIBRATION_MLA(acc, a, b)    ((int32_t) ((uint32_t) (acc) + (uint32_t) (((int64_t) (a) * (b)) >> 32)))
+
+#endif
+
+/* High word of a * b, and acc minus it rounded up as SMMLS does; b is never INT32_MIN */
+#define VIBRATION_MUL(a, b)         VIBRATION_MLA(0, (a), (b))
+#define VIBRATION_MLS(acc, a, b)    VIBRATION_MLA((acc), (a), -(b))
+
+/* cos(2 pi k / VIBRATION_FFT_LEN), k = 0..64, Q31 */
+static const int32_t vibration_cos[] =
+{
+    0x7FFFFFFF, 0x7FF62182, 0x7FD8878E, 0x7FA736B4, 0x7F62368F, 0x7F0991C4,
+    0x7E9D55FC, 0x7E1D93EA, 0x7D8A5F40, 0x7CE3CEB2, 0x7C29FBEE, 0x7B5D039E,
+    0x7A7D055B, 0x798A23B1, 0x78848414, 0x776C4EDB, 0x7641AF3D, 0x7504D345,
+    0x73B5EBD1, 0x72552C85, 0x70E2CBC6, 0x6F5F02B2, 0x6DCA0D14, 0x6C242960,
+    0x6A6D98A4, 0x68A69E81, 0x66CF8120, 0x64E88926, 0x62F201AC, 0x60EC3830,
+    0x5ED77C8A, 0x5CB420E0, 0x5A82799A, 0x5842DD54, 0x55F5A4D2, 0x539B2AF0,
+    0x5133CC94, 0x4EBFE8A5, 0x4C3FDFF4, 0x49B41533, 0x471CECE7, 0x447ACD50,
+    0x41CE1E65, 0x3F1749B8, 0x3C56BA70, 0x398CDD32, 0x36BA2014, 0x33DEF287,
+    0x30FBC54D, 0x2E110A62, 0x2B1F34EB, 0x2826B928, 0x25280C5E, 0x2223A4C5,
+    0x1F19F97B, 0x1C0B826A, 0x18F8B83C, 0x15E21445, 0x12C8106F, 0x0FAB272B,
+    0x0C8BD35E, 0x096A9049, 0x0647D97C, 0x03242ABF, 0x00000000
+};
+
+#define VIBRATION_QUARTER       (VIBRATION_FFT_LEN / 4U)
+#define VIBRATION_HANN_POWER    (3.0f / 8.0f)   /* Mean square of the window */
+
+/* cos and sin of 2 pi k / VIBRATION_FFT_LEN, k = 0..VIBRATION_FFT_LEN / 2 */
+static void vibration_twiddle(uint32_t k, int32_t *p_c, int32_t *p_s)
+{
+    if (k <= VIBRATION_QUARTER)
+    {
+        *p_c = vibration_cos[k];
+        *p_s = vibration_cos[VIBRATION_QUARTER - k];
+    }
+    else
+    {
+        *p_c = -vibration_cos[(2U * VIBRATION_QUARTER) - k];
+        *p_s = vibration_cos[k - VIBRATION_QUARTER];
+    }
+}
+
+/*
+ * In-place radix-2 FFT of VIBRATION_BINS interleaved complex values. Every
+ * stage halves, so the result is the DFT over VIBRATION_BINS and the
+ * magnitudes never grow.
+ */
+static void vibration_cfft(int32_t *p_z)
+{
+    uint32_t i;
+    uint32_t j = 0;
+    uint32_t bit;
+    uint32_t len;
+    uint32_t k;
+    uint32_t a;
+    uint32_t b;
+    int32_t t;
+    int32_t c;
+    int32_t s;
+    int32_t tr;
+    int32_t ti;
+    int32_t ar;
+    int32_t ai;
+
+    for (i = 1; i < VIBRATION_BINS; i++)
+    {
+        for (bit = VIBRATION_BINS >> 1; j & bit; bit >>= 1)
+            j ^= bit;
+        j |= bit;
+
+        if (i < j)
+        {
+            t = p_z[2U * i];
+            p_z[2U * i] = p_z[2U * j];
+            p_z[2U * j] = t;
+            t = p_z[(2U * i) + 1U];
+            p_z[(2U * i) + 1U] = p_z[(2U * j) + 1U];
+            p_z[(2U * j) + 1U] = t;
+        }
+    }
+
+    for (len = 2; len <= VIBRATION_BINS; len <<= 1)
+    {
+        for (k = 0; k < (len / 2U); k++)
+        {
+            /* exp(-2 pi i k / len) = c - i s */
+            vibration_twiddle(k * (VIBRATION_FFT_LEN / len), &c, &s);
+
+            for (i = k; i < VIBRATION_BINS; i += len)
+            {
+                a = 2U * i;
+                b = 2U * (i + (len / 2U));
+
+                /* t = b * w / 2 */
+                tr = VIBRATION_MLA(VIBRATION_MUL(p_z[b], c), p_z[b + 1U], s);
+                ti = VIBRATION_MLS(VIBRATION_MUL(p_z[b + 1U], c), p_z[b], s);
+                ar = p_z[a] >> 1;
+                ai = p_z[a + 1U] >> 1;
+
+                p_z[a] = ar + tr;
+                p_z[a + 1U] = ai + ti;
+                p_z[b] = ar - tr;
+                p_z[b + 1U] = ai - ti;
+            }
+        }
+    }
+}
+
+/*
+ * One axis: time-domain statistics into p_axis, then remove the mean,
+ * window, transform and leave the one-sided power spectrum in p_vib->power,
+ * mg^2 per bin.
+ */
+static void vibration_spectrum(vibration_t *p_vib, int16_t const *p_samples, vibration_axis_t *p_axis)
+{
+    int32_t sum = 0;
+    int32_t mean;
+    int32_t d;
+    int32_t c;
+    int32_t s;
+    int32_t zr;
+    int32_t zi;
+    int32_t mr;
+    int32_t mi;
+    int32_t pr;
+    int32_t pi;
+    int32_t qr;
+    int32_t qi;
+    int32_t xr;
+    int32_t xi;
+    uint32_t peak = 0;
+    uint64_t sumsq = 0;
+    uint32_t n;
+    uint32_t k;
+    float mg_per_lsb = 1000.0f / (float) p_vib->cfg.lsb_per_g;
+    float scale;
+    float rms;
+
+    for (n = 0; n < VIBRATION_FFT_LEN; n++)
+        sum += p_samples[n];
+    mean = sum / (int32_t) VIBRATION_FFT_LEN;
+
+    for (n = 0; n < VIBRATION_FFT_LEN; n++)
+    {
+        d = p_samples[n] - mean;
+        d = (d > INT16_MAX) ? INT16_MAX : ((d < -INT16_MAX) ? -INT16_MAX : d);
+        sumsq += (uint64_t) (d * d);
+        if ((uint32_t) ((d < 0) ? -d : d) > peak)
+            peak = (uint32_t) ((d < 0) ? -d : d);
+
+        /* Hann, (1 - cos) / 2 in Q31; d * w * 2^15 */
+        vibration_twiddle((n <= (VIBRATION_FFT_LEN / 2U)) ? n : (VIBRATION_FFT_LEN - n), &c, &s);
+        p_vib->work[n] = VIBRATION_MUL(d * 65536, (INT32_MAX >> 1) - (c >> 1));
+    }
+
+    rms = sqrtf((float) sumsq / (float) VIBRATION_FFT_LEN) * mg_per_lsb;
+    p_axis->rms_mg = (rms < 65535.0f) ? (uint16_t) (rms + 0.5f) : UINT16_MAX;
+    p_axis->peak_mg = (uint16_t) (((float) peak * mg_per_lsb) + 0.5f);
+    p_axis->crest_x100 = (sumsq > 0U) ? (uint16_t) (((float) peak * mg_per_lsb * 100.0f / rms) + 0.5f) : 0U;
+
+    /* Even samples real, odd imaginary: the real FFT is a half-length complex one */
+    vibration_cfft(p_vib->work);
+
+    /* Mean square in mg^2 from the DFT / VIBRATION_FFT_LEN of d * w * 2^15, both sides */
+    scale = mg_per_lsb / 32768.0f;
+    scale = 2.0f * scale * scale / VIBRATION_HANN_POWER;
+
+    for (k = 0; k <= VIBRATION_BINS; k++)
+    {
+        zr = p_vib->work[2U * (k % VIBRATION_BINS)];
+        zi = p_vib->work[(2U * (k % VIBRATION_BINS)) + 1U];
+        mr = p_vib->work[2U * ((VIBRATION_BINS - k) % VIBRATION_BINS)];
+        mi = p_vib->work[(2U * ((VIBRATION_BINS - k) % VIBRATION_BINS)) + 1U];
+
+        /* Even and odd sample spectra: p = (z + conj(m)) / 2, q = (z - conj(m)) / 2 */
+        pr = (zr >> 1) + (mr >> 1);
+        pi = (zi >> 1) - (mi >> 1);
+        qr = (zr >> 1) - (mr >> 1);
+        qi = (zi >> 1) + (mi >> 1);
+
+        /* x / 2 = p / 2 - i w q / 2 */
+        vibration_twiddle(k, &c, &s);
+        xr = (pr >> 1) + VIBRATION_MLS(VIBRATION_MUL(qi, c), qr, s);
+        xi = (pi >> 1) - VIBRATION_MLA(VIBRATION_MUL(qr, c), qi, s);
+
+        p_vib->power[k] = (((float) xr * (float) xr) + ((float) xi * (float) xi)) * scale;
+    }
+
+    /* DC and Nyquist have no mirror image */
+    p_vib->power[0] *= 0.5f;
+    p_vib->power[VIBRATION_BINS] *= 0.5f;
+}
+
+/* Band energies and the strongest peaks of the spectrum in p_vib->power */
+static void vibration_reduce(vibration_t const *p_vib, vibration_axis_t *p_axis)
+{
+    float const *p = p_vib->power;
+    uint32_t rate = p_vib->cfg.rate_hz;
+    uint32_t top[VIBRATION_PEAKS] = { 0 };
+    uint32_t band;
+    uint32_t k;
+    uint32_t i;
+    uint32_t lo;
+    uint32_t hi;
+    float energy;
+    float m0;
+    float m1;
+    float m2;
+    float delta;
+
+    for (band = 0; band < VIBRATION_BANDS; band++)
+    {
+        energy = 0.0f;
+        for (k = 1; k <= VIBRATION_BINS; k++)
+        {
+            /* The last band includes its upper edge, usually the Nyquist bin */
+            if (((k * rate) >= ((uint32_t) p_vib->cfg.band_edges_hz[band] * VIBRATION_FFT_LEN))
+                && (((k * rate) < ((uint32_t) p_vib->cfg.band_edges_hz[band + 1U] * VIBRATION_FFT_LEN))
+                    || ((band == (VIBRATION_BANDS - 1U))
+                        && ((k * rate) == ((uint32_t) p_vib->cfg.band_edges_hz[band + 1U] * VIBRATION_FFT_LEN)))))
+                energy += p[k];
+        }
+        p_axis->band_energy[band] = (energy < 4294967040.0f) ? (uint32_t) (energy + 0.5f) : UINT32_MAX;
+    }
+
+    /* Local maxima above the DC leakage in bin 1, strongest first */
+    for (k = 2; k < VIBRATION_BINS; k++)
+    {
+        if ((p[k] <= p[k - 1U]) || (p[k] < p[k + 1U]))
+            continue;
+
+        for (i = VIBRATION_PEAKS; i > 0; i--)
+        {
+            if ((top[i - 1U] != 0) && (p[top[i - 1U]] >= p[k]))
+                break;
+            if (i < VIBRATION_PEAKS)
+                top[i] = top[i - 1U];
+        }
+        if (i < VIBRATION_PEAKS)
+            top[i] = k;
+    }
+
+    for (i = 0; i < VIBRATION_PEAKS; i++)
+    {
+        k = top[i];
+        if (k == 0)
+        {
+            p_axis->peaks[i].freq_dhz = 0;
+            p_axis->peaks[i].amplitude_mg = 0;
+            continue;
+        }
+
+        /* Exact for a Hann window: offset from the magnitudes of the three bins */
+        m0 = sqrtf(p[k - 1U]);
+        m1 = sqrtf(p[k]);
+        m2 = sqrtf(p[k + 1U]);
+        delta = 2.0f * (m2 - m0) / (m0 + (2.0f * m1) + m2);
+        p_axis->peaks[i].freq_dhz = (uint16_t) ((((float) k + delta) * (float) rate * 10.0f
+                                                 / (float) VIBRATION_FFT_LEN) + 0.5f);
+
+        /* A sinusoid's power spreads over the main lobe, two bins either side */
+        lo = (k > 2U) ? (k - 2U) : 1U;
+        hi = ((k + 2U) < VIBRATION_BINS) ? (k + 2U) : VIBRATION_BINS;
+        energy = 0.0f;
+        for (; lo <= hi; lo++)
+            energy += p[lo];
+        energy = sqrtf(2.0f * energy);
+        p_axis->peaks[i].amplitude_mg = (energy < 65535.0f) ? (uint16_t) (energy + 0.5f) : UINT16_MAX;
+
+        /* Below the output resolution it is not worth a peak */
+        if (p_axis->peaks[i].amplitude_mg == 0)
+            p_axis->peaks[i].freq_dhz = 0;
+    }
+}
+
+void vibration_init(vibration_t *p_vib, vibration_config_t const *p_cfg)
+{
+    memset(p_vib, 0, sizeof(*p_vib));
+    p_vib->cfg = *p_cfg;
+}
+
+/* Drop the partial window, e.g. after a gap in the samples */
+void vibration_restart(vibration_t *p_vib)
+{
+    if (p_vib->count > 0)
+        p_vib->restarts++;
+    p_vib->count = 0;
+}
+
+/* Returns true when the window is full and vibration_process() is due */
+bool vibration_add(vibration_t *p_vib, int16_t const accel[VIBRATION_AXES])
+{
+    uint8_t axis;
+
+    if (p_vib->count >= VIBRATION_FFT_LEN)
+        return true;
+
+    for (axis = 0; axis < VIBRATION_AXES; axis++)
+        p_vib->samples[axis][p_vib->count] = accel[axis];
+    p_vib->count++;
+
+    return (p_vib->count >= VIBRATION_FFT_LEN);
+}
+
+/* Analyse the full window and start the next one */
+void vibration_process(vibration_t *p_vib, vibration_result_t *p_result)
+{
+    uint8_t axis;
+
+    for (axis = 0; axis < VIBRATION_AXES; axis++)
+    {
+        vibration_spectrum(p_vib, p_vib->samples[axis], &p_result->axis[axis]);
+        vibration_reduce(p_vib, &p_result->axis[axis]);
+    }
+
+    p_vib->count = 0;
+    p_vib->windows++;
+    p_result->windows = p_vib->windows;
+}
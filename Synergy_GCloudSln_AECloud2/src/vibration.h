@@ -0,0 +1,75 @@
+/*
+ * vibration.h
+ *
+ *  Vibration spectrum of accelerometer windows, for condition monitoring.
+ *
+ *  Samples are collected into windows of VIBRATION_FFT_LEN per axis. Each
+ *  window has its mean removed, a Hann window applied and goes through a
+ *  real FFT; what is kept is the band energies, the strongest spectral
+ *  peaks and the time-domain RMS, peak and crest factor, not the samples.
+ *
+ *  The FFT is fixed point: Q31 twiddles, int32 data halved at every stage
+ *  so it cannot overflow. Butterflies take the high word of 32 x 32-bit
+ *  products, one SMMUL/SMMLA/SMMLS each with the Cortex-M4 DSP extension.
+ *  The portable path implements the same operations in C and gives
+ *  bit-identical results; define VIBRATION_SCALAR to force it on the
+ *  target. The spectrum is reduced in single precision.
+ */
+
+#ifndef VIBRATION_H_
+#define VIBRATION_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define VIBRATION_FFT_LEN       (256U)
+#define VIBRATION_BINS          (VIBRATION_FFT_LEN / 2U)
+#define VIBRATION_AXES          (3U)
+#define VIBRATION_BANDS         (6U)
+#define VIBRATION_PEAKS         (3U)
+
+typedef struct st_vibration_config
+{
+    uint16_t rate_hz;                               /* Sample rate */
+    uint16_t lsb_per_g;
+    uint16_t band_edges_hz[VIBRATION_BANDS + 1];    /* Ascending, the last at most rate_hz / 2 */
+} vibration_config_t;
+
+typedef struct st_vibration_peak
+{
+    uint16_t freq_dhz;          /* 0.1 Hz, 0 when there is no peak */
+    uint16_t amplitude_mg;      /* Of the sinusoid */
+} vibration_peak_t;
+
+typedef struct st_vibration_axis
+{
+    uint16_t rms_mg;            /* About the window mean */
+    uint16_t peak_mg;
+    uint16_t crest_x100;        /* Peak over RMS */
+    uint32_t band_energy[VIBRATION_BANDS];     /* Mean square in the band, mg^2 */
+    vibration_peak_t peaks[VIBRATION_PEAKS];    /* Strongest first */
+} vibration_axis_t;
+
+typedef struct st_vibration_result
+{
+    uint32_t windows;           /* Windows analysed since init */
+    vibration_axis_t axis[VIBRATION_AXES];
+} vibration_result_t;
+
+typedef struct st_vibration
+{
+    vibration_config_t cfg;
+    uint16_t count;             /* Samples in the current window */
+    uint32_t windows;
+    uint32_t restarts;          /* Windows dropped by vibration_restart() */
+    int16_t  samples[VIBRATION_AXES][VIBRATION_FFT_LEN];
+    int32_t  work[VIBRATION_FFT_LEN];           /* VIBRATION_BINS complex values */
+    float    power[VIBRATION_BINS + 1];         /* One-sided, mg^2 per bin */
+} vibration_t;
+
+void vibration_init(vibration_t *p_vib, vibration_config_t const *p_cfg);
+void vibration_restart(vibration_t *p_vib);
+bool vibration_add(vibration_t *p_vib, int16_t const accel[VIBRATION_AXES]);
+void vibration_process(vibration_t *p_vib, vibration_result_t *p_result);
+
+#endif /* VIBRATION_H_ */
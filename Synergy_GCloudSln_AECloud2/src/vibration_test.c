@@ -0,0 +1,278 @@
+/*
+ * vibration_test.c
+ *
+ *  Host checks of the fixed-point vibration spectrum on synthetic accel
+ *  windows at the FIFO rate:
+ *   - tones from 5 to 190 Hz come out as the strongest peak at their
+ *     frequency and amplitude, and a 2 mg tone is still resolved;
+ *   - the band energies add up to the square of the RMS;
+ *   - an impulse train gives its crest factor;
+ *   - a gap drops the partial window;
+ *   - the DSP path, built with host_dsp/bsp_api.h, is bit-identical to the
+ *     scalar path on random windows, full scale included.
+ *  Ends with the cost of one window of three axes on both paths.
+ *
+ *  Built by host_test.mk with SENSORS_BUS_SIM; empty in the firmware build.
+ */
+
+#if defined(SENSORS_BUS_SIM)
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "host_test.h"
+#include "vibration.h"
+
+#define TEST_RATE_HZ            (400U)              /* IMU_FIFO_RATE_HZ */
+#define TEST_LSB_PER_G          (8192U)             /* SENSOR_UNITS_ACCEL_LSB_PER_G, 4 g */
+#define TEST_LSB_PER_MG         (TEST_LSB_PER_G / 1000.0)
+#define TEST_SWEEP_STEP_HZ      (0.37)
+#define TEST_DSP_WINDOWS        (20000U)
+#define TEST_BENCH_WINDOWS      (20000U)
+
+/* The same analysis built with -D__ARM_FEATURE_DSP=1 and these names */
+void vibration_dsp_init(vibration_t *p_vib, vibration_config_t const *p_cfg);
+bool vibration_dsp_add(vibration_t *p_vib, int16_t const accel[VIBRATION_AXES]);
+void vibration_dsp_process(vibration_t *p_vib, vibration_result_t *p_result);
+
+/* sensors_vibration_cfg */
+static vibration_config_t const test_cfg =
+{
+    .rate_hz = TEST_RATE_HZ,
+    .lsb_per_g = TEST_LSB_PER_G,
+    .band_edges_hz = { 2, 10, 25, 50, 100, 150, 200 }
+};
+
+static vibration_t test_vib;
+static vibration_t test_dsp;
+static vibration_result_t test_result;
+
+typedef struct st_test_tone
+{
+    double freq_hz;
+    double amplitude_mg;
+} test_tone_t;
+
+/* Standard normal, Box-Muller */
+static double test_gauss(void)
+{
+    double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+    double v = (rand() + 1.0) / (RAND_MAX + 2.0);
+
+    return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+/* One window of up to two tones on every axis, with 1 g on z and noise */
+static void test_window(test_tone_t const *p_tones, uint32_t tones, double noise_mg)
+{
+    int16_t accel[VIBRATION_AXES];
+    double t;
+    double value;
+    uint32_t n;
+    uint32_t axis;
+    uint32_t i;
+
+    vibration_init(&test_vib, &test_cfg);
+    for (n = 0; n < VIBRATION_FFT_LEN; n++)
+    {
+        t = (double)n / TEST_RATE_HZ;
+        for (axis = 0; axis < VIBRATION_AXES; axis++)
+        {
+            value = (axis == 2U) ? TEST_LSB_PER_G : 0.0;
+            for (i = 0; i < tones; i++)
+                value += p_tones[i].amplitude_mg * TEST_LSB_PER_MG * sin((2.0 * M_PI * p_tones[i].freq_hz * t) + axis);
+            value += noise_mg * TEST_LSB_PER_MG * test_gauss();
+            accel[axis] = (int16_t)lround(value);
+        }
+        HOST_TEST_CHECK(vibration_add(&test_vib, accel) == (n == (VIBRATION_FFT_LEN - 1U)));
+    }
+    vibration_process(&test_vib, &test_result);
+}
+
+static void test_sweep(void)
+{
+    test_tone_t tone = { 5.0, 300.0 };
+    vibration_peak_t const *p_peak;
+    double freq_err = 0.0;
+    double amplitude_err = 0.0;
+
+    for (; tone.freq_hz < 190.0; tone.freq_hz += TEST_SWEEP_STEP_HZ)
+    {
+        test_window(&tone, 1U, 0.0);
+        p_peak = &test_result.axis[0].peaks[0];
+        freq_err = fmax(freq_err, fabs((p_peak->freq_dhz / 10.0) - tone.freq_hz));
+        amplitude_err = fmax(amplitude_err, fabs(p_peak->amplitude_mg - tone.amplitude_mg) / tone.amplitude_mg);
+    }
+    printf("300 mg tones 5-190 Hz: frequency within %.2f Hz, amplitude within %.2f %%\r\n", freq_err,
+           100.0 * amplitude_err);
+    HOST_TEST_CHECK(freq_err < 0.1);
+    HOST_TEST_CHECK(amplitude_err < 0.01);
+}
+
+static void test_tones(void)
+{
+    test_tone_t const two[] = { { 29.6, 300.0 }, { 88.3, 60.0 } };
+    test_tone_t const small = { 50.0, 2.0 };
+    vibration_axis_t const *p_axis;
+    double band_sum;
+    uint32_t axis;
+    uint32_t band;
+
+    test_window(two, 2U, 50.0);
+    for (axis = 0; axis < VIBRATION_AXES; axis++)
+    {
+        p_axis = &test_result.axis[axis];
+        band_sum = 0.0;
+        for (band = 0; band < VIBRATION_BANDS; band++)
+            band_sum += p_axis->band_energy[band];
+
+        printf("axis %lu: rms %u mg, sqrt(band sum) %.1f mg, peaks %.1f Hz %u mg, %.1f Hz %u mg\r\n",
+               (unsigned long)axis, p_axis->rms_mg, sqrt(band_sum), p_axis->peaks[0].freq_dhz / 10.0,
+               p_axis->peaks[0].amplitude_mg, p_axis->peaks[1].freq_dhz / 10.0, p_axis->peaks[1].amplitude_mg);
+
+        /* The bands start at 2 Hz, so only a little of the noise is outside them */
+        HOST_TEST_CHECK(fabs(sqrt(band_sum) - p_axis->rms_mg) < (0.02 * p_axis->rms_mg));
+        HOST_TEST_CHECK(fabs((p_axis->peaks[0].freq_dhz / 10.0) - 29.6) < 0.3);
+        HOST_TEST_CHECK(fabs((p_axis->peaks[1].freq_dhz / 10.0) - 88.3) < 0.3);
+        HOST_TEST_CHECK(abs(p_axis->peaks[1].amplitude_mg - 60) < 6);
+    }
+
+    test_window(&small, 1U, 0.0);
+    printf("2 mg tone at 50 Hz: %.1f Hz %u mg\r\n", test_result.axis[0].peaks[0].freq_dhz / 10.0,
+           test_result.axis[0].peaks[0].amplitude_mg);
+    HOST_TEST_CHECK(fabs((test_result.axis[0].peaks[0].freq_dhz / 10.0) - 50.0) < 0.5);
+    HOST_TEST_CHECK(test_result.axis[0].peaks[0].amplitude_mg == 2U);
+}
+
+/* 2000 LSB every 64 samples: a peak of 2000 * 63 / 64 about the mean over an RMS of 2000 * sqrt(63) / 64 */
+static void test_impulses(void)
+{
+    int16_t accel[VIBRATION_AXES] = { 0 };
+    double crest;
+    double expected;
+    uint32_t n;
+
+    vibration_init(&test_vib, &test_cfg);
+    for (n = 0; n < VIBRATION_FFT_LEN; n++)
+    {
+        accel[0] = ((n % 64U) == 0U) ? 2000 : 0;
+        (void)vibration_add(&test_vib, accel);
+    }
+    vibration_process(&test_vib, &test_result);
+
+    crest = test_result.axis[0].crest_x100 / 100.0;
+    expected = (2000.0 * 63.0 / 64.0) / sqrt((2000.0 * 2000.0 * 63.0) / (64.0 * 64.0));
+    printf("impulse train: crest factor %.2f, %.2f expected\r\n", crest, expected);
+    HOST_TEST_CHECK(fabs(crest - expected) < 0.1);
+    HOST_TEST_CHECK(test_result.axis[1].rms_mg == 0U);
+}
+
+static void test_restart(void)
+{
+    int16_t const accel[VIBRATION_AXES] = { 0, 0, TEST_LSB_PER_G };
+    uint32_t n;
+
+    vibration_init(&test_vib, &test_cfg);
+    for (n = 0; n < 100U; n++)
+        HOST_TEST_CHECK(!vibration_add(&test_vib, accel));
+    vibration_restart(&test_vib);
+    vibration_restart(&test_vib);
+    HOST_TEST_CHECK(test_vib.restarts == 1U);
+
+    for (n = 1; n < VIBRATION_FFT_LEN; n++)
+        HOST_TEST_CHECK(!vibration_add(&test_vib, accel));
+    HOST_TEST_CHECK(vibration_add(&test_vib, accel));
+    vibration_process(&test_vib, &test_result);
+    HOST_TEST_CHECK((test_result.windows == 1U) && (test_vib.count == 0U));
+    HOST_TEST_CHECK(test_result.axis[2].rms_mg == 0U);
+}
+
+/* Random windows, a quarter at full scale, through both builds */
+static void test_dsp_identical(void)
+{
+    vibration_result_t scalar;
+    vibration_result_t dsp;
+    int16_t accel[VIBRATION_AXES];
+    uint32_t mismatches = 0;
+    uint32_t w;
+    uint32_t n;
+    uint32_t axis;
+
+    /* vibration_axis_t has padding; clear it so memcmp() sees only the members */
+    memset(&scalar, 0, sizeof(scalar));
+    memset(&dsp, 0, sizeof(dsp));
+    vibration_init(&test_vib, &test_cfg);
+    vibration_dsp_init(&test_dsp, &test_cfg);
+    for (w = 0; w < TEST_DSP_WINDOWS; w++)
+    {
+        for (n = 0; n < VIBRATION_FFT_LEN; n++)
+        {
+            for (axis = 0; axis < VIBRATION_AXES; axis++)
+            {
+                if ((w & 3U) == 0U)
+                    accel[axis] = (rand() & 1) ? INT16_MAX : INT16_MIN;
+                else
+                    accel[axis] = (int16_t)((rand() & 0xFFFF) >> (w & 15U));
+            }
+            (void)vibration_add(&test_vib, accel);
+            (void)vibration_dsp_add(&test_dsp, accel);
+        }
+        vibration_process(&test_vib, &scalar);
+        vibration_dsp_process(&test_dsp, &dsp);
+        if ((memcmp(&scalar, &dsp, sizeof(scalar)) != 0)
+            || (memcmp(test_vib.power, test_dsp.power, sizeof(test_vib.power)) != 0))
+            mismatches++;
+    }
+    printf("DSP path: %lu mismatches with the scalar path over %lu windows\r\n", (unsigned long)mismatches,
+           (unsigned long)TEST_DSP_WINDOWS);
+    HOST_TEST_CHECK(mismatches == 0U);
+}
+
+/* Host cycles; the emulated intrinsics say nothing of the target's cost */
+static void test_benchmark(void)
+{
+    test_tone_t const two[] = { { 29.6, 300.0 }, { 88.3, 60.0 } };
+    int16_t window[VIBRATION_AXES][VIBRATION_FFT_LEN];
+    uint64_t start;
+    uint64_t scalar_cycles;
+    uint64_t dsp_cycles;
+    uint32_t k;
+
+    test_window(two, 2U, 20.0);
+    memcpy(window, test_vib.samples, sizeof(window));
+    vibration_dsp_init(&test_dsp, &test_cfg);
+
+    start = host_test_cycles();
+    for (k = 0; k < TEST_BENCH_WINDOWS; k++)
+    {
+        memcpy(test_vib.samples, window, sizeof(window));
+        vibration_process(&test_vib, &test_result);
+    }
+    scalar_cycles = host_test_cycles() - start;
+
+    start = host_test_cycles();
+    for (k = 0; k < TEST_BENCH_WINDOWS; k++)
+    {
+        memcpy(test_dsp.samples, window, sizeof(window));
+        vibration_dsp_process(&test_dsp, &test_result);
+    }
+    dsp_cycles = host_test_cycles() - start;
+
+    printf("%.0f cycles/window scalar, %.0f with the emulated DSP intrinsics\r\n",
+           (double)scalar_cycles / TEST_BENCH_WINDOWS, (double)dsp_cycles / TEST_BENCH_WINDOWS);
+}
+
+int main(void)
+{
+    srand(23);
+    test_sweep();
+    test_tones();
+    test_impulses();
+    test_restart();
+    test_dsp_identical();
+    test_benchmark();
+
+    return host_test_finish("vibration");
+}
+
+#endif /* SENSORS_BUS_SIM */